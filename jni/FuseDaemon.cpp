@@ -20,6 +20,7 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
 #include <android/log.h>
@@ -34,6 +35,8 @@
 #include <fuse_lowlevel.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <linux/magic.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,17 +49,22 @@
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unicode/utext.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <queue>
-#include <regex>
+#include <shared_mutex>
+#include <sstream>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
@@ -65,15 +73,28 @@
 #include "BpfSyscallWrappers.h"
 #include "MediaProviderWrapper.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+#include "libfuse_jni/FuseStats.h"
 #include "libfuse_jni/FuseUtils.h"
+#include "libfuse_jni/InvalidationQueue.h"
+#include "libfuse_jni/LevelDbOptions.h"
+#include "libfuse_jni/NegativeEntryCache.h"
+#include "libfuse_jni/OpenResultCache.h"
 #include "libfuse_jni/ReaddirHelper.h"
 #include "libfuse_jni/RedactionInfo.h"
+#include "libfuse_jni/TransformScheduler.h"
 
-using mediaprovider::fuse::DirectoryEntry;
+using mediaprovider::fuse::DirectoryEntries;
 using mediaprovider::fuse::dirhandle;
 using mediaprovider::fuse::handle;
+using mediaprovider::fuse::InvalidationQueue;
 using mediaprovider::fuse::node;
+using mediaprovider::fuse::FuseOpStat;
+using mediaprovider::fuse::LatencyHistogram;
+using mediaprovider::fuse::OpenResultCache;
 using mediaprovider::fuse::RedactionInfo;
+using mediaprovider::fuse::ScopedOpTimer;
+using mediaprovider::fuse::StartupStats;
 using std::string;
 using std::vector;
 
@@ -106,6 +127,10 @@ const bool IS_OS_DEBUGABLE = android::base::GetIntProperty("ro.debuggable", 0);
 #define FUSE_MAX_MAX_PAGES 256
 
 const size_t MAX_READ_SIZE = FUSE_MAX_MAX_PAGES * getpagesize();
+
+// How far to read ahead of sequential readers, see maybe_readahead(). Overridden by
+// persist.sys.fuse.readahead_kb, 0 disables readahead.
+constexpr size_t DEFAULT_READAHEAD_KB = 2048;
 // Stolen from: UserHandle#getUserId
 constexpr int PER_USER_RANGE = 100000;
 
@@ -116,16 +141,6 @@ const int MY_UID = getuid();
 const int MY_USER_ID = MY_UID / PER_USER_RANGE;
 const std::string MY_USER_ID_STRING(std::to_string(MY_UID / PER_USER_RANGE));
 
-// Regex copied from FileUtils.java in MediaProvider, but without media directory.
-const std::regex PATTERN_OWNED_PATH(
-        "^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)/([^/]+)(/?.*)?",
-        std::regex_constants::icase);
-const std::regex PATTERN_BPF_BACKING_PATH("^/storage/[^/]+/[0-9]+/Android/(data|obb)$",
-                                          std::regex_constants::icase);
-const std::regex PATTERN_PRIVATE_PATH(
-        "^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)(/.*)?$",
-        std::regex_constants::icase);
-
 static constexpr char TRANSFORM_SYNTHETIC_DIR[] = "synthetic";
 static constexpr char TRANSFORM_TRANSCODE_DIR[] = "transcode";
 
@@ -141,10 +156,37 @@ enum class BpfFd { REMOVE = -2 };
  * the fadvises cause a very significant slowdown in tests (specifically fio
  * seq_write). So call fadvise on the file handles with the most reads/writes
  * only after a threshold is passed.
+ *
+ * The threshold scales with the device's memory (or persist.sys.fuse.fadvise_threshold_mb) and
+ * shrinks under memory pressure as reported by PSI. Files are fadvised in order of their bytes
+ * times how long ago they were last used, so that large files nobody is reading anymore go
+ * first while the working set of active readers stays cached.
+ *
+ * Sequential writers are also written back and dropped from the page cache a window behind
+ * them, without waiting for the threshold, see WriteBehind().
+ *
+ * Every read and write records a message, so messages are passed to the background thread
+ * through a lock-free ring rather than a locked queue. Senders only take a lock to wake up the
+ * background thread when it's idle.
  */
 class FAdviser {
   public:
-    FAdviser() : thread_(MessageLoop, this), total_size_(0) {}
+    FAdviser()
+        : tail_(0),
+          head_(0),
+          idle_(false),
+          total_size_(0),
+          records_(0),
+          base_threshold_(GetBaseThreshold()),
+          threshold_(base_threshold_),
+          fadvised_bytes_(0),
+          fadvised_files_(0),
+          written_behind_bytes_(0) {
+        for (size_t i = 0; i < kQueueSize; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        thread_ = std::thread(MessageLoop, this);
+    }
 
     ~FAdviser() {
         SendMessage(Message::quit);
@@ -155,63 +197,193 @@ class FAdviser {
 
     void Close(int fd) { SendMessage(Message::close, fd); }
 
+    // Asks the kernel to start reading |size| bytes at |off| of |fd| into the page cache. Done on
+    // the message loop since POSIX_FADV_WILLNEED can block on the lower filesystem.
+    void Readahead(int fd, off_t off, size_t size) {
+        SendMessage(Message::readahead, fd, size, off);
+    }
+
+    // Tells the kernel to start writing back the |size| bytes just written at |off| of |fd|, and
+    // drops the window before it, written back by now, from the page cache. Streaming writers
+    // otherwise fill the page cache with dirty pages nobody will read until the threshold is hit.
+    void WriteBehind(int fd, off_t off, size_t size) {
+        SendMessage(Message::writebehind, fd, size, off);
+    }
+
   private:
     struct Message {
-        enum Type { record, close, quit };
+        enum Type { record, close, readahead, writebehind, quit };
         Type type;
         int fd;
         size_t size;
+        off_t off;
     };
 
-    void RecordImpl(int fd, size_t size) {
-        total_size_ += size;
+    // A bounded multi-producer single-consumer ring. Each slot's |sequence| tells whose turn it
+    // is: it equals the position of the next message to be pushed into it, or that position + 1
+    // once the message is ready to be popped.
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+    static constexpr size_t kQueueSize = 1024;
+    static_assert((kQueueSize & (kQueueSize - 1)) == 0, "kQueueSize must be a power of two");
+
+    bool TryPush(const Message& message) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & (kQueueSize - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.message = message;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (static_cast<ssize_t>(sequence - pos) < 0) {
+                // Full.
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
 
-        // Find or create record in files_
-        // Remove record from sizes_ if it exists, adjusting size appropriately
-        auto file = files_.find(fd);
-        if (file != files_.end()) {
-            auto old_size = file->second;
-            size += old_size->first;
-            sizes_.erase(old_size);
+    // Only called from the message loop.
+    bool TryPop(Message* message) {
+        Slot& slot = slots_[head_ & (kQueueSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+            return false;
+        }
+        *message = slot.message;
+        slot.sequence.store(head_ + kQueueSize, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+    struct File {
+        // Bytes read or written since the file was last fadvised.
+        size_t size;
+        // Value of |records_| when the file was last read or written.
+        uint64_t last_record;
+    };
+
+    // Returns the threshold without memory pressure: 1/64th of RAM, between 32MB and 256MB.
+    static size_t GetBaseThreshold() {
+        const size_t threshold_mb =
+                android::base::GetUintProperty<size_t>("persist.sys.fuse.fadvise_threshold_mb", 0);
+        if (threshold_mb > 0) {
+            return threshold_mb * 1024 * 1024;
+        }
+        const size_t ram = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * getpagesize();
+        return std::clamp<size_t>(ram / 64, 32 * 1024 * 1024, 256 * 1024 * 1024);
+    }
+
+    // Returns the percentage of time in the last 10s some tasks were stalled on memory, or 0 if
+    // PSI isn't available.
+    static double GetMemoryPressure() {
+        std::string psi;
+        if (!android::base::ReadFileToString("/proc/pressure/memory", &psi)) {
+            return 0;
+        }
+        double avg10 = 0;
+        if (sscanf(psi.c_str(), "some avg10=%lf", &avg10) != 1) {
+            return 0;
+        }
+        return avg10;
+    }
+
+    void UpdateThreshold() {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_pressure_check_ < kPressureCheckInterval) {
+            return;
+        }
+        last_pressure_check_ = now;
+
+        // Keep less in the page cache the more memory is contended.
+        const double pressure = GetMemoryPressure();
+        if (pressure >= 20) {
+            threshold_ = base_threshold_ / 4;
+        } else if (pressure >= 5) {
+            threshold_ = base_threshold_ / 2;
         } else {
-            file = files_.insert(Files::value_type(fd, sizes_.end())).first;
+            threshold_ = base_threshold_;
         }
+    }
 
-        // Now (re) insert record in sizes_
-        auto new_size = sizes_.insert(Sizes::value_type(size, fd));
-        file->second = new_size;
+    void RecordImpl(int fd, size_t size) {
+        total_size_ += size;
+        File& file = files_[fd];
+        file.size += size;
+        file.last_record = ++records_;
 
+        UpdateThreshold();
         if (total_size_ < threshold_) return;
 
+        const size_t target = threshold_ / 2;
         LOG(INFO) << "Threshold exceeded - fadvising " << total_size_;
-        while (!sizes_.empty() && total_size_ > target_) {
-            auto size = --sizes_.end();
-            total_size_ -= size->first;
-            posix_fadvise(size->second, 0, 0, POSIX_FADV_DONTNEED);
-            files_.erase(size->second);
-            sizes_.erase(size);
+        // fadvise the files with the most bytes least recently used first.
+        std::vector<std::pair<double, int>> files;
+        files.reserve(files_.size());
+        for (const auto& [file_fd, f] : files_) {
+            const uint64_t age = records_ - f.last_record + 1;
+            files.emplace_back(static_cast<double>(f.size) * age, file_fd);
+        }
+        std::sort(files.begin(), files.end(), std::greater<>());
+        for (auto it = files.begin(); it != files.end() && total_size_ > target; ++it) {
+            const size_t file_size = files_[it->second].size;
+            total_size_ -= file_size;
+            posix_fadvise(it->second, 0, 0, POSIX_FADV_DONTNEED);
+            files_.erase(it->second);
+            fadvised_bytes_ += file_size;
+            fadvised_files_++;
         }
         LOG(INFO) << "Threshold now " << total_size_;
+
+        if (ATrace_isEnabled()) {
+            ATrace_setCounter("fuse_fadvised_bytes", fadvised_bytes_);
+            ATrace_setCounter("fuse_fadvised_files", fadvised_files_);
+            ATrace_setCounter("fuse_fadvise_threshold", threshold_);
+        }
+    }
+
+    void WriteBehindImpl(int fd, off_t off, size_t size) {
+        // Like readahead, |fd| may have been closed or reused, which is harmless: this never waits
+        // for the writeback and only drops clean pages.
+        sync_file_range(fd, off, size, SYNC_FILE_RANGE_WRITE);
+        const off_t drop_off = std::max<off_t>(off - static_cast<off_t>(size), 0);
+        const size_t drop_size = off - drop_off;
+        if (drop_size == 0) return;
+        posix_fadvise(fd, drop_off, drop_size, POSIX_FADV_DONTNEED);
+        written_behind_bytes_ += drop_size;
+
+        // These bytes no longer count towards the threshold.
+        auto file = files_.find(fd);
+        if (file != files_.end()) {
+            const size_t dropped = std::min(file->second.size, drop_size);
+            file->second.size -= dropped;
+            total_size_ -= dropped;
+        }
+
+        if (ATrace_isEnabled()) {
+            ATrace_setCounter("fuse_written_behind_bytes", written_behind_bytes_);
+        }
     }
 
     void CloseImpl(int fd) {
         auto file = files_.find(fd);
         if (file == files_.end()) return;
 
-        total_size_ -= file->second->first;
-        sizes_.erase(file->second);
+        total_size_ -= file->second.size;
         files_.erase(file);
     }
 
     void MessageLoopImpl() {
         while (1) {
             Message message;
-
-            {
-                std::unique_lock<std::mutex> lock(mutex_);
-                cv_.wait(lock, [this] { return !queue_.empty(); });
-                message = queue_.front();
-                queue_.pop();
+            if (!TryPop(&message)) {
+                WaitForMessage();
+                continue;
             }
 
             switch (message.type) {
@@ -223,42 +395,140 @@ class FAdviser {
                     CloseImpl(message.fd);
                     break;
 
+                case Message::readahead:
+                    // |fd| may have been closed (or even reused) since, which is harmless for a
+                    // hint.
+                    posix_fadvise(message.fd, message.off, message.size, POSIX_FADV_WILLNEED);
+                    break;
+
+                case Message::writebehind:
+                    WriteBehindImpl(message.fd, message.off, message.size);
+                    break;
+
                 case Message::quit:
                     return;
             }
         }
     }
 
+    void WaitForMessage() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.store(true, std::memory_order_seq_cst);
+        // Pairs with the fence in SendMessage(): either the sender sees |idle_| and wakes us up,
+        // or we see its message here.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(lock, [this] { return HasMessage(); });
+        idle_.store(false, std::memory_order_relaxed);
+    }
+
+    bool HasMessage() const {
+        return slots_[head_ & (kQueueSize - 1)].sequence.load(std::memory_order_acquire) ==
+               head_ + 1;
+    }
+
     static int MessageLoop(FAdviser* ptr) {
         ptr->MessageLoopImpl();
         return 0;
     }
 
-    void SendMessage(Message::Type type, int fd = -1, size_t size = 0) {
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            Message message = {type, fd, size};
-            queue_.push(message);
+    void SendMessage(Message::Type type, int fd = -1, size_t size = 0, off_t off = 0) {
+        const Message message = {type, fd, size, off};
+        while (!TryPush(message)) {
+            // The background thread is behind, let it catch up. Messages can't be dropped since
+            // the bookkeeping of closed files would go stale.
+            std::this_thread::yield();
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
         }
-        cv_.notify_one();
     }
 
+    Slot slots_[kQueueSize];
+    std::atomic<size_t> tail_;
+    // Only accessed by the message loop.
+    size_t head_;
+
+    // Set while the message loop waits for messages, so that senders know to wake it up.
+    std::atomic<bool> idle_;
     std::mutex mutex_;
     std::condition_variable cv_;
-    std::queue<Message> queue_;
     std::thread thread_;
 
-    typedef std::multimap<size_t, int> Sizes;
-    typedef std::map<int, Sizes::iterator> Files;
+    static constexpr std::chrono::seconds kPressureCheckInterval = std::chrono::seconds(1);
 
-    Files files_;
-    Sizes sizes_;
+    std::unordered_map<int, File> files_;
     size_t total_size_;
+    // Number of records so far, used as a clock for recency.
+    uint64_t records_;
+
+    const size_t base_threshold_;
+    // Total bytes of all files above which files are fadvised, until half of it is left.
+    size_t threshold_;
+    std::chrono::steady_clock::time_point last_pressure_check_;
+
+    // Totals of what was fadvised away.
+    uint64_t fadvised_bytes_;
+    uint64_t fadvised_files_;
+    // Total bytes dropped behind sequential writers.
+    uint64_t written_behind_bytes_;
+};
+
+// Time taken to open leveldb connections, and time operations waited for one being opened.
+// Opening threads outlive the mounts they open connections for, hence not in |struct fuse|.
+static LatencyHistogram gLevelDbOpenLatency;
+static LatencyHistogram gLevelDbOpenWaitLatency;
+static std::atomic<uint64_t> gLevelDbOpenFailures = 0;
+
+static std::string dumpLevelDbOpenStats() {
+    if (gLevelDbOpenLatency.count() == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "leveldb_open: opens=" << gLevelDbOpenLatency.count()
+       << " failures=" << gLevelDbOpenFailures.load(std::memory_order_relaxed)
+       << " p50_us<=" << gLevelDbOpenLatency.PercentileUpperBoundUs(50)
+       << " p99_us<=" << gLevelDbOpenLatency.PercentileUpperBoundUs(99)
+       << " waits=" << gLevelDbOpenWaitLatency.count()
+       << " wait_p99_us<=" << gLevelDbOpenWaitLatency.PercentileUpperBoundUs(99) << "\n";
+    return os.str();
+}
+
+/*
+ * Position of a paginated read of a leveldb instance, kept between pages so that reading the next
+ * one resumes the same iterator, over the same snapshot, instead of seeking a new one.
+ */
+struct LevelDbCursor {
+    explicit LevelDbCursor(std::shared_ptr<leveldb::DB> _db) : db(std::move(_db)) {
+        snapshot = db->GetSnapshot();
+        leveldb::ReadOptions options;
+        options.snapshot = snapshot;
+        // A full scan would only evict the blocks needed by point lookups.
+        options.fill_cache = false;
+        it.reset(db->NewIterator(options));
+    }
+
+    ~LevelDbCursor() {
+        it.reset();
+        db->ReleaseSnapshot(snapshot);
+    }
+
+    LevelDbCursor(const LevelDbCursor&) = delete;
+    LevelDbCursor& operator=(const LevelDbCursor&) = delete;
 
-    const size_t threshold_ = 64 * 1024 * 1024;
-    const size_t target_ = 32 * 1024 * 1024;
+    const std::shared_ptr<leveldb::DB> db;
+    const leveldb::Snapshot* snapshot;
+    std::unique_ptr<leveldb::Iterator> it;
+    // Last key of the page read so far, which the next page starts after.
+    std::string last_key;
 };
 
+// A leveldb connection, or the connection being opened in the background. Yields nullptr if the
+// connection couldn't be opened.
+using LevelDbFuture = std::shared_future<std::shared_ptr<leveldb::DB>>;
+
 /* Single FUSE mount */
 struct fuse {
     explicit fuse(const std::string& _path, const ino_t _ino, const bool _uncached_mode,
@@ -271,13 +541,34 @@ struct fuse {
           uncached_mode(_uncached_mode),
           mp(0),
           zero_addr(0),
+          readahead_window(0),
+          writebehind_window(0),
+          negative_entry_timeout(0),
+          adaptive_attr_timeout(0),
+          open_result_ttl(0),
+          open_results(MY_UID),
+          prefetch_transforms(false),
           disable_dentry_cache(false),
           passthrough(false),
           upstream_passthrough(false),
           bpf(_bpf),
           bpf_fd(std::move(_bpf_fd)),
-          supported_transcoding_relative_paths(_supported_transcoding_relative_paths),
-          supported_uncached_relative_paths(_supported_uncached_relative_paths) {}
+          transcoding_paths(CompileRelativePaths(_supported_transcoding_relative_paths)),
+          uncached_paths(CompileRelativePaths(_supported_uncached_relative_paths)),
+          invalidations([this](const std::vector<InvalidationQueue::Invalidation>& batch) {
+              for (const InvalidationQueue::Invalidation& inval : batch) {
+                  // Invalidating the dentry can fail if there's no dcache entry, however, there
+                  // may still be cached attributes, so attempt to invalidate those by
+                  // invalidating the inode
+                  if (fuse_lowlevel_notify_inval_entry(se, inval.parent, inval.name.c_str(),
+                                                       inval.name.size()) &&
+                      inval.child) {
+                      fuse_lowlevel_notify_inval_inode(se, inval.child, 0, 0);
+                  }
+              }
+          }) {
+        CPU_ZERO(&worker_cpus);
+    }
 
     inline bool IsRoot(const node* node) const { return node == root; }
 
@@ -289,6 +580,16 @@ struct fuse {
     }
 
     inline string GetTransformsDir() { return GetEffectiveRootPath() + "/.transforms"; }
+
+    // Returns a trie of |relative_paths| under the effective root, to match paths against.
+    mediaprovider::fuse::PrefixTrie CompileRelativePaths(
+            const std::vector<string>& relative_paths) {
+        std::vector<string> prefixes;
+        for (const string& relative_path : relative_paths) {
+            prefixes.push_back(GetEffectiveRootPath() + "/" + relative_path);
+        }
+        return mediaprovider::fuse::PrefixTrie(prefixes);
+    }
     inline string GetPickerTranscodedDir() {
         return GetEffectiveRootPath() + "/.picker_transcoded";
     }
@@ -327,25 +628,7 @@ struct fuse {
             return false;
         }
 
-        const std::string& base_path = GetEffectiveRootPath() + "/";
-        for (const std::string& relative_path : supported_transcoding_relative_paths) {
-            if (android::base::StartsWithIgnoreCase(path, base_path + relative_path)) {
-                return true;
-            }
-        }
-
-        return false;
-    }
-
-    inline bool IsUncachedPath(const std::string& path) {
-        const std::string base_path = GetEffectiveRootPath() + "/";
-        for (const std::string& relative_path : supported_uncached_relative_paths) {
-            if (android::base::StartsWithIgnoreCase(path, base_path + relative_path)) {
-                return true;
-            }
-        }
-
-        return false;
+        return transcoding_paths.MatchesPrefixOf(path);
     }
 
     inline bool ShouldNotCache(const std::string& path) {
@@ -354,7 +637,7 @@ struct fuse {
             return true;
         }
 
-        if (supported_uncached_relative_paths.empty()) {
+        if (uncached_paths.empty()) {
             // By default there is no supported uncached path. Just return early in this case.
             return false;
         }
@@ -365,14 +648,14 @@ struct fuse {
         }
 
         if (android::base::EndsWith(path, "/")) {
-            return IsUncachedPath(path);
+            return uncached_paths.MatchesPrefixOf(path);
         } else {
             // Append a slash at the end to make sure that the exact match is picked up.
-            return IsUncachedPath(path + "/");
+            return uncached_paths.MatchesPrefixOf(path, "/");
         }
     }
 
-    std::recursive_mutex lock;
+    mediaprovider::fuse::RecursiveSharedMutex lock;
     const string path;
     // The Inode tracker associated with this FUSE instance.
     mediaprovider::fuse::NodeTracker tracker;
@@ -393,9 +676,45 @@ struct fuse {
      * The memory is read only and should never be modified.
      */
     /* const */ char* zero_addr;
+    /*
+     * Sealed memfd of MAX_READ_SIZE zeroized bytes, used instead of |zero_addr| when available so
+     * that libfuse can splice redacted ranges to the kernel rather than copy them. Reads of its
+     * holes are served from the shared zero page.
+     */
+    android::base::unique_fd zero_fd;
 
     FAdviser fadviser;
 
+    // Always-on latency statistics of the most frequent operations, see FuseDaemon::DumpStats().
+    mediaprovider::fuse::FuseStats stats;
+
+    // Number of bytes to read ahead of sequential readers, 0 to disable.
+    size_t readahead_window;
+    // Number of bytes a sequential writer is written back and dropped behind, 0 to disable.
+    size_t writebehind_window;
+
+    // CPUs the worker threads are pinned to, none to let the scheduler decide.
+    cpu_set_t worker_cpus;
+
+    // How long the kernel may cache that a name doesn't exist, 0 to disable.
+    std::chrono::milliseconds negative_entry_timeout;
+    // The negative entries handed out, so that they can be invalidated when the name is created.
+    mediaprovider::fuse::NegativeEntryCache negative_entries;
+
+    // Longest the kernel may cache the attributes of files that are otherwise not cached, see
+    // get_attr_timeout(), 0 to disable.
+    std::chrono::milliseconds adaptive_attr_timeout;
+    mediaprovider::fuse::AttrTimeoutStats attr_timeouts;
+
+    // How long the permission checks of opens for reading are reused for reopens, 0 to disable.
+    std::chrono::milliseconds open_result_ttl;
+    mediaprovider::fuse::OpenResultCache open_results;
+
+    // Whether to start transforms when a file is opened rather than on its first read.
+    bool prefetch_transforms;
+    // The transforms of nodes, e.g. transcoding, pending or in flight.
+    mediaprovider::fuse::TransformScheduler transforms;
+
     std::atomic_bool* active;
     std::atomic_bool disable_dentry_cache;
     std::atomic_bool passthrough;
@@ -406,12 +725,39 @@ struct fuse {
 
     // FUSE device id.
     std::atomic_uint dev;
-    const std::vector<string> supported_transcoding_relative_paths;
-    const std::vector<string> supported_uncached_relative_paths;
-
-    // LevelDb Connection Map
-    std::map<std::string, leveldb::DB*> level_db_connection_map;
-    std::recursive_mutex level_db_mutex;
+    // The supported transcoding and uncached relative paths, under the effective root.
+    const mediaprovider::fuse::PrefixTrie transcoding_paths;
+    const mediaprovider::fuse::PrefixTrie uncached_paths;
+
+    // LevelDb Connection Map. |level_db_mutex| only guards the map: leveldb::DB is thread-safe, so
+    // each operation copies the connection it needs and uses it without holding any lock.
+    // Connections are opened in the background, and the first operations using one wait for it.
+    std::map<std::string, LevelDbFuture> level_db_connection_map;
+    std::shared_mutex level_db_mutex;
+    // Paginated reads in progress, by instance, see readLevelDbPage(). Guarded by
+    // |level_db_mutex|, but each cursor is taken out of the map while a page is read.
+    std::map<std::string, std::unique_ptr<LevelDbCursor>> level_db_cursors;
+    // Whether leveldb connections are opened in the background.
+    bool open_level_db_async;
+    // Threads opening leveldb connections in the background, see joinLevelDbOpeners(). Guarded by
+    // |level_db_mutex|.
+    std::vector<std::thread> level_db_openers;
+
+    // The kernel dentry invalidations not issued yet, stopped before |se| is destroyed.
+    InvalidationQueue invalidations;
+
+    // Reads of the lower filesystem being replied to, each blocking its worker thread.
+    mediaprovider::fuse::InFlightStats reads_in_flight;
+
+    // Timing of the startup of this session, owned by FuseDaemon::Start().
+    mediaprovider::fuse::StartupStats* startup = nullptr;
+
+    // Whether the lower filesystem caches are warmed up at startup for the directories opened
+    // the most in the previous session, see warm_start().
+    bool warm_start;
+    // Number of times each directory was opened, by path relative to |path|, when |warm_start|.
+    std::mutex dir_opens_lock;
+    std::unordered_map<std::string, uint32_t> dir_opens;
 };
 
 struct OpenInfo {
@@ -481,35 +827,91 @@ static bool is_file_locked(int fd, const std::string& path) {
     return locked;
 }
 
+// Worker threads of all the FUSE sessions of the process. Not part of struct fuse, because
+// workers that libfuse stops while idle may only exit after the session is gone.
+static mediaprovider::fuse::WorkerStats worker_stats;
+
+// Accounts for the libfuse worker thread it belongs to, from its first request until it exits,
+// and pins it to the CPUs configured for workers, if any. Also attaches the worker to the JVM up
+// front: most requests make an upcall, and the attachment then lasts as long as the worker, which
+// max_idle_threads keeps around.
+class WorkerThread {
+  public:
+    explicit WorkerThread(const struct fuse* fuse) {
+        worker_stats.Started();
+        ATrace_setCounter("fuse_workers", worker_stats.live());
+        if (CPU_COUNT(&fuse->worker_cpus) > 0 &&
+            sched_setaffinity(0, sizeof(fuse->worker_cpus), &fuse->worker_cpus) < 0) {
+            PLOG(WARNING) << "Failed to set the CPU affinity of FUSE worker";
+        }
+        if (fuse->mp) {
+            mediaprovider::fuse::MediaProviderWrapper::AttachCurrentThread();
+        }
+    }
+
+    ~WorkerThread() {
+        worker_stats.Exited();
+        ATrace_setCounter("fuse_workers", worker_stats.live());
+    }
+
+    WorkerThread(const WorkerThread&) = delete;
+    WorkerThread& operator=(const WorkerThread&) = delete;
+};
+
 static struct fuse* get_fuse(fuse_req_t req) {
-    return reinterpret_cast<struct fuse*>(fuse_req_userdata(req));
+    struct fuse* fuse = reinterpret_cast<struct fuse*>(fuse_req_userdata(req));
+    // Every request goes through here first, so this is where worker threads are first seen.
+    thread_local WorkerThread worker(fuse);
+    return fuse;
+}
+
+// Exports the node lifecycle counters of |fuse| as trace counters for profiling.
+static void trace_node_stats(struct fuse* fuse) {
+    if (!ATrace_isEnabled()) {
+        return;
+    }
+    const mediaprovider::fuse::NodeTracker::Stats stats = fuse->tracker.GetStats();
+    ATrace_setCounter("fuse_node_lookups", stats.lookups);
+    ATrace_setCounter("fuse_nodes_created", stats.nodes_created);
+    ATrace_setCounter("fuse_nodes_deleted", stats.nodes_deleted);
+    ATrace_setCounter("fuse_node_slabs", stats.node_slabs.slabs);
+    ATrace_setCounter("fuse_handle_slabs", stats.handle_slabs.slabs);
+    ATrace_setCounter("fuse_dirhandle_slabs", stats.dirhandle_slabs.slabs);
+
+    const mediaprovider::fuse::FileLookupCache::Stats lookup_stats =
+            fuse->mp->GetFileLookupCacheStats();
+    ATrace_setCounter("fuse_file_lookup_cache_hits", lookup_stats.hits);
+    ATrace_setCounter("fuse_file_lookup_cache_misses", lookup_stats.misses);
+    ATrace_setCounter("fuse_file_lookup_cache_size", lookup_stats.size);
+
+    const mediaprovider::fuse::AccessDecisionCache::Stats access_stats =
+            fuse->mp->GetAccessDecisionCacheStats();
+    ATrace_setCounter("fuse_access_decision_cache_hits", access_stats.hits);
+    ATrace_setCounter("fuse_access_decision_cache_misses", access_stats.misses);
+    ATrace_setCounter("fuse_access_decision_cache_size", access_stats.size);
 }
 
 static bool is_package_owned_path(const string& path, const string& fuse_path) {
     if (path.rfind(fuse_path, 0) != 0) {
         return false;
     }
-    return std::regex_match(path, PATTERN_OWNED_PATH);
+    return mediaprovider::fuse::classifyStoragePath(path).IsPackageOwned();
 }
 
 static bool is_bpf_backing_path(const string& path) {
-    return std::regex_match(path, PATTERN_BPF_BACKING_PATH);
+    return mediaprovider::fuse::classifyStoragePath(path).IsBpfBackingDir();
 }
 
-// See fuse_lowlevel.h fuse_lowlevel_notify_inval_entry for how to call this safetly without
-// deadlocking the kernel
-static void fuse_inval(fuse_session* se, fuse_ino_t parent_ino, fuse_ino_t child_ino,
+// Queues the invalidation of |child_name| and of its inode for the background thread of
+// |fuse->invalidations|: see fuse_lowlevel.h fuse_lowlevel_notify_inval_entry for why this would
+// otherwise deadlock the kernel when called while serving a request.
+static void fuse_inval(struct fuse* fuse, fuse_ino_t parent_ino, fuse_ino_t child_ino,
                        const string& child_name, const string& path) {
     if (mediaprovider::fuse::containsMount(path)) {
         LOG(WARNING) << "Ignoring attempt to invalidate dentry for FUSE mounts";
         return;
     }
-
-    if (fuse_lowlevel_notify_inval_entry(se, parent_ino, child_name.c_str(), child_name.size())) {
-        // Invalidating the dentry can fail if there's no dcache entry, however, there may still
-        // be cached attributes, so attempt to invalidate those by invalidating the inode
-        fuse_lowlevel_notify_inval_inode(se, child_ino, 0, 0);
-    }
+    fuse->invalidations.Push(parent_ino, child_name, child_ino);
 }
 
 static double get_entry_timeout(const string& path, bool should_inval, struct fuse* fuse) {
@@ -529,6 +931,24 @@ static double get_entry_timeout(const string& path, bool should_inval, struct fu
     return std::numeric_limits<double>::max();
 }
 
+// Returns for how long the kernel may cache the attributes |s| of |path|.
+static double get_attr_timeout(const string& path, const struct stat& s, struct fuse* fuse) {
+    if (!fuse->ShouldNotCache(path)) {
+        return std::numeric_limits<double>::max();
+    }
+    if (fuse->adaptive_attr_timeout.count() == 0) {
+        return 0;
+    }
+    // The lower filesystem may be changed without going through FUSE, but each change updates
+    // the ctime, so a file that hasn't changed for long is unlikely to change soon.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const double timeout = mediaprovider::fuse::getAdaptiveAttrTimeout(
+            s, now, std::chrono::duration<double>(fuse->adaptive_attr_timeout).count());
+    fuse->attr_timeouts.Record(timeout);
+    return timeout;
+}
+
 static std::string get_path(node* node) {
     const string& io_path = node->GetIoPath();
     return io_path.empty() ? node->BuildPath() : io_path;
@@ -554,6 +974,33 @@ static inline bool is_hidden_dir_path(const string& path, struct fuse* fuse) {
     return is_transforms_dir_path(path, fuse) || is_picker_transcoded_dir_path(path, fuse);
 }
 
+// Returns true if the kernel may be told that |path| doesn't exist for a while, instead of
+// asking again on every lookup. This only holds if the path doesn't exist for any uid, see
+// reply_lookup_error().
+static bool is_negative_entry_cacheable(const string& path, struct fuse* fuse) {
+    return fuse->negative_entry_timeout.count() > 0 && !fuse->disable_dentry_cache &&
+           !is_package_owned_path(path, fuse->path) && !fuse->ShouldNotCache(path) &&
+           !is_hidden_dir_path(path, fuse);
+}
+
+// Invalidates the negative entries of names equal to |name| ignoring case in |parent|, for when
+// |name| has just been created. The kernel replaces the negative entry of |name| itself, so it is
+// left alone unless |include_name| is true.
+static void invalidate_negative_entries(struct fuse* fuse, fuse_ino_t parent, const string& name,
+                                        bool include_name) {
+    std::vector<string> names = fuse->negative_entries.Remove(parent, name);
+    if (!include_name) {
+        names.erase(std::remove(names.begin(), names.end(), name), names.end());
+    }
+    if (names.empty()) {
+        return;
+    }
+    // Invalidate async, otherwise we will deadlock the kernel, see fuse_inval().
+    for (const string& n : names) {
+        fuse->invalidations.Push(parent, n, 0 /* child */);
+    }
+}
+
 /*
  * Check if the provided path is an Android/data or Android/obb folder under /storage/ that might
  * be the subject of confusion in applying restrictions due to the presence of default ignorable
@@ -564,6 +1011,12 @@ static inline bool is_hidden_dir_path(const string& path, struct fuse* fuse) {
  */
 bool is_data_or_obb_path_with_default_ignorable_codepoints(const std::string_view& path) {
     if (__builtin_available(android 31, *)) {
+        // Skip copying pure ASCII paths, they can't contain default ignorable codepoints.
+        if (!path.empty() &&
+            mediaprovider::fuse::findFirstNonAscii(path) == std::string_view::npos) {
+            return false;
+        }
+
         const std::string filtered_path =
                 mediaprovider::fuse::removeDefaultIgnorableCodepoints(path);
         if (filtered_path.empty()) {
@@ -573,15 +1026,21 @@ bool is_data_or_obb_path_with_default_ignorable_codepoints(const std::string_vie
 
         // Check if the path doesn't match the filtered path (contains default ignorable
         // codepoints), and if it's a private path (e.g. /storage/emulated/0/Android/data).
-        return path != filtered_path
-               && std::regex_match(filtered_path, PATTERN_PRIVATE_PATH);
+        return path != filtered_path &&
+               mediaprovider::fuse::classifyStoragePath(filtered_path).IsDataOrObb();
     }
     return false;
 }
 
+// Returns whether the transforms of |path| must be looked up from MediaProvider.
+static bool needs_file_lookup(struct fuse* fuse, const string& path, bool synthetic_path) {
+    return synthetic_path || fuse->IsTranscodeSupportedPath(path);
+}
+
 static std::unique_ptr<mediaprovider::fuse::FileLookupResult> validate_node_path(
         const std::string& path, const std::string& name, fuse_req_t req, int* error_code,
-        struct fuse_entry_param* e, const FuseOp op) {
+        struct fuse_entry_param* e, const FuseOp op,
+        const mediaprovider::fuse::FileLookupResult* prefetched_lookup) {
     struct fuse* fuse = get_fuse(req);
     if (is_data_or_obb_path_with_default_ignorable_codepoints(path)) {
         LOG(WARNING) << "Failing validate_node_path due to default ignorable codepoints: " << path;
@@ -622,14 +1081,16 @@ static std::unique_ptr<mediaprovider::fuse::FileLookupResult> validate_node_path
         return std::make_unique<mediaprovider::fuse::FileLookupResult>(0, 0, 0, true, false, "");
     }
 
-    if (!synthetic_path && !fuse->IsTranscodeSupportedPath(path)) {
+    if (!needs_file_lookup(fuse, path, synthetic_path)) {
         // Transforms are only supported for synthetic or transcode-supported paths
         return std::make_unique<mediaprovider::fuse::FileLookupResult>(0, 0, 0, true, false, "");
     }
 
     // Handle potential file transforms
     std::unique_ptr<mediaprovider::fuse::FileLookupResult> file_lookup_result =
-            fuse->mp->FileLookup(path, req->ctx.uid, req->ctx.pid);
+            prefetched_lookup
+                    ? std::make_unique<mediaprovider::fuse::FileLookupResult>(*prefetched_lookup)
+                    : fuse->mp->FileLookup(path, req->ctx.uid, req->ctx.pid);
 
     if (!file_lookup_result) {
         // Fail lookup if we can't fetch FileLookupResult for path
@@ -650,7 +1111,9 @@ static std::unique_ptr<mediaprovider::fuse::FileLookupResult> validate_node_path
 
 static node* make_node_entry(fuse_req_t req, node* parent, const string& name,
                              const string& parent_path, const string& path,
-                             struct fuse_entry_param* e, int* error_code, const FuseOp op) {
+                             struct fuse_entry_param* e, int* error_code, const FuseOp op,
+                             const mediaprovider::fuse::FileLookupResult* prefetched_lookup =
+                                     nullptr) {
     struct fuse* fuse = get_fuse(req);
     const struct fuse_ctx* ctx = fuse_req_ctx(req);
     node* node;
@@ -658,7 +1121,7 @@ static node* make_node_entry(fuse_req_t req, node* parent, const string& name,
     memset(e, 0, sizeof(*e));
 
     std::unique_ptr<mediaprovider::fuse::FileLookupResult> file_lookup_result =
-            validate_node_path(path, name, req, error_code, e, op);
+            validate_node_path(path, name, req, error_code, e, op, prefetched_lookup);
     if (!file_lookup_result) {
         // Fail lookup if we can't validate |path, |errno| would have already been set
         return nullptr;
@@ -692,16 +1155,12 @@ static node* make_node_entry(fuse_req_t req, node* parent, const string& name,
         if (name != node->GetName()) {
             // Force node invalidation to fix the kernel dentry cache for case (1) above
             should_invalidate = true;
-            // Make copies of the node name and path so we're not attempting to acquire
-            // any node locks from the invalidation thread. Depending on timing, we may end
-            // up invalidating the wrong inode but that shouldn't result in correctness issues.
-            const fuse_ino_t parent_ino = fuse->ToInode(parent);
-            const fuse_ino_t child_ino = fuse->ToInode(node);
-            const std::string& node_name = node->GetName();
-            std::thread t([=]() { fuse_inval(fuse->se, parent_ino, child_ino, node_name, path); });
-            t.detach();
-            // Update the name after |node_name| reference above has been captured in lambda
-            // This avoids invalidating the node again on subsequent accesses with |name|
+            // The queue keeps a copy of the node name, so the invalidation thread doesn't
+            // acquire any node locks. Depending on timing, we may end up invalidating the wrong
+            // inode but that shouldn't result in correctness issues.
+            fuse_inval(fuse, fuse->ToInode(parent), fuse->ToInode(node), node->GetName(), path);
+            // Update the name after it has been queued for invalidation. This avoids
+            // invalidating the node again on subsequent accesses with |name|
             node->SetName(name);
         }
 
@@ -745,7 +1204,7 @@ static node* make_node_entry(fuse_req_t req, node* parent, const string& name,
     // directories.
     if (!fuse->bpf || !is_bpf_backing_path(parent_path)) {
         e->entry_timeout = get_entry_timeout(path, should_invalidate, fuse);
-        e->attr_timeout = fuse->ShouldNotCache(path) ? 0 : std::numeric_limits<double>::max();
+        e->attr_timeout = get_attr_timeout(path, e->attr, fuse);
     }
     return node;
 }
@@ -840,18 +1299,33 @@ static void pf_init(void* userdata, struct fuse_conn_info* conn) {
     conn->max_read = MAX_READ_SIZE;
 
     fuse->active->store(true, std::memory_order_release);
+    fuse->startup->Reached(StartupStats::Phase::init);
 }
 
+// Must be called with |fuse->level_db_mutex| held exclusively. The connection is closed once the
+// operations still using it are done.
 static void removeInstance(struct fuse* fuse, std::string instance_name) {
-    if (fuse->level_db_connection_map.find(instance_name) != fuse->level_db_connection_map.end()) {
-        delete fuse->level_db_connection_map[instance_name];
-        (fuse->level_db_connection_map).erase(instance_name);
+    fuse->level_db_cursors.erase(instance_name);
+    if (fuse->level_db_connection_map.erase(instance_name) > 0) {
         LOG(INFO) << "Removed leveldb connection for " << instance_name;
     }
 }
 
+// Waits for the leveldb connections being opened in the background, so that none of them is
+// still being opened once the mount is gone.
+static void joinLevelDbOpeners(struct fuse* fuse) {
+    std::vector<std::thread> openers;
+    {
+        std::lock_guard<std::shared_mutex> guard(fuse->level_db_mutex);
+        openers.swap(fuse->level_db_openers);
+    }
+    for (std::thread& opener : openers) {
+        opener.join();
+    }
+}
+
 static void removeLevelDbConnection(struct fuse* fuse) {
-    fuse->level_db_mutex.lock();
+    std::lock_guard<std::shared_mutex> guard(fuse->level_db_mutex);
     if (android::base::StartsWith(fuse->path, PRIMARY_VOLUME_PREFIX)) {
         removeInstance(fuse, VOLUME_INTERNAL);
         removeInstance(fuse, OWNERSHIP_RELATION);
@@ -863,11 +1337,106 @@ static void removeLevelDbConnection(struct fuse* fuse) {
         std::transform(volume_name.begin(), volume_name.end(), volume_name.begin(), ::tolower);
         removeInstance(fuse, volume_name);
     }
-    fuse->level_db_mutex.unlock();
+}
+
+// Maximum number of directories whose opens are counted, and of directories warmed up at startup.
+static constexpr size_t MAX_TRACKED_DIR_OPENS = 1024;
+static constexpr size_t MAX_WARM_START_DIRS = 64;
+// Maximum number of entries of a directory stat()ed when warming it up.
+static constexpr size_t MAX_WARM_START_DIR_ENTRIES = 1024;
+
+static std::string warm_start_file_path() {
+    return "/data/media/" + MY_USER_ID_STRING + "/.transforms/fuse_warm_start_dirs";
+}
+
+static void record_dir_open(struct fuse* fuse, const std::string& path) {
+    if (!fuse->warm_start || path.size() <= fuse->path.size()) {
+        return;
+    }
+    std::string relative_path = path.substr(fuse->path.size() + 1);
+
+    std::lock_guard<std::mutex> guard(fuse->dir_opens_lock);
+    auto it = fuse->dir_opens.find(relative_path);
+    if (it != fuse->dir_opens.end()) {
+        it->second++;
+    } else if (fuse->dir_opens.size() < MAX_TRACKED_DIR_OPENS) {
+        fuse->dir_opens.emplace(std::move(relative_path), 1);
+    }
+}
+
+// Saves the directories opened the most, most opened first, for warm_start() to read on the next
+// startup.
+static void save_warm_start_dirs(struct fuse* fuse) {
+    std::vector<std::pair<std::string, uint32_t>> dirs;
+    {
+        std::lock_guard<std::mutex> guard(fuse->dir_opens_lock);
+        if (fuse->dir_opens.empty()) {
+            return;
+        }
+        dirs.assign(fuse->dir_opens.begin(), fuse->dir_opens.end());
+    }
+    const size_t count = std::min(dirs.size(), MAX_WARM_START_DIRS);
+    std::partial_sort(dirs.begin(), dirs.begin() + count, dirs.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    std::string contents;
+    for (size_t i = 0; i < count; i++) {
+        contents += dirs[i].first + "\n";
+    }
+    const std::string file_path = warm_start_file_path();
+    const std::string tmp_file_path = file_path + ".tmp";
+    if (!android::base::WriteStringToFile(contents, tmp_file_path) ||
+        rename(tmp_file_path.c_str(), file_path.c_str())) {
+        PLOG(WARNING) << "Failed to save warm start directories";
+        unlink(tmp_file_path.c_str());
+    }
+}
+
+// Reads the directories saved by save_warm_start_dirs() through the lower filesystem, and stats
+// their entries, so that the first lookups and directory reads after boot find the dentries and
+// inodes cached. The nodes themselves are only created by lookups: a node can't exist without a
+// reference held by the kernel.
+static void warm_start(struct fuse* fuse) {
+    std::string contents;
+    if (!android::base::ReadFileToString(warm_start_file_path(), &contents)) {
+        return;
+    }
+
+    size_t dirs = 0;
+    for (const std::string& relative_path : android::base::Split(contents, "\n")) {
+        if (dirs == MAX_WARM_START_DIRS) {
+            break;
+        }
+        if (relative_path.empty() || relative_path.find("..") != std::string::npos) {
+            continue;
+        }
+        const std::string path = fuse->path + "/" + relative_path;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            continue;
+        }
+        dirs++;
+        struct dirent* entry;
+        size_t entries = 0;
+        while (entries < MAX_WARM_START_DIR_ENTRIES && (entry = readdir(dir)) != nullptr) {
+            struct stat st;
+            if (entry->d_name[0] != '.') {
+                fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW);
+                entries++;
+            }
+        }
+        closedir(dir);
+    }
+    fuse->startup->Reached(StartupStats::Phase::warm_start);
+    LOG(INFO) << "Warmed up " << dirs << " directories";
 }
 
 static void pf_destroy(void* userdata) {
     struct fuse* fuse = reinterpret_cast<struct fuse*>(userdata);
+    if (fuse->warm_start) {
+        save_warm_start_dirs(fuse);
+    }
+    joinLevelDbOpeners(fuse);
     removeLevelDbConnection(fuse);
     LOG(INFO) << "DESTROY " << fuse->path;
 
@@ -888,9 +1457,10 @@ static bool is_app_accessible_path(struct fuse* fuse, const string& path, uid_t
         return false;
     }
 
-    std::smatch match;
-    if (std::regex_match(path, match, PATTERN_OWNED_PATH)) {
-        const std::string& pkg = match[1];
+    const mediaprovider::fuse::StoragePath storage_path =
+            mediaprovider::fuse::classifyStoragePath(path);
+    if (storage_path.IsPackageOwned()) {
+        const std::string_view pkg = storage_path.package;
         // .nomedia is not a valid package. .nomedia always exists in /Android/data directory,
         // and it's not an external file/directory of any package
         if (pkg == ".nomedia") {
@@ -954,19 +1524,15 @@ void fuse_bpf_install(struct fuse* fuse, struct fuse_entry_param* e, const strin
     }
 }
 
-static std::regex storage_emulated_regex("^\\/storage\\/emulated\\/([0-9]+)");
-
 static bool is_user_accessible_path(fuse_req_t req, const struct fuse* fuse, const string& path) {
-    std::smatch match;
-    std::regex_search(path, match, storage_emulated_regex);
-
     // Ensure the FuseDaemon user id matches the user id or cross-user lookups are allowed in
     // requested path
-    if (match.size() == 2 && std::to_string(getuid() / PER_USER_RANGE) != match[1].str()) {
+    const mediaprovider::fuse::StoragePath storage_path =
+            mediaprovider::fuse::classifyStoragePath(path);
+    const int userId = storage_path.user_id;
+    if (storage_path.volume == "emulated" && userId >= 0 && userId != MY_USER_ID) {
         // If user id mismatch, check cross-user lookups
-        long userId = strtol(match[1].str().c_str(), nullptr, 10);
-        if (userId < 0 || userId > MAX_USER_ID ||
-            !fuse->mp->ShouldAllowLookup(req->ctx.uid, userId)) {
+        if (userId > MAX_USER_ID || !fuse->mp->ShouldAllowLookup(req->ctx.uid, userId)) {
             return false;
         }
     }
@@ -975,7 +1541,8 @@ static bool is_user_accessible_path(fuse_req_t req, const struct fuse* fuse, con
 
 static node* do_lookup(fuse_req_t req, fuse_ino_t parent, const char* name,
                        struct fuse_entry_param* e, int* error_code, const FuseOp op,
-                       const bool validate_access, int* backing_fd = NULL) {
+                       const bool validate_access, int* backing_fd = NULL,
+                       const mediaprovider::fuse::FileLookupResult* prefetched_lookup = nullptr) {
     struct fuse* fuse = get_fuse(req);
     node* parent_node = fuse->FromInode(parent);
     if (!parent_node) {
@@ -1001,7 +1568,9 @@ static node* do_lookup(fuse_req_t req, fuse_ino_t parent, const char* name,
         return nullptr;
     }
 
-    auto node = make_node_entry(req, parent_node, name, parent_path, child_path, e, error_code, op);
+    auto node = make_node_entry(req, parent_node, name, parent_path, child_path, e, error_code, op,
+                                prefetched_lookup);
+    fuse->tracker.NodeLookedUp();
 
     if (fuse->bpf) {
         if (op == FuseOp::lookup) {
@@ -1019,8 +1588,44 @@ static node* do_lookup(fuse_req_t req, fuse_ino_t parent, const char* name,
     return node;
 }
 
+// Replies to a lookup of |name| in |parent| that failed with |error_code|.
+//
+// If the name just doesn't exist on the lower fs, this is a negative entry instead of an error,
+// so that the kernel fails lookups of it on its own until it times out or the name is created.
+// Lookups may also fail with ENOENT for names hidden from the calling uid only, but the kernel
+// dentry cache is shared by all uids, so the lower fs is checked again to tell those apart.
+// Names created on the lower fs by anything else than this daemon or MediaProvider (which calls
+// FuseDaemon::InvalidateFuseDentryCache) are only seen once the negative entry times out.
+static void reply_lookup_error(fuse_req_t req, fuse_ino_t parent, const char* name,
+                               int error_code) {
+    struct fuse* fuse = get_fuse(req);
+    if (error_code != ENOENT || fuse->negative_entry_timeout.count() == 0) {
+        fuse_reply_err(req, error_code);
+        return;
+    }
+
+    node* parent_node = fuse->FromInode(parent);
+    if (parent_node) {
+        const string path = parent_node->BuildPath() + "/" + name;
+        struct stat st;
+        if (is_negative_entry_cacheable(path, fuse) && lstat(path.c_str(), &st) < 0 &&
+            errno == ENOENT &&
+            fuse->negative_entries.Add(parent, name, fuse->negative_entry_timeout)) {
+            // An entry with a zero inode is a negative entry.
+            struct fuse_entry_param e = {};
+            e.entry_timeout =
+                    std::chrono::duration<double>(fuse->negative_entry_timeout).count();
+            fuse_reply_entry(req, &e);
+            return;
+        }
+    }
+    fuse_reply_err(req, error_code);
+}
+
 static void pf_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
     ATRACE_CALL();
+    ScopedOpTimer op_timer(&get_fuse(req)->stats, FuseOpStat::lookup);
+    get_fuse(req)->startup->Reached(StartupStats::Phase::first_request);
     struct fuse_entry_param e;
     int backing_fd = -1;
 
@@ -1029,16 +1634,18 @@ static void pf_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
         fuse_reply_entry(req, &e);
     } else {
         CHECK(error_code != 0);
-        fuse_reply_err(req, error_code);
+        reply_lookup_error(req, parent, name, error_code);
     }
 
     if (backing_fd != -1) close(backing_fd);
+    trace_node_stats(get_fuse(req));
 }
 
 static void pf_lookup_postfilter(fuse_req_t req, fuse_ino_t parent, uint32_t error_in,
                                  const char* name, struct fuse_entry_out* feo,
                                  struct fuse_entry_bpf_out* febo) {
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::lookup_postfilter);
 
     ATRACE_CALL();
     node* parent_node = fuse->FromInode(parent);
@@ -1063,28 +1670,46 @@ static void pf_lookup_postfilter(fuse_req_t req, fuse_ino_t parent, uint32_t err
     fuse_reply_buf(req, (const char*)&buf, sizeof(buf));
 }
 
-static void do_forget(fuse_req_t req, struct fuse* fuse, fuse_ino_t ino, uint64_t nlookup) {
+// Releases |nlookup| references to |ino|, collecting the nodes to delete in |reclaimed|. Must be
+// called with |fuse->lock| held.
+static void do_forget(fuse_req_t req, struct fuse* fuse, fuse_ino_t ino, uint64_t nlookup,
+                      std::vector<node*>* reclaimed) {
     node* node = fuse->FromInode(ino);
     TRACE_NODE(node, req);
     if (node) {
         // This is a narrowing conversion from an unsigned 64bit to a 32bit value. For
         // some reason we only keep 32 bit refcounts but the kernel issues
         // forget requests with a 64 bit counter.
-        int backing_id = node->GetBackingId();
-        if (node->Release(static_cast<uint32_t>(nlookup))) {
-            if (backing_id) fuse_passthrough_close(req, backing_id);
+        node->Release(static_cast<uint32_t>(nlookup), reclaimed);
+    }
+}
+
+// Deletes the nodes collected by do_forget(), without |fuse->lock| held so that a large batch of
+// forgets doesn't stall other operations.
+static void reclaim_nodes(fuse_req_t req, struct fuse* fuse, std::vector<node*>* reclaimed) {
+    for (node* node : *reclaimed) {
+        fuse->transforms.Forget(fuse->ToInode(node));
+        fuse->open_results.Forget(fuse->ToInode(node));
+        for (const int backing_id : node->GetBackingIds()) {
+            fuse_passthrough_close(req, backing_id);
         }
     }
+    node::Reclaim(reclaimed);
 }
 
 static void pf_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
     // Always allow to forget so no need to check is_app_accessible_path()
     ATRACE_CALL();
-    node* node;
     struct fuse* fuse = get_fuse(req);
 
-    do_forget(req, fuse, ino, nlookup);
+    std::vector<node*> reclaimed;
+    {
+        std::lock_guard<RecursiveSharedMutex> guard(fuse->lock);
+        do_forget(req, fuse, ino, nlookup, &reclaimed);
+    }
+    reclaim_nodes(req, fuse, &reclaimed);
     fuse_reply_none(req);
+    trace_node_stats(fuse);
 }
 
 static void pf_forget_multi(fuse_req_t req,
@@ -1093,10 +1718,18 @@ static void pf_forget_multi(fuse_req_t req,
     ATRACE_CALL();
     struct fuse* fuse = get_fuse(req);
 
-    for (int i = 0; i < count; i++) {
-        do_forget(req, fuse, forgets[i].ino, forgets[i].nlookup);
+    // Take the lock once for the whole batch, which can have thousands of entries when the kernel
+    // evicts dentries under memory pressure.
+    std::vector<node*> reclaimed;
+    {
+        std::lock_guard<RecursiveSharedMutex> guard(fuse->lock);
+        for (int i = 0; i < count; i++) {
+            do_forget(req, fuse, forgets[i].ino, forgets[i].nlookup, &reclaimed);
+        }
     }
+    reclaim_nodes(req, fuse, &reclaimed);
     fuse_reply_none(req);
+    trace_node_stats(fuse);
 }
 
 static void pf_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset, off_t length,
@@ -1114,6 +1747,8 @@ static void pf_getattr(fuse_req_t req,
                        struct fuse_file_info* fi) {
     ATRACE_CALL();
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::getattr);
+    fuse->startup->Reached(StartupStats::Phase::first_request);
     node* node = fuse->FromInode(ino);
     if (!node) {
         fuse_reply_err(req, ENOENT);
@@ -1131,8 +1766,7 @@ static void pf_getattr(fuse_req_t req,
     if (lstat(path.c_str(), &s) < 0) {
         fuse_reply_err(req, errno);
     } else {
-        fuse_reply_attr(req, &s,
-                        fuse->ShouldNotCache(path) ? 0 : std::numeric_limits<double>::max());
+        fuse_reply_attr(req, &s, get_attr_timeout(path, s, fuse));
     }
 }
 
@@ -1153,6 +1787,7 @@ static void pf_setattr(fuse_req_t req,
         fuse_reply_err(req, ENOENT);
         return;
     }
+    fuse->open_results.Forget(ino);
 
     int fd = -1;
     if (fi) {
@@ -1235,7 +1870,7 @@ static void pf_setattr(fuse_req_t req,
     }
 
     lstat(path.c_str(), attr);
-    fuse_reply_attr(req, attr, fuse->ShouldNotCache(path) ? 0 : std::numeric_limits<double>::max());
+    fuse_reply_attr(req, attr, get_attr_timeout(path, *attr, fuse));
 }
 
 static void pf_canonical_path(fuse_req_t req, fuse_ino_t ino)
@@ -1279,6 +1914,7 @@ static void pf_mknod(fuse_req_t req,
         fuse_reply_err(req, errno);
         return;
     }
+    invalidate_negative_entries(fuse, parent, name, false /* include_name */);
 
     int error_code = 0;
     struct fuse_entry_param e;
@@ -1324,6 +1960,7 @@ static void pf_mkdir(fuse_req_t req,
         fuse_reply_err(req, errno);
         return;
     }
+    invalidate_negative_entries(fuse, parent, name, false /* include_name */);
 
     int error_code = 0;
     struct fuse_entry_param e;
@@ -1363,6 +2000,7 @@ static void pf_unlink(fuse_req_t req, fuse_ino_t parent, const char* name) {
 
     // TODO(b/169306422): Log each deleted node
     parent_node->SetDeletedForChild(name);
+    fuse->mp->InvalidateFileLookup(child_path);
     fuse_reply_err(req, 0);
 }
 
@@ -1488,6 +2126,18 @@ static int do_rename(fuse_req_t req, fuse_ino_t parent, const char* name, fuse_i
         new_parent_node->SetDeletedForChild(new_name);
         // TODO(b/169306422): Log each renamed node
         old_parent_node->RenameChild(name, new_name, new_parent_node);
+        invalidate_negative_entries(fuse, new_parent, new_name, false /* include_name */);
+        // Permissions depend on the path, of the renamed node or of the nodes under it.
+        fuse->open_results.Clear();
+        // Cached lookups under a renamed directory are keyed by their old paths, so drop
+        // everything rather than walking the cache.
+        struct stat st;
+        if (lstat(new_child_path.c_str(), &st) == 0 && !S_ISDIR(st.st_mode)) {
+            fuse->mp->InvalidateFileLookup(old_child_path);
+            fuse->mp->InvalidateFileLookup(new_child_path);
+        } else {
+            fuse->mp->InvalidateFileLookup("");
+        }
     }
     return res;
 }
@@ -1510,7 +2160,7 @@ static handle* create_handle_for_node(struct fuse* fuse, const string& path, int
                                       uid_t transforms_uid, node* node, const RedactionInfo* ri,
                                       const bool allow_passthrough, const bool open_info_direct_io,
                                       int* keep_cache) {
-    std::lock_guard<std::recursive_mutex> guard(fuse->lock);
+    std::lock_guard<RecursiveSharedMutex> guard(fuse->lock);
 
     bool redaction_needed = ri->isRedactionNeeded();
     handle* handle = nullptr;
@@ -1530,9 +2180,10 @@ static handle* create_handle_for_node(struct fuse* fuse, const string& path, int
         // arbitrary bytes the first time around. However, if we ensure that transforms are
         // completed, then it's safe to use passthrough. Additionally, transcoded nodes never
         // require redaction so (2) implies (1)
-        handle = new struct handle(fd, ri, !open_info_direct_io /* cached */,
-                                   !redaction_needed && transforms_complete /* passthrough */, uid,
-                                   transforms_uid);
+        handle = new (fuse->tracker.handle_allocator())
+                struct handle(fd, ri, !open_info_direct_io /* cached */,
+                              !redaction_needed && transforms_complete /* passthrough */, uid,
+                              transforms_uid);
     } else {
         // Without fuse->passthrough, we don't want to use the FUSE VFS cache in two cases:
         // 1. When redaction is needed because app A with EXIF access might access
@@ -1561,34 +2212,39 @@ static handle* create_handle_for_node(struct fuse* fuse, const string& path, int
         } else {
             *keep_cache = transforms_complete;
         }
-        handle = new struct handle(fd, ri, !direct_io /* cached */, false /* passthrough */, uid,
-                                   transforms_uid);
+        handle = new (fuse->tracker.handle_allocator())
+                struct handle(fd, ri, !direct_io /* cached */, false /* passthrough */, uid,
+                              transforms_uid);
     }
 
     node->AddHandle(handle);
     return handle;
 }
 
-static bool do_passthrough_enable(fuse_req_t req, struct fuse_file_info* fi, unsigned int fd,
-                                  node* node) {
+// Sets up passthrough of |h|, opened from |io_path| with |open_flags|.
+static bool do_passthrough_enable(fuse_req_t req, struct fuse_file_info* fi, handle* h,
+                                  const string& io_path, int open_flags, node* node) {
     struct fuse* fuse = get_fuse(req);
 
     if (fuse->upstream_passthrough) {
-        int backing_id = node->GetBackingId();
+        // Registering a backing file with the kernel is a round trip of its own, so opens of a
+        // file share the backing ids previous opens of it with the same access mode registered.
+        const int access_mode = open_flags & O_ACCMODE;
+        int backing_id = node->AcquireBackingId(io_path, access_mode);
         if (!backing_id) {
-            backing_id = fuse_passthrough_open(req, fd);
-            if (!backing_id) return false;
-            // We only ever want one backing id per backed file
-            if (!node->SetBackingId(backing_id)) {
-                fuse_passthrough_close(req, backing_id);
-                backing_id = node->GetBackingId();
-                if (!backing_id) return false;
+            const int new_backing_id = fuse_passthrough_open(req, h->fd);
+            if (!new_backing_id) return false;
+            backing_id = node->AddBackingId(io_path, access_mode, new_backing_id);
+            if (backing_id != new_backing_id) {
+                // Another open registered one first.
+                fuse_passthrough_close(req, new_backing_id);
             }
         }
 
+        h->backing_id = backing_id;
         fi->backing_id = backing_id;
     } else {
-        int passthrough_fh = fuse_passthrough_enable(req, fd);
+        int passthrough_fh = fuse_passthrough_enable(req, h->fd);
 
         if (passthrough_fh <= 0) {
             return false;
@@ -1638,9 +2294,62 @@ static void fill_fuse_file_info(const handle* handle, const OpenInfo* open_info,
     fi->direct_io = !handle->cached;
 }
 
+// Returns the transform of |node| for reads of |uid| through |h|. It doesn't use |node|, which
+// may be deleted before a transform started in the background is done.
+static mediaprovider::fuse::TransformScheduler::Transform make_transform(struct fuse* fuse,
+                                                                         node* node, uid_t uid,
+                                                                         const handle* h) {
+    return [mp = fuse->mp, src = node->BuildPath(), dst = node->GetIoPath(),
+            transforms = node->GetTransforms(), reason = node->GetTransformsReason(), uid,
+            open_uid = h->uid, transforms_uid = h->transforms_uid] {
+        return mp->Transform(src, dst, transforms, reason, uid, open_uid, transforms_uid);
+    };
+}
+
+// Checks with MediaProvider whether |ctx| may open |node|, reusing the result of the check made
+// for a recent open for reading of the same node by the same uid, if any. Opens of paths that
+// support transcoding always make the check, MediaProvider tracks them for transcoding.
+static std::unique_ptr<FileOpenResult> on_file_open(struct fuse* fuse, node* node, fuse_ino_t ino,
+                                                    const string& build_path,
+                                                    const string& io_path,
+                                                    const struct fuse_ctx* ctx,
+                                                    const OpenInfo& open_info) {
+    const bool use_cache = !open_info.for_write && fuse->open_result_ttl.count() > 0 &&
+                           !fuse->IsTranscodeSupportedPath(build_path);
+    uint64_t generation = 0;
+    if (use_cache) {
+        std::unique_ptr<OpenResultCache::Result> cached = fuse->open_results.Get(ino, ctx->uid);
+        if (cached) {
+            // The access is still reported, as the check would have.
+            fuse->mp->OnCachedFileOpen(build_path, ctx->uid);
+            return std::make_unique<FileOpenResult>(0 /* status */, cached->uid,
+                                                    cached->transforms_uid, -1 /* fd */,
+                                                    new RedactionInfo(cached->redaction_info));
+        }
+        generation = fuse->open_results.generation();
+    }
+
+    // Force permission check with the build path because the MediaProvider database might not be
+    // aware of the io_path
+    // We don't redact if the caller was granted write permission for this file
+    std::unique_ptr<FileOpenResult> result = fuse->mp->OnFileOpen(
+            build_path, io_path, ctx->uid, ctx->pid, node->GetTransformsReason(),
+            open_info.for_write, !open_info.for_write /* redact */,
+            true /* log_transforms_metrics */);
+    // An fd opened by MediaProvider can only be used once.
+    if (use_cache && result && result->status == 0 && result->fd < 0 && result->redaction_info) {
+        fuse->open_results.Put(ino, ctx->uid,
+                               {static_cast<uid_t>(result->uid), result->transforms_uid,
+                                *result->redaction_info},
+                               generation, fuse->open_result_ttl);
+    }
+    return result;
+}
+
 static void pf_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
     ATRACE_CALL();
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::open);
     node* node = fuse->FromInode(ino);
     if (!node) {
         fuse_reply_err(req, ENOENT);
@@ -1662,13 +2371,13 @@ static void pf_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
         TRACE_NODE(node, req) << (open_info.for_write ? "write" : "read");
     }
 
-    // Force permission check with the build path because the MediaProvider database might not be
-    // aware of the io_path
-    // We don't redact if the caller was granted write permission for this file
-    std::unique_ptr<FileOpenResult> result = fuse->mp->OnFileOpen(
-            build_path, io_path, ctx->uid, ctx->pid, node->GetTransformsReason(),
-            open_info.for_write, !open_info.for_write /* redact */,
-            true /* log_transforms_metrics */);
+    if (open_info.for_write) {
+        // What is written may change the result of later opens for reading, e.g. the redaction.
+        fuse->open_results.Forget(ino);
+    }
+
+    std::unique_ptr<FileOpenResult> result =
+            on_file_open(fuse, node, ino, build_path, io_path, ctx, open_info);
     if (!result) {
         fuse_reply_err(req, EFAULT);
         return;
@@ -1695,22 +2404,29 @@ static void pf_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
     int keep_cache = 1;
     // If is_fd_from_java==true, we disallow passthrough because the fd can be pointing to the
     // FUSE fs if gotten from another process
-    const handle* h = create_handle_for_node(fuse, io_path, fd, result->uid, result->transforms_uid,
+    handle* h = create_handle_for_node(fuse, io_path, fd, result->uid, result->transforms_uid,
                                              node, result->redaction_info.release(),
                                              /* allow_passthrough */ !is_fd_from_java,
                                              open_info.direct_io, &keep_cache);
     fill_fuse_file_info(h, &open_info, keep_cache, fi);
+    if (h->passthrough) {
+        op_timer.set_op(FuseOpStat::open_passthrough);
+    }
 
     // TODO(b/173190192) ensuring that h->cached must be enabled in order to
     // user FUSE passthrough is a conservative rule and might be dropped as
     // soon as demonstrated its correctness.
-    if (h->passthrough && !do_passthrough_enable(req, fi, fd, node)) {
+    if (h->passthrough && !do_passthrough_enable(req, fi, h, io_path, open_info.flags, node)) {
         // TODO: Should we crash here so we can find errors easily?
         PLOG(ERROR) << "Passthrough OPEN failed for " << io_path;
         fuse_reply_err(req, EFAULT);
         return;
     }
 
+    if (fuse->prefetch_transforms && !open_info.for_write && !node->IsTransformsComplete()) {
+        fuse->transforms.Prefetch(ino, make_transform(fuse, node, ctx->uid, h));
+    }
+
     fuse_reply_open(req, fi);
 }
 
@@ -1732,6 +2448,24 @@ static void do_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_inf
     }
 }
 
+/**
+ * Returns a sealed memfd of |size| zeroized bytes, or -1 on failure. Sealing it guarantees that
+ * it can't be written to or resized, so that it always reads as zeros.
+ */
+static int create_zero_memfd(size_t size) {
+    android::base::unique_fd fd(memfd_create("fuse_zero", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!fd.ok()) {
+        PLOG(WARNING) << "memfd_create failed, redacted ranges will be copied";
+        return -1;
+    }
+    if (ftruncate(fd.get(), size) ||
+        fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)) {
+        PLOG(WARNING) << "Failed to set up zero memfd, redacted ranges will be copied";
+        return -1;
+    }
+    return fd.release();
+}
+
 /**
  * Sets the parameters for a fuse_buf that reads from memory, including flags.
  * Makes buf->mem point to an already mapped region of zeroized memory.
@@ -1756,39 +2490,125 @@ static void create_file_fuse_buf(size_t size, off_t pos, int fd, fuse_buf* buf)
     buf->mem = nullptr;
 }
 
+// Number of consecutive sequential reads of a handle before reading ahead of it.
+static constexpr int kReadaheadMinSequentialReads = 2;
+
+/**
+ * Reads ahead of |h| if it looks like it's being read sequentially. The kernel only reads ahead
+ * on the FUSE file, which doesn't help direct_io or redacted reads, so advise the lower file
+ * |readahead_window| bytes ahead of the reader, half a window at a time.
+ */
+static void maybe_readahead(struct fuse* fuse, handle* h, off_t off, size_t size) {
+    const size_t window = fuse->readahead_window;
+    if (window == 0) {
+        return;
+    }
+
+    const off_t end = off + size;
+    off_t readahead_off;
+    size_t readahead_size;
+    {
+        std::lock_guard<std::mutex> guard(h->readahead_lock);
+        // Concurrent reads of the same handle may be served slightly out of order, so anything
+        // within one read of the last one still counts as sequential.
+        const off_t slack = size;
+        if (off >= h->next_read_off - slack && off <= h->next_read_off + slack) {
+            h->sequential_reads++;
+        } else {
+            h->sequential_reads = 0;
+            h->readahead_end = 0;
+        }
+        h->next_read_off = std::max(h->next_read_off, end);
+
+        if (h->sequential_reads < kReadaheadMinSequentialReads ||
+            h->readahead_end >= static_cast<off_t>(end + window / 2)) {
+            return;
+        }
+        readahead_off = std::max(h->readahead_end, end);
+        h->readahead_end = end + window;
+        readahead_size = h->readahead_end - readahead_off;
+    }
+    fuse->fadviser.Readahead(h->fd, readahead_off, readahead_size);
+}
+
+/**
+ * Writes back and drops |h| from the lower page cache behind the writer if it looks like it's
+ * being written sequentially, a |writebehind_window| at a time. Writes are already combined into
+ * large FUSE_WRITEs by the kernel's writeback cache, so this is about the page cache, not the
+ * number of writes.
+ */
+static void maybe_writebehind(struct fuse* fuse, handle* h, off_t off, size_t size) {
+    const size_t window = fuse->writebehind_window;
+    if (window == 0) {
+        return;
+    }
+
+    const off_t end = off + size;
+    off_t writebehind_off;
+    {
+        std::lock_guard<std::mutex> guard(h->readahead_lock);
+        // Like for reads, concurrent writes of the same handle may be served out of order.
+        const off_t slack = size;
+        if (off < h->next_write_off - slack || off > h->next_write_off + slack) {
+            h->writebehind_off = off;
+        }
+        h->next_write_off = std::max(h->next_write_off, end);
+
+        if (end < h->writebehind_off + static_cast<off_t>(window)) {
+            return;
+        }
+        writebehind_off = h->writebehind_off;
+        h->writebehind_off = end;
+    }
+    fuse->fadviser.WriteBehind(h->fd, writebehind_off, end - writebehind_off);
+}
+
+// Number of buffers a redacted read can reply with without allocating. Reads usually overlap
+// only 1-3 redaction ranges (e.g. EXIF location tags), i.e. need at most 7 buffers.
+static constexpr size_t kInlineRedactionBufs = 8;
+
 static void do_read_with_redaction(fuse_req_t req, size_t size, off_t off, fuse_file_info* fi,
                                    bool direct_io) {
     handle* h = reinterpret_cast<handle*>(fi->fh);
 
-    std::vector<ReadRange> ranges;
-    h->ri->getReadRanges(off, size, &ranges);
+    const size_t num_bufs = h->ri->getReadRangeCount(off, size);
 
     // As an optimization, return early if there are no ranges to redact.
-    if (ranges.size() == 0) {
+    if (num_bufs == 0) {
         do_read(req, size, off, fi, direct_io);
         return;
     }
 
-    const size_t num_bufs = ranges.size();
-    auto bufvec_ptr = std::unique_ptr<fuse_bufvec, decltype(free)*>{
-            reinterpret_cast<fuse_bufvec*>(
-                    malloc(sizeof(fuse_bufvec) + (num_bufs - 1) * sizeof(fuse_buf))),
-            free};
-    fuse_bufvec& bufvec = *bufvec_ptr;
+    // fuse_bufvec ends with a one element array of fuse_bufs, which we extend in place.
+    struct {
+        fuse_bufvec bufvec;
+        fuse_buf extra_bufs[kInlineRedactionBufs - 1];
+    } inline_bufvec;
+    auto heap_bufvec = std::unique_ptr<fuse_bufvec, decltype(free)*>{nullptr, free};
+    if (num_bufs > kInlineRedactionBufs) {
+        heap_bufvec.reset(reinterpret_cast<fuse_bufvec*>(
+                malloc(sizeof(fuse_bufvec) + (num_bufs - 1) * sizeof(fuse_buf))));
+    }
+    fuse_bufvec& bufvec = heap_bufvec ? *heap_bufvec : inline_bufvec.bufvec;
 
     // initialize bufvec
     bufvec.count = num_bufs;
     bufvec.idx = 0;
     bufvec.off = 0;
 
-    for (int i = 0; i < num_bufs; ++i) {
-        const ReadRange& range = ranges[i];
-        if (range.is_redaction) {
-            create_mem_fuse_buf(range.size, &(bufvec.buf[i]), get_fuse(req));
+    struct fuse* fuse = get_fuse(req);
+    size_t i = 0;
+    h->ri->forEachReadRange(off, size, [&](const ReadRange& range) {
+        CHECK(i < num_bufs);
+        if (range.is_redaction && fuse->zero_fd.ok()) {
+            create_file_fuse_buf(range.size, 0, fuse->zero_fd.get(), &(bufvec.buf[i]));
+        } else if (range.is_redaction) {
+            create_mem_fuse_buf(range.size, &(bufvec.buf[i]), fuse);
         } else {
             create_file_fuse_buf(range.size, range.start, h->fd, &(bufvec.buf[i]));
         }
-    }
+        i++;
+    });
 
     fuse_reply_data(req, &bufvec, static_cast<fuse_buf_copy_flags>(0));
 }
@@ -1802,13 +2622,13 @@ static void pf_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
     }
     const bool direct_io = !h->cached;
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::read);
 
     node* node = fuse->FromInode(ino);
 
     if (!node->IsTransformsComplete()) {
-        if (!fuse->mp->Transform(node->BuildPath(), node->GetIoPath(), node->GetTransforms(),
-                                 node->GetTransformsReason(), req->ctx.uid, h->uid,
-                                 h->transforms_uid)) {
+        // Concurrent readers wait for the same transform, which may have been started on open.
+        if (!fuse->transforms.Run(ino, make_transform(fuse, node, req->ctx.uid, h))) {
             fuse_reply_err(req, EFAULT);
             return;
         }
@@ -1816,8 +2636,12 @@ static void pf_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
     }
 
     fuse->fadviser.Record(h->fd, size);
+    maybe_readahead(fuse, h, off, size);
 
+    mediaprovider::fuse::ScopedInFlight in_flight(&fuse->reads_in_flight);
+    ATrace_setCounter("fuse_reads_in_flight", fuse->reads_in_flight.current());
     if (h->ri->isRedactionNeeded()) {
+        op_timer.set_op(FuseOpStat::read_redacted);
         do_read_with_redaction(req, size, off, fi, direct_io);
     } else {
         do_read(req, size, off, fi, direct_io);
@@ -1842,6 +2666,7 @@ static void pf_write_buf(fuse_req_t req,
     struct fuse_bufvec buf = FUSE_BUFVEC_INIT(fuse_buf_size(bufv));
     ssize_t size;
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::write_buf);
 
     buf.buf[0].fd = h->fd;
     buf.buf[0].pos = off;
@@ -1855,39 +2680,49 @@ static void pf_write_buf(fuse_req_t req,
         // Execute Record *before* fuse_reply_write to avoid the following ordering:
         // fuse_reply_write -> pf_release (destroy handle) -> Record (use handle after free)
         fuse->fadviser.Record(h->fd, size);
+        maybe_writebehind(fuse, h, off, size);
         fuse_reply_write(req, size);
     }
 }
-// Haven't tested this one. Not sure what calls it.
-#if 0
-static void pf_copy_file_range(fuse_req_t req, fuse_ino_t ino_in,
-                                 off_t off_in, struct fuse_file_info* fi_in,
-                                 fuse_ino_t ino_out, off_t off_out,
-                                 struct fuse_file_info* fi_out, size_t len,
-                                 int flags)
-{
-    handle* h_in = reinterpret_cast<handle *>(fi_in->fh);
-    handle* h_out = reinterpret_cast<handle *>(fi_out->fh);
-    struct fuse_bufvec buf_in = FUSE_BUFVEC_INIT(len);
-    struct fuse_bufvec buf_out = FUSE_BUFVEC_INIT(len);
-    ssize_t size;
-
-    buf_in.buf[0].fd = h_in->fd;
-    buf_in.buf[0].pos = off_in;
-    buf_in.buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD|FUSE_BUF_FD_SEEK);
+// Returns whether |fd| is a file of a FUSE filesystem, e.g. an fd MediaProvider opened through
+// FUSE. Copying those from a FUSE worker could end up waiting on itself.
+static bool is_fuse_fd(int fd) {
+    struct statfs st;
+    return fstatfs(fd, &st) != 0 || st.f_type == FUSE_SUPER_MAGIC;
+}
 
-    buf_out.buf[0].fd = h_out->fd;
-    buf_out.buf[0].pos = off_out;
-    buf_out.buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD|FUSE_BUF_FD_SEEK);
-    size = fuse_buf_copy(&buf_out, &buf_in, (enum fuse_buf_copy_flags) 0);
+static void pf_copy_file_range(fuse_req_t req, fuse_ino_t ino_in, off_t off_in,
+                               struct fuse_file_info* fi_in, fuse_ino_t ino_out, off_t off_out,
+                               struct fuse_file_info* fi_out, size_t len, int flags) {
+    ATRACE_CALL();
+    struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::copy_file_range);
+    handle* h_in = reinterpret_cast<handle*>(fi_in->fh);
+    handle* h_out = reinterpret_cast<handle*>(fi_out->fh);
+    node* node_in = fuse->FromInode(ino_in);
+
+    // The lower files can only be copied as is if the source is read unmodified. Otherwise, or if
+    // the lower filesystem can't copy them, EOPNOTSUPP makes the kernel fall back to reads and
+    // writes through FUSE. Unlike ENOSYS, it doesn't disable copy_file_range for good.
+    if (flags != 0 || !node_in || h_in->ri->isRedactionNeeded() ||
+        !node_in->IsTransformsComplete() || is_fuse_fd(h_in->fd) || is_fuse_fd(h_out->fd)) {
+        fuse_reply_err(req, EOPNOTSUPP);
+        return;
+    }
 
+    // Called through syscall() since the libc wrapper isn't available before API level 34.
+    const ssize_t size =
+            syscall(__NR_copy_file_range, h_in->fd, &off_in, h_out->fd, &off_out, len, 0);
     if (size < 0) {
-        fuse_reply_err(req, -size);
+        const int error = errno;
+        fuse_reply_err(req, (error == EXDEV || error == ENOSYS) ? EOPNOTSUPP : error);
+        return;
     }
 
+    // As in pf_write_buf(), Record before replying, after which |h_out| may be released.
+    fuse->fadviser.Record(h_out->fd, size);
     fuse_reply_write(req, size);
 }
-#endif
 
 /*
  * This function does nothing except being a placeholder to keep the FUSE
@@ -1919,7 +2754,14 @@ static void pf_release(fuse_req_t req,
     TRACE_NODE(node, req);
 
     fuse->fadviser.Close(h->fd);
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+        // Drop the results of the opens made while the file was being written.
+        fuse->open_results.Forget(ino);
+    }
     if (node) {
+        if (h->backing_id && node->ReleaseBackingId(h->backing_id)) {
+            fuse_passthrough_close(req, h->backing_id);
+        }
         node->DestroyHandle(h);
     }
 
@@ -1984,15 +2826,70 @@ static void pf_opendir(fuse_req_t req,
         fuse_reply_err(req, errno);
         return;
     }
+    record_dir_open(fuse, path);
 
-    dirhandle* h = new dirhandle(dir);
+    dirhandle* h = new (fuse->tracker.dirhandle_allocator()) dirhandle(dir);
     node->AddDirHandle(h);
 
     fi->fh = ptr_to_id(h);
     fuse_reply_open(req, fi);
 }
 
-#define READDIR_BUF 32768LU
+// Returns a buffer of at least |size| bytes for readdir() replies, reused by the calling thread
+// across requests.
+static char* get_readdir_buffer(size_t size) {
+    static thread_local std::vector<char> buffer;
+    if (buffer.size() < size) {
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+// Number of directory entries fetched at a time while listing a directory. A readdir() buffer
+// holds a few hundred entries at most.
+#define DIRECTORY_ENTRIES_CHUNK_SIZE 1024
+
+// Fetches the FileLookupResults of the entries of |h| from |begin| on that need one with a single
+// upcall, so that readdirplus doesn't make one per entry.
+static void prefetch_file_lookups(fuse_req_t req, struct fuse* fuse, const string& path,
+                                  dirhandle* h, size_t begin) {
+    if (begin < h->de.size() && h->de.is_error(begin)) {
+        // Failed to list the directory, see do_readdir_common().
+        return;
+    }
+
+    std::vector<size_t> indices;
+    std::vector<string> child_paths;
+    for (size_t i = begin; i < h->de.size(); i++) {
+        string child_path = path + "/" + h->de.name(i);
+        if (needs_file_lookup(fuse, child_path, is_synthetic_path(child_path, fuse))) {
+            indices.push_back(i);
+            child_paths.push_back(std::move(child_path));
+        }
+    }
+    if (child_paths.empty()) {
+        return;
+    }
+
+    std::vector<std::unique_ptr<mediaprovider::fuse::FileLookupResult>> results =
+            fuse->mp->FileLookupBatch(child_paths, req->ctx.uid, req->ctx.pid);
+    h->lookups.resize(h->de.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        h->lookups[indices[i]] = std::move(results[i]);
+    }
+}
+
+// Appends the next chunk of the entries of the directory at |path| to |h->de|, prefetching
+// their FileLookupResults for readdirplus.
+static void fetch_directory_entries(fuse_req_t req, struct fuse* fuse, const string& path,
+                                    dirhandle* h, bool plus) {
+    const size_t begin = h->de.size();
+    fuse->mp->GetDirectoryEntries(req->ctx.uid, path, h->d, &h->cursor,
+                                  DIRECTORY_ENTRIES_CHUNK_SIZE, &h->de);
+    if (plus) {
+        prefetch_file_lookups(req, fuse, path, h, begin);
+    }
+}
 
 static void do_readdir_common(fuse_req_t req,
                               fuse_ino_t ino,
@@ -2002,10 +2899,11 @@ static void do_readdir_common(fuse_req_t req,
                               bool plus) {
     struct fuse* fuse = get_fuse(req);
     dirhandle* h = reinterpret_cast<dirhandle*>(fi->fh);
-    size_t len = std::min<size_t>(size, READDIR_BUF);
-    char buf[READDIR_BUF];
+    // Fill as much of the kernel's buffer as it asks for, to save round trips on large
+    // directories.
+    size_t len = std::min<size_t>(size, MAX_READ_SIZE);
+    char* buf = get_readdir_buffer(len);
     size_t used = 0;
-    std::shared_ptr<DirectoryEntry> de;
 
     struct fuse_entry_param e;
     size_t entry_size = 0;
@@ -2030,12 +2928,14 @@ static void do_readdir_common(fuse_req_t req,
         return;
     }
 
-    // Get all directory entries from MediaProvider on first readdir() call of
-    // directory handle. h->next_off = 0 indicates that current readdir() call
-    // is first readdir() call for the directory handle, Avoid multiple JNI calls
-    // for single directory handle.
+    // Start listing the directory on first readdir() call of directory handle.
+    // h->next_off = 0 indicates that current readdir() call is first readdir()
+    // call for the directory handle. Entries are then fetched in chunks as they are
+    // consumed, so that the first entries of large directories come back quickly.
     if (h->next_off == 0) {
-        h->de = fuse->mp->GetDirectoryEntries(req->ctx.uid, path, h->d);
+        h->de.clear();
+        h->lookups.clear();
+        h->cursor = DirectoryEntryCursor();
     }
     // If the last entry in the previous readdir() call was rejected due to
     // buffer capacity constraints, update directory offset to start from
@@ -2044,25 +2944,47 @@ static void do_readdir_common(fuse_req_t req,
     if (off != h->next_off) {
         h->next_off = off;
     }
-    const int num_directory_entries = h->de.size();
-    // Check for errors. Any error/exception occurred while obtaining directory
-    // entries will be indicated by marking first directory entry name as empty
-    // string. In the erroneous case corresponding d_type will hold error number.
-    if (num_directory_entries && h->de[0]->d_name.empty()) {
-        fuse_reply_err(req, h->de[0]->d_type);
-        return;
-    }
 
-    while (h->next_off < num_directory_entries) {
-        de = h->de[h->next_off];
-        entry_size = 0;
+    while (true) {
+        if (static_cast<size_t>(h->next_off) >= h->de.size()) {
+            if (h->cursor.done()) {
+                break;
+            }
+            fetch_directory_entries(req, fuse, path, h, plus);
+            continue;
+        }
+        const char* name = h->de.name(h->next_off);
+        const int type = h->de.type(h->next_off);
+        // Check for errors. Any error/exception occurred while obtaining directory
+        // entries will be indicated by an entry with an empty name, after the
+        // entries fetched before the error. In the erroneous case corresponding d_type
+        // will hold error number. Report it once the entries before it are consumed.
+        if (h->de.is_error(h->next_off)) {
+            if (used == 0) {
+                fuse_reply_err(req, type);
+                return;
+            }
+            break;
+        }
+        // Stop at the first entry that doesn't fit, before looking it up, so that the kernel
+        // never misses a lookup done on its behalf.
+        entry_size = plus ? fuse_add_direntry_plus(req, nullptr, 0, name, nullptr, 0)
+                          : fuse_add_direntry(req, nullptr, 0, name, nullptr, 0);
+        if (used + entry_size > len) {
+            break;
+        }
         h->next_off++;
         if (plus) {
             int error_code = 0;
+            std::shared_ptr<const mediaprovider::fuse::FileLookupResult> lookup;
+            if (static_cast<size_t>(h->next_off) <= h->lookups.size()) {
+                lookup = std::move(h->lookups[h->next_off - 1]);
+            }
             // Skip validating user and app access as they are already performed on parent node
-            if (do_lookup(req, ino, de->d_name.c_str(), &e, &error_code, FuseOp::readdir, false)) {
-                entry_size = fuse_add_direntry_plus(req, buf + used, len - used, de->d_name.c_str(),
-                                                    &e, h->next_off);
+            if (do_lookup(req, ino, name, &e, &error_code, FuseOp::readdir, false, nullptr,
+                          lookup.get())) {
+                entry_size =
+                        fuse_add_direntry_plus(req, buf + used, len - used, name, &e, h->next_off);
             } else {
                 // Ignore lookup errors on
                 // 1. non-existing files returned from MediaProvider database.
@@ -2078,24 +3000,14 @@ static void do_readdir_common(fuse_req_t req,
         } else {
             // This should never happen because we have readdir_plus enabled without adaptive
             // readdir_plus, FUSE_CAP_READDIRPLUS_AUTO
-            LOG(WARNING) << "Handling plain readdir for " << de->d_name << ". Invalid d_ino";
+            LOG(WARNING) << "Handling plain readdir for " << name << ". Invalid d_ino";
             e.attr.st_ino = FUSE_UNKNOWN_INO;
-            e.attr.st_mode = de->d_type << 12;
-            entry_size = fuse_add_direntry(req, buf + used, len - used, de->d_name.c_str(), &e.attr,
-                                           h->next_off);
-        }
-        // If buffer in fuse_add_direntry[_plus] is not large enough then
-        // the entry is not added to buffer but the size of the entry is still
-        // returned. Check available buffer size + returned entry size is less
-        // than actual buffer size to confirm entry is added to buffer.
-        if (used + entry_size > len) {
-            // When an entry is rejected, lookup called by readdir_plus will not be tracked by
-            // kernel. Call forget on the rejected node to decrement the reference count.
-            if (plus && e.ino > 0) {
-                do_forget(req, fuse, e.ino, 1);
-            }
-            break;
+            e.attr.st_mode = type << 12;
+            entry_size =
+                    fuse_add_direntry(req, buf + used, len - used, name, &e.attr, h->next_off);
         }
+        // The entry was checked to fit above.
+        CHECK_LE(used + entry_size, len);
         used += entry_size;
     }
     fuse_reply_buf(req, buf, used);
@@ -2104,6 +3016,7 @@ static void do_readdir_common(fuse_req_t req,
 static void pf_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
                        struct fuse_file_info* fi) {
     ATRACE_CALL();
+    ScopedOpTimer op_timer(&get_fuse(req)->stats, FuseOpStat::readdir);
     do_readdir_common(req, ino, size, off, fi, false);
 }
 
@@ -2115,7 +3028,9 @@ static void pf_readdir_postfilter(fuse_req_t req, fuse_ino_t ino, uint32_t error
                                   off_t off_out, size_t size_out, const void* dirents_in,
                                   struct fuse_file_info* fi) {
     struct fuse* fuse = get_fuse(req);
-    char buf[READDIR_BUF];
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::readdir_postfilter);
+    // Filtered entries are never larger than the original ones.
+    char* buf = get_readdir_buffer(sizeof(struct fuse_read_out) + size_out);
     struct fuse_read_out* fro = (struct fuse_read_out*)(buf);
     size_t used = 0;
     bool redacted = false;
@@ -2168,6 +3083,7 @@ static void pf_readdirplus(fuse_req_t req,
                            off_t off,
                            struct fuse_file_info* fi) {
     ATRACE_CALL();
+    ScopedOpTimer op_timer(&get_fuse(req)->stats, FuseOpStat::readdirplus);
     do_readdir_common(req, ino, size, off, fi, true);
 }
 
@@ -2290,6 +3206,7 @@ static void pf_create(fuse_req_t req,
                       struct fuse_file_info* fi) {
     ATRACE_CALL();
     struct fuse* fuse = get_fuse(req);
+    ScopedOpTimer op_timer(&fuse->stats, FuseOpStat::create);
     node* parent_node = fuse->FromInode(parent);
     if (!parent_node) {
         fuse_reply_err(req, ENOENT);
@@ -2312,6 +3229,7 @@ static void pf_create(fuse_req_t req,
         fuse_reply_err(req, mp_return_code);
         return;
     }
+    fuse->mp->InvalidateFileLookup(child_path);
 
     mode = (mode & (~0777)) | 0664;
     int fd = open(child_path.c_str(), open_info.flags, mode);
@@ -2323,6 +3241,7 @@ static void pf_create(fuse_req_t req,
         fuse_reply_err(req, error_code);
         return;
     }
+    invalidate_negative_entries(fuse, parent, name, false /* include_name */);
 
     int error_code = 0;
     struct fuse_entry_param e;
@@ -2337,13 +3256,15 @@ static void pf_create(fuse_req_t req,
 
     // Let MediaProvider know we've created a new file
     fuse->mp->OnFileCreated(child_path);
+    // The file may have existed already, and is now open for writing.
+    fuse->open_results.Forget(e.ino);
 
     // TODO(b/147274248): Assume there will be no EXIF to redact.
     // This prevents crashing during reads but can be a security hole if a malicious app opens an fd
     // to the file before all the EXIF content is written. We could special case reads before the
     // first close after a file has just been created.
     int keep_cache = 1;
-    const handle* h = create_handle_for_node(
+    handle* h = create_handle_for_node(
             fuse, child_path, fd, req->ctx.uid, 0 /* transforms_uid */, node, new RedactionInfo(),
             /* allow_passthrough */ true, open_info.direct_io, &keep_cache);
     fill_fuse_file_info(h, &open_info, keep_cache, fi);
@@ -2351,7 +3272,8 @@ static void pf_create(fuse_req_t req,
     // TODO(b/173190192) ensuring that h->cached must be enabled in order to
     // user FUSE passthrough is a conservative rule and might be dropped as
     // soon as demonstrated its correctness.
-    if (h->passthrough && !do_passthrough_enable(req, fi, fd, node)) {
+    if (h->passthrough &&
+        !do_passthrough_enable(req, fi, h, child_path, open_info.flags, node)) {
         PLOG(ERROR) << "Passthrough CREATE failed for " << child_path;
         fuse_reply_err(req, EFAULT);
         return;
@@ -2439,13 +3361,33 @@ static struct fuse_lowlevel_ops ops{
             .forget_multi = pf_forget_multi,
     /*.flock = pf_flock,*/
             .fallocate = pf_fallocate, .readdirplus = pf_readdirplus,
-    /*.copy_file_range = pf_copy_file_range,*/
+            .copy_file_range = pf_copy_file_range,
 };
 
-static struct fuse_loop_config config = {
-        .clone_fd = 1,
-        .max_idle_threads = 10,
-};
+// Returns the CPUs listed in |cpus| as comma-separated numbers and ranges, e.g. "0-3,6", or an
+// empty set if there are none or they can't be parsed.
+static cpu_set_t parse_cpu_list(const std::string& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const std::string& range : android::base::Split(cpus, ",")) {
+        if (range.empty()) {
+            continue;
+        }
+        const std::vector<std::string> bounds = android::base::Split(range, "-");
+        unsigned int first = 0;
+        unsigned int last = 0;
+        if (bounds.size() > 2 || !android::base::ParseUint(bounds[0], &first, CPU_SETSIZE - 1u) ||
+            !android::base::ParseUint(bounds.back(), &last, CPU_SETSIZE - 1u) || first > last) {
+            LOG(ERROR) << "Invalid CPU list: " << cpus;
+            CPU_ZERO(&set);
+            return set;
+        }
+        for (unsigned int cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return set;
+}
 
 static std::unordered_map<enum fuse_log_level, enum android_LogPriority> fuse_to_android_loglevel({
     {FUSE_LOG_EMERG, ANDROID_LOG_FATAL},
@@ -2473,7 +3415,7 @@ bool FuseDaemon::ShouldOpenWithFuse(int fd, bool for_read, const std::string& pa
     bool use_fuse = false;
 
     if (active.load(std::memory_order_acquire)) {
-        std::lock_guard<std::recursive_mutex> guard(fuse->lock);
+        std::shared_lock<RecursiveSharedMutex> guard(fuse->lock);
         const node* node = node::LookupAbsolutePath(fuse->root, path);
         if (node && node->HasCachedHandle()) {
             use_fuse = true;
@@ -2496,12 +3438,14 @@ bool FuseDaemon::UsesFusePassthrough() const {
 
 void FuseDaemon::InvalidateFuseDentryCache(const std::string& path) {
     LOG(VERBOSE) << "Invalidating FUSE dentry cache";
+    // Whatever changed the file may also have changed how it is looked up.
+    mp.InvalidateFileLookup(path);
     if (active.load(std::memory_order_acquire)) {
         string name;
         fuse_ino_t parent;
         fuse_ino_t child;
         {
-            std::lock_guard<std::recursive_mutex> guard(fuse->lock);
+            std::shared_lock<RecursiveSharedMutex> guard(fuse->lock);
             const node* node = node::LookupAbsolutePath(fuse->root, path);
             if (node) {
                 name = node->GetName();
@@ -2511,14 +3455,62 @@ void FuseDaemon::InvalidateFuseDentryCache(const std::string& path) {
         }
 
         if (!name.empty()) {
-            std::thread t([=]() { fuse_inval(fuse->se, parent, child, name, path); });
-            t.detach();
+            fuse->open_results.Forget(child);
+            fuse_inval(fuse, parent, child, name, path);
+        }
+
+        // The path may also have just been created, while the kernel still caches that it (or
+        // a name equal to it ignoring case) doesn't exist.
+        const size_t slash = path.rfind('/');
+        if (slash != string::npos) {
+            fuse_ino_t dir = 0;
+            {
+                std::shared_lock<RecursiveSharedMutex> guard(fuse->lock);
+                const node* dir_node = node::LookupAbsolutePath(fuse->root, path.substr(0, slash));
+                if (dir_node) {
+                    dir = fuse->ToInode(const_cast<class node*>(dir_node));
+                }
+            }
+            if (dir) {
+                invalidate_negative_entries(fuse, dir, path.substr(slash + 1),
+                                            true /* include_name */);
+            }
         }
     } else {
         LOG(WARNING) << "FUSE daemon is inactive. Cannot invalidate dentry";
     }
 }
 
+std::string FuseDaemon::DumpStats() {
+    if (!active.load(std::memory_order_acquire)) {
+        return "";
+    }
+    return fuse->startup->Dump() + fuse->stats.Dump() +
+           fuse->reads_in_flight.Dump("reads_in_flight") + fuse->negative_entries.Dump() +
+           fuse->attr_timeouts.Dump() + fuse->open_results.Dump() + fuse->invalidations.Dump() +
+           fuse->transforms.Dump() + worker_stats.Dump() + MediaProviderWrapper::DumpThreadStats() +
+           mp.GetUpcallStats().Dump() + dumpLevelDbOpenStats();
+}
+
+void FuseDaemon::FlushFuseDentryInvalidations() {
+    if (active.load(std::memory_order_acquire)) {
+        fuse->invalidations.Flush();
+    }
+}
+
+void FuseDaemon::InvalidateFileLookupCache(const std::string& path) {
+    LOG(VERBOSE) << "Invalidating file lookup cache";
+    mp.InvalidateFileLookup(path);
+}
+
+void FuseDaemon::InvalidateAccessDecisionCache() {
+    LOG(VERBOSE) << "Invalidating access decision cache";
+    mp.InvalidateAccessDecisions();
+    if (active.load(std::memory_order_acquire)) {
+        fuse->open_results.Clear();
+    }
+}
+
 FuseDaemon::FuseDaemon(JNIEnv* env, jobject mediaProvider) : mp(env, mediaProvider),
                                                              active(false), fuse(nullptr) {}
 
@@ -2567,6 +3559,7 @@ void FuseDaemon::Start(android::base::unique_fd fd, const std::string& path,
                        const std::vector<std::string>& supported_transcoding_relative_paths,
                        const std::vector<std::string>& supported_uncached_relative_paths) {
     android::base::SetDefaultTag(LOG_TAG);
+    StartupStats startup;
 
     struct fuse_args args;
     struct fuse_cmdline_opts opts;
@@ -2606,11 +3599,21 @@ void FuseDaemon::Start(android::base::unique_fd fd, const std::string& path,
     if (!bpf_enabled) {
         LOG(INFO) << "Not using FUSE BPF";
     }
+    startup.Reached(StartupStats::Phase::bpf_prog);
+
+    // Lets benchmarks compare the uncached mode with the default one on any volume.
+    const bool use_uncached_mode = android::base::GetBoolProperty(
+            "persist.sys.fuse.uncached_mode.override", uncached_mode);
+    if (use_uncached_mode != uncached_mode) {
+        LOG(INFO) << "Uncached mode is " << (use_uncached_mode ? "enabled" : "disabled")
+                  << " because of property persist.sys.fuse.uncached_mode.override";
+    }
 
-    struct fuse fuse_default(path, stat.st_ino, uncached_mode, bpf_enabled, std::move(bpf_fd),
-                             supported_transcoding_relative_paths,
+    struct fuse fuse_default(path, stat.st_ino, use_uncached_mode, bpf_enabled,
+                             std::move(bpf_fd), supported_transcoding_relative_paths,
                              supported_uncached_relative_paths);
     fuse_default.mp = &mp;
+    fuse_default.startup = &startup;
     // fuse_default is stack allocated, but it's safe to save it as an instance variable because
     // this method blocks and FuseDaemon#active tells if we are currently blocking
     fuse = &fuse_default;
@@ -2623,6 +3626,8 @@ void FuseDaemon::Start(android::base::unique_fd fd, const std::string& path,
     if (fuse_default.zero_addr == MAP_FAILED) {
         LOG(FATAL) << "mmap failed - could not start fuse! errno = " << errno;
     }
+    fuse_default.zero_fd.reset(create_zero_memfd(MAX_READ_SIZE));
+    startup.Reached(StartupStats::Phase::zero_addr);
 
     // Custom logging for libfuse
     if (android::base::GetBoolProperty("persist.sys.fuse.log", false)) {
@@ -2639,6 +3644,62 @@ void FuseDaemon::Start(android::base::unique_fd fd, const std::string& path,
         LOG(INFO) << "Using FUSE passthrough";
     }
 
+    fuse->readahead_window = android::base::GetUintProperty<size_t>(
+                                     "persist.sys.fuse.readahead_kb", DEFAULT_READAHEAD_KB) *
+                             1024;
+    fuse->writebehind_window =
+            android::base::GetUintProperty<size_t>("persist.sys.fuse.writebehind_kb", 0) * 1024;
+
+    // libfuse starts workers on demand and stops those beyond max_idle_threads once idle. Keep
+    // about one idle worker per core, so that bursts don't keep starting and stopping threads.
+    const unsigned int cpus = std::max<long>(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    struct fuse_loop_config loop_config = {
+            .clone_fd = 1,
+            .max_idle_threads = android::base::GetUintProperty<unsigned int>(
+                    "persist.sys.fuse.max_idle_threads", std::clamp(cpus, 4u, 16u)),
+    };
+    LOG(INFO) << "Keeping up to " << loop_config.max_idle_threads << " idle FUSE workers";
+    // E.g. the big cores of a big.LITTLE device, as "4-7".
+    const std::string worker_cpus =
+            android::base::GetProperty("persist.sys.fuse.worker_cpus", "");
+    fuse->worker_cpus = parse_cpu_list(worker_cpus);
+    if (CPU_COUNT(&fuse->worker_cpus) > 0) {
+        LOG(INFO) << "Pinning FUSE workers to CPUs " << worker_cpus;
+    }
+
+    fuse->negative_entry_timeout = std::chrono::milliseconds(
+            android::base::GetUintProperty<uint64_t>("persist.sys.fuse.negative_entry_timeout_ms",
+                                                     0));
+    if (fuse->negative_entry_timeout.count() > 0) {
+        LOG(INFO) << "Caching negative entries for " << fuse->negative_entry_timeout.count()
+                  << "ms";
+    }
+
+    fuse->adaptive_attr_timeout = std::chrono::milliseconds(
+            android::base::GetUintProperty<uint64_t>("persist.sys.fuse.adaptive_attr_timeout_ms",
+                                                     0));
+    if (fuse->adaptive_attr_timeout.count() > 0) {
+        LOG(INFO) << "Caching attributes of unchanged uncached files for up to "
+                  << fuse->adaptive_attr_timeout.count() << "ms";
+    }
+
+    fuse->open_result_ttl = std::chrono::milliseconds(
+            android::base::GetUintProperty<uint64_t>("persist.sys.fuse.open_result_ttl_ms", 0));
+    if (fuse->open_result_ttl.count() > 0) {
+        LOG(INFO) << "Reusing open permission checks for " << fuse->open_result_ttl.count()
+                  << "ms";
+    }
+
+    fuse->prefetch_transforms =
+            android::base::GetBoolProperty("persist.sys.fuse.transform_prefetch", false);
+
+    fuse->open_level_db_async =
+            android::base::GetBoolProperty("persist.sys.fuse.leveldb.async_open", true);
+
+    // Only the primary volume is mounted on every boot.
+    fuse->warm_start = android::base::GetBoolProperty("persist.sys.fuse.warm_start", false) &&
+                       android::base::StartsWith(path, PRIMARY_VOLUME_PREFIX);
+
     struct fuse_session
             * se = fuse_session_new(&args, &ops, sizeof(ops), &fuse_default);
     if (!se) {
@@ -2649,14 +3710,27 @@ void FuseDaemon::Start(android::base::unique_fd fd, const std::string& path,
     fuse_default.active = &active;
     se->fd = fd.release();  // libfuse owns the FD now
     se->mountpoint = strdup(path.c_str());
+    startup.Reached(StartupStats::Phase::session);
+
+    std::thread warm_start_thread;
+    if (fuse->warm_start) {
+        warm_start_thread = std::thread(warm_start, fuse);
+    }
 
     // Single thread. Useful for debugging
     // fuse_session_loop(se);
     // Multi-threaded
     LOG(INFO) << "Starting fuse...";
-    fuse_session_loop_mt(se, &config);
+    fuse_session_loop_mt(se, &loop_config);
     fuse->active->store(false, std::memory_order_release);
     LOG(INFO) << "Ending fuse...";
+    if (warm_start_thread.joinable()) {
+        warm_start_thread.join();
+    }
+    // Connections may still have been set up after the session was destroyed.
+    joinLevelDbOpeners(fuse);
+    // Nothing may notify the kernel through |se| once it is destroyed.
+    fuse_default.invalidations.Stop();
 
     if (munmap(fuse_default.zero_addr, MAX_READ_SIZE)) {
         PLOG(ERROR) << "munmap failed!";
@@ -2685,7 +3759,7 @@ std::unique_ptr<FdAccessResult> FuseDaemon::CheckFdAccess(int fd, uid_t uid) con
         return std::make_unique<FdAccessResult>(string(), false);
     }
 
-    std::lock_guard<std::recursive_mutex> guard(fuse->lock);
+    std::shared_lock<RecursiveSharedMutex> guard(fuse->lock);
     const node* node = node::LookupInode(fuse->root, ino);
     if (!node) {
         PLOG(DEBUG) << "CheckFdAccess no node found with given ino";
@@ -2706,48 +3780,97 @@ void FuseDaemon::InitializeDeviceId(const std::string& path) {
     fuse->dev.store(stat.st_dev, std::memory_order_release);
 }
 
+static std::shared_ptr<leveldb::DB> openLevelDb(const std::string& instance_name,
+                                                const std::string& path,
+                                                const leveldb::Options& options) {
+    const auto start = std::chrono::steady_clock::now();
+    leveldb::DB* leveldb;
+    leveldb::Status status = leveldb::DB::Open(options, path, &leveldb);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    gLevelDbOpenLatency.Record(elapsed);
+    if (!status.ok()) {
+        gLevelDbOpenFailures++;
+        LOG(ERROR) << "Leveldb connection failed for :" << instance_name
+                   << " with error:" << status.ToString();
+        return nullptr;
+    }
+    LOG(INFO) << "Leveldb connection established for :" << instance_name << " in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms";
+    return std::shared_ptr<leveldb::DB>(leveldb);
+}
+
+// Returns the leveldb connection of |instance_name|, or nullptr if there's none. Waits for the
+// connection if it's still being opened.
+static std::shared_ptr<leveldb::DB> getLevelDbConnection(struct fuse* fuse,
+                                                         const std::string& instance_name) {
+    LevelDbFuture connection;
+    {
+        std::shared_lock<std::shared_mutex> guard(fuse->level_db_mutex);
+        auto it = fuse->level_db_connection_map.find(instance_name);
+        if (it == fuse->level_db_connection_map.end()) {
+            LOG(ERROR) << "Leveldb setup is missing for: " << instance_name;
+            return nullptr;
+        }
+        connection = it->second;
+    }
+
+    if (connection.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        const auto start = std::chrono::steady_clock::now();
+        connection.wait();
+        gLevelDbOpenWaitLatency.Record(std::chrono::steady_clock::now() - start);
+    }
+    std::shared_ptr<leveldb::DB> db = connection.get();
+    if (!db) {
+        LOG(ERROR) << "Leveldb connection is unavailable for: " << instance_name;
+    }
+    return db;
+}
+
 void FuseDaemon::SetupLevelDbConnection(const std::string& instance_name) {
-    if (CheckLevelDbConnection(instance_name)) {
-        LOG(DEBUG) << "Leveldb connection already exists for :" << instance_name;
-        return;
+    std::lock_guard<std::shared_mutex> guard(fuse->level_db_mutex);
+    auto it = fuse->level_db_connection_map.find(instance_name);
+    if (it != fuse->level_db_connection_map.end()) {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+            it->second.get() != nullptr) {
+            LOG(DEBUG) << "Leveldb connection already exists for :" << instance_name;
+            return;
+        }
+        // Opening it failed, try again.
+        fuse->level_db_connection_map.erase(it);
     }
 
     std::string leveldbPath =
             "/data/media/" + MY_USER_ID_STRING + "/.transforms/recovery/leveldb-" + instance_name;
-    leveldb::Options options;
-    options.create_if_missing = true;
-    leveldb::DB* leveldb;
-    leveldb::Status status = leveldb::DB::Open(options, leveldbPath, &leveldb);
-    if (status.ok()) {
-        fuse->level_db_connection_map.insert(
-                std::pair<std::string, leveldb::DB*>(instance_name, leveldb));
-        LOG(INFO) << "Leveldb connection established for :" << instance_name;
+    const leveldb::Options options = GetLevelDbOptions(
+            instance_name == OWNERSHIP_RELATION ? LevelDbRole::ownership : LevelDbRole::backup);
+    // Opening replays the log and may compact, which shouldn't delay the volume becoming
+    // available. The thread is joined before the mount goes away, see joinLevelDbOpeners().
+    auto promise = std::make_shared<std::promise<std::shared_ptr<leveldb::DB>>>();
+    fuse->level_db_connection_map.emplace(instance_name, promise->get_future().share());
+    if (fuse->open_level_db_async) {
+        fuse->level_db_openers.emplace_back([promise, instance_name, leveldbPath, options]() {
+            promise->set_value(openLevelDb(instance_name, leveldbPath, options));
+        });
     } else {
-        LOG(ERROR) << "Leveldb connection failed for :" << instance_name
-                   << " with error:" << status.ToString();
+        promise->set_value(openLevelDb(instance_name, leveldbPath, options));
     }
 }
 
 void FuseDaemon::SetupLevelDbInstances() {
     if (android::base::StartsWith(fuse->root->GetIoPath(), PRIMARY_VOLUME_PREFIX)) {
         // Setup leveldb instance for both external primary and internal volume.
-        fuse->level_db_mutex.lock();
         // Create level db instance for internal volume
         SetupLevelDbConnection(mediaprovider::fuse::VOLUME_INTERNAL);
         // Create level db instance for external primary volume
         SetupLevelDbConnection(VOLUME_EXTERNAL_PRIMARY);
         // Create level db instance to store owner id to owner package name and vice versa relation
         SetupLevelDbConnection(OWNERSHIP_RELATION);
-        fuse->level_db_mutex.unlock();
     }
 }
 
 void FuseDaemon::SetupPublicVolumeLevelDbInstance(const std::string& volume_name) {
-    // Setup leveldb instance for both external primary and internal volume.
-    fuse->level_db_mutex.lock();
     // Create level db instance for public volume
     SetupLevelDbConnection(volume_name);
-    fuse->level_db_mutex.unlock();
 }
 
 std::string deriveVolumeName(const std::string& path) {
@@ -2761,36 +3884,31 @@ std::string deriveVolumeName(const std::string& path) {
 }
 
 void FuseDaemon::DeleteFromLevelDb(const std::string& key) {
-    fuse->level_db_mutex.lock();
     std::string volume_name = deriveVolumeName(key);
-    if (!CheckLevelDbConnection(volume_name)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, volume_name);
+    if (!db) {
         LOG(ERROR) << "DeleteFromLevelDb: Missing leveldb connection.";
         return;
     }
 
     leveldb::Status status;
-    status = fuse->level_db_connection_map[volume_name]->Delete(leveldb::WriteOptions(), key);
+    status = db->Delete(leveldb::WriteOptions(), key);
     if (!status.ok()) {
         LOG(ERROR) << "Failure in leveldb delete for key: " << key
                    << " from volume:" << volume_name;
     }
-    fuse->level_db_mutex.unlock();
 }
 
 void FuseDaemon::InsertInLevelDb(const std::string& volume_name, const std::string& key,
                                  const std::string& value) {
-    fuse->level_db_mutex.lock();
-    if (!CheckLevelDbConnection(volume_name)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, volume_name);
+    if (!db) {
         LOG(ERROR) << "InsertInLevelDb: Missing leveldb connection.";
         return;
     }
 
     leveldb::Status status;
-    status = fuse->level_db_connection_map[volume_name]->Put(leveldb::WriteOptions(), key,
-                                                             value);
-    fuse->level_db_mutex.unlock();
+    status = db->Put(leveldb::WriteOptions(), key, value);
     if (!status.ok()) {
         LOG(ERROR) << "Failure in leveldb insert for key: " << key
                    << " in volume:" << volume_name;
@@ -2798,50 +3916,95 @@ void FuseDaemon::InsertInLevelDb(const std::string& volume_name, const std::stri
     }
 }
 
-std::vector<std::string> FuseDaemon::ReadFilePathsFromLevelDb(const std::string& volume_name,
-                                                              const std::string& last_read_value,
-                                                              int limit) {
-    fuse->level_db_mutex.lock();
-    int counter = 0;
-    std::vector<std::string> file_paths;
+// Appends up to |limit| keys of |instance_name| after |last_read_value|, or from the first one if
+// it's empty, to |entries|, followed by its value if |with_values|. Returns false if there's no
+// connection to |instance_name|.
+static bool readLevelDbPage(struct fuse* fuse, const std::string& instance_name,
+                            const std::string& last_read_value, int limit, bool with_values,
+                            std::vector<std::string>* entries) {
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, instance_name);
+    if (!db) {
+        return false;
+    }
 
-    if (!CheckLevelDbConnection(volume_name)) {
-        fuse->level_db_mutex.unlock();
-        LOG(ERROR) << "ReadFilePathsFromLevelDb: Missing leveldb connection";
-        return file_paths;
+    std::unique_ptr<LevelDbCursor> cursor;
+    {
+        std::lock_guard<std::shared_mutex> guard(fuse->level_db_mutex);
+        auto it = fuse->level_db_cursors.find(instance_name);
+        if (it != fuse->level_db_cursors.end()) {
+            cursor = std::move(it->second);
+            fuse->level_db_cursors.erase(it);
+        }
     }
 
-    leveldb::Iterator* it =
-            fuse->level_db_connection_map[volume_name]->NewIterator(leveldb::ReadOptions());
-    if (android::base::EqualsIgnoreCase(last_read_value, "")) {
-        it->SeekToFirst();
+    leveldb::Iterator* it;
+    if (cursor && cursor->db == db && !last_read_value.empty() &&
+        cursor->last_key == last_read_value) {
+        // The next page of the previous read, just carry on.
+        it = cursor->it.get();
     } else {
-        // Start after last read value
-        leveldb::Slice slice = last_read_value;
-        it->Seek(slice);
-        it->Next();
+        cursor = std::make_unique<LevelDbCursor>(db);
+        it = cursor->it.get();
+        if (last_read_value.empty()) {
+            it->SeekToFirst();
+        } else {
+            // Start after last read value
+            it->Seek(last_read_value);
+            if (it->Valid() && it->key() == leveldb::Slice(last_read_value)) {
+                it->Next();
+            }
+        }
     }
+
+    int counter = 0;
     for (; it->Valid() && counter < limit; it->Next()) {
-        file_paths.push_back(it->key().ToString());
+        entries->push_back(it->key().ToString());
+        if (with_values) {
+            entries->push_back(it->value().ToString());
+        }
         counter++;
     }
-    fuse->level_db_mutex.unlock();
+
+    // Keep the cursor for the next page unless this was the last one.
+    if (counter > 0 && it->Valid()) {
+        cursor->last_key = entries->at(entries->size() - (with_values ? 2 : 1));
+        std::lock_guard<std::shared_mutex> guard(fuse->level_db_mutex);
+        fuse->level_db_cursors[instance_name] = std::move(cursor);
+    }
+    return true;
+}
+
+std::vector<std::string> FuseDaemon::ReadFilePathsFromLevelDb(const std::string& volume_name,
+                                                              const std::string& last_read_value,
+                                                              int limit) {
+    std::vector<std::string> file_paths;
+    if (!readLevelDbPage(fuse, volume_name, last_read_value, limit, false /* with_values */,
+                         &file_paths)) {
+        LOG(ERROR) << "ReadFilePathsFromLevelDb: Missing leveldb connection";
+    }
     return file_paths;
 }
 
+std::vector<std::string> FuseDaemon::ReadBackedUpEntriesFromLevelDb(
+        const std::string& volume_name, const std::string& last_read_value, int limit) {
+    std::vector<std::string> entries;
+    if (!readLevelDbPage(fuse, volume_name, last_read_value, limit, true /* with_values */,
+                         &entries)) {
+        LOG(ERROR) << "ReadBackedUpEntriesFromLevelDb: Missing leveldb connection";
+    }
+    return entries;
+}
+
 std::string FuseDaemon::ReadBackedUpDataFromLevelDb(const std::string& filePath) {
-    fuse->level_db_mutex.lock();
     std::string data = "";
     std::string volume_name = deriveVolumeName(filePath);
-    if (!CheckLevelDbConnection(volume_name)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, volume_name);
+    if (!db) {
         LOG(ERROR) << "ReadBackedUpDataFromLevelDb: Missing leveldb connection.";
         return data;
     }
 
-    leveldb::Status status = fuse->level_db_connection_map[volume_name]->Get(
-            leveldb::ReadOptions(), filePath, &data);
-    fuse->level_db_mutex.unlock();
+    leveldb::Status status = db->Get(leveldb::ReadOptions(), filePath, &data);
 
     if (status.IsNotFound()) {
         LOG(VERBOSE) << "Key is not found in leveldb: " << filePath << " " << status.ToString();
@@ -2853,18 +4016,15 @@ std::string FuseDaemon::ReadBackedUpDataFromLevelDb(const std::string& filePath)
 }
 
 std::string FuseDaemon::ReadOwnership(const std::string& key) {
-    fuse->level_db_mutex.lock();
     // Return empty string if key not found
     std::string data = "";
-    if (!CheckLevelDbConnection(OWNERSHIP_RELATION)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, OWNERSHIP_RELATION);
+    if (!db) {
         LOG(ERROR) << "ReadOwnership: Missing leveldb connection.";
         return data;
     }
 
-    leveldb::Status status = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Get(
-            leveldb::ReadOptions(), key, &data);
-    fuse->level_db_mutex.unlock();
+    leveldb::Status status = db->Get(leveldb::ReadOptions(), key, &data);
 
     if (status.IsNotFound()) {
         LOG(VERBOSE) << "Key is not found in leveldb: " << key << " " << status.ToString();
@@ -2877,88 +4037,66 @@ std::string FuseDaemon::ReadOwnership(const std::string& key) {
 
 void FuseDaemon::CreateOwnerIdRelation(const std::string& ownerId,
                                        const std::string& ownerPackageIdentifier) {
-    fuse->level_db_mutex.lock();
-    if (!CheckLevelDbConnection(OWNERSHIP_RELATION)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, OWNERSHIP_RELATION);
+    if (!db) {
         LOG(ERROR) << "CreateOwnerIdRelation: Missing leveldb connection.";
         return;
     }
 
-    leveldb::Status status1, status2;
-    status1 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Put(
-            leveldb::WriteOptions(), ownerId, ownerPackageIdentifier);
-    status2 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Put(
-            leveldb::WriteOptions(), ownerPackageIdentifier, ownerId);
-    if (!status1.ok() || !status2.ok()) {
-        // If both inserts did not go through, remove both.
-        status1 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Delete(leveldb::WriteOptions(),
-                                                                            ownerId);
-        status2 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Delete(leveldb::WriteOptions(),
-                                                                            ownerPackageIdentifier);
+    // Both directions of the relation are written atomically, so concurrent readers never see
+    // only one of them and a failure leaves neither behind.
+    leveldb::WriteBatch batch;
+    batch.Put(ownerId, ownerPackageIdentifier);
+    batch.Put(ownerPackageIdentifier, ownerId);
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok()) {
         LOG(ERROR) << "Failure in leveldb insert for owner_id: " << ownerId
                    << " and ownerPackageIdentifier: " << ownerPackageIdentifier;
     }
-    fuse->level_db_mutex.unlock();
 }
 
 void FuseDaemon::RemoveOwnerIdRelation(const std::string& ownerId,
                                        const std::string& ownerPackageIdentifier) {
-    fuse->level_db_mutex.lock();
-    if (!CheckLevelDbConnection(OWNERSHIP_RELATION)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, OWNERSHIP_RELATION);
+    if (!db) {
         LOG(ERROR) << "RemoveOwnerIdRelation: Missing leveldb connection.";
         return;
     }
 
-    leveldb::Status status1, status2;
-    status1 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Delete(leveldb::WriteOptions(),
-                                                                        ownerId);
-    status2 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Delete(leveldb::WriteOptions(),
-                                                                        ownerPackageIdentifier);
-    if (status1.ok() && status2.ok()) {
+    leveldb::WriteBatch batch;
+    batch.Delete(ownerId);
+    batch.Delete(ownerPackageIdentifier);
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+    if (status.ok()) {
         LOG(INFO) << "Successfully deleted rows in leveldb for owner_id: " << ownerId
                   << " and ownerPackageIdentifier: " << ownerPackageIdentifier;
     } else {
-        // If both deletes did not go through, revert both.
-        status1 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Put(
-                leveldb::WriteOptions(), ownerId, ownerPackageIdentifier);
-        status2 = fuse->level_db_connection_map[OWNERSHIP_RELATION]->Put(
-                leveldb::WriteOptions(), ownerPackageIdentifier, ownerId);
         LOG(ERROR) << "Failure in leveldb delete for owner_id: " << ownerId
                    << " and ownerPackageIdentifier: " << ownerPackageIdentifier;
     }
-    fuse->level_db_mutex.unlock();
 }
 
 std::map<std::string, std::string> FuseDaemon::GetOwnerRelationship() {
-    fuse->level_db_mutex.lock();
     std::map<std::string, std::string> resultMap;
-    if (!CheckLevelDbConnection(OWNERSHIP_RELATION)) {
-        fuse->level_db_mutex.unlock();
+    std::shared_ptr<leveldb::DB> db = getLevelDbConnection(fuse, OWNERSHIP_RELATION);
+    if (!db) {
         LOG(ERROR) << "GetOwnerRelationship: Missing leveldb connection.";
         return resultMap;
     }
 
-    leveldb::Status status;
     // Get the key-value pairs from the database.
-    leveldb::Iterator* it =
-            fuse->level_db_connection_map[OWNERSHIP_RELATION]->NewIterator(leveldb::ReadOptions());
+    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
         std::string key = it->key().ToString();
         std::string value = it->value().ToString();
         resultMap.insert(std::pair<std::string, std::string>(key, value));
     }
 
-    fuse->level_db_mutex.unlock();
     return resultMap;
 }
 
 bool FuseDaemon::CheckLevelDbConnection(const std::string& instance_name) {
-    if (fuse->level_db_connection_map.find(instance_name) == fuse->level_db_connection_map.end()) {
-        LOG(ERROR) << "Leveldb setup is missing for: " << instance_name;
-        return false;
-    }
-    return true;
+    return getLevelDbConnection(fuse, instance_name) != nullptr;
 }
 
 } //namespace fuse
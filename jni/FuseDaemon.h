@@ -64,6 +64,31 @@ class FuseDaemon final {
      */
     void InvalidateFuseDentryCache(const std::string& path);
 
+    /**
+     * Wait until the dentry invalidations requested so far have been issued to the kernel. Must
+     * not be called from a FUSE thread.
+     */
+    void FlushFuseDentryInvalidations();
+
+    /**
+     * Invalidate cached MediaProvider file lookup results for path, or all of them if path is
+     * empty
+     */
+    void InvalidateFileLookupCache(const std::string& path);
+
+    /**
+     * Invalidate cached MediaProvider access decisions, e.g. whether a uid may access the
+     * Android/data or Android/obb directory of a package
+     */
+    void InvalidateAccessDecisionCache();
+
+    /**
+     * Returns latency statistics of the most frequent FUSE operations and of the upcalls to
+     * MediaProvider, and negative entry cache statistics, one per line, or an empty string if the
+     * daemon isn't running
+     */
+    std::string DumpStats();
+
     /**
      * Checks if the given uid has access to the given fd with or without redaction.
      */
@@ -85,7 +110,9 @@ class FuseDaemon final {
     void SetupPublicVolumeLevelDbInstance(const std::string& volume_name);
 
     /**
-     * Creates a leveldb instance and sets up a connection.
+     * Creates a leveldb instance and sets up a connection. The connection is opened in the
+     * background unless persist.sys.fuse.leveldb.async_open is false, and operations using it
+     * before it's open wait for it.
      */
     void SetupLevelDbConnection(const std::string& instance_name);
 
@@ -102,10 +129,21 @@ class FuseDaemon final {
 
     /**
      * Reads file paths for given volume from leveldb for given range.
+     *
+     * Paging through a volume, by passing the last path of each page as |lastReadValue| of the
+     * next one, reads a consistent snapshot of it with a single iterator.
      */
     std::vector<std::string> ReadFilePathsFromLevelDb(const std::string& volume_name,
                                                       const std::string& lastReadValue, int limit);
 
+    /**
+     * Like ReadFilePathsFromLevelDb(), but also reads the backed up data of each file path in the
+     * same pass. Returns the file paths and their data interleaved.
+     */
+    std::vector<std::string> ReadBackedUpEntriesFromLevelDb(const std::string& volume_name,
+                                                            const std::string& lastReadValue,
+                                                            int limit);
+
     /**
      * Reads backed up data from leveldb.
      */
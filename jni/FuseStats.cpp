@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FuseStats"
+
+#include "include/libfuse_jni/FuseStats.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace mediaprovider {
+namespace fuse {
+
+namespace {
+
+thread_local std::chrono::nanoseconds tls_jni_time(0);
+thread_local uint64_t tls_jni_exceptions = 0;
+
+const char* OpName(FuseOpStat op) {
+    switch (op) {
+        case FuseOpStat::lookup:
+            return "lookup";
+        case FuseOpStat::getattr:
+            return "getattr";
+        case FuseOpStat::open:
+            return "open";
+        case FuseOpStat::open_passthrough:
+            return "open_passthrough";
+        case FuseOpStat::read:
+            return "read";
+        case FuseOpStat::read_redacted:
+            return "read_redacted";
+        case FuseOpStat::write_buf:
+            return "write_buf";
+        case FuseOpStat::copy_file_range:
+            return "copy_file_range";
+        case FuseOpStat::readdir:
+            return "readdir";
+        case FuseOpStat::readdirplus:
+            return "readdirplus";
+        case FuseOpStat::create:
+            return "create";
+        case FuseOpStat::lookup_postfilter:
+            return "lookup_postfilter";
+        case FuseOpStat::readdir_postfilter:
+            return "readdir_postfilter";
+        case FuseOpStat::count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* UpcallName(UpcallStat upcall) {
+    switch (upcall) {
+        case UpcallStat::insert_file:
+            return "insert_file";
+        case UpcallStat::delete_file:
+            return "delete_file";
+        case UpcallStat::on_file_open:
+            return "on_file_open";
+        case UpcallStat::on_cached_file_open:
+            return "on_cached_file_open";
+        case UpcallStat::is_creating_dir_allowed:
+            return "is_creating_dir_allowed";
+        case UpcallStat::is_deleting_dir_allowed:
+            return "is_deleting_dir_allowed";
+        case UpcallStat::get_directory_entries:
+            return "get_directory_entries";
+        case UpcallStat::is_opendir_allowed:
+            return "is_opendir_allowed";
+        case UpcallStat::is_uid_allowed_access_to_data_or_obb_path:
+            return "is_uid_allowed_access_to_data_or_obb_path";
+        case UpcallStat::rename:
+            return "rename";
+        case UpcallStat::on_file_created:
+            return "on_file_created";
+        case UpcallStat::should_allow_lookup:
+            return "should_allow_lookup";
+        case UpcallStat::is_app_clone_user:
+            return "is_app_clone_user";
+        case UpcallStat::file_lookup:
+            return "file_lookup";
+        case UpcallStat::file_lookup_batch:
+            return "file_lookup_batch";
+        case UpcallStat::transform:
+            return "transform";
+        case UpcallStat::count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* PhaseName(StartupStats::Phase phase) {
+    switch (phase) {
+        case StartupStats::Phase::bpf_prog:
+            return "bpf_prog";
+        case StartupStats::Phase::zero_addr:
+            return "zero_addr";
+        case StartupStats::Phase::session:
+            return "session";
+        case StartupStats::Phase::init:
+            return "init";
+        case StartupStats::Phase::warm_start:
+            return "warm_start";
+        case StartupStats::Phase::first_request:
+            return "first_request";
+        case StartupStats::Phase::count:
+            break;
+    }
+    return "unknown";
+}
+
+uint64_t AverageUs(const LatencyHistogram& histogram) {
+    const uint64_t count = histogram.count();
+    if (count == 0) {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(histogram.total()).count() /
+           count;
+}
+
+}  // namespace
+
+void LatencyHistogram::Record(std::chrono::nanoseconds duration) {
+    const uint64_t ns = std::max<int64_t>(duration.count(), 0);
+    const uint64_t us = ns / 1000;
+    // Index of the highest set bit, i.e. floor(log2(us)), with 0 and 1us both in bucket 0.
+    const int bucket = us < 2 ? 0 : std::min(63 - __builtin_clzll(us), kNumBuckets - 1);
+
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::PercentileUpperBoundUs(double percentile) const {
+    const uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, total * percentile / 100);
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+        seen += bucket(i);
+        if (seen >= rank) {
+            return uint64_t(1) << (i + 1);
+        }
+    }
+    return uint64_t(1) << kNumBuckets;
+}
+
+void FuseStats::Record(FuseOpStat op, std::chrono::nanoseconds duration,
+                       std::chrono::nanoseconds jni) {
+    OpStats& stats = stats_[static_cast<int>(op)];
+    stats.latency.Record(duration);
+    if (jni.count() > 0) {
+        stats.jni.Record(jni);
+    }
+}
+
+std::string FuseStats::Dump() const {
+    std::ostringstream os;
+    for (int i = 0; i < static_cast<int>(FuseOpStat::count); ++i) {
+        const OpStats& stats = stats_[i];
+        if (stats.latency.count() == 0) {
+            continue;
+        }
+        os << OpName(static_cast<FuseOpStat>(i)) << ": count=" << stats.latency.count()
+           << " avg_us=" << AverageUs(stats.latency)
+           << " p50_us<=" << stats.latency.PercentileUpperBoundUs(50)
+           << " p90_us<=" << stats.latency.PercentileUpperBoundUs(90)
+           << " p99_us<=" << stats.latency.PercentileUpperBoundUs(99)
+           << " jni_count=" << stats.jni.count() << " jni_avg_us=" << AverageUs(stats.jni)
+           << " buckets=[";
+        for (int j = 0; j < LatencyHistogram::kNumBuckets; ++j) {
+            os << (j > 0 ? "," : "") << stats.latency.bucket(j);
+        }
+        os << "]\n";
+    }
+
+    return os.str();
+}
+
+void UpcallStats::Record(UpcallStat upcall, std::chrono::nanoseconds duration, bool threw) {
+    Stats& stats = stats_[static_cast<int>(upcall)];
+    stats.latency.Record(duration);
+    if (threw) {
+        stats.exceptions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::string UpcallStats::Dump() const {
+    std::ostringstream os;
+    for (int i = 0; i < static_cast<int>(UpcallStat::count); ++i) {
+        const Stats& stats = stats_[i];
+        if (stats.latency.count() == 0) {
+            continue;
+        }
+        os << "upcall " << UpcallName(static_cast<UpcallStat>(i))
+           << ": count=" << stats.latency.count() << " avg_us=" << AverageUs(stats.latency)
+           << " p50_us<=" << stats.latency.PercentileUpperBoundUs(50)
+           << " p99_us<=" << stats.latency.PercentileUpperBoundUs(99)
+           << " exceptions=" << stats.exceptions.load(std::memory_order_relaxed) << "\n";
+    }
+    return os.str();
+}
+
+void WorkerStats::Started() {
+    const uint64_t live = started_.fetch_add(1, std::memory_order_relaxed) + 1 -
+                          exited_.load(std::memory_order_relaxed);
+    uint64_t peak = peak_.load(std::memory_order_relaxed);
+    while (live > peak && !peak_.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void WorkerStats::Exited() {
+    exited_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string WorkerStats::Dump() const {
+    if (started() == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "workers: live=" << live() << " peak=" << peak() << " started=" << started()
+       << " exited=" << exited() << "\n";
+    return os.str();
+}
+
+void InFlightStats::Started() {
+    const uint64_t current = current_.fetch_add(1, std::memory_order_relaxed) + 1;
+    started_.fetch_add(1, std::memory_order_relaxed);
+    concurrency_sum_.fetch_add(current, std::memory_order_relaxed);
+    uint64_t peak = peak_.load(std::memory_order_relaxed);
+    while (current > peak &&
+           !peak_.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+    }
+}
+
+void InFlightStats::Finished() {
+    current_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::string InFlightStats::Dump(const char* name) const {
+    const uint64_t count = started();
+    if (count == 0) {
+        return "";
+    }
+    // Hundredths of a request, without floating point formatting.
+    const uint64_t avg_x100 = concurrency_sum_.load(std::memory_order_relaxed) * 100 / count;
+    std::ostringstream os;
+    os << name << ": current=" << current() << " peak=" << peak() << " started=" << count
+       << " avg_concurrency=" << avg_x100 / 100 << "." << (avg_x100 % 100 < 10 ? "0" : "")
+       << avg_x100 % 100 << "\n";
+    return os.str();
+}
+
+void AttrTimeoutStats::Record(double timeout) {
+    replies_.fetch_add(1, std::memory_order_relaxed);
+    if (timeout > 0) {
+        cached_.fetch_add(1, std::memory_order_relaxed);
+        timeout_ms_sum_.fetch_add(static_cast<uint64_t>(timeout * 1000),
+                                  std::memory_order_relaxed);
+    }
+}
+
+std::string AttrTimeoutStats::Dump() const {
+    const uint64_t replies = replies_.load(std::memory_order_relaxed);
+    if (replies == 0) {
+        return "";
+    }
+    const uint64_t cached = cached_.load(std::memory_order_relaxed);
+    std::ostringstream os;
+    os << "adaptive_attr_timeouts: replies=" << replies << " cached=" << cached
+       << " avg_timeout_ms="
+       << (cached ? timeout_ms_sum_.load(std::memory_order_relaxed) / cached : 0) << "\n";
+    return os.str();
+}
+
+void StartupStats::Reached(Phase phase) {
+    std::atomic<int64_t>& elapsed_ns = elapsed_ns_[static_cast<int>(phase)];
+    if (elapsed_ns.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start_;
+    // 0 means not reached, so count at least 1ns.
+    int64_t expected = 0;
+    elapsed_ns.compare_exchange_strong(expected, std::max<int64_t>(elapsed.count(), 1),
+                                       std::memory_order_relaxed);
+}
+
+std::string StartupStats::Dump() const {
+    std::ostringstream os;
+    os << "startup:";
+    bool reached = false;
+    for (int i = 0; i < static_cast<int>(Phase::count); i++) {
+        const std::chrono::nanoseconds duration = elapsed(static_cast<Phase>(i));
+        if (duration.count() == 0) {
+            continue;
+        }
+        reached = true;
+        os << " " << PhaseName(static_cast<Phase>(i)) << "_us="
+           << std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+    if (!reached) {
+        return "";
+    }
+    os << "\n";
+    return os.str();
+}
+
+std::chrono::nanoseconds CurrentThreadJniTime() {
+    return tls_jni_time;
+}
+
+void NoteJniException() {
+    ++tls_jni_exceptions;
+}
+
+ScopedUpcallTimer::ScopedUpcallTimer(UpcallStats* stats, UpcallStat upcall)
+    : stats_(stats),
+      upcall_(upcall),
+      start_(std::chrono::steady_clock::now()),
+      exceptions_start_(tls_jni_exceptions) {}
+
+ScopedUpcallTimer::~ScopedUpcallTimer() {
+    const std::chrono::nanoseconds duration = std::chrono::steady_clock::now() - start_;
+    tls_jni_time += duration;
+    stats_->Record(upcall_, duration, tls_jni_exceptions != exceptions_start_);
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
@@ -16,6 +16,12 @@
 
 #include "include/libfuse_jni/FuseUtils.h"
 
+#include <strings.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <regex>
 #include <string>
 #include <vector>
@@ -54,6 +60,158 @@ bool containsMount(const string& path) {
            android::base::EqualsIgnoreCase(path_suffix, obb_suffix);
 }
 
+namespace {
+
+// Returns the component of |path| starting at |*pos|, and moves |*pos| to the '/' following it
+// or to the end of |path|.
+std::string_view nextComponent(std::string_view path, size_t* pos) {
+    const size_t start = *pos;
+    size_t end = path.find('/', start);
+    if (end == std::string_view::npos) {
+        end = path.size();
+    }
+    *pos = end;
+    return path.substr(start, end - start);
+}
+
+// Moves |*pos| past the '/' it is at. Returns false if it is at the end of |path| instead.
+bool skipSlash(std::string_view path, size_t* pos) {
+    if (*pos == path.size()) {
+        return false;
+    }
+    ++*pos;
+    return true;
+}
+
+char toLowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+// Returns the user id |component| consists of, or -1 if it isn't only made of digits.
+int parseUserId(std::string_view component) {
+    if (component.empty()) {
+        return -1;
+    }
+    int64_t user_id = 0;
+    for (const char c : component) {
+        if (c < '0' || c > '9') {
+            return -1;
+        }
+        user_id = std::min<int64_t>(user_id * 10 + (c - '0'), INT_MAX);
+    }
+    return static_cast<int>(user_id);
+}
+
+}  // namespace
+
+StoragePath classifyStoragePath(std::string_view path) {
+    static constexpr std::string_view kStorage = "/storage/";
+    StoragePath result;
+    if (path.size() < kStorage.size() ||
+        !equalsIgnoreCase(path.substr(0, kStorage.size()), kStorage)) {
+        return result;
+    }
+
+    size_t pos = kStorage.size();
+    const std::string_view volume = nextComponent(path, &pos);
+    if (volume.empty()) {
+        return result;
+    }
+    result.kind = StoragePath::Kind::volume;
+    result.volume = volume;
+    if (!skipSlash(path, &pos)) {
+        return result;
+    }
+
+    std::string_view component = nextComponent(path, &pos);
+    result.user_id = parseUserId(component);
+    if (result.user_id >= 0) {
+        if (!skipSlash(path, &pos)) {
+            return result;
+        }
+        component = nextComponent(path, &pos);
+    }
+    if (!equalsIgnoreCase(component, "android")) {
+        return result;
+    }
+    if (!skipSlash(path, &pos)) {
+        result.kind = StoragePath::Kind::android_dir;
+        return result;
+    }
+
+    component = nextComponent(path, &pos);
+    if (!equalsIgnoreCase(component, "data") && !equalsIgnoreCase(component, "obb")) {
+        return result;
+    }
+    if (!skipSlash(path, &pos)) {
+        result.kind = StoragePath::Kind::data_or_obb_dir;
+        return result;
+    }
+
+    result.kind = StoragePath::Kind::in_data_or_obb;
+    result.package = nextComponent(path, &pos);
+    return result;
+}
+
+PrefixTrie::PrefixTrie(const std::vector<std::string>& prefixes) {
+    if (prefixes.empty()) {
+        return;
+    }
+    nodes_.emplace_back();
+    for (const std::string& prefix : prefixes) {
+        uint32_t node = 0;
+        for (const char c : prefix) {
+            const char folded = toLowerAscii(c);
+            uint32_t next = 0;
+            for (const auto& [child_char, child] : nodes_[node].children) {
+                if (child_char == folded) {
+                    next = child;
+                    break;
+                }
+            }
+            if (next == 0) {
+                next = nodes_.size();
+                nodes_[node].children.emplace_back(folded, next);
+                // May reallocate |nodes_|, so only after the last use of nodes_[node] above.
+                nodes_.emplace_back();
+            }
+            node = next;
+        }
+        nodes_[node].terminal = true;
+    }
+}
+
+bool PrefixTrie::MatchesPrefixOf(std::string_view str, std::string_view suffix) const {
+    if (nodes_.empty()) {
+        return false;
+    }
+    uint32_t node = 0;
+    for (const std::string_view part : {str, suffix}) {
+        for (const char c : part) {
+            if (nodes_[node].terminal) {
+                return true;
+            }
+            const char folded = toLowerAscii(c);
+            uint32_t next = 0;
+            for (const auto& [child_char, child] : nodes_[node].children) {
+                if (child_char == folded) {
+                    next = child;
+                    break;
+                }
+            }
+            if (next == 0) {
+                return false;
+            }
+            node = next;
+        }
+    }
+    return nodes_[node].terminal;
+}
+
 string getVolumeNameFromPath(const std::string& path) {
     std::string volume_name = "";
     if (!android::base::StartsWith(path, STORAGE_PREFIX)) {
@@ -73,20 +231,63 @@ string getVolumeNameFromPath(const std::string& path) {
     return volume_name;
 }
 
+size_t findFirstNonAscii(const std::string_view& str) {
+    const char* data = str.data();
+    const size_t length = str.length();
+    size_t i = 0;
+    // Check 8 bytes at a time for any with the high bit set, which compilers vectorize further.
+    constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word & kHighBits) {
+            break;
+        }
+    }
+    for (; i < length; i++) {
+        if (static_cast<unsigned char>(data[i]) & 0x80) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+double getAdaptiveAttrTimeout(const struct stat& s, const struct timespec& now,
+                              double max_timeout) {
+    const auto seconds = [](const struct timespec& ts) {
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+    };
+    const double changed = std::max(seconds(s.st_ctim), seconds(s.st_mtim));
+    const double age = seconds(now) - changed;
+    if (age <= 0) {
+        // Changed just now, or the clock went backwards.
+        return 0;
+    }
+    return std::min(age / 10, max_timeout);
+}
+
 std::string removeDefaultIgnorableCodepoints(const std::string_view& str) {
     // These libicu unicode methods require SDK 31 or above. Otherwise, we return an empty string.
     if (__builtin_available(android 31, *)) {
+        // No ASCII codepoint is default ignorable, so only the part of |str| from its first
+        // non-ASCII byte needs decoding, and most paths have none.
+        const size_t ascii_length = findFirstNonAscii(str);
+        if (ascii_length == std::string_view::npos) {
+            return std::string(str);
+        }
+        const std::string_view tail = str.substr(ascii_length);
+
         UErrorCode error_code = U_ZERO_ERROR;
         UText *ut = utext_openUTF8(nullptr,
-                                   str.data(),
-                                   (int64_t) str.length(),
+                                   tail.data(),
+                                   (int64_t) tail.length(),
                                    &error_code);
         if (ut == nullptr || U_FAILURE(error_code)) {
             LOG(WARNING) << "Could not decode string as UTF-8: error " << error_code << ": " << str;
             return "";
         }
 
-        std::string out;
+        std::string out(str.substr(0, ascii_length));
         // Arbitrary +8 for some extra room.
         out.reserve(str.length() + 8);
         for (UChar32 c = utext_next32From(ut, 0);
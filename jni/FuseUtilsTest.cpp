@@ -20,6 +20,11 @@
 
 #include <gtest/gtest.h>
 
+#include <climits>
+#include <regex>
+#include <string>
+#include <vector>
+
 namespace mediaprovider::fuse {
 
 TEST(FuseUtilsTest, testContainsMount_isTrueForAndroidDataObb) {
@@ -73,4 +78,138 @@ TEST(FuseUtilsTest, getVolumeNameFromPath) {
     EXPECT_EQ(getVolumeNameFromPath("/data/user_de/0/com.example.app/"), VOLUME_INTERNAL);
 }
 
+TEST(FuseUtilsTest, classifyStoragePath) {
+    StoragePath path = classifyStoragePath("/storage/emulated/10/Android/data/com.foo/cache");
+    EXPECT_EQ(StoragePath::Kind::in_data_or_obb, path.kind);
+    EXPECT_EQ("emulated", path.volume);
+    EXPECT_EQ(10, path.user_id);
+    EXPECT_EQ("com.foo", path.package);
+
+    path = classifyStoragePath("/storage/ABCD-1234/ANDROID/OBB");
+    EXPECT_EQ(StoragePath::Kind::data_or_obb_dir, path.kind);
+    EXPECT_EQ("ABCD-1234", path.volume);
+    EXPECT_EQ(-1, path.user_id);
+    EXPECT_TRUE(path.package.empty());
+
+    EXPECT_EQ(StoragePath::Kind::android_dir,
+              classifyStoragePath("/storage/emulated/0/Android").kind);
+    EXPECT_EQ(StoragePath::Kind::volume, classifyStoragePath("/storage/emulated/0/DCIM").kind);
+    EXPECT_EQ(StoragePath::Kind::volume, classifyStoragePath("/storage/emulated").kind);
+    EXPECT_EQ(StoragePath::Kind::other, classifyStoragePath("/storage/").kind);
+    EXPECT_EQ(StoragePath::Kind::other, classifyStoragePath("/data/media/0").kind);
+    EXPECT_EQ(INT_MAX, classifyStoragePath("/storage/emulated/99999999999999999999").user_id);
+}
+
+TEST(FuseUtilsTest, classifyStoragePath_matchesRegexes) {
+    const std::regex owned("^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)/([^/]+)(/?.*)?",
+                           std::regex_constants::icase);
+    const std::regex bpf_backing("^/storage/[^/]+/[0-9]+/Android/(data|obb)$",
+                                 std::regex_constants::icase);
+    const std::regex data_or_obb("^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)(/.*)?$",
+                                 std::regex_constants::icase);
+    const std::vector<std::string> paths = {
+            "",
+            "/",
+            "/storage",
+            "/storage/",
+            "/storage//0/Android/data/pkg",
+            "/storage/emulated",
+            "/storage/emulated/",
+            "/storage/emulated/0",
+            "/storage/emulated/0/",
+            "/storage/emulated/0/DCIM/Camera/IMG_0001.jpg",
+            "/storage/emulated/0/Android",
+            "/storage/emulated/0/Android/",
+            "/storage/emulated/0/Androids/data/pkg",
+            "/storage/emulated/0/Android/data",
+            "/storage/emulated/0/Android/data/",
+            "/storage/emulated/0/Android/data//pkg",
+            "/storage/emulated/0/Android/data/pkg",
+            "/storage/emulated/0/Android/data/pkg/",
+            "/storage/emulated/0/Android/data/pkg/files/a.txt",
+            "/storage/emulated/0/Android/database/pkg",
+            "/storage/emulated/0/Android/media/pkg",
+            "/storage/emulated/10/Android/obb",
+            "/storage/emulated/10/ANDROID/OBB/pkg",
+            "/storage/emulated/0a/Android/data/pkg",
+            "/storage/emulated/0/0/Android/data/pkg",
+            "/storage/emulated/Android/data",
+            "/storage/emulated/Android/data/pkg",
+            "/storage/1234-ABCD/Android/data/pkg",
+            "/storage/1234-ABCD/Android/obb",
+            "/STORAGE/emulated/0/android/DATA/pkg",
+            "/storage/emulated/0/Android/data/.nomedia",
+            "/data/media/0/Android/data/pkg",
+            "//storage/emulated/0/Android/data/pkg",
+    };
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+        const StoragePath storage_path = classifyStoragePath(path);
+        std::smatch match;
+        const bool is_owned = std::regex_match(path, match, owned);
+        EXPECT_EQ(is_owned, storage_path.IsPackageOwned());
+        if (is_owned) {
+            EXPECT_EQ(match[1].str(), storage_path.package);
+        }
+        EXPECT_EQ(std::regex_match(path, bpf_backing), storage_path.IsBpfBackingDir());
+        EXPECT_EQ(std::regex_match(path, data_or_obb), storage_path.IsDataOrObb());
+    }
+}
+
+TEST(FuseUtilsTest, PrefixTrie) {
+    const PrefixTrie trie({"/storage/emulated/0/DCIM/Camera/", "/storage/emulated/0/Movies/",
+                           "/storage/emulated/0/DCIM/Camera/Sub/"});
+    EXPECT_TRUE(trie.MatchesPrefixOf("/storage/emulated/0/DCIM/Camera/VID_0001.mp4"));
+    EXPECT_TRUE(trie.MatchesPrefixOf("/storage/emulated/0/dcim/CAMERA/VID_0001.mp4"));
+    EXPECT_TRUE(trie.MatchesPrefixOf("/storage/emulated/0/Movies/"));
+    EXPECT_TRUE(trie.MatchesPrefixOf("/storage/emulated/0/Movies", "/"));
+    EXPECT_FALSE(trie.MatchesPrefixOf("/storage/emulated/0/Movies"));
+    EXPECT_FALSE(trie.MatchesPrefixOf("/storage/emulated/0/MoviesX/a.mp4"));
+    EXPECT_FALSE(trie.MatchesPrefixOf("/storage/emulated/0/DCIM/a.mp4"));
+    EXPECT_FALSE(trie.MatchesPrefixOf(""));
+
+    EXPECT_TRUE(PrefixTrie().empty());
+    EXPECT_FALSE(PrefixTrie().MatchesPrefixOf("/storage/emulated/0/Movies/"));
+    EXPECT_TRUE(PrefixTrie({""}).MatchesPrefixOf("/anything"));
+}
+
+TEST(FuseUtilsTest, findFirstNonAscii) {
+    EXPECT_EQ(std::string_view::npos, findFirstNonAscii(""));
+    EXPECT_EQ(std::string_view::npos, findFirstNonAscii("/storage/emulated/0/Android/data"));
+    EXPECT_EQ(0, findFirstNonAscii("\xc3\xa9"));
+    EXPECT_EQ(3, findFirstNonAscii("abc\xc3\xa9"));
+    // Past a whole word, and in the last bytes.
+    EXPECT_EQ(19, findFirstNonAscii("/storage/emulated/0\xc2\xad/Android"));
+    EXPECT_EQ(19, findFirstNonAscii("/storage/emulated/0\xc2"));
+}
+
+TEST(FuseUtilsTest, getAdaptiveAttrTimeout) {
+    struct stat s = {};
+    s.st_mtim = {1000, 0};
+    s.st_ctim = {1000, 0};
+    // A tenth of the time since the last change, up to the maximum.
+    EXPECT_DOUBLE_EQ(10, getAdaptiveAttrTimeout(s, {1100, 0}, 60));
+    EXPECT_DOUBLE_EQ(60, getAdaptiveAttrTimeout(s, {100000, 0}, 60));
+    // The later of ctime, e.g. renamed, and mtime counts.
+    s.st_ctim = {1090, 0};
+    EXPECT_DOUBLE_EQ(1, getAdaptiveAttrTimeout(s, {1100, 0}, 60));
+    s.st_mtim = {1095, 0};
+    EXPECT_DOUBLE_EQ(0.5, getAdaptiveAttrTimeout(s, {1100, 0}, 60));
+    // Being changed, or changed in the future.
+    EXPECT_DOUBLE_EQ(0, getAdaptiveAttrTimeout(s, {1095, 0}, 60));
+    EXPECT_DOUBLE_EQ(0, getAdaptiveAttrTimeout(s, {1000, 0}, 60));
+}
+
+TEST(FuseUtilsTest, removeDefaultIgnorableCodepoints) {
+    const std::string ascii = "/storage/emulated/0/Android/data/com.foo";
+    EXPECT_EQ(ascii, removeDefaultIgnorableCodepoints(ascii));
+    // U+00AD SOFT HYPHEN and U+200B ZERO WIDTH SPACE are default ignorable, U+00E9 isn't.
+    EXPECT_EQ("/storage/emulated/0/Android/data",
+              removeDefaultIgnorableCodepoints("/storage/emulated/0/Andr\xc2\xadoid/data"));
+    EXPECT_EQ("/storage/emulated/0/Android/data",
+              removeDefaultIgnorableCodepoints("\xe2\x80\x8b/storage/emulated/0/Android/data"));
+    EXPECT_EQ("/storage/emulated/0/caf\xc3\xa9/x",
+              removeDefaultIgnorableCodepoints("/storage/emulated/0/caf\xc3\xa9\xc2\xad/x"));
+}
+
 }  // namespace mediaprovider::fuse
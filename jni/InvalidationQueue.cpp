@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/libfuse_jni/InvalidationQueue.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+namespace mediaprovider {
+namespace fuse {
+
+InvalidationQueue::~InvalidationQueue() {
+    Stop();
+}
+
+void InvalidationQueue::Push(uint64_t parent, const std::string& name, uint64_t child) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stopping_) {
+        return;
+    }
+    push_seq_++;
+    stats_.pushed++;
+
+    auto [it, inserted] = pending_index_.try_emplace(Key{parent, name}, pending_.size());
+    if (!inserted) {
+        // Not taken by the background thread yet, so issuing it once covers both pushes.
+        if (child) {
+            pending_[it->second].child = child;
+        }
+        stats_.deduped++;
+        return;
+    }
+    pending_.push_back(Invalidation{parent, name, child});
+    stats_.depth++;
+    stats_.peak_depth = std::max(stats_.peak_depth, stats_.depth);
+
+    if (!worker_.joinable()) {
+        worker_ = std::thread(&InvalidationQueue::WorkerLoop, this);
+    }
+    cond_.notify_all();
+}
+
+void InvalidationQueue::Flush() {
+    std::unique_lock<std::mutex> lock(lock_);
+    const uint64_t seq = push_seq_;
+    cond_.wait(lock, [this, seq] { return issued_seq_ >= seq; });
+}
+
+void InvalidationQueue::Stop() {
+    std::thread worker;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+        worker = std::move(worker_);
+        cond_.notify_all();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void InvalidationQueue::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        cond_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+        if (pending_.empty()) {
+            break;
+        }
+
+        std::vector<Invalidation> batch = std::move(pending_);
+        pending_.clear();
+        pending_index_.clear();
+        const uint64_t seq = push_seq_;
+        stats_.depth = 0;
+
+        lock.unlock();
+        notify_(batch);
+        lock.lock();
+
+        stats_.batches++;
+        stats_.issued += batch.size();
+        issued_seq_ = seq;
+        cond_.notify_all();
+    }
+}
+
+InvalidationQueue::Stats InvalidationQueue::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+std::string InvalidationQueue::Dump() const {
+    const Stats stats = GetStats();
+    if (stats.pushed == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "invalidations: pushed=" << stats.pushed << " deduped=" << stats.deduped
+       << " batches=" << stats.batches << " issued=" << stats.issued << " depth=" << stats.depth
+       << " peak_depth=" << stats.peak_depth << "\n";
+    return os.str();
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InvalidationQueueTest"
+
+#include "libfuse_jni/InvalidationQueue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mediaprovider::fuse {
+
+TEST(InvalidationQueueTest, dedupesPendingInvalidations) {
+    std::mutex lock;
+    std::condition_variable cond;
+    bool release = false;
+    std::vector<std::vector<std::pair<std::string, uint64_t>>> batches;
+    InvalidationQueue queue([&](const std::vector<InvalidationQueue::Invalidation>& batch) {
+        std::unique_lock<std::mutex> guard(lock);
+        batches.emplace_back();
+        for (const InvalidationQueue::Invalidation& inval : batch) {
+            batches.back().emplace_back(inval.name, inval.child);
+        }
+        cond.notify_all();
+        cond.wait(guard, [&] { return release; });
+    });
+
+    queue.Push(1, "a", 0);
+    {
+        // Wait for the background thread to be issuing "a".
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&] { return !batches.empty(); });
+    }
+    queue.Push(1, "b", 0);
+    queue.Push(1, "b", 7);
+    queue.Push(1, "b", 0);
+    // Already being issued, so it must be issued again.
+    queue.Push(1, "a", 0);
+    // Same name in another directory.
+    queue.Push(2, "b", 0);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        release = true;
+    }
+    cond.notify_all();
+    queue.Flush();
+
+    ASSERT_EQ(2, batches.size());
+    ASSERT_EQ(1, batches[0].size());
+    ASSERT_EQ(std::make_pair(std::string("b"), uint64_t(7)), batches[1][0]);
+    ASSERT_EQ(std::make_pair(std::string("a"), uint64_t(0)), batches[1][1]);
+    ASSERT_EQ(std::make_pair(std::string("b"), uint64_t(0)), batches[1][2]);
+    ASSERT_EQ(3, batches[1].size());
+
+    const InvalidationQueue::Stats stats = queue.GetStats();
+    ASSERT_EQ(6, stats.pushed);
+    ASSERT_EQ(2, stats.deduped);
+    ASSERT_EQ(2, stats.batches);
+    ASSERT_EQ(4, stats.issued);
+    ASSERT_EQ(0, stats.depth);
+}
+
+TEST(InvalidationQueueTest, stopIssuesPendingInvalidations) {
+    std::atomic<int> issued = 0;
+    InvalidationQueue queue([&](const std::vector<InvalidationQueue::Invalidation>& batch) {
+        issued += batch.size();
+    });
+    // Nothing pushed yet.
+    queue.Flush();
+
+    for (int i = 0; i < 100; i++) {
+        queue.Push(1, std::to_string(i), 0);
+    }
+    queue.Stop();
+    ASSERT_EQ(100, issued);
+
+    // Dropped once stopped.
+    queue.Push(1, "a", 0);
+    queue.Flush();
+    ASSERT_EQ(100, issued);
+}
+
+}  // namespace mediaprovider::fuse
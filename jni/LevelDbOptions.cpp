@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/libfuse_jni/LevelDbOptions.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/system_properties.h>
+
+#include <cstddef>
+#include <string>
+
+#include "leveldb/cache.h"
+#include "leveldb/filter_policy.h"
+
+namespace mediaprovider {
+namespace fuse {
+namespace {
+
+struct RoleDefaults {
+    const char* name;
+    // Bits per key of the bloom filter, 0 for none. 10 bits give about 1% false positives.
+    int bloom_bits;
+    size_t block_cache_kb;
+    size_t write_buffer_kb;
+    bool compression;
+};
+
+// The ownership relation only has a couple of rows per app, so keep its memory footprint small.
+// The backup instances are looked up by path for every restored file, most of which are small
+// and many of which were never backed up, hence the bloom filter and the larger cache.
+constexpr RoleDefaults kOwnershipDefaults = {"ownership", 10, 256, 256, true};
+constexpr RoleDefaults kBackupDefaults = {"backup", 10, 2048, 4096, true};
+
+// Like android::base::GetUintProperty(), which this library can't depend on.
+size_t GetSizeProperty(const RoleDefaults& role, const char* option, size_t default_value) {
+    const std::string name = std::string("persist.sys.fuse.leveldb.") + role.name + "." + option;
+    char value[PROP_VALUE_MAX];
+    if (__system_property_get(name.c_str(), value) <= 0) {
+        return default_value;
+    }
+    char* end;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    return (*end == '\0' && value[0] != '-') ? parsed : default_value;
+}
+
+bool GetBoolProperty(const RoleDefaults& role, const char* option, bool default_value) {
+    const std::string name = std::string("persist.sys.fuse.leveldb.") + role.name + "." + option;
+    char value[PROP_VALUE_MAX];
+    if (__system_property_get(name.c_str(), value) <= 0) {
+        return default_value;
+    }
+    if (!strcmp(value, "true") || !strcmp(value, "1")) return true;
+    if (!strcmp(value, "false") || !strcmp(value, "0")) return false;
+    return default_value;
+}
+
+// Options shared by all the instances of a role, see GetLevelDbOptions().
+struct RoleOptions {
+    explicit RoleOptions(const RoleDefaults& role) {
+        const size_t bloom_bits = GetSizeProperty(role, "bloom_bits", role.bloom_bits);
+        const size_t block_cache_kb = GetSizeProperty(role, "block_cache_kb", role.block_cache_kb);
+        options.create_if_missing = true;
+        options.filter_policy =
+                bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(bloom_bits) : nullptr;
+        // Without a block cache, leveldb creates an 8MB one for each instance.
+        options.block_cache = leveldb::NewLRUCache(block_cache_kb * 1024);
+        options.write_buffer_size =
+                GetSizeProperty(role, "write_buffer_kb", role.write_buffer_kb) * 1024;
+        options.compression = GetBoolProperty(role, "compression", role.compression)
+                                      ? leveldb::kSnappyCompression
+                                      : leveldb::kNoCompression;
+    }
+
+    leveldb::Options options;
+};
+
+}  // namespace
+
+leveldb::Options GetLevelDbOptions(LevelDbRole role) {
+    // Never destroyed, since instances may still be open during static destruction.
+    if (role == LevelDbRole::ownership) {
+        static const RoleOptions* ownership = new RoleOptions(kOwnershipDefaults);
+        return ownership->options;
+    }
+    static const RoleOptions* backup = new RoleOptions(kBackupDefaults);
+    return backup->options;
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
@@ -15,10 +15,14 @@
  */
 
 #include "MediaProviderWrapper.h"
+#include "libfuse_jni/FuseStats.h"
+#include "libfuse_jni/FuseUtils.h"
 #include "libfuse_jni/ReaddirHelper.h"
 
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
+#include <android-base/strings.h>
 #include <jni.h>
 #include <nativehelper/scoped_local_ref.h>
 #include <nativehelper/scoped_primitive_array.h>
@@ -26,6 +30,8 @@
 
 #include <pthread.h>
 
+#include <algorithm>
+#include <iterator>
 #include <mutex>
 #include <unordered_map>
 
@@ -37,8 +43,14 @@ namespace {
 
 constexpr const char* kPropRedactionEnabled = "persist.sys.fuse.redaction-enabled";
 
+// Number of (path, uid) pairs whose FileLookup results are cached.
+constexpr size_t kFileLookupCacheCapacity = 1024;
+// Number of access decisions cached, e.g. one per (uid, package) whose files the uid accesses.
+constexpr size_t kAccessDecisionCacheCapacity = 4096;
+
 constexpr uid_t ROOT_UID = 0;
 constexpr uid_t SHELL_UID = 2000;
+constexpr uid_t PER_USER_RANGE = 100000;
 
 // These need to stay in sync with MediaProvider.java's DIRECTORY_ACCESS_FOR_* constants.
 enum DirectoryAccessRequestType {
@@ -54,8 +66,20 @@ inline bool shouldBypassMediaProvider(uid_t uid) {
     return uid == SHELL_UID || uid == ROOT_UID;
 }
 
+// Paths are matched ignoring case, like the FUSE node tree does.
+std::string FileLookupCacheKey(const std::string& path) {
+    std::string key(path);
+    for (char& c : key) {
+        if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 'a';
+        }
+    }
+    return key;
+}
+
 static bool CheckForJniException(JNIEnv* env) {
     if (env->ExceptionCheck()) {
+        NoteJniException();
         env->ExceptionDescribe();
         env->ExceptionClear();
         return true;
@@ -111,47 +135,66 @@ int isDirAccessAllowedInternal(JNIEnv* env, jobject media_provider_object,
     return res;
 }
 
-bool isUidAllowedAccessToDataOrObbPathInternal(JNIEnv* env, jobject media_provider_object,
-                                               jmethodID mid_is_uid_allowed_path_access_, uid_t uid,
-                                               const string& path) {
+// Returns nullopt if the upcall threw.
+std::optional<bool> isUidAllowedAccessToDataOrObbPathInternal(
+        JNIEnv* env, jobject media_provider_object, jmethodID mid_is_uid_allowed_path_access_,
+        uid_t uid, const string& path) {
     ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(path.c_str()));
     bool res = env->CallBooleanMethod(media_provider_object, mid_is_uid_allowed_path_access_, uid,
                                       j_path.get());
 
     if (CheckForJniException(env)) {
-        return false;
+        return std::nullopt;
     }
     return res;
 }
 
-std::vector<std::shared_ptr<DirectoryEntry>> getFilesInDirectoryInternal(
-        JNIEnv* env, jobject media_provider_object, jmethodID mid_get_files_in_dir, uid_t uid,
-        const string& path) {
-    std::vector<std::shared_ptr<DirectoryEntry>> directory_entries;
+// Adds up to |limit| file names following |*after_id| to |directory_entries|, and sets
+// |*after_id| to where the next page starts, or to -1 if there are no more.
+void getFilesInDirectoryPageInternal(JNIEnv* env, jobject media_provider_object,
+                                     jmethodID mid_get_files_in_dir_page, uid_t uid,
+                                     const string& path, int limit, int64_t* after_id,
+                                     DirectoryEntries* directory_entries) {
+    const size_t begin = directory_entries->size();
     ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(path.c_str()));
 
     ScopedLocalRef<jobjectArray> files_list(
-            env, static_cast<jobjectArray>(env->CallObjectMethod(
-                         media_provider_object, mid_get_files_in_dir, j_path.get(), uid)));
+            env, static_cast<jobjectArray>(
+                         env->CallObjectMethod(media_provider_object, mid_get_files_in_dir_page,
+                                               j_path.get(), uid, static_cast<jlong>(*after_id),
+                                               limit)));
+    *after_id = -1;
 
     if (CheckForJniException(env)) {
-        directory_entries.push_back(std::make_shared<DirectoryEntry>("", EFAULT));
-        return directory_entries;
+        directory_entries->AddError(EFAULT);
+        return;
     }
 
     int de_count = env->GetArrayLength(files_list.get());
+    if (de_count == limit + 1) {
+        // The page is full, its last element is where the next one starts.
+        ScopedLocalRef<jstring> j_next(
+                env, (jstring)env->GetObjectArrayElement(files_list.get(), limit));
+        ScopedUtfChars next(env, j_next.get());
+        if (next.c_str() == nullptr || !android::base::ParseInt(next.c_str(), after_id)) {
+            LOG(ERROR) << "Error reading next page returned from MediaProvider";
+            directory_entries->AddError(EFAULT);
+            return;
+        }
+        de_count = limit;
+    }
     if (de_count == 1) {
         ScopedLocalRef<jstring> j_d_name(env,
                                          (jstring)env->GetObjectArrayElement(files_list.get(), 0));
         ScopedUtfChars d_name(env, j_d_name.get());
         if (d_name.c_str() == nullptr) {
             LOG(ERROR) << "Error reading file name returned from MediaProvider at index " << 0;
-            directory_entries.push_back(std::make_shared<DirectoryEntry>("", EFAULT));
-            return directory_entries;
+            directory_entries->AddError(EFAULT);
+            return;
         } else if (d_name.c_str()[0] == '\0') {
             // Calling package has no storage permissions.
-            directory_entries.push_back(std::make_shared<DirectoryEntry>("", EPERM));
-            return directory_entries;
+            directory_entries->AddError(EPERM);
+            return;
         }
     }
 
@@ -162,13 +205,12 @@ std::vector<std::shared_ptr<DirectoryEntry>> getFilesInDirectoryInternal(
 
         if (d_name.c_str() == nullptr) {
             LOG(ERROR) << "Error reading file name returned from MediaProvider at index " << i;
-            directory_entries.resize(0);
-            directory_entries.push_back(std::make_shared<DirectoryEntry>("", EFAULT));
+            directory_entries->Truncate(begin);
+            directory_entries->AddError(EFAULT);
             break;
         }
-        directory_entries.push_back(std::make_shared<DirectoryEntry>(d_name.c_str(), DT_REG));
+        directory_entries->Add(d_name.c_str(), DT_REG);
     }
-    return directory_entries;
 }
 
 int renameInternal(JNIEnv* env, jobject media_provider_object, jmethodID mid_rename,
@@ -193,6 +235,14 @@ int validatePathIfUnicodeCheckEnabled(JNIEnv* env, jobject media_provider_object
     return 0;
 }
 
+void onCachedFileOpenInternal(JNIEnv* env, jobject media_provider_object,
+                              jmethodID mid_on_cached_file_open, const string& path, uid_t uid) {
+    ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(path.c_str()));
+
+    env->CallVoidMethod(media_provider_object, mid_on_cached_file_open, j_path.get(), uid);
+    CheckForJniException(env);
+}
+
 void onFileCreatedInternal(JNIEnv* env, jobject media_provider_object,
                            jmethodID mid_on_file_created, const string& path) {
     ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(path.c_str()));
@@ -209,6 +259,8 @@ void onFileCreatedInternal(JNIEnv* env, jobject media_provider_object,
 
 JavaVM* MediaProviderWrapper::gJavaVm = nullptr;
 pthread_key_t MediaProviderWrapper::gJniEnvKey;
+std::atomic<uint64_t> MediaProviderWrapper::gThreadsAttached = 0;
+std::atomic<uint64_t> MediaProviderWrapper::gThreadsDetached = 0;
 
 void MediaProviderWrapper::OneTimeInit(JavaVM* vm) {
     gJavaVm = vm;
@@ -218,7 +270,9 @@ void MediaProviderWrapper::OneTimeInit(JavaVM* vm) {
                        MediaProviderWrapper::DetachThreadFunction);
 }
 
-MediaProviderWrapper::MediaProviderWrapper(JNIEnv* env, jobject media_provider) {
+MediaProviderWrapper::MediaProviderWrapper(JNIEnv* env, jobject media_provider)
+    : file_lookup_cache_(kFileLookupCacheCapacity),
+      access_decision_cache_(kAccessDecisionCacheCapacity) {
     if (!media_provider) {
         LOG(FATAL) << "MediaProvider is null!";
     }
@@ -237,9 +291,10 @@ MediaProviderWrapper::MediaProviderWrapper(JNIEnv* env, jobject media_provider)
     mid_on_file_open_ = CacheMethod(env, "onFileOpen",
                                     "(Ljava/lang/String;Ljava/lang/String;IIIZZZ)Lcom/android/"
                                     "providers/media/FileOpenResult;");
+    mid_on_cached_file_open_ = CacheMethod(env, "onCachedFileOpen", "(Ljava/lang/String;I)V");
     mid_is_diraccess_allowed_ = CacheMethod(env, "isDirAccessAllowed", "(Ljava/lang/String;II)I");
-    mid_get_files_in_dir_ =
-            CacheMethod(env, "getFilesInDirectory", "(Ljava/lang/String;I)[Ljava/lang/String;");
+    mid_get_files_in_dir_page_ = CacheMethod(env, "getFilesInDirectoryPage",
+                                             "(Ljava/lang/String;IJI)[Ljava/lang/String;");
     mid_rename_ = CacheMethod(env, "rename", "(Ljava/lang/String;Ljava/lang/String;I)I");
     mid_is_uid_allowed_access_to_data_or_obb_path_ =
             CacheMethod(env, "isUidAllowedAccessToDataOrObbPath", "(ILjava/lang/String;)Z");
@@ -250,6 +305,9 @@ MediaProviderWrapper::MediaProviderWrapper(JNIEnv* env, jobject media_provider)
     mid_file_lookup_ =
             CacheMethod(env, "onFileLookup",
                         "(Ljava/lang/String;II)Lcom/android/providers/media/FileLookupResult;");
+    mid_file_lookup_batch_ =
+            CacheMethod(env, "onFileLookupBatch",
+                        "([Ljava/lang/String;II)[Lcom/android/providers/media/FileLookupResult;");
 
     // FileLookupResult
     file_lookup_result_class_ = env->FindClass("com/android/providers/media/FileLookupResult");
@@ -290,6 +348,7 @@ MediaProviderWrapper::~MediaProviderWrapper() {
 }
 
 int MediaProviderWrapper::InsertFile(const string& path, uid_t uid) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::insert_file);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     int errCode = validatePathIfUnicodeCheckEnabled(env, media_provider_object_,
@@ -307,6 +366,7 @@ int MediaProviderWrapper::InsertFile(const string& path, uid_t uid) {
 }
 
 int MediaProviderWrapper::DeleteFile(const string& path, uid_t uid) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::delete_file);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     int errCode = validatePathIfUnicodeCheckEnabled(env, media_provider_object_,
@@ -329,6 +389,7 @@ std::unique_ptr<FileOpenResult> MediaProviderWrapper::OnFileOpen(const string& p
                                                                  pid_t tid, int transforms_reason,
                                                                  bool for_write, bool redact,
                                                                  bool log_transforms_metrics) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::on_file_open);
     JNIEnv* env = MaybeAttachCurrentThread();
     if (shouldBypassMediaProvider(uid)) {
         return std::make_unique<FileOpenResult>(0, uid, /* transforms_uid */ 0, /* nativeFd */ -1,
@@ -376,11 +437,21 @@ std::unique_ptr<FileOpenResult> MediaProviderWrapper::OnFileOpen(const string& p
     }
 }
 
+void MediaProviderWrapper::OnCachedFileOpen(const string& path, uid_t uid) {
+    if (shouldBypassMediaProvider(uid)) {
+        return;
+    }
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::on_cached_file_open);
+    JNIEnv* env = MaybeAttachCurrentThread();
+    onCachedFileOpenInternal(env, media_provider_object_, mid_on_cached_file_open_, path, uid);
+}
+
 int MediaProviderWrapper::IsCreatingDirAllowed(const string& path, uid_t uid) {
     if (shouldBypassMediaProvider(uid)) {
         return 0;
     }
 
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::is_creating_dir_allowed);
     JNIEnv* env = MaybeAttachCurrentThread();
     return isDirAccessAllowedInternal(env, media_provider_object_, mid_is_diraccess_allowed_, path,
                                       uid, kCreateDirectoryRequest);
@@ -391,33 +462,55 @@ int MediaProviderWrapper::IsDeletingDirAllowed(const string& path, uid_t uid) {
         return 0;
     }
 
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::is_deleting_dir_allowed);
     JNIEnv* env = MaybeAttachCurrentThread();
     return isDirAccessAllowedInternal(env, media_provider_object_, mid_is_diraccess_allowed_, path,
                                       uid, kDeleteDirectoryRequest);
 }
 
-std::vector<std::shared_ptr<DirectoryEntry>> MediaProviderWrapper::GetDirectoryEntries(
-        uid_t uid, const string& path, DIR* dirp) {
-    // Default value in case JNI thread was being terminated
-    std::vector<std::shared_ptr<DirectoryEntry>> res;
-    if (shouldBypassMediaProvider(uid)) {
-        addDirectoryEntriesFromLowerFs(dirp, /* filter */ nullptr, &res);
-        return res;
+void MediaProviderWrapper::GetDirectoryEntries(uid_t uid, const string& path, DIR* dirp,
+                                               DirectoryEntryCursor* cursor, size_t max_entries,
+                                               DirectoryEntries* entries) {
+    using Phase = DirectoryEntryCursor::Phase;
+
+    const size_t begin = entries->size();
+    if (cursor->phase == Phase::start) {
+        cursor->phase = shouldBypassMediaProvider(uid) ? Phase::lower_fs : Phase::media_provider;
+        cursor->after_id = 0;
+    }
+
+    if (cursor->phase == Phase::media_provider) {
+        ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::get_directory_entries);
+        JNIEnv* env = MaybeAttachCurrentThread();
+        getFilesInDirectoryPageInternal(env, media_provider_object_, mid_get_files_in_dir_page_,
+                                        uid, path, static_cast<int>(max_entries),
+                                        &cursor->after_id, entries);
+
+        const bool added = entries->size() > begin;
+        if (added && entries->is_error(begin)) {
+            // Error, see getFilesInDirectoryPageInternal().
+            cursor->phase = Phase::done;
+            return;
+        } else if (added && entries->name(begin)[0] == '/') {
+            // Path is unknown to MediaProvider, get files and directories from lower file system.
+            entries->Truncate(begin);
+            cursor->phase = Phase::lower_fs;
+        } else if (cursor->after_id < 0) {
+            // add directory names from lower file system.
+            cursor->phase = Phase::lower_fs_directories;
+        }
+        if (entries->size() > begin) {
+            return;
+        }
     }
 
-    JNIEnv* env = MaybeAttachCurrentThread();
-    res = getFilesInDirectoryInternal(env, media_provider_object_, mid_get_files_in_dir_, uid, path);
-
-    const int res_size = res.size();
-    if (res_size && res[0]->d_name[0] == '/') {
-        // Path is unknown to MediaProvider, get files and directories from lower file system.
-        res.resize(0);
-        addDirectoryEntriesFromLowerFs(dirp, /* filter */ nullptr, &res);
-    } else if (res_size == 0 || !res[0]->d_name.empty()) {
-        // add directory names from lower file system.
-        addDirectoryEntriesFromLowerFs(dirp, /* filter */ &isDirectory, &res);
+    if (cursor->phase == Phase::lower_fs || cursor->phase == Phase::lower_fs_directories) {
+        bool (*const filter)(const dirent&) =
+                cursor->phase == Phase::lower_fs ? nullptr : &isDirectory;
+        if (addDirectoryEntriesFromLowerFs(dirp, filter, max_entries, entries)) {
+            cursor->phase = Phase::done;
+        }
     }
-    return res;
 }
 
 int MediaProviderWrapper::IsOpendirAllowed(const string& path, uid_t uid, bool forWrite) {
@@ -425,6 +518,7 @@ int MediaProviderWrapper::IsOpendirAllowed(const string& path, uid_t uid, bool f
         return 0;
     }
 
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::is_opendir_allowed);
     JNIEnv* env = MaybeAttachCurrentThread();
     return isDirAccessAllowedInternal(env, media_provider_object_, mid_is_diraccess_allowed_, path,
                                       uid,
@@ -436,14 +530,39 @@ bool MediaProviderWrapper::isUidAllowedAccessToDataOrObbPath(uid_t uid, const st
         return true;
     }
 
+    // MediaProvider decides from the package owning the path and from whether it's under
+    // Android/obb, so all paths owned by a package share the same decision.
+    std::string key;
+    const StoragePath storage_path = classifyStoragePath(path);
+    if (storage_path.IsPackageOwned()) {
+        // |package| follows "Android/data/" or "Android/obb/".
+        const std::string_view parent(storage_path.package.data() - 4, 4);
+        key = (android::base::EqualsIgnoreCase(parent, "obb/") ? "obb:" : "data:") +
+              std::to_string(uid) + ":" + std::string(storage_path.package);
+        if (std::optional<bool> allowed = access_decision_cache_.Get(key)) {
+            return *allowed;
+        }
+    }
+    const uint64_t generation = access_decision_cache_.generation();
+
+    ScopedUpcallTimer upcall_timer(&upcall_stats_,
+                                   UpcallStat::is_uid_allowed_access_to_data_or_obb_path);
     JNIEnv* env = MaybeAttachCurrentThread();
-    return isUidAllowedAccessToDataOrObbPathInternal(
+    const std::optional<bool> allowed = isUidAllowedAccessToDataOrObbPathInternal(
             env, media_provider_object_, mid_is_uid_allowed_access_to_data_or_obb_path_, uid, path);
+    if (!allowed) {
+        return false;
+    }
+    if (!key.empty()) {
+        access_decision_cache_.Put(key, *allowed, generation);
+    }
+    return *allowed;
 }
 
 int MediaProviderWrapper::Rename(const string& old_path, const string& new_path, uid_t uid) {
     // Rename from SHELL_UID should go through MediaProvider to update database rows, so only bypass
     // MediaProvider for ROOT_UID.
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::rename);
     JNIEnv* env = MaybeAttachCurrentThread();
     int errCodeForOldPath = validatePathIfUnicodeCheckEnabled(env, media_provider_object_,
                                                               mid_unicode_check_enabled_, old_path);
@@ -469,12 +588,22 @@ int MediaProviderWrapper::Rename(const string& old_path, const string& new_path,
 }
 
 void MediaProviderWrapper::OnFileCreated(const string& path) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::on_file_created);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     return onFileCreatedInternal(env, media_provider_object_, mid_on_file_created_, path);
 }
 
 bool MediaProviderWrapper::ShouldAllowLookup(uid_t uid, int path_user_id) {
+    // MediaProvider only looks at the user of |uid|.
+    const std::string key =
+            "lookup:" + std::to_string(uid / PER_USER_RANGE) + ":" + std::to_string(path_user_id);
+    if (std::optional<bool> allowed = access_decision_cache_.Get(key)) {
+        return *allowed;
+    }
+    const uint64_t generation = access_decision_cache_.generation();
+
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::should_allow_lookup);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     bool res = env->CallBooleanMethod(media_provider_object_, mid_should_allow_lookup_, uid,
@@ -483,10 +612,12 @@ bool MediaProviderWrapper::ShouldAllowLookup(uid_t uid, int path_user_id) {
     if (CheckForJniException(env)) {
         return false;
     }
+    access_decision_cache_.Put(key, res, generation);
     return res;
 }
 
 bool MediaProviderWrapper::IsAppCloneUser(uid_t userId) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::is_app_clone_user);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     bool res = env->CallBooleanMethod(media_provider_object_, mid_is_app_clone_user_, userId);
@@ -499,6 +630,17 @@ bool MediaProviderWrapper::IsAppCloneUser(uid_t userId) {
 
 std::unique_ptr<FileLookupResult> MediaProviderWrapper::FileLookup(const std::string& path,
                                                                    uid_t uid, pid_t tid) {
+    // Lookups on behalf of MediaProvider itself depend on the calling thread (see
+    // MediaProvider#getBinderUidForFuse), so they are never cached.
+    const bool cacheable = uid != getuid();
+    if (cacheable) {
+        std::unique_ptr<FileLookupResult> cached = file_lookup_cache_.Get(path, uid);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::file_lookup);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(path.c_str()));
@@ -511,28 +653,234 @@ std::unique_ptr<FileLookupResult> MediaProviderWrapper::FileLookup(const std::st
         return nullptr;
     }
 
-    int transforms = env->GetIntField(j_res_file_lookup_object.get(), fid_file_lookup_transforms_);
+    std::unique_ptr<FileLookupResult> file_lookup_result =
+            ToFileLookupResult(env, j_res_file_lookup_object.get());
+    if (cacheable) {
+        MaybeCacheFileLookup(path, uid, *file_lookup_result);
+    }
+    return file_lookup_result;
+}
+
+std::vector<std::unique_ptr<FileLookupResult>> MediaProviderWrapper::FileLookupBatch(
+        const std::vector<std::string>& paths, uid_t uid, pid_t tid) {
+    std::vector<std::unique_ptr<FileLookupResult>> results(paths.size());
+
+    // Only ask MediaProvider about the paths we don't have cached results for.
+    const bool cacheable = uid != getuid();
+    std::vector<size_t> misses;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (cacheable) {
+            results[i] = file_lookup_cache_.Get(paths[i], uid);
+        }
+        if (!results[i]) {
+            misses.push_back(i);
+        }
+    }
+    if (misses.empty()) {
+        return results;
+    }
+
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::file_lookup_batch);
+    JNIEnv* env = MaybeAttachCurrentThread();
+
+    ScopedLocalRef<jclass> string_class(env, env->FindClass("java/lang/String"));
+    ScopedLocalRef<jobjectArray> j_paths(
+            env, env->NewObjectArray(misses.size(), string_class.get(), nullptr));
+    if (CheckForJniException(env)) {
+        return results;
+    }
+    for (size_t i = 0; i < misses.size(); i++) {
+        ScopedLocalRef<jstring> j_path(env, env->NewStringUTF(paths[misses[i]].c_str()));
+        env->SetObjectArrayElement(j_paths.get(), i, j_path.get());
+    }
+
+    ScopedLocalRef<jobjectArray> j_results(
+            env, static_cast<jobjectArray>(env->CallObjectMethod(
+                         media_provider_object_, mid_file_lookup_batch_, j_paths.get(), uid, tid)));
+
+    if (CheckForJniException(env)) {
+        return results;
+    }
+
+    for (size_t i = 0; i < misses.size(); i++) {
+        ScopedLocalRef<jobject> j_result(env, env->GetObjectArrayElement(j_results.get(), i));
+        if (!j_result.get()) {
+            // MediaProvider failed to look this path up, leave it to a regular FileLookup().
+            continue;
+        }
+        const std::string& path = paths[misses[i]];
+        results[misses[i]] = ToFileLookupResult(env, j_result.get());
+        if (cacheable) {
+            MaybeCacheFileLookup(path, uid, *results[misses[i]]);
+        }
+    }
+    return results;
+}
+
+std::unique_ptr<FileLookupResult> MediaProviderWrapper::ToFileLookupResult(
+        JNIEnv* env, jobject j_file_lookup_result) {
+    int transforms = env->GetIntField(j_file_lookup_result, fid_file_lookup_transforms_);
     int transforms_reason =
-            env->GetIntField(j_res_file_lookup_object.get(), fid_file_lookup_transforms_reason_);
-    int original_uid = env->GetIntField(j_res_file_lookup_object.get(), fid_file_lookup_uid_);
-    bool transforms_complete = env->GetBooleanField(j_res_file_lookup_object.get(),
-                                                    fid_file_lookup_transforms_complete_);
-    bool transforms_supported = env->GetBooleanField(j_res_file_lookup_object.get(),
-                                                     fid_file_lookup_transforms_supported_);
+            env->GetIntField(j_file_lookup_result, fid_file_lookup_transforms_reason_);
+    int original_uid = env->GetIntField(j_file_lookup_result, fid_file_lookup_uid_);
+    bool transforms_complete =
+            env->GetBooleanField(j_file_lookup_result, fid_file_lookup_transforms_complete_);
+    bool transforms_supported =
+            env->GetBooleanField(j_file_lookup_result, fid_file_lookup_transforms_supported_);
     ScopedLocalRef<jstring> j_io_path(
-            env,
-            (jstring)env->GetObjectField(j_res_file_lookup_object.get(), fid_file_lookup_io_path_));
+            env, (jstring)env->GetObjectField(j_file_lookup_result, fid_file_lookup_io_path_));
     ScopedUtfChars j_io_path_utf(env, j_io_path.get());
 
-    std::unique_ptr<FileLookupResult> file_lookup_result = std::make_unique<FileLookupResult>(
-            transforms, transforms_reason, original_uid, transforms_complete, transforms_supported,
-            string(j_io_path_utf.c_str()));
-    return file_lookup_result;
+    return std::make_unique<FileLookupResult>(transforms, transforms_reason, original_uid,
+                                              transforms_complete, transforms_supported,
+                                              string(j_io_path_utf.c_str()));
+}
+
+void MediaProviderWrapper::MaybeCacheFileLookup(const std::string& path, uid_t uid,
+                                                const FileLookupResult& result) {
+    // Results for files that support transforms depend on the transform state and on pending
+    // opens of the calling thread, so only cache the (common) case of files that don't.
+    if (result.transforms == 0 && !result.transforms_supported) {
+        file_lookup_cache_.Put(path, uid, result);
+    }
+}
+
+void MediaProviderWrapper::InvalidateFileLookup(const std::string& path) {
+    if (path.empty()) {
+        file_lookup_cache_.Clear();
+    } else {
+        file_lookup_cache_.Invalidate(path);
+    }
+}
+
+std::unique_ptr<FileLookupResult> FileLookupCache::Get(const std::string& path, uid_t uid) {
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto it = entries_by_path_.find(FileLookupCacheKey(path));
+    if (it != entries_by_path_.end()) {
+        for (EntryList::iterator entry : it->second) {
+            if (entry->uid == uid) {
+                entries_.splice(entries_.begin(), entries_, entry);
+                stats_.hits++;
+                return std::make_unique<FileLookupResult>(entry->result);
+            }
+        }
+    }
+    stats_.misses++;
+    return nullptr;
+}
+
+void FileLookupCache::Put(const std::string& path, uid_t uid, const FileLookupResult& result) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    std::string key = FileLookupCacheKey(path);
+    std::lock_guard<std::mutex> guard(lock_);
+
+    std::vector<EntryList::iterator>& path_entries = entries_by_path_[key];
+    for (EntryList::iterator entry : path_entries) {
+        if (entry->uid == uid) {
+            // Raced with another lookup for the same file, keep the newest result.
+            EraseLocked(entry);
+            break;
+        }
+    }
+
+    if (entries_.size() >= capacity_) {
+        EraseLocked(std::prev(entries_.end()));
+    }
+
+    entries_.emplace_front(key, uid, result);
+    entries_by_path_[key].push_back(entries_.begin());
+    stats_.size = entries_.size();
+}
+
+void FileLookupCache::Invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto it = entries_by_path_.find(FileLookupCacheKey(path));
+    if (it == entries_by_path_.end()) {
+        return;
+    }
+    for (EntryList::iterator entry : it->second) {
+        entries_.erase(entry);
+    }
+    entries_by_path_.erase(it);
+    stats_.size = entries_.size();
+}
+
+void FileLookupCache::Clear() {
+    std::lock_guard<std::mutex> guard(lock_);
+    entries_.clear();
+    entries_by_path_.clear();
+    stats_.size = 0;
+}
+
+FileLookupCache::Stats FileLookupCache::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+void FileLookupCache::EraseLocked(EntryList::iterator entry) {
+    auto it = entries_by_path_.find(entry->key);
+    CHECK(it != entries_by_path_.end());
+
+    std::vector<EntryList::iterator>& path_entries = it->second;
+    path_entries.erase(std::find(path_entries.begin(), path_entries.end(), entry));
+    if (path_entries.empty()) {
+        entries_by_path_.erase(it);
+    }
+    entries_.erase(entry);
+    stats_.size = entries_.size();
+}
+
+std::optional<bool> AccessDecisionCache::Get(const std::string& key) {
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto it = decisions_.find(key);
+    if (it == decisions_.end()) {
+        stats_.misses++;
+        return std::nullopt;
+    }
+    stats_.hits++;
+    return it->second;
+}
+
+void AccessDecisionCache::Put(const std::string& key, bool allowed, uint64_t generation) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    // Invalidate() bumps the generation with |lock_| held, so nothing can be invalidated between
+    // here and the insertion.
+    if (generation != generation_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (decisions_.size() >= capacity_) {
+        decisions_.clear();
+    }
+    decisions_[key] = allowed;
+    stats_.size = decisions_.size();
+}
+
+void AccessDecisionCache::Invalidate() {
+    std::lock_guard<std::mutex> guard(lock_);
+    generation_.fetch_add(1, std::memory_order_release);
+    decisions_.clear();
+    stats_.size = 0;
+}
+
+AccessDecisionCache::Stats AccessDecisionCache::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
 }
 
 bool MediaProviderWrapper::Transform(const std::string& src, const std::string& dst, int transforms,
                                      int transforms_reason, uid_t read_uid, uid_t open_uid,
                                      uid_t transforms_uid) {
+    ScopedUpcallTimer upcall_timer(&upcall_stats_, UpcallStat::transform);
     JNIEnv* env = MaybeAttachCurrentThread();
 
     ScopedLocalRef<jstring> j_src(env, env->NewStringUTF(src.c_str()));
@@ -571,6 +919,13 @@ jmethodID MediaProviderWrapper::CacheMethod(JNIEnv* env, const char method_name[
 void MediaProviderWrapper::DetachThreadFunction(void* unused) {
     int detach = gJavaVm->DetachCurrentThread();
     CHECK_EQ(detach, 0);
+    gThreadsDetached.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string MediaProviderWrapper::DumpThreadStats() {
+    return "jni_threads: attached=" +
+           std::to_string(gThreadsAttached.load(std::memory_order_relaxed)) +
+           " detached=" + std::to_string(gThreadsDetached.load(std::memory_order_relaxed)) + "\n";
 }
 
 JNIEnv* MediaProviderWrapper::MaybeAttachCurrentThread() {
@@ -591,6 +946,7 @@ JNIEnv* MediaProviderWrapper::MaybeAttachCurrentThread() {
     CHECK(env != nullptr);
 
     pthread_setspecific(gJniEnvKey, env);
+    gThreadsAttached.fetch_add(1, std::memory_order_relaxed);
     return env;
 }
 
@@ -25,11 +25,16 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <list>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "libfuse_jni/FuseStats.h"
 #include "libfuse_jni/ReaddirHelper.h"
 #include "libfuse_jni/RedactionInfo.h"
 
@@ -83,6 +88,112 @@ struct FileLookupResult {
     const std::string io_path;
 };
 
+/**
+ * Bounded LRU cache of FileLookupResults keyed by path (ignoring case) and uid, so that repeated
+ * lookups of the same file by the same app don't each make a JNI upcall. Entries must be
+ * invalidated whenever MediaProvider could return a different result for a path.
+ */
+class FileLookupCache final {
+  public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t size;
+    };
+
+    explicit FileLookupCache(size_t capacity) : capacity_(capacity), stats_{} {}
+
+    /**
+     * Returns a copy of the cached result for |path| and |uid|, or nullptr if there is none.
+     */
+    std::unique_ptr<FileLookupResult> Get(const std::string& path, uid_t uid);
+
+    /**
+     * Caches |result| for |path| and |uid|, evicting the least recently used entry if full.
+     */
+    void Put(const std::string& path, uid_t uid, const FileLookupResult& result);
+
+    /**
+     * Drops the cached results of all uids for |path|.
+     */
+    void Invalidate(const std::string& path);
+
+    /**
+     * Drops all cached results.
+     */
+    void Clear();
+
+    Stats GetStats() const;
+
+  private:
+    struct Entry {
+        Entry(const std::string& key, uid_t uid, const FileLookupResult& result)
+            : key(key), uid(uid), result(result) {}
+
+        const std::string key;
+        const uid_t uid;
+        const FileLookupResult result;
+    };
+    using EntryList = std::list<Entry>;
+
+    void EraseLocked(EntryList::iterator entry);
+
+    const size_t capacity_;
+    mutable std::mutex lock_;
+    // Most recently used first.
+    EntryList entries_;
+    // Case-folded path -> entries for that path, one per uid.
+    std::unordered_map<std::string, std::vector<EntryList::iterator>> entries_by_path_;
+    Stats stats_;
+};
+
+/**
+ * Cache of MediaProvider access decisions that only change with the installed packages, their
+ * permissions and the users, e.g. whether a uid may access a package's Android/data directory.
+ * Invalidate() must be called whenever any of those change. Decisions being made while the cache
+ * is invalidated aren't cached, see generation().
+ */
+class AccessDecisionCache final {
+  public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t size;
+    };
+
+    explicit AccessDecisionCache(size_t capacity) : capacity_(capacity), stats_{} {}
+
+    /**
+     * Returns the current generation, to be passed to Put() with the decision made after it.
+     */
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    /**
+     * Returns the cached decision for |key|, or nullopt if there is none.
+     */
+    std::optional<bool> Get(const std::string& key);
+
+    /**
+     * Caches |allowed| for |key| unless the cache was invalidated since |generation|. Drops all
+     * cached decisions first if full: they're cheap to make again compared to tracking their use.
+     */
+    void Put(const std::string& key, bool allowed, uint64_t generation);
+
+    /**
+     * Drops all cached decisions, including those being made.
+     */
+    void Invalidate();
+
+    Stats GetStats() const;
+
+  private:
+    const size_t capacity_;
+    std::atomic<uint64_t> generation_ = 0;
+    mutable std::mutex lock_;
+    std::unordered_map<std::string, bool> decisions_;
+    Stats stats_;
+};
+
 /**
  * Class that wraps MediaProvider.java and all of the needed JNI calls to make
  * interaction with MediaProvider easier.
@@ -125,21 +236,25 @@ class MediaProviderWrapper final {
     int DeleteFile(const std::string& path, uid_t uid);
 
     /**
-     * Gets directory entries for given path from MediaProvider database and lower file system
+     * Gets the next directory entries for given path from MediaProvider database and lower file
+     * system, so that large directories can be listed incrementally.
      *
      * @param uid UID of the calling app.
      * @param path Relative path of the directory.
      * @param dirp Pointer to directory stream, used to query lower file system.
-     * @return DirectoryEntries with list of directory entries on success.
+     * @param cursor Position of the listing, advanced past the returned entries. A default
+     * constructed cursor starts a new listing, which is complete once cursor->done().
+     * @param max_entries Maximum number of entries to return.
+     * @param entries DirectoryEntries the next directory entries are added to, possibly none.
      * File names in a directory are obtained from MediaProvider. If a path is unknown to
      * MediaProvider, file names are obtained from lower file system. All directory names in the
-     * given directory are obtained from lower file system.
-     * An empty string in first directory entry name indicates the error occurred while obtaining
-     * directory entries, directory entry type will hold the corresponding errno information.
+     * given directory are obtained from lower file system, after the file names.
+     * If an error occurs while obtaining directory entries, an error entry is added instead,
+     * see DirectoryEntries.
      */
-    std::vector<std::shared_ptr<DirectoryEntry>> GetDirectoryEntries(uid_t uid,
-                                                                     const std::string& path,
-                                                                     DIR* dirp);
+    void GetDirectoryEntries(uid_t uid, const std::string& path, DIR* dirp,
+                             DirectoryEntryCursor* cursor, size_t max_entries,
+                             DirectoryEntries* entries);
 
     /**
      * Determines if the given UID is allowed to open the file denoted by the given path.
@@ -159,6 +274,15 @@ class MediaProviderWrapper final {
                                                bool for_write, bool redact,
                                                bool log_transforms_metrics);
 
+    /**
+     * Called when |uid| opens the file denoted by |path| reusing the result of an earlier
+     * OnFileOpen(), so that MediaProvider still accounts for the access.
+     *
+     * @param path path of the opened file that is used for database operations
+     * @param uid UID of the calling app
+     */
+    void OnCachedFileOpen(const std::string& path, uid_t uid);
+
     /**
      * Determines if the given UID is allowed to create a directory with the given path.
      *
@@ -196,6 +320,8 @@ class MediaProviderWrapper final {
      *      app directories.
      *    * Installer apps have access to Android/obb directories
      *
+     * Decisions for paths owned by a package are cached, see InvalidateAccessDecisions().
+     *
      * @param uid UID of the app
      * @param path the private path that the UID wants to access
      * @return true if it matches, otherwise return false.
@@ -223,16 +349,49 @@ class MediaProviderWrapper final {
 
     /**
      * Returns FileLookupResult to determine transform info for a path and uid.
+     *
+     * Results that don't require transforms are cached, see InvalidateFileLookup().
      */
     std::unique_ptr<FileLookupResult> FileLookup(const std::string& path, uid_t uid, pid_t tid);
 
+    /**
+     * Returns the FileLookupResults of all |paths| for |uid| with a single upcall, e.g. for all
+     * entries of a directory listing. Results are in the same order as |paths|; the result for a
+     * path is nullptr if it couldn't be fetched, in which case callers should fall back to
+     * FileLookup().
+     */
+    std::vector<std::unique_ptr<FileLookupResult>> FileLookupBatch(
+            const std::vector<std::string>& paths, uid_t uid, pid_t tid);
+
+    /**
+     * Drops any cached FileLookup() results for |path|, or all of them if |path| is empty.
+     */
+    void InvalidateFileLookup(const std::string& path);
+
+    FileLookupCache::Stats GetFileLookupCacheStats() const {
+        return file_lookup_cache_.GetStats();
+    }
+
+    /**
+     * Drops the cached isUidAllowedAccessToDataOrObbPath() and ShouldAllowLookup() decisions.
+     */
+    void InvalidateAccessDecisions() { access_decision_cache_.Invalidate(); }
+
+    AccessDecisionCache::Stats GetAccessDecisionCacheStats() const {
+        return access_decision_cache_.GetStats();
+    }
+
+    /** Returns the latency and exception statistics of the upcalls made so far. */
+    const UpcallStats& GetUpcallStats() const { return upcall_stats_; }
+
     /** Transforms from src to dst file */
     bool Transform(const std::string& src, const std::string& dst, int transforms,
                    int transforms_reason, uid_t read_uid, uid_t open_uid, uid_t transforms_uid);
 
     /**
      * Determines if to allow FUSE_LOOKUP for uid. Might allow uids that don't belong to the
-     * MediaProvider user, depending on OEM configuration.
+     * MediaProvider user, depending on OEM configuration. Decisions are cached, see
+     * InvalidateAccessDecisions().
      *
      * @param uid linux uid to check
      */
@@ -251,6 +410,18 @@ class MediaProviderWrapper final {
      */
     static void OneTimeInit(JavaVM* vm);
 
+    /**
+     * Attaches the calling thread to the JVM unless it already is, so that its first upcall
+     * doesn't pay for it. The thread is detached when it exits.
+     */
+    static void AttachCurrentThread() { MaybeAttachCurrentThread(); }
+
+    /**
+     * Returns a human readable dump of how many threads were attached to and detached from the
+     * JVM, on a single line.
+     */
+    static std::string DumpThreadStats();
+
     /** TLS Key to map a given thread to its JNIEnv. */
     static pthread_key_t gJniEnvKey;
 
@@ -264,9 +435,10 @@ class MediaProviderWrapper final {
     jmethodID mid_delete_file_;
     jmethodID mid_unicode_check_enabled_;
     jmethodID mid_on_file_open_;
+    jmethodID mid_on_cached_file_open_;
     jmethodID mid_scan_file_;
     jmethodID mid_is_diraccess_allowed_;
-    jmethodID mid_get_files_in_dir_;
+    jmethodID mid_get_files_in_dir_page_;
     jmethodID mid_rename_;
     jmethodID mid_is_uid_allowed_access_to_data_or_obb_path_;
     jmethodID mid_on_file_created_;
@@ -274,6 +446,7 @@ class MediaProviderWrapper final {
     jmethodID mid_is_app_clone_user_;
     jmethodID mid_transform_;
     jmethodID mid_file_lookup_;
+    jmethodID mid_file_lookup_batch_;
     /** Cached FileLookupResult field IDs **/
     jfieldID fid_file_lookup_transforms_;
     jfieldID fid_file_lookup_transforms_reason_;
@@ -288,11 +461,25 @@ class MediaProviderWrapper final {
     jfieldID fid_file_open_redaction_ranges_;
     jfieldID fid_file_open_fd_;
 
+    FileLookupCache file_lookup_cache_;
+    AccessDecisionCache access_decision_cache_;
+    UpcallStats upcall_stats_;
+
     /**
      * Auxiliary for caching MediaProvider methods.
      */
     jmethodID CacheMethod(JNIEnv* env, const char method_name[], const char signature[]);
 
+    /**
+     * Converts a FileLookupResult returned by MediaProvider.
+     */
+    std::unique_ptr<FileLookupResult> ToFileLookupResult(JNIEnv* env, jobject j_file_lookup_result);
+
+    /**
+     * Caches |result| for |path| and |uid| if it can't change without the file changing.
+     */
+    void MaybeCacheFileLookup(const std::string& path, uid_t uid, const FileLookupResult& result);
+
     // Attaches the current thread (if necessary) and returns the JNIEnv
     // associated with it.
     static JNIEnv* MaybeAttachCurrentThread();
@@ -301,6 +488,10 @@ class MediaProviderWrapper final {
     static void DetachThreadFunction(void* unused);
 
     static JavaVM* gJavaVm;
+    // Number of threads attached and detached by MaybeAttachCurrentThread() and
+    // DetachThreadFunction().
+    static std::atomic<uint64_t> gThreadsAttached;
+    static std::atomic<uint64_t> gThreadsDetached;
 };
 
 }  // namespace fuse
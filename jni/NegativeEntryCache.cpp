@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/libfuse_jni/NegativeEntryCache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace mediaprovider {
+namespace fuse {
+
+NegativeEntryCache::Key NegativeEntryCache::MakeKey(uint64_t parent, const std::string& name) {
+    Key key{parent, name};
+    for (char& c : key.folded_name) {
+        if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 'a';
+        }
+    }
+    return key;
+}
+
+bool NegativeEntryCache::Add(uint64_t parent, const std::string& name, Clock::duration timeout,
+                             Clock::time_point now) {
+    std::lock_guard<std::mutex> guard(lock_);
+    const Clock::time_point expiry = now + timeout;
+    Key key = MakeKey(parent, name);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        for (Entry& entry : it->second) {
+            if (entry.name == name) {
+                entry.expiry = expiry;
+                stats_.replies++;
+                stats_.reprobes++;
+                return true;
+            }
+        }
+    }
+
+    if (stats_.entries >= max_entries_) {
+        PruneExpiredLocked(now);
+        if (stats_.entries >= max_entries_) {
+            stats_.rejected++;
+            return false;
+        }
+        // Pruning may have erased |it|.
+        it = entries_.find(key);
+    }
+
+    if (it == entries_.end()) {
+        it = entries_.emplace(std::move(key), std::vector<Entry>()).first;
+    }
+    it->second.push_back({name, expiry});
+    stats_.entries++;
+    stats_.replies++;
+    return true;
+}
+
+std::vector<std::string> NegativeEntryCache::Remove(uint64_t parent, const std::string& name,
+                                                    Clock::time_point now) {
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = entries_.find(MakeKey(parent, name));
+    if (it == entries_.end()) {
+        return names;
+    }
+    for (Entry& entry : it->second) {
+        if (entry.expiry > now) {
+            names.push_back(std::move(entry.name));
+        }
+    }
+    stats_.entries -= it->second.size();
+    stats_.invalidations += names.size();
+    entries_.erase(it);
+    return names;
+}
+
+void NegativeEntryCache::PruneExpiredLocked(Clock::time_point now) {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        std::vector<Entry>& spellings = it->second;
+        const auto expired = std::remove_if(spellings.begin(), spellings.end(),
+                                            [now](const Entry& e) { return e.expiry <= now; });
+        stats_.entries -= spellings.end() - expired;
+        spellings.erase(expired, spellings.end());
+        it = spellings.empty() ? entries_.erase(it) : std::next(it);
+    }
+}
+
+NegativeEntryCache::Stats NegativeEntryCache::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+std::string NegativeEntryCache::Dump() const {
+    const Stats stats = GetStats();
+    if (stats.replies == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "negative_entries: entries=" << stats.entries << " replies=" << stats.replies
+       << " reprobes=" << stats.reprobes << " invalidations=" << stats.invalidations
+       << " rejected=" << stats.rejected << "\n";
+    return os.str();
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NegativeEntryCacheTest"
+
+#include "libfuse_jni/NegativeEntryCache.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace mediaprovider::fuse {
+
+TEST(NegativeEntryCacheTest, removesAllSpellings) {
+    NegativeEntryCache cache;
+    const NegativeEntryCache::Clock::time_point now = NegativeEntryCache::Clock::now();
+    const std::chrono::seconds timeout(10);
+
+    ASSERT_TRUE(cache.Add(1, ".nomedia", timeout, now));
+    ASSERT_TRUE(cache.Add(1, ".NoMedia", timeout, now));
+    ASSERT_TRUE(cache.Add(2, ".nomedia", timeout, now));
+    // Looking up the same name again only refreshes its entry.
+    ASSERT_TRUE(cache.Add(1, ".nomedia", timeout, now));
+    ASSERT_EQ(3, cache.GetStats().entries);
+    ASSERT_EQ(4, cache.GetStats().replies);
+    ASSERT_EQ(1, cache.GetStats().reprobes);
+
+    std::vector<std::string> names = cache.Remove(1, ".NOMEDIA", now);
+    std::sort(names.begin(), names.end());
+    ASSERT_EQ((std::vector<std::string>{".NoMedia", ".nomedia"}), names);
+    ASSERT_EQ(1, cache.GetStats().entries);
+    ASSERT_EQ(2, cache.GetStats().invalidations);
+    ASSERT_TRUE(cache.Remove(1, ".nomedia", now).empty());
+
+    // Expired entries don't need to be invalidated.
+    ASSERT_TRUE(cache.Remove(2, ".nomedia", now + timeout).empty());
+    ASSERT_EQ(0, cache.GetStats().entries);
+}
+
+TEST(NegativeEntryCacheTest, rejectsWhenFull) {
+    NegativeEntryCache cache(2 /* max_entries */);
+    const NegativeEntryCache::Clock::time_point now = NegativeEntryCache::Clock::now();
+
+    ASSERT_TRUE(cache.Add(1, "a", std::chrono::seconds(1), now));
+    ASSERT_TRUE(cache.Add(1, "b", std::chrono::seconds(10), now));
+    ASSERT_FALSE(cache.Add(1, "c", std::chrono::seconds(10), now));
+    ASSERT_EQ(1, cache.GetStats().rejected);
+
+    // Once "a" expired, it makes room for another entry.
+    ASSERT_TRUE(cache.Add(1, "c", std::chrono::seconds(10), now + std::chrono::seconds(1)));
+    ASSERT_EQ(2, cache.GetStats().entries);
+}
+
+}  // namespace mediaprovider::fuse
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NodeTrackerTest"
+
+#include <gtest/gtest.h>
+
+#include "node-inl.h"
+
+namespace mediaprovider::fuse {
+
+TEST(NodeTrackerTest, exists) {
+    RecursiveSharedMutex lock;
+    NodeTracker tracker(&lock);
+    node* parent = node::Create(nullptr, "/path", "", true, 0, 0, &lock, 0, &tracker);
+    node* child = node::Create(parent, "child", "", true, 0, 0, &lock, 0, &tracker);
+    const __u64 ino = node::ToInode(child);
+
+    ASSERT_TRUE(tracker.Exists(ino));
+    ASSERT_TRUE(child->IsLive());
+    tracker.CheckTracked(ino);
+
+    // Still in an allocated slab thanks to |parent|, so safe to check.
+    child->Release(1);
+    ASSERT_FALSE(tracker.Exists(ino));
+    ASSERT_DEATH(tracker.CheckTracked(ino), "");
+
+    // Not a node at all.
+    ASSERT_FALSE(tracker.Exists(node::ToInode(parent) + 8));
+    int not_a_node = 0;
+    ASSERT_FALSE(tracker.Exists(reinterpret_cast<uintptr_t>(&not_a_node)));
+    ASSERT_DEATH(tracker.CheckTracked(reinterpret_cast<uintptr_t>(&not_a_node)), "");
+
+    parent->Release(1);
+}
+
+}  // namespace mediaprovider::fuse
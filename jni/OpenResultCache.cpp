@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/libfuse_jni/OpenResultCache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace mediaprovider {
+namespace fuse {
+
+uint64_t OpenResultCache::generation() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return generation_;
+}
+
+std::unique_ptr<OpenResultCache::Result> OpenResultCache::Get(uint64_t ino, uid_t uid,
+                                                              Clock::time_point now) {
+    if (uid == proxy_uid_) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = entries_.find(ino);
+    if (it != entries_.end()) {
+        for (const Entry& entry : it->second) {
+            if (entry.uid == uid && entry.expiry > now) {
+                stats_.hits++;
+                return std::make_unique<Result>(entry.result);
+            }
+        }
+    }
+    stats_.misses++;
+    return nullptr;
+}
+
+void OpenResultCache::Put(uint64_t ino, uid_t uid, const Result& result, uint64_t generation,
+                          Clock::duration ttl, Clock::time_point now) {
+    if (uid == proxy_uid_) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock_);
+    if (generation != generation_) {
+        // The node may have changed while its result was being computed.
+        return;
+    }
+
+    const Clock::time_point expiry = now + ttl;
+    auto it = entries_.find(ino);
+    if (it != entries_.end()) {
+        for (Entry& entry : it->second) {
+            if (entry.uid == uid) {
+                entry.result = result;
+                entry.expiry = expiry;
+                return;
+            }
+        }
+    }
+
+    if (stats_.entries >= max_entries_) {
+        PruneExpiredLocked(now);
+        if (stats_.entries >= max_entries_) {
+            return;
+        }
+        // Pruning may have erased |it|.
+        it = entries_.find(ino);
+    }
+
+    if (it == entries_.end()) {
+        it = entries_.emplace(ino, std::vector<Entry>()).first;
+    }
+    it->second.push_back({uid, result, expiry});
+    stats_.entries++;
+}
+
+void OpenResultCache::Forget(uint64_t ino) {
+    std::lock_guard<std::mutex> guard(lock_);
+    generation_++;
+    auto it = entries_.find(ino);
+    if (it == entries_.end()) {
+        return;
+    }
+    stats_.entries -= it->second.size();
+    stats_.invalidations += it->second.size();
+    entries_.erase(it);
+}
+
+void OpenResultCache::Clear() {
+    std::lock_guard<std::mutex> guard(lock_);
+    generation_++;
+    stats_.invalidations += stats_.entries;
+    stats_.entries = 0;
+    entries_.clear();
+}
+
+void OpenResultCache::PruneExpiredLocked(Clock::time_point now) {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        std::vector<Entry>& uids = it->second;
+        const auto expired = std::remove_if(uids.begin(), uids.end(),
+                                            [now](const Entry& e) { return e.expiry <= now; });
+        stats_.entries -= uids.end() - expired;
+        uids.erase(expired, uids.end());
+        it = uids.empty() ? entries_.erase(it) : std::next(it);
+    }
+}
+
+OpenResultCache::Stats OpenResultCache::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+std::string OpenResultCache::Dump() const {
+    const Stats stats = GetStats();
+    if (stats.hits + stats.misses == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "open_results: entries=" << stats.entries << " hits=" << stats.hits
+       << " misses=" << stats.misses << " invalidations=" << stats.invalidations << "\n";
+    return os.str();
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
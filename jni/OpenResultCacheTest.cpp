@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenResultCacheTest"
+
+#include "libfuse_jni/OpenResultCache.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace mediaprovider::fuse {
+
+TEST(OpenResultCacheTest, expiresAndForgets) {
+    OpenResultCache cache(/* proxy_uid */ 10000);
+    const OpenResultCache::Clock::time_point now = OpenResultCache::Clock::now();
+    const off64_t ranges[] = {10, 20};
+    const OpenResultCache::Result result{1000, 0, RedactionInfo(1, ranges)};
+
+    cache.Put(1, 1000, result, cache.generation(), std::chrono::seconds(1), now);
+    std::unique_ptr<OpenResultCache::Result> cached = cache.Get(1, 1000, now);
+    ASSERT_NE(nullptr, cached);
+    ASSERT_EQ(1000, cached->uid);
+    ASSERT_EQ(1, cached->redaction_info.size());
+    // Other uids and nodes aren't served, nor expired results.
+    ASSERT_EQ(nullptr, cache.Get(1, 1001, now));
+    ASSERT_EQ(nullptr, cache.Get(2, 1000, now));
+    ASSERT_EQ(nullptr, cache.Get(1, 1000, now + std::chrono::seconds(1)));
+
+    cache.Forget(1);
+    ASSERT_EQ(nullptr, cache.Get(1, 1000, now));
+
+    // A check made before the node was forgotten isn't cached.
+    const uint64_t generation = cache.generation();
+    cache.Forget(1);
+    cache.Put(1, 1000, result, generation, std::chrono::seconds(1), now);
+    ASSERT_EQ(nullptr, cache.Get(1, 1000, now));
+
+    cache.Put(1, 1000, result, cache.generation(), std::chrono::seconds(1), now);
+    cache.Put(2, 1000, result, cache.generation(), std::chrono::seconds(1), now);
+    cache.Clear();
+    ASSERT_EQ(nullptr, cache.Get(2, 1000, now));
+
+    const OpenResultCache::Stats stats = cache.GetStats();
+    ASSERT_EQ(0, stats.entries);
+    ASSERT_EQ(1, stats.hits);
+    ASSERT_EQ(3, stats.invalidations);
+}
+
+TEST(OpenResultCacheTest, neverCachesProxiedOpens) {
+    const uid_t proxy_uid = 10000;
+    OpenResultCache cache(proxy_uid);
+    const OpenResultCache::Clock::time_point now = OpenResultCache::Clock::now();
+    const off64_t ranges[] = {10, 20};
+
+    // An app with write access opens the node through MediaProvider, unredacted.
+    cache.Put(1, proxy_uid, {1000, 0, RedactionInfo()}, cache.generation(),
+              std::chrono::seconds(1), now);
+    // Another app opening it through MediaProvider must not get that result.
+    ASSERT_EQ(nullptr, cache.Get(1, proxy_uid, now));
+
+    cache.Put(1, proxy_uid, {1001, 0, RedactionInfo(1, ranges)},
+              cache.generation(), std::chrono::seconds(1), now);
+    ASSERT_EQ(nullptr, cache.Get(1, proxy_uid, now));
+    ASSERT_EQ(0, cache.GetStats().entries);
+}
+
+}  // namespace mediaprovider::fuse
@@ -17,44 +17,109 @@
 
 #include "libfuse_jni/ReaddirHelper.h"
 #include <android-base/logging.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
 
 namespace mediaprovider {
 namespace fuse {
 namespace {
 
+// Size of the buffer entries are read into from the lower file system, big enough for a few
+// hundred entries per system call rather than the few dozen readdir(3) fetches at a time.
+constexpr size_t kGetdentsBufferSize = 32 * 1024;
+
 inline bool is_dot_or_dotdot(const char* name) {
     return name && name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
 }
 
+// Reads the next entries of directory |fd| into |buffer|, returning the number of bytes read, 0
+// at the end of the directory, or -1 and sets errno on failure. getdents64() is only available
+// from API level 32.
+ssize_t getdents64(int fd, std::vector<char>* buffer) {
+    return syscall(SYS_getdents64, fd, buffer->data(), buffer->size());
+}
+
 }  // namespace
 
+void DirectoryEntries::Add(std::string_view name, int type) {
+    entries_.push_back({static_cast<uint32_t>(names_.size()), type});
+    names_.insert(names_.end(), name.begin(), name.end());
+    names_.push_back('\0');
+}
+
+void DirectoryEntries::Truncate(size_t size) {
+    if (size >= entries_.size()) {
+        return;
+    }
+    names_.resize(entries_[size].name_offset);
+    entries_.resize(size);
+}
+
 bool isDirectory(const dirent& entry) {
     if (entry.d_type == DT_DIR) return true;
     return false;
 }
 
 void addDirectoryEntriesFromLowerFs(DIR* dirp, bool (*const filter)(const dirent&),
-        std::vector<std::shared_ptr<DirectoryEntry>>* directory_entries) {
-    while (1) {
-        errno = 0;
-        const struct dirent* entry = readdir(dirp);
-        if (entry == nullptr) {
-            if (errno) {
-                PLOG(ERROR) << "DEBUG: readdir(): readdir failed with %d" << errno;
-                directory_entries->resize(0);
-                directory_entries->push_back(std::make_shared<DirectoryEntry>("", errno));
+        DirectoryEntries* directory_entries) {
+    addDirectoryEntriesFromLowerFs(dirp, filter, SIZE_MAX, directory_entries);
+}
+
+// Reads the entries with getdents64() straight from the file descriptor of |dirp| rather than
+// through readdir(3), so |dirp| must not be read with readdir(3) as well, although rewinddir(3)
+// is fine. When |max_entries| is reached in the middle of what was read, the file offset is
+// moved back to right after the last entry added, so that nothing is kept across calls.
+bool addDirectoryEntriesFromLowerFs(DIR* dirp, bool (*const filter)(const dirent&),
+                                    size_t max_entries, DirectoryEntries* directory_entries) {
+    // Shared by all the directories listed by the calling thread.
+    static thread_local std::vector<char> buffer(kGetdentsBufferSize);
+
+    const int fd = dirfd(dirp);
+    const size_t begin = directory_entries->size();
+    size_t added = 0;
+    while (added < max_entries) {
+        const ssize_t size = getdents64(fd, &buffer);
+        if (size <= 0) {
+            if (size < 0) {
+                const int error = errno;
+                PLOG(ERROR) << "DEBUG: readdir(): getdents64 failed with " << error;
+                directory_entries->Truncate(begin);
+                directory_entries->AddError(error);
             }
-            break;
+            return true;
         }
-        // Ignore '.' & '..' to maintain consistency with directory entries
-        // returned by MediaProvider.
-        if (is_dot_or_dotdot(entry->d_name)) continue;
-        if (filter == nullptr || filter(*entry)) {
-            directory_entries->push_back(
-                    std::make_shared<DirectoryEntry>(entry->d_name, entry->d_type));
+
+        for (ssize_t pos = 0; pos < size;) {
+            // The records have the layout of struct dirent, but are only as long as their name.
+            const struct dirent* entry = reinterpret_cast<const struct dirent*>(&buffer[pos]);
+            pos += entry->d_reclen;
+            // Ignore '.' & '..' to maintain consistency with directory entries
+            // returned by MediaProvider.
+            if (is_dot_or_dotdot(entry->d_name)) continue;
+            // Check the filter used to list only directories inline.
+            const bool matches =
+                    filter == nullptr ||
+                    (filter == &isDirectory ? entry->d_type == DT_DIR : filter(*entry));
+            if (!matches) continue;
+
+            directory_entries->Add(entry->d_name, entry->d_type);
+            if (++added == max_entries) {
+                if (pos < size && lseek(fd, entry->d_off, SEEK_SET) < 0) {
+                    const int error = errno;
+                    PLOG(ERROR) << "DEBUG: readdir(): lseek failed with " << error;
+                    directory_entries->Truncate(begin);
+                    directory_entries->AddError(error);
+                    return true;
+                }
+                return false;
+            }
         }
     }
+    return false;
 }
 
 }  // namespace fuse
@@ -20,7 +20,6 @@
 
 #include <algorithm>
 
-using std::unique_ptr;
 using std::vector;
 
 namespace mediaprovider {
@@ -117,92 +116,61 @@ RedactionInfo::RedactionInfo(int redaction_ranges_num, const off64_t* redaction_
     processRedactionRanges(redaction_ranges_num, redaction_ranges);
 }
 
-unique_ptr<vector<RedactionRange>> RedactionInfo::getOverlappingRedactionRanges(size_t size,
-                                                                                off64_t off) const {
-    if (hasOverlapWithReadRequest(size, off)) {
-        const off64_t start = off;
-        const off64_t end = static_cast<off64_t>(off + size);
-
-        auto first_redaction = redaction_ranges_.end();
-        auto last_redaction = redaction_ranges_.begin();
-        for (auto iter = redaction_ranges_.begin(); iter != redaction_ranges_.end(); ++iter) {
-            if (iter->second > start && iter->first < end) {
-                if (iter < first_redaction) first_redaction = iter;
-                if (iter > last_redaction) last_redaction = iter;
-            }
-
-            if (iter->first >= end) {
-                break;
-            }
-        }
+std::pair<vector<RedactionRange>::const_iterator, vector<RedactionRange>::const_iterator>
+RedactionInfo::getOverlappingRedactionRanges(size_t size, off64_t off) const {
+    if (!hasOverlapWithReadRequest(size, off)) {
+        return {redaction_ranges_.end(), redaction_ranges_.end()};
+    }
 
-        if (first_redaction != redaction_ranges_.end()) {
-            CHECK(first_redaction <= last_redaction);
-            return std::make_unique<vector<RedactionRange>>(first_redaction, last_redaction + 1);
+    const off64_t start = off;
+    const off64_t end = static_cast<off64_t>(off + size);
+
+    // redaction_ranges_ is sorted and its ranges don't overlap, so both their starts and their
+    // ends are in ascending order. The first overlapping range is the first one ending after
+    // |start|.
+    const auto ends_after_start = [start](const RedactionRange& r) { return r.second > start; };
+    auto first_redaction = redaction_ranges_.end();
+
+    // Sequential readers usually hit the same range as their previous read, or the next one.
+    const size_t hint = read_cursor_.load(std::memory_order_relaxed);
+    for (size_t i = hint; i < std::min(hint + 2, redaction_ranges_.size()); ++i) {
+        if (ends_after_start(redaction_ranges_[i]) &&
+            (i == 0 || !ends_after_start(redaction_ranges_[i - 1]))) {
+            first_redaction = redaction_ranges_.begin() + i;
+            break;
         }
     }
-    return std::make_unique<vector<RedactionRange>>();
-}
-
-void RedactionInfo::getReadRanges(off64_t off, size_t size, std::vector<ReadRange>* out) const {
-    const auto rr = getOverlappingRedactionRanges(size, off);
-    const size_t num_ranges = rr->size();
-    if (num_ranges == 0) {
-        return;
+    if (first_redaction == redaction_ranges_.end()) {
+        first_redaction = std::partition_point(redaction_ranges_.begin(), redaction_ranges_.end(),
+                                               [&](const RedactionRange& r) {
+                                                   return !ends_after_start(r);
+                                               });
     }
 
-    const off64_t read_start = off;
-    const off64_t read_end = static_cast<off64_t>(read_start + size);
-
-    // The algorithm for computing redaction ranges is very simple.
-    // Given a set of overlapping redaction ranges [s1, e1) [s2, e2) .. [sN, eN) for a read
-    // [s, e)
-    //
-    // We can construct a series of indices that we know will be the starts of every read range
-    // that we intend to return. Then, it's relatively simple to compute the lengths of the ranges.
-    // Also note that the read ranges we return always alternate in whether they're redacting or
-    // not. i.e, we will never return two consecutive redacting ranges or non redacting ranges.
-    std::vector<off64_t> sorted_indices;
-
-    // Compute the list of indices -- this list will always contain { e1, s2, e2... sN }
-    // In addition, it may contain s or both (s and s1), depending on the start index.
-    // In addition, it may contain e or both (e and eN), depending on the end index.
-    //
-    // For a concrete example, consider ranges [10, 20) and [30, 40)
-    // For a read [0, 60) : sorted_indices will be { 0, 10, 20, 30, 40, 60 } is_first = false
-    // For a read [15, 60) : sorted_indices will be { 15, 20, 30, 40, 60 } is_first = true
-    // For a read [0, 35) : sorted_indices will be { 0, 10, 20, 30, 35 } is_first = false
-    // For a read [15, 35) : sorted_indices will be { 15, 20, 30, 35 } is_first = true
-    for (int i = 0; i < num_ranges; ++i) {
-        sorted_indices.push_back(rr->at(i).first);
-        sorted_indices.push_back(rr->at(i).second);
+    // The overlapping ranges are then all the following ones starting before |end|.
+    auto last_redaction = first_redaction;
+    while (last_redaction != redaction_ranges_.end() && last_redaction->first < end) {
+        ++last_redaction;
     }
 
-    // Find the right position for read_start in sorted_indices
-    // Either insert at the beginning or replace s1 with read_start
-    bool is_first_range_redaction = true;
-    if (read_start < rr->at(0).first) {
-        is_first_range_redaction = false;
-        sorted_indices.insert(sorted_indices.begin(), read_start);
-    } else {
-        sorted_indices.front() = read_start;
+    if (first_redaction != last_redaction) {
+        read_cursor_.store(last_redaction - 1 - redaction_ranges_.begin(),
+                           std::memory_order_relaxed);
     }
+    return {first_redaction, last_redaction};
+}
 
-    // Find the right position for read_end in sorted_indices
-    // Either insert at the end or replace eN with read_end
-    if (read_end > rr->at(num_ranges - 1).second) {
-        sorted_indices.push_back(read_end);
-    } else {
-        sorted_indices.back() = read_end;
-    }
+void RedactionInfo::getReadRanges(off64_t off, size_t size, std::vector<ReadRange>* out) const {
+    forEachReadRange(off, size, [out](const ReadRange& range) {
+        CHECK(range.size > 0);
+        out->push_back(range);
+    });
+}
 
-    bool is_redaction = is_first_range_redaction;
-    for (int i = 0; i < (sorted_indices.size() - 1); ++i) {
-        const off64_t read_size = sorted_indices[i + 1] - sorted_indices[i];
-        CHECK(read_size > 0);
-        out->push_back(ReadRange(sorted_indices[i], read_size, is_redaction));
-        is_redaction = !is_redaction;
-    }
+size_t RedactionInfo::getReadRangeCount(off64_t off, size_t size) const {
+    size_t count = 0;
+    forEachReadRange(off, size, [&count](const ReadRange&) { count++; });
+    return count;
 }
 
 }  // namespace fuse
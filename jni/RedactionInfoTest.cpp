@@ -381,4 +381,61 @@ TEST(RedactionInfoTest, testSingleRedactionRangesZeroSize) {
     EXPECT_EQ(0, out.size());
 }
 
+// Read range count matches the ranges actually returned
+TEST(RedactionInfoTest, testReadRangeCount) {
+    off64_t ranges[6] = {10, 20, 30, 40, 50, 60};
+
+    RedactionInfo info(3, ranges);
+
+    const std::pair<off64_t, size_t> reads[] = {
+            {0, 100}, {0, 5}, {15, 10}, {10, 10}, {25, 30}, {35, 20}, {60, 10}, {5, 60},
+    };
+    for (const auto& [off, size] : reads) {
+        std::vector<ReadRange> out;
+        info.getReadRanges(off, size, &out);
+        EXPECT_EQ(out.size(), info.getReadRangeCount(off, size)) << off << ", " << size;
+    }
+}
+
+// Many redaction ranges, read sequentially and then backwards
+TEST(RedactionInfoTest, testManyRedactionRanges) {
+    // Ranges are: [100 * i, 100 * i + 10) for i in [0, 1000)
+    constexpr int kNumRanges = 1000;
+    std::vector<off64_t> ranges;
+    for (int i = 0; i < kNumRanges; ++i) {
+        ranges.push_back(100 * i);
+        ranges.push_back(100 * i + 10);
+    }
+    RedactionInfo info(kNumRanges, ranges.data());
+    EXPECT_EQ(kNumRanges, info.size());
+
+    const auto check_read = [&info](off64_t off, size_t size) {
+        std::vector<ReadRange> out;
+        info.getReadRanges(off, size, &out);
+
+        // Read ranges must cover the read exactly, and be redacted exactly where a redaction
+        // range is.
+        off64_t pos = off;
+        for (const ReadRange& range : out) {
+            EXPECT_EQ(pos, range.start);
+            EXPECT_EQ(range.start % 100 < 10, range.is_redaction) << range;
+            pos += range.size;
+        }
+        if (!out.empty()) {
+            EXPECT_EQ(static_cast<off64_t>(off + size), pos);
+        }
+    };
+
+    for (off64_t off = 0; off < 100 * kNumRanges; off += 64) {
+        check_read(off, 64);
+    }
+    for (off64_t off = 100 * kNumRanges - 250; off >= 0; off -= 250) {
+        check_read(off, 250);
+    }
+
+    std::vector<ReadRange> out;
+    info.getReadRanges(55, 30, &out);  // read offsets [55, 85)
+    EXPECT_EQ(0, out.size());
+}
+
 }  // namespace mediaprovider::fuse
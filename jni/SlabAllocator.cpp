@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SlabAllocator"
+
+#include "include/libfuse_jni/SlabAllocator.h"
+
+#include <android-base/logging.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace mediaprovider {
+namespace fuse {
+
+namespace {
+
+constexpr size_t kObjectAlignment = alignof(std::max_align_t);
+
+constexpr size_t AlignUp(size_t size) {
+    return (size + kObjectAlignment - 1) & ~(kObjectAlignment - 1);
+}
+
+}  // namespace
+
+// Header at the start of every slab, followed by its objects.
+struct SlabAllocator::Slab {
+    SlabAllocator* owner;
+    // Links in the owner's |available_| or |full_| list.
+    Slab* prev;
+    Slab* next;
+    // Singly linked list of freed objects, each storing a pointer to the next one.
+    void* free_list;
+    // Index of the first object that has never been handed out.
+    size_t next_unused;
+    // Number of objects currently allocated.
+    size_t live;
+
+    char* objects() { return reinterpret_cast<char*>(this) + AlignUp(sizeof(Slab)); }
+};
+
+SlabAllocator::SlabAllocator(size_t object_size, size_t max_empty_slabs)
+    : object_size_(AlignUp(std::max(object_size, sizeof(void*)))),
+      objects_per_slab_((kSlabSize - AlignUp(sizeof(Slab))) / object_size_),
+      max_empty_slabs_(max_empty_slabs) {
+    CHECK(objects_per_slab_ > 0) << "Object size too large for a slab: " << object_size;
+}
+
+SlabAllocator::~SlabAllocator() {
+    std::lock_guard<std::mutex> guard(lock_);
+
+    if (stats_.live_objects > 0) {
+        LOG(ERROR) << "Destroying allocator with " << stats_.live_objects << " live objects";
+    }
+
+    for (Slab* list : {available_, full_}) {
+        while (list != nullptr) {
+            Slab* next = list->next;
+            if (list->live == 0) {
+                free(list);
+            } else {
+                // Leak it, but make sure freeing its remaining objects doesn't touch this
+                // allocator.
+                list->owner = nullptr;
+            }
+            list = next;
+        }
+    }
+}
+
+void* SlabAllocator::Allocate(size_t size) {
+    CHECK(size <= object_size_) << "Cannot allocate " << size << " bytes from a slab of "
+                                << object_size_ << " byte objects";
+
+    std::lock_guard<std::mutex> guard(lock_);
+
+    Slab* slab = available_;
+    if (slab == nullptr) {
+        slab = NewSlab();
+        LinkLocked(&available_, slab);
+        empty_slabs_++;
+    }
+
+    void* ptr;
+    if (slab->free_list != nullptr) {
+        ptr = slab->free_list;
+        slab->free_list = *reinterpret_cast<void**>(ptr);
+    } else {
+        ptr = slab->objects() + slab->next_unused * object_size_;
+        slab->next_unused++;
+    }
+
+    if (slab->live++ == 0) {
+        empty_slabs_--;
+    }
+    if (slab->live == objects_per_slab_) {
+        UnlinkLocked(&available_, slab);
+        LinkLocked(&full_, slab);
+    }
+
+    stats_.live_objects++;
+    stats_.allocations++;
+    return ptr;
+}
+
+// static
+void SlabAllocator::Free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(kSlabSize - 1));
+    SlabAllocator* owner = slab->owner;
+    if (owner == nullptr) {
+        // The allocator was destroyed while this object was still alive.
+        if (--slab->live == 0) {
+            free(slab);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(owner->lock_);
+    owner->FreeLocked(slab, ptr);
+}
+
+bool SlabAllocator::Contains(const void* ptr) const {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    const Slab* slab = reinterpret_cast<const Slab*>(address & ~(kSlabSize - 1));
+
+    std::lock_guard<std::mutex> guard(lock_);
+    if (slabs_.find(slab) == slabs_.end()) {
+        return false;
+    }
+    const uintptr_t objects = reinterpret_cast<uintptr_t>(slab) + AlignUp(sizeof(Slab));
+    return address >= objects && (address - objects) % object_size_ == 0 &&
+           (address - objects) / object_size_ < slab->next_unused;
+}
+
+SlabAllocator::Stats SlabAllocator::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+SlabAllocator::Slab* SlabAllocator::NewSlab() {
+    void* memory = aligned_alloc(kSlabSize, kSlabSize);
+    CHECK(memory != nullptr) << "Failed to allocate slab";
+
+    Slab* slab = static_cast<Slab*>(memory);
+    slab->owner = this;
+    slab->prev = nullptr;
+    slab->next = nullptr;
+    slab->free_list = nullptr;
+    slab->next_unused = 0;
+    slab->live = 0;
+
+    slabs_.insert(slab);
+    stats_.slabs++;
+    return slab;
+}
+
+void SlabAllocator::FreeLocked(Slab* slab, void* ptr) {
+    CHECK(slab->live > 0);
+
+    *reinterpret_cast<void**>(ptr) = slab->free_list;
+    slab->free_list = ptr;
+
+    if (slab->live-- == objects_per_slab_) {
+        UnlinkLocked(&full_, slab);
+        LinkLocked(&available_, slab);
+    }
+    stats_.live_objects--;
+
+    if (slab->live == 0) {
+        if (empty_slabs_ < max_empty_slabs_) {
+            empty_slabs_++;
+        } else {
+            UnlinkLocked(&available_, slab);
+            slabs_.erase(slab);
+            free(slab);
+            stats_.slabs--;
+        }
+    }
+}
+
+// static
+void SlabAllocator::LinkLocked(Slab** list, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = *list;
+    if (*list != nullptr) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+// static
+void SlabAllocator::UnlinkLocked(Slab** list, Slab* slab) {
+    if (slab->prev != nullptr) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next != nullptr) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = nullptr;
+    slab->next = nullptr;
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
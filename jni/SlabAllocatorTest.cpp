@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SlabAllocatorTest"
+
+#include "libfuse_jni/SlabAllocator.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mediaprovider::fuse {
+
+TEST(SlabAllocatorTest, reusesAndReclaimsSlabs) {
+    const size_t object_size = 96;
+    SlabAllocator allocator(object_size, 1 /* max_empty_slabs */);
+    std::vector<void*> objects;
+
+    // Fill a few slabs.
+    const size_t per_slab = SlabAllocator::kSlabSize / object_size;
+    for (size_t i = 0; i < 4 * per_slab; i++) {
+        void* ptr = allocator.Allocate(object_size);
+        ASSERT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % alignof(std::max_align_t));
+        objects.push_back(ptr);
+    }
+    const size_t slabs = allocator.GetStats().slabs;
+    ASSERT_GE(slabs, 4);
+    ASSERT_EQ(objects.size(), allocator.GetStats().live_objects);
+
+    // Freed objects are reused before any new slab is allocated.
+    SlabAllocator::Free(objects.back());
+    objects.back() = allocator.Allocate(object_size);
+    ASSERT_EQ(slabs, allocator.GetStats().slabs);
+
+    // Once all objects are freed, only one empty slab is kept around.
+    for (void* ptr : objects) {
+        SlabAllocator::Free(ptr);
+    }
+    ASSERT_EQ(0, allocator.GetStats().live_objects);
+    ASSERT_EQ(1, allocator.GetStats().slabs);
+    ASSERT_EQ(objects.size() + 1, allocator.GetStats().allocations);
+}
+
+TEST(SlabAllocatorTest, contains) {
+    const size_t object_size = 96;
+    SlabAllocator allocator(object_size, 0 /* max_empty_slabs */);
+    char* first = static_cast<char*>(allocator.Allocate(object_size));
+    char* second = static_cast<char*>(allocator.Allocate(object_size));
+
+    ASSERT_TRUE(allocator.Contains(first));
+    ASSERT_TRUE(allocator.Contains(second));
+    // Freed objects can still be read while their slab is around.
+    SlabAllocator::Free(second);
+    ASSERT_TRUE(allocator.Contains(second));
+    // Not the start of an object, nor one handed out yet.
+    ASSERT_FALSE(allocator.Contains(first + 8));
+    ASSERT_FALSE(allocator.Contains(first + 2 * allocator.object_size()));
+    int not_an_object = 0;
+    ASSERT_FALSE(allocator.Contains(&not_an_object));
+
+    // The slab is gone once empty.
+    SlabAllocator::Free(first);
+    ASSERT_FALSE(allocator.Contains(first));
+}
+
+}  // namespace mediaprovider::fuse
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/libfuse_jni/TransformScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace mediaprovider {
+namespace fuse {
+
+TransformScheduler::~TransformScheduler() {
+    std::unique_lock<std::mutex> lock(lock_);
+    stopping_ = true;
+    for (auto& [ino, task] : queue_) {
+        if (task->state == Task::State::queued) {
+            task->state = Task::State::done;
+            stats_.queue_depth--;
+        }
+    }
+    queue_.clear();
+    cond_.notify_all();
+    cond_.wait(lock, [this] { return threads_ == 0; });
+}
+
+bool TransformScheduler::Run(uint64_t ino, Transform transform) {
+    std::unique_lock<std::mutex> lock(lock_);
+    auto it = tasks_.find(ino);
+    if (it == tasks_.end()) {
+        auto task = std::make_shared<Task>();
+        task->transform = std::move(transform);
+        task->state = Task::State::running;
+        tasks_.emplace(ino, task);
+        return RunTaskLocked(&lock, ino, task);
+    }
+
+    std::shared_ptr<Task> task = it->second;
+    stats_.coalesced++;
+    if (task->state == Task::State::queued) {
+        // Don't wait behind the other queued transforms, the background thread will skip it.
+        task->state = Task::State::running;
+        stats_.queue_depth--;
+        return RunTaskLocked(&lock, ino, task);
+    }
+
+    cond_.wait(lock, [&task] { return task->state == Task::State::done; });
+    // The caller now knows the result, so a prefetched result needn't be kept any longer.
+    it = tasks_.find(ino);
+    if (it != tasks_.end() && it->second == task) {
+        tasks_.erase(it);
+    }
+    return task->result;
+}
+
+void TransformScheduler::Prefetch(uint64_t ino, Transform transform) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stopping_ || tasks_.count(ino)) {
+        return;
+    }
+
+    auto task = std::make_shared<Task>();
+    task->transform = std::move(transform);
+    task->prefetched = true;
+    tasks_.emplace(ino, task);
+    queue_.emplace_back(ino, std::move(task));
+    stats_.prefetches++;
+    stats_.queue_depth++;
+    stats_.peak_queue_depth = std::max(stats_.peak_queue_depth, stats_.queue_depth);
+
+    if (threads_ < max_threads_) {
+        threads_++;
+        std::thread(&TransformScheduler::WorkerLoop, this).detach();
+    }
+}
+
+void TransformScheduler::Forget(uint64_t ino) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = tasks_.find(ino);
+    if (it == tasks_.end()) {
+        return;
+    }
+    if (it->second->state == Task::State::queued) {
+        it->second->state = Task::State::done;
+        stats_.queue_depth--;
+        cond_.notify_all();
+    }
+    tasks_.erase(it);
+}
+
+bool TransformScheduler::RunTaskLocked(std::unique_lock<std::mutex>* lock, uint64_t ino,
+                                       const std::shared_ptr<Task>& task) {
+    lock->unlock();
+    const auto start = std::chrono::steady_clock::now();
+    const bool result = task->transform();
+    latency_.Record(std::chrono::steady_clock::now() - start);
+    lock->lock();
+
+    stats_.runs++;
+    if (!result) {
+        stats_.failures++;
+    }
+    task->result = result;
+    task->state = Task::State::done;
+    task->transform = nullptr;
+    // Keep a successful prefetched result for Run() to find, drop anything else so that failed
+    // transforms are retried.
+    if (!result || !task->prefetched) {
+        auto it = tasks_.find(ino);
+        if (it != tasks_.end() && it->second == task) {
+            tasks_.erase(it);
+        }
+    }
+    cond_.notify_all();
+    return result;
+}
+
+void TransformScheduler::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!queue_.empty()) {
+        auto [ino, task] = std::move(queue_.front());
+        queue_.pop_front();
+        if (task->state != Task::State::queued) {
+            continue;
+        }
+        task->state = Task::State::running;
+        stats_.queue_depth--;
+        RunTaskLocked(&lock, ino, task);
+    }
+    threads_--;
+    cond_.notify_all();
+}
+
+TransformScheduler::Stats TransformScheduler::GetStats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+std::string TransformScheduler::Dump() const {
+    const Stats stats = GetStats();
+    if (stats.runs + stats.coalesced == 0) {
+        return "";
+    }
+    std::ostringstream os;
+    os << "transforms: runs=" << stats.runs << " prefetches=" << stats.prefetches
+       << " coalesced=" << stats.coalesced << " failures=" << stats.failures
+       << " queue_depth=" << stats.queue_depth << " peak_queue_depth=" << stats.peak_queue_depth
+       << " p50_us<=" << latency_.PercentileUpperBoundUs(50)
+       << " p99_us<=" << latency_.PercentileUpperBoundUs(99) << "\n";
+    return os.str();
+}
+
+}  // namespace fuse
+}  // namespace mediaprovider
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransformSchedulerTest"
+
+#include "libfuse_jni/TransformScheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mediaprovider::fuse {
+
+TEST(TransformSchedulerTest, coalescesConcurrentRuns) {
+    TransformScheduler scheduler;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool release = false;
+    std::atomic<int> calls = 0;
+    auto transform = [&] {
+        calls++;
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&] { return release; });
+        return true;
+    };
+
+    std::vector<std::thread> readers;
+    std::atomic<int> succeeded = 0;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&] {
+            if (scheduler.Run(1, transform)) succeeded++;
+        });
+    }
+    // Wait for all readers to be either running or waiting for the transform.
+    while (calls + scheduler.GetStats().coalesced < 4) std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        release = true;
+    }
+    cond.notify_all();
+    for (std::thread& reader : readers) reader.join();
+
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(4, succeeded);
+    ASSERT_EQ(1, scheduler.GetStats().runs);
+    ASSERT_EQ(3, scheduler.GetStats().coalesced);
+
+    // The transform is done and forgotten, a failed one is retried.
+    ASSERT_FALSE(scheduler.Run(1, [] { return false; }));
+    ASSERT_FALSE(scheduler.Run(1, [] { return false; }));
+    ASSERT_EQ(3, scheduler.GetStats().runs);
+    ASSERT_EQ(2, scheduler.GetStats().failures);
+}
+
+TEST(TransformSchedulerTest, prefetch) {
+    TransformScheduler scheduler(1);
+    std::atomic<int> calls = 0;
+    auto transform = [&] {
+        calls++;
+        return true;
+    };
+
+    scheduler.Prefetch(1, transform);
+    // Already queued or done.
+    scheduler.Prefetch(1, transform);
+    // Runs the prefetched transform or waits for its result, without transforming again.
+    ASSERT_TRUE(scheduler.Run(1, transform));
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(1, scheduler.GetStats().prefetches);
+    ASSERT_EQ(1, scheduler.GetStats().coalesced);
+    ASSERT_EQ(0, scheduler.GetStats().queue_depth);
+
+    // A forgotten node is transformed again.
+    scheduler.Prefetch(2, transform);
+    scheduler.Forget(2);
+    ASSERT_TRUE(scheduler.Run(2, transform));
+    ASSERT_LE(2, calls);
+    ASSERT_GE(3, calls);
+}
+
+}  // namespace mediaprovider::fuse
@@ -169,6 +169,46 @@ void com_android_providers_media_FuseDaemon_invalidate_fuse_dentry_cache(JNIEnv*
     // TODO(b/145741152): Throw exception
 }
 
+void com_android_providers_media_FuseDaemon_flush_fuse_dentry_invalidations(JNIEnv* env,
+                                                                           jobject self,
+                                                                           jlong java_daemon) {
+    fuse::FuseDaemon* const daemon = reinterpret_cast<fuse::FuseDaemon*>(java_daemon);
+    if (daemon) {
+        CHECK(pthread_getspecific(fuse::MediaProviderWrapper::gJniEnvKey) == nullptr);
+        daemon->FlushFuseDentryInvalidations();
+    }
+}
+
+void com_android_providers_media_FuseDaemon_invalidate_file_lookup_cache(JNIEnv* env,
+                                                                          jobject self,
+                                                                          jlong java_daemon,
+                                                                          jstring java_path) {
+    fuse::FuseDaemon* const daemon = reinterpret_cast<fuse::FuseDaemon*>(java_daemon);
+    if (daemon) {
+        if (!java_path) {
+            daemon->InvalidateFileLookupCache("");
+            return;
+        }
+
+        ScopedUtfChars utf_chars_path(env, java_path);
+        if (!utf_chars_path.c_str()) {
+            // TODO(b/145741152): Throw exception
+            return;
+        }
+        daemon->InvalidateFileLookupCache(utf_chars_path.c_str());
+    }
+    // TODO(b/145741152): Throw exception
+}
+
+void com_android_providers_media_FuseDaemon_invalidate_access_decision_cache(JNIEnv* env,
+                                                                             jobject self,
+                                                                             jlong java_daemon) {
+    fuse::FuseDaemon* const daemon = reinterpret_cast<fuse::FuseDaemon*>(java_daemon);
+    if (daemon) {
+        daemon->InvalidateAccessDecisionCache();
+    }
+}
+
 jobject com_android_providers_media_FuseDaemon_check_fd_access(JNIEnv* env, jobject self,
                                                                jlong java_daemon, jint fd,
                                                                jint uid) {
@@ -255,6 +295,21 @@ jobjectArray com_android_providers_media_FuseDaemon_read_backed_up_file_paths(
                                                   utf_chars_lastReadValue.c_str(), limit));
 }
 
+jobjectArray com_android_providers_media_FuseDaemon_read_backed_up_entries(
+        JNIEnv* env, jobject self, jlong java_daemon, jstring volumeName, jstring lastReadValue,
+        jint limit) {
+    fuse::FuseDaemon* const daemon = reinterpret_cast<fuse::FuseDaemon*>(java_daemon);
+    ScopedUtfChars utf_chars_volumeName(env, volumeName);
+    ScopedUtfChars utf_chars_lastReadValue(env, lastReadValue);
+    if (!utf_chars_volumeName.c_str()) {
+        LOG(WARNING) << "Couldn't initialise FUSE device id";
+        return nullptr;
+    }
+    return convert_string_vector_to_object_array(
+            env, daemon->ReadBackedUpEntriesFromLevelDb(utf_chars_volumeName.c_str(),
+                                                        utf_chars_lastReadValue.c_str(), limit));
+}
+
 jstring com_android_providers_media_FuseDaemon_read_backed_up_data(JNIEnv* env, jobject self,
                                                                    jlong java_daemon,
                                                                    jstring java_path) {
@@ -320,6 +375,15 @@ void com_android_providers_media_FuseDaemon_remove_owner_id_relation(JNIEnv* env
                                   utf_chars_owner_pkg_identifier.c_str());
 }
 
+jstring com_android_providers_media_FuseDaemon_dump_stats(JNIEnv* env, jobject self,
+                                                         jlong java_daemon) {
+    fuse::FuseDaemon* const daemon = reinterpret_cast<fuse::FuseDaemon*>(java_daemon);
+    if (!daemon) {
+        return env->NewStringUTF("");
+    }
+    return env->NewStringUTF(daemon->DumpStats().c_str());
+}
+
 const JNINativeMethod methods[] = {
         {"native_new", "(Lcom/android/providers/media/MediaProvider;)J",
          reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_new)},
@@ -338,6 +402,17 @@ const JNINativeMethod methods[] = {
         {"native_invalidate_fuse_dentry_cache", "(JLjava/lang/String;)V",
          reinterpret_cast<void*>(
                  com_android_providers_media_FuseDaemon_invalidate_fuse_dentry_cache)},
+        {"native_flush_fuse_dentry_invalidations", "(J)V",
+         reinterpret_cast<void*>(
+                 com_android_providers_media_FuseDaemon_flush_fuse_dentry_invalidations)},
+        {"native_invalidate_file_lookup_cache", "(JLjava/lang/String;)V",
+         reinterpret_cast<void*>(
+                 com_android_providers_media_FuseDaemon_invalidate_file_lookup_cache)},
+        {"native_invalidate_access_decision_cache", "(J)V",
+         reinterpret_cast<void*>(
+                 com_android_providers_media_FuseDaemon_invalidate_access_decision_cache)},
+        {"native_dump_stats", "(J)Ljava/lang/String;",
+         reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_dump_stats)},
         {"native_check_fd_access", "(JII)Lcom/android/providers/media/FdAccessResult;",
          reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_check_fd_access)},
         {"native_initialize_device_id", "(JLjava/lang/String;)V",
@@ -355,6 +430,9 @@ const JNINativeMethod methods[] = {
         {"native_read_backed_up_file_paths",
          "(JLjava/lang/String;Ljava/lang/String;I)[Ljava/lang/String;",
          reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_read_backed_up_file_paths)},
+        {"native_read_backed_up_entries",
+         "(JLjava/lang/String;Ljava/lang/String;I)[Ljava/lang/String;",
+         reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_read_backed_up_entries)},
         {"native_read_backed_up_data", "(JLjava/lang/String;)Ljava/lang/String;",
          reinterpret_cast<void*>(com_android_providers_media_FuseDaemon_read_backed_up_data)},
         {"native_read_ownership", "(JLjava/lang/String;)Ljava/lang/String;",
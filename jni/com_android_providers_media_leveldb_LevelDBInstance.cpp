@@ -2,6 +2,8 @@
 #include <nativehelper/scoped_utf_chars.h>
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+#include "libfuse_jni/LevelDbOptions.h"
 
 #ifndef _Included_com_android_providers_media_leveldb_LevelDBInstance
 #define _Included_com_android_providers_media_leveldb_LevelDBInstance
@@ -23,25 +25,61 @@ static std::string getStatusCode(leveldb::Status status) {
     }
 }
 
-static jobject createLevelDBResult(JNIEnv* env, leveldb::Status status, std::string value) {
+// Class and fields of LevelDBResult, looked up once per call rather than once per result.
+struct LevelDBResultClass {
+    jclass clazz;
+    jfieldID codeField;
+    jfieldID messageField;
+    jfieldID valueField;
+};
+
+static LevelDBResultClass getLevelDBResultClass(JNIEnv* env) {
+    LevelDBResultClass resultClass;
+    resultClass.clazz = env->FindClass("com/android/providers/media/leveldb/LevelDBResult");
+    resultClass.codeField = env->GetFieldID(resultClass.clazz, "mCode", "Ljava/lang/String;");
+    resultClass.messageField =
+            env->GetFieldID(resultClass.clazz, "mErrorMessage", "Ljava/lang/String;");
+    resultClass.valueField = env->GetFieldID(resultClass.clazz, "mValue", "Ljava/lang/String;");
+    return resultClass;
+}
+
+// Helper to set a String field of |object|, without leaking a local reference to the string.
+static void setStringField(JNIEnv* env, jobject object, jfieldID field, const std::string& value) {
+    jstring jvalue = env->NewStringUTF(value.c_str());
+    env->SetObjectField(object, field, jvalue);
+    env->DeleteLocalRef(jvalue);
+}
+
+static jobject newLevelDBResult(JNIEnv* env, const LevelDBResultClass& resultClass,
+                                leveldb::Status status, const std::string& value) {
     // Create the object of the class LevelDBResult
-    jclass levelDbResultClass = env->FindClass("com/android/providers/media/leveldb/LevelDBResult");
-    jobject levelDbResultData = env->AllocObject(levelDbResultClass);
-
-    // Get the UserData fields to be set
-    jfieldID codeField = env->GetFieldID(levelDbResultClass, "mCode", "Ljava/lang/String;");
-    jfieldID messageField =
-            env->GetFieldID(levelDbResultClass, "mErrorMessage", "Ljava/lang/String;");
-    jfieldID valueField = env->GetFieldID(levelDbResultClass, "mValue", "Ljava/lang/String;");
-
-    std::string statusCode = getStatusCode(status);
-    env->SetObjectField(levelDbResultData, codeField, env->NewStringUTF(statusCode.c_str()));
-    env->SetObjectField(levelDbResultData, messageField,
-                        env->NewStringUTF(status.ToString().c_str()));
-    env->SetObjectField(levelDbResultData, valueField, env->NewStringUTF(value.c_str()));
+    jobject levelDbResultData = env->AllocObject(resultClass.clazz);
+
+    setStringField(env, levelDbResultData, resultClass.codeField, getStatusCode(status));
+    setStringField(env, levelDbResultData, resultClass.messageField, status.ToString());
+    setStringField(env, levelDbResultData, resultClass.valueField, value);
     return levelDbResultData;
 }
 
+static jobject createLevelDBResult(JNIEnv* env, leveldb::Status status, std::string value) {
+    return newLevelDBResult(env, getLevelDBResultClass(env), status, value);
+}
+
+// Adds the key and value of |leveldbentry| to |batch|, using the LevelDBEntry getters
+// |getKeyMethodId| and |getValueMethodId|.
+static void addToWriteBatch(JNIEnv* env, jobject leveldbentry, jmethodID getKeyMethodId,
+                            jmethodID getValueMethodId, leveldb::WriteBatch* batch) {
+    jstring key = (jstring)env->CallObjectMethod(leveldbentry, getKeyMethodId);
+    jstring value = (jstring)env->CallObjectMethod(leveldbentry, getValueMethodId);
+    {
+        ScopedUtfChars utf_chars_key(env, key);
+        ScopedUtfChars utf_chars_value(env, value);
+        batch->Put(utf_chars_key.c_str(), utf_chars_value.c_str());
+    }
+    env->DeleteLocalRef(key);
+    env->DeleteLocalRef(value);
+}
+
 static leveldb::Status insertInLevelDB(JNIEnv* env, jobject obj, jlong leveldbptr,
                                        jobject leveldbentry) {
     jclass levelDbEntryClass = env->GetObjectClass(leveldbentry);
@@ -73,8 +111,9 @@ JNIEXPORT jlong JNICALL
             Java_com_android_providers_media_leveldb_LevelDBInstance_nativeCreateInstance(
                 JNIEnv* env, jclass leveldbInstanceClass, jstring path) {
     ScopedUtfChars utf_chars_path(env, path);
-    leveldb::Options options;
-    options.create_if_missing = true;
+    // These instances hold the backup of the whole external storage, see BackupExecutor.
+    const leveldb::Options options =
+            mediaprovider::fuse::GetLevelDbOptions(mediaprovider::fuse::LevelDbRole::backup);
     leveldb::DB* leveldb;
     leveldb::Status status = leveldb::DB::Open(options, utf_chars_path.c_str(), &leveldb);
     if (status.ok()) {
@@ -100,6 +139,44 @@ JNIEXPORT jobject JNICALL Java_com_android_providers_media_leveldb_LevelDBInstan
     return createLevelDBResult(env, status, value);
 }
 
+/*
+ * Class:     com_android_providers_media_leveldb_LevelDBInstance
+ * Method:    nativeBulkQuery
+ * Signature: (J[Ljava/lang/String;)[Lcom/android/providers/media/leveldb/LevelDBResult;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_android_providers_media_leveldb_LevelDBInstance_nativeBulkQuery(
+        JNIEnv* env, jobject obj, jlong leveldbptr, jobjectArray keys) {
+    const LevelDBResultClass resultClass = getLevelDBResultClass(env);
+    const jsize length = env->GetArrayLength(keys);
+    jobjectArray results = env->NewObjectArray(length, resultClass.clazz, nullptr);
+    if (results == nullptr) {
+        return nullptr;
+    }
+
+    leveldb::DB* leveldb = reinterpret_cast<leveldb::DB*>(leveldbptr);
+    // All keys are read from the same snapshot, so that concurrent writes can't make the results
+    // inconsistent with each other.
+    const leveldb::Snapshot* snapshot = leveldb->GetSnapshot();
+    leveldb::ReadOptions options;
+    options.snapshot = snapshot;
+    std::string value;
+    for (jsize i = 0; i < length; i++) {
+        jstring key = (jstring)env->GetObjectArrayElement(keys, i);
+        leveldb::Status status;
+        value.clear();
+        {
+            ScopedUtfChars utf_chars_key(env, key);
+            status = leveldb->Get(options, utf_chars_key.c_str(), &value);
+        }
+        jobject result = newLevelDBResult(env, resultClass, status, value);
+        env->SetObjectArrayElement(results, i, result);
+        env->DeleteLocalRef(result);
+        env->DeleteLocalRef(key);
+    }
+    leveldb->ReleaseSnapshot(snapshot);
+    return results;
+}
+
 /*
  * Class:     com_android_providers_media_leveldb_LevelDBInstance
  * Method:    nativeInsert
@@ -134,17 +211,24 @@ JNIEXPORT jobject JNICALL Java_com_android_providers_media_leveldb_LevelDBInstan
     jmethodID hasNextMethod = env->GetMethodID(iteratorClass, "hasNext", "()Z");
     jmethodID nextMethod = env->GetMethodID(iteratorClass, "next", "()Ljava/lang/Object;");
 
-    leveldb::Status status;
+    jclass levelDbEntryClass =
+            env->FindClass("com/android/providers/media/leveldb/LevelDBEntry");
+    jmethodID getKeyMethodId =
+            env->GetMethodID(levelDbEntryClass, "getKey", "()Ljava/lang/String;");
+    jmethodID getValueMethodId =
+            env->GetMethodID(levelDbEntryClass, "getValue", "()Ljava/lang/String;");
 
-    // Iterate through the list
+    // Collect all entries and commit them with a single write, so that the chunk is inserted
+    // atomically and with one log write rather than one per entry.
+    leveldb::WriteBatch batch;
     while (env->CallBooleanMethod(iterator, hasNextMethod)) {
         jobject jLevelDBEntryObject = env->CallObjectMethod(iterator, nextMethod);
-        leveldb::Status status = insertInLevelDB(env, obj, leveldbptr, jLevelDBEntryObject);
-        if (!status.ok()) {
-            break;
-        }
+        addToWriteBatch(env, jLevelDBEntryObject, getKeyMethodId, getValueMethodId, &batch);
+        env->DeleteLocalRef(jLevelDBEntryObject);
     }
 
+    leveldb::DB* leveldb = reinterpret_cast<leveldb::DB*>(leveldbptr);
+    leveldb::Status status = leveldb->Write(leveldb::WriteOptions(), &batch);
     return createLevelDBResult(env, status, "");
 }
 
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of the node tree, redaction and readdir hot paths of the FUSE daemon.
+//
+// All inputs are synthetic and fully deterministic (fixed sizes, names and offsets), so that
+// results of different builds can be compared directly, e.g. with
+// `fuse_benchmark --benchmark_repetitions=10 --benchmark_format=json` and compare.py.
+
+#define LOG_TAG "FuseBenchmark"
+
+#include <benchmark/benchmark.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+
+#include "libfuse_jni/FuseUtils.h"
+#include "libfuse_jni/ReaddirHelper.h"
+#include "libfuse_jni/RedactionInfo.h"
+#include "node-inl.h"
+
+using mediaprovider::fuse::addDirectoryEntriesFromLowerFs;
+using mediaprovider::fuse::classifyStoragePath;
+using mediaprovider::fuse::DirectoryEntries;
+using mediaprovider::fuse::node;
+using mediaprovider::fuse::NodeTracker;
+using mediaprovider::fuse::ReadRange;
+using mediaprovider::fuse::RecursiveSharedMutex;
+using mediaprovider::fuse::RedactionInfo;
+using mediaprovider::fuse::StoragePath;
+
+namespace {
+
+// A tree of nodes owned by the fixture, deleted along with it.
+class Tree {
+  public:
+    Tree() : tracker_(&lock_) {
+        root_ = node::CreateRoot("/storage/emulated/0", &lock_, 1 /* ino */, &tracker_);
+    }
+
+    ~Tree() { node::DeleteTree(root_); }
+
+    node* root() const { return root_; }
+
+    node* Add(node* parent, const std::string& name, int transforms = 0) {
+        return node::Create(parent, name, "", true /* transforms_complete */, transforms,
+                            0 /* transforms_reason */, &lock_, 0 /* ino */, &tracker_);
+    }
+
+    // Adds a chain of |depth| directories under the root and returns the deepest one.
+    node* AddChain(int depth) {
+        node* n = root_;
+        for (int i = 0; i < depth; ++i) {
+            n = Add(n, "dir" + std::to_string(i));
+        }
+        return n;
+    }
+
+  private:
+    RecursiveSharedMutex lock_;
+    NodeTracker tracker_;
+    node* root_;
+};
+
+// Returns names like the ones of a camera directory: IMG_20240101_000123.jpg.
+std::string FileName(int i) {
+    std::string index = std::to_string(i);
+    return "IMG_20240101_" + std::string(6 - std::min<size_t>(6, index.size()), '0') + index +
+           ".jpg";
+}
+
+// Looks up the children of a directory of |range(0)| files, in a fixed pseudo-random order.
+void BM_LookupChildByName_WideDir(benchmark::State& state) {
+    const int num_children = state.range(0);
+    Tree tree;
+    std::vector<std::string> names;
+    for (int i = 0; i < num_children; ++i) {
+        names.push_back(FileName(i));
+        tree.Add(tree.root(), names.back());
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        // 7919 is prime, so this visits every child before repeating.
+        i = (i + 7919) % names.size();
+        benchmark::DoNotOptimize(tree.root()->LookupChildByName(names[i], false /* acquire */));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupChildByName_WideDir)->RangeMultiplier(8)->Range(8, 32768);
+
+// Looks up names differing only in case from the stored ones.
+void BM_LookupChildByName_CaseInsensitive(benchmark::State& state) {
+    const int num_children = state.range(0);
+    Tree tree;
+    std::vector<std::string> names;
+    for (int i = 0; i < num_children; ++i) {
+        std::string name = FileName(i);
+        tree.Add(tree.root(), name);
+        for (char& c : name) {
+            if (c >= 'a' && c <= 'z') {
+                c = c - 'a' + 'A';
+            } else if (c >= 'A' && c <= 'Z') {
+                c = c - 'A' + 'a';
+            }
+        }
+        names.push_back(name);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        i = (i + 7919) % names.size();
+        benchmark::DoNotOptimize(tree.root()->LookupChildByName(names[i], false /* acquire */));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupChildByName_CaseInsensitive)->Arg(1024);
+
+// Looks up one name shared by |range(0)| nodes that differ only in their transforms, matching
+// the last one created.
+void BM_LookupChildByName_TransformVariants(benchmark::State& state) {
+    const int num_variants = state.range(0);
+    Tree tree;
+    for (int i = 0; i < 1024; ++i) {
+        tree.Add(tree.root(), FileName(i));
+    }
+    for (int i = 1; i <= num_variants; ++i) {
+        tree.Add(tree.root(), "VID_20240101_000001.mp4", i);
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.root()->LookupChildByName(
+                "VID_20240101_000001.mp4", false /* acquire */, num_variants));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupChildByName_TransformVariants)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+// Builds the path of a node |range(0)| levels below the root.
+void BM_BuildPath(benchmark::State& state) {
+    Tree tree;
+    node* leaf = tree.AddChain(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(leaf->BuildPath());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildPath)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+// Same as BM_BuildPath, but renames the top directory before every iteration, so that every
+// path is built again from scratch.
+void BM_BuildPath_AfterRename(benchmark::State& state) {
+    Tree tree;
+    node* leaf = tree.AddChain(state.range(0));
+    node* top = tree.root()->LookupChildByName("dir0", false /* acquire */);
+
+    int i = 0;
+    for (auto _ : state) {
+        top->Rename("dir0_" + std::to_string(i++ % 2), tree.root());
+        benchmark::DoNotOptimize(leaf->BuildPath());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildPath_AfterRename)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+// Builds the logging-safe path of a node |range(0)| levels below the root.
+void BM_BuildSafePath(benchmark::State& state) {
+    Tree tree;
+    node* leaf = tree.AddChain(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(leaf->BuildSafePath());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildSafePath)->Arg(4)->Arg(16);
+
+// Resolves the absolute path of a file in a directory of 1024 files, |range(0)| levels below
+// the root.
+void BM_LookupAbsolutePath(benchmark::State& state) {
+    Tree tree;
+    node* dir = tree.AddChain(state.range(0));
+    for (int i = 0; i < 1024; ++i) {
+        tree.Add(dir, FileName(i));
+    }
+    const std::string path = dir->BuildPath() + "/" + FileName(512);
+    CHECK(node::LookupAbsolutePath(tree.root(), path) != nullptr);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node::LookupAbsolutePath(tree.root(), path));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupAbsolutePath)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+// Paths the access checks of a lookup classify, from shallow to deep.
+const char* const kAccessCheckPaths[] = {
+        "/storage/emulated/0/DCIM/Camera/IMG_20240101_000123.jpg",
+        "/storage/emulated/0/Android/data/com.example.app/files/Pictures/IMG_0001.jpg",
+        "/storage/emulated/10/Download",
+        "/storage/1234-ABCD/Android/obb",
+};
+
+// The access checks of a lookup as they used to be done, with the regular expressions
+// classifyStoragePath() replaced: an owned path match and a search for the user id.
+void BM_ClassifyStoragePath_Regex(benchmark::State& state) {
+    const std::regex owned("^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)/([^/]+)(/?.*)?",
+                           std::regex_constants::icase);
+    const std::regex storage_emulated("^\\/storage\\/emulated\\/([0-9]+)");
+    const std::string path = kAccessCheckPaths[state.range(0)];
+
+    for (auto _ : state) {
+        std::smatch match;
+        benchmark::DoNotOptimize(std::regex_match(path, match, owned));
+        benchmark::DoNotOptimize(std::regex_search(path, match, storage_emulated));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClassifyStoragePath_Regex)->DenseRange(0, 3);
+
+// Same as BM_ClassifyStoragePath_Regex, with classifyStoragePath().
+void BM_ClassifyStoragePath(benchmark::State& state) {
+    const std::string path = kAccessCheckPaths[state.range(0)];
+
+    for (auto _ : state) {
+        const StoragePath storage_path = classifyStoragePath(path);
+        benchmark::DoNotOptimize(storage_path.IsPackageOwned());
+        benchmark::DoNotOptimize(storage_path.user_id);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClassifyStoragePath)->DenseRange(0, 3);
+
+// Returns |num_ranges| redaction ranges of 16 bytes every 4KiB, like the metadata of a large
+// image or video.
+std::unique_ptr<RedactionInfo> MakeRedactionInfo(int num_ranges) {
+    std::vector<off64_t> ranges;
+    for (int i = 0; i < num_ranges; ++i) {
+        ranges.push_back(off64_t(i) * 4096 + 100);
+        ranges.push_back(off64_t(i) * 4096 + 116);
+    }
+    return std::make_unique<RedactionInfo>(num_ranges, ranges.data());
+}
+
+// Reads a file with |range(0)| redaction ranges sequentially, |range(1)| bytes at a time.
+void BM_GetReadRanges_Sequential(benchmark::State& state) {
+    const int num_ranges = state.range(0);
+    const size_t size = state.range(1);
+    std::unique_ptr<RedactionInfo> ri = MakeRedactionInfo(num_ranges);
+    const off64_t file_size = off64_t(num_ranges) * 4096;
+
+    std::vector<ReadRange> out;
+    off64_t off = 0;
+    for (auto _ : state) {
+        out.clear();
+        ri->getReadRanges(off, size, &out);
+        benchmark::DoNotOptimize(out.data());
+        off = (off + size) % file_size;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_GetReadRanges_Sequential)->ArgsProduct({{1, 64, 4096}, {4096, 128 * 1024}});
+
+// Same as BM_GetReadRanges_Sequential, but at fixed pseudo-random offsets.
+void BM_GetReadRanges_Random(benchmark::State& state) {
+    const int num_ranges = state.range(0);
+    const size_t size = state.range(1);
+    std::unique_ptr<RedactionInfo> ri = MakeRedactionInfo(num_ranges);
+    const off64_t file_size = off64_t(num_ranges) * 4096;
+
+    std::vector<ReadRange> out;
+    uint64_t seed = 1;
+    for (auto _ : state) {
+        // Linear congruential generator, so that offsets are the same for every run.
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        const off64_t off = (seed >> 33) % file_size;
+        out.clear();
+        ri->getReadRanges(off, size, &out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_GetReadRanges_Random)->ArgsProduct({{1, 64, 4096}, {4096, 128 * 1024}});
+
+// Lists a lower filesystem directory of |range(0)| files.
+void BM_AddDirectoryEntriesFromLowerFs(benchmark::State& state) {
+    const int num_files = state.range(0);
+    const char* tmpdir = getenv("TMPDIR");
+    std::string dir_path = std::string(tmpdir != nullptr ? tmpdir : "/data/local/tmp") +
+                           "/fuse_benchmark_XXXXXX";
+    if (mkdtemp(dir_path.data()) == nullptr) {
+        state.SkipWithError("Failed to create temporary directory");
+        return;
+    }
+    for (int i = 0; i < num_files; ++i) {
+        const std::string path = dir_path + "/" + FileName(i);
+        close(open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600));
+    }
+
+    DIR* dirp = opendir(dir_path.c_str());
+    CHECK(dirp != nullptr);
+    DirectoryEntries entries;
+    for (auto _ : state) {
+        entries.clear();
+        rewinddir(dirp);
+        addDirectoryEntriesFromLowerFs(dirp, nullptr /* filter */, &entries);
+        CHECK_EQ(entries.size(), size_t(num_files));
+    }
+    state.SetItemsProcessed(state.iterations() * num_files);
+    closedir(dirp);
+
+    for (int i = 0; i < num_files; ++i) {
+        unlink((dir_path + "/" + FileName(i)).c_str());
+    }
+    rmdir(dir_path.c_str());
+}
+BENCHMARK(BM_AddDirectoryEntriesFromLowerFs)->Arg(16)->Arg(256)->Arg(4096);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives realistic workloads against a directory of a mounted FUSE volume (e.g.
+// /storage/emulated/0/DCIM) and reports throughput and latency percentiles, one line per run.
+// See fuse_e2e_benchmark.sh to run every workload in each FuseDaemon mode.
+//
+// Usage: fuse_e2e_benchmark [--flag=value...] <workload> <dir>
+//
+// Workloads:
+//   stat       Parallel stat() of random files of a tree of --files files.
+//   readdir    Lists a directory of --files files and stats every entry, like `ls -l`, which
+//              the kernel serves with readdirplus.
+//   seq_read   Sequential --bs reads of a --size_mb file (or --file).
+//   rand_read  Random --bs reads of a --size_mb file (or --file). Pass a file with location
+//              metadata as --file, read by an app without ACCESS_MEDIA_LOCATION, to measure
+//              redacted reads.
+//   seq_write  Sequential --bs writes of a --size_mb file, then fsync(), like fio seq_write.
+//   churn      Create, write, rename and unlink of small files.
+//
+// Flags:
+//   --threads=N      Number of threads running the workload (default 1).
+//   --duration_s=N   How long to run the workload for (default 10).
+//   --files=N        Number of files of the stat and readdir workloads (default 10000).
+//   --size_mb=N      Size of the file of the read and write workloads (default 256).
+//   --bs=N           Block size of the read and write workloads in bytes (default 131072).
+//   --file=PATH      Existing file to read instead of creating one.
+//   --label=STRING   Added to the output, e.g. the mode of the daemon (default none).
+//   --drop_caches    Drops the page cache after setup (requires root).
+
+#define LOG_TAG "FuseE2eBenchmark"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+#include "libfuse_jni/FuseStats.h"
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+using mediaprovider::fuse::LatencyHistogram;
+
+namespace {
+
+struct Options {
+    int threads = 1;
+    int duration_s = 10;
+    int files = 10000;
+    uint64_t size_mb = 256;
+    size_t bs = 128 * 1024;
+    std::string file;
+    std::string label;
+    bool drop_caches = false;
+};
+
+// Results of a run, shared by all threads.
+struct Results {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> errors = 0;
+};
+
+// Runs one operation of a workload on thread |thread|, and returns the number of bytes it
+// transferred or -1 on error.
+using Op = std::function<int64_t(int thread, std::mt19937_64* rng)>;
+
+std::string FileName(int i) {
+    return StringPrintf("IMG_20240101_%06d.jpg", i);
+}
+
+void CreateFile(const std::string& path, size_t size) {
+    unique_fd fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660));
+    PCHECK(fd.ok()) << "Failed to create " << path;
+    std::vector<char> buf(std::min<size_t>(size, 1024 * 1024), 'x');
+    for (size_t written = 0; written < size; written += buf.size()) {
+        const size_t len = std::min(buf.size(), size - written);
+        PCHECK(android::base::WriteFully(fd, buf.data(), len)) << "Failed to write " << path;
+    }
+}
+
+void RemoveTree(const std::string& path) {
+    DIR* dirp = opendir(path.c_str());
+    if (dirp != nullptr) {
+        while (struct dirent* de = readdir(dirp)) {
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+                continue;
+            }
+            const std::string child = path + "/" + de->d_name;
+            if (de->d_type == DT_DIR) {
+                RemoveTree(child);
+            } else {
+                unlink(child.c_str());
+            }
+        }
+        closedir(dirp);
+    }
+    rmdir(path.c_str());
+}
+
+void DropCaches() {
+    sync();
+    if (!android::base::WriteStringToFile("3", "/proc/sys/vm/drop_caches")) {
+        PLOG(WARNING) << "Failed to drop caches";
+    }
+}
+
+// Runs |op| on |options.threads| threads for |options.duration_s| seconds.
+void Run(const Options& options, const Op& op, Results* results) {
+    const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(options.duration_s);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; ++t) {
+        threads.emplace_back([&, t] {
+            // Fixed seeds, so that every run issues the same operations.
+            std::mt19937_64 rng(t + 1);
+            while (std::chrono::steady_clock::now() < deadline) {
+                const auto start = std::chrono::steady_clock::now();
+                const int64_t bytes = op(t, &rng);
+                results->latency.Record(std::chrono::steady_clock::now() - start);
+                if (bytes < 0) {
+                    results->errors.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    results->bytes.fetch_add(bytes, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void Report(const std::string& workload, const Options& options, const Results& results,
+            std::chrono::nanoseconds elapsed) {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    const uint64_t count = results.latency.count();
+    const uint64_t total_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(results.latency.total()).count();
+    const uint64_t avg_us = count == 0 ? 0 : total_us / count;
+    printf("workload=%s label=%s threads=%d ops=%" PRIu64 " errors=%" PRIu64
+           " ops_per_s=%.1f MiB_per_s=%.2f avg_us=%" PRIu64 " p50_us<=%" PRIu64
+           " p90_us<=%" PRIu64 " p99_us<=%" PRIu64 "\n",
+           workload.c_str(), options.label.c_str(), options.threads, count,
+           results.errors.load(), count / seconds, results.bytes.load() / seconds / (1024 * 1024),
+           avg_us, results.latency.PercentileUpperBoundUs(50),
+           results.latency.PercentileUpperBoundUs(90), results.latency.PercentileUpperBoundUs(99));
+    fflush(stdout);
+}
+
+// Spreads |files| files over directories of 100 files, like a camera roll split by date.
+std::vector<std::string> CreateTree(const std::string& dir, int files) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < files; ++i) {
+        const std::string subdir = StringPrintf("%s/%d", dir.c_str(), i / 100);
+        if (i % 100 == 0) {
+            PCHECK(mkdir(subdir.c_str(), 0770) == 0 || errno == EEXIST) << subdir;
+        }
+        paths.push_back(subdir + "/" + FileName(i));
+        CreateFile(paths.back(), 0);
+    }
+    return paths;
+}
+
+Op StatOp(const std::string& dir, const Options& options) {
+    auto paths = std::make_shared<std::vector<std::string>>(CreateTree(dir, options.files));
+    return [paths](int, std::mt19937_64* rng) -> int64_t {
+        struct stat st;
+        return stat((*paths)[(*rng)() % paths->size()].c_str(), &st) == 0 ? 0 : -1;
+    };
+}
+
+Op ReaddirOp(const std::string& dir, const Options& options) {
+    for (int i = 0; i < options.files; ++i) {
+        CreateFile(dir + "/" + FileName(i), 0);
+    }
+    return [dir](int, std::mt19937_64*) -> int64_t {
+        DIR* dirp = opendir(dir.c_str());
+        if (dirp == nullptr) {
+            return -1;
+        }
+        int64_t result = 0;
+        while (struct dirent* de = readdir(dirp)) {
+            struct stat st;
+            if (fstatat(dirfd(dirp), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                result = -1;
+            }
+        }
+        closedir(dirp);
+        return result;
+    };
+}
+
+Op ReadOp(const std::string& dir, const Options& options, bool sequential) {
+    std::string path = options.file;
+    if (path.empty()) {
+        path = dir + "/" + FileName(0);
+        CreateFile(path, options.size_mb * 1024 * 1024);
+    }
+    struct stat st;
+    PCHECK(stat(path.c_str(), &st) == 0) << "Failed to stat " << path;
+    const off_t size = st.st_size;
+    CHECK(size >= static_cast<off_t>(options.bs)) << path << " is smaller than --bs";
+
+    struct State {
+        std::vector<unique_fd> fds;
+        std::vector<off_t> offsets;
+    };
+    auto state = std::make_shared<State>();
+    for (int t = 0; t < options.threads; ++t) {
+        state->fds.emplace_back(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        PCHECK(state->fds.back().ok()) << "Failed to open " << path;
+        // Spread sequential readers over the file.
+        state->offsets.push_back((size / options.threads) * t / options.bs * options.bs);
+    }
+    const size_t bs = options.bs;
+    return [state, size, bs, sequential](int t, std::mt19937_64* rng) -> int64_t {
+        std::vector<char> buf(bs);
+        off_t off;
+        if (sequential) {
+            off = state->offsets[t];
+            state->offsets[t] = (off + bs + bs > static_cast<size_t>(size)) ? 0 : off + bs;
+        } else {
+            off = ((*rng)() % (size / bs)) * bs;
+        }
+        return pread(state->fds[t].get(), buf.data(), bs, off);
+    };
+}
+
+Op SeqWriteOp(const std::string& dir, const Options& options) {
+    struct State {
+        std::vector<unique_fd> fds;
+        std::vector<off_t> offsets;
+    };
+    auto state = std::make_shared<State>();
+    for (int t = 0; t < options.threads; ++t) {
+        const std::string path = dir + "/" + FileName(t);
+        state->fds.emplace_back(
+                open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660));
+        PCHECK(state->fds.back().ok()) << "Failed to create " << path;
+        state->offsets.push_back(0);
+    }
+    const size_t bs = options.bs;
+    const off_t size = options.size_mb * 1024 * 1024;
+    return [state, size, bs](int t, std::mt19937_64*) -> int64_t {
+        std::vector<char> buf(bs, 'x');
+        const int fd = state->fds[t].get();
+        const ssize_t written = pwrite(fd, buf.data(), bs, state->offsets[t]);
+        state->offsets[t] += bs;
+        if (state->offsets[t] >= size) {
+            // Like fio, start over once the file is complete.
+            if (fsync(fd) != 0) {
+                return -1;
+            }
+            state->offsets[t] = 0;
+        }
+        return written;
+    };
+}
+
+Op ChurnOp(const std::string& dir, const Options& options) {
+    for (int t = 0; t < options.threads; ++t) {
+        const std::string subdir = StringPrintf("%s/%d", dir.c_str(), t);
+        PCHECK(mkdir(subdir.c_str(), 0770) == 0) << subdir;
+    }
+    auto counters = std::make_shared<std::vector<int>>(options.threads);
+    return [dir, counters](int t, std::mt19937_64*) -> int64_t {
+        const int i = (*counters)[t]++;
+        const std::string path = StringPrintf("%s/%d/%s", dir.c_str(), t, FileName(i).c_str());
+        const std::string new_path = path + ".renamed";
+        unique_fd fd(open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0660));
+        if (!fd.ok()) {
+            return -1;
+        }
+        char buf[4096] = {};
+        const bool ok = android::base::WriteFully(fd, buf, sizeof(buf));
+        fd.reset();
+        if (!ok || rename(path.c_str(), new_path.c_str()) != 0 || unlink(new_path.c_str()) != 0) {
+            return -1;
+        }
+        return sizeof(buf);
+    };
+}
+
+bool ParseFlag(const std::string& arg, Options* options) {
+    auto value = [&arg](const char* name, std::string* out) {
+        const std::string prefix = std::string("--") + name + "=";
+        if (!android::base::StartsWith(arg, prefix)) {
+            return false;
+        }
+        *out = arg.substr(prefix.size());
+        return true;
+    };
+    std::string v;
+    if (value("threads", &v)) return android::base::ParseInt(v, &options->threads, 1);
+    if (value("duration_s", &v)) return android::base::ParseInt(v, &options->duration_s, 1);
+    if (value("files", &v)) return android::base::ParseInt(v, &options->files, 1);
+    if (value("size_mb", &v)) return android::base::ParseUint(v, &options->size_mb);
+    if (value("bs", &v)) return android::base::ParseUint(v, &options->bs) && options->bs > 0;
+    if (value("file", &options->file)) return true;
+    if (value("label", &options->label)) return true;
+    if (arg == "--drop_caches") {
+        options->drop_caches = true;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+
+    Options options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (android::base::StartsWith(argv[i], "--")) {
+            if (!ParseFlag(argv[i], &options)) {
+                LOG(ERROR) << "Invalid flag " << argv[i];
+                return 1;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() != 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " [--flag=value...] <workload> <dir>";
+        return 1;
+    }
+    const std::string& workload = args[0];
+    const std::string dir = args[1] + "/.fuse_e2e_benchmark_" + workload;
+
+    RemoveTree(dir);
+    PCHECK(mkdir(dir.c_str(), 0770) == 0) << "Failed to create " << dir;
+
+    Op op;
+    if (workload == "stat") {
+        op = StatOp(dir, options);
+    } else if (workload == "readdir") {
+        op = ReaddirOp(dir, options);
+    } else if (workload == "seq_read") {
+        op = ReadOp(dir, options, true /* sequential */);
+    } else if (workload == "rand_read") {
+        op = ReadOp(dir, options, false /* sequential */);
+    } else if (workload == "seq_write") {
+        op = SeqWriteOp(dir, options);
+    } else if (workload == "churn") {
+        op = ChurnOp(dir, options);
+    } else {
+        LOG(ERROR) << "Unknown workload " << workload;
+        RemoveTree(dir);
+        return 1;
+    }
+
+    if (options.drop_caches) {
+        DropCaches();
+    }
+
+    Results results;
+    const auto start = std::chrono::steady_clock::now();
+    Run(options, op, &results);
+    Report(workload, options, results, std::chrono::steady_clock::now() - start);
+
+    // Drop the workload's fds and buffers before removing its files.
+    op = nullptr;
+    RemoveTree(dir);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#!/bin/bash
+#
+# Copyright (C) 2024 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs every fuse_e2e_benchmark workload against the FUSE volume of a rooted device, once per
+# FuseDaemon mode, and prints one result line per workload and mode.
+#
+# Usage: fuse_e2e_benchmark.sh [-d dir] [-m "modes"] [-w "workloads"] [-t threads] [-s seconds]
+#
+# Build the benchmark first with `m fuse_e2e_benchmark`. Switching modes reboots the device,
+# since fuse-bpf can only be toggled at boot.
+
+DIR=/storage/emulated/0/DCIM
+MODES="default passthrough bpf uncached"
+WORKLOADS="stat readdir seq_read rand_read seq_write churn"
+THREADS=4
+SECONDS_PER_RUN=10
+DEVICE_BIN=/data/local/tmp/fuse_e2e_benchmark
+
+while getopts "d:m:w:t:s:" opt; do
+    case $opt in
+        d) DIR=$OPTARG;;
+        m) MODES=$OPTARG;;
+        w) WORKLOADS=$OPTARG;;
+        t) THREADS=$OPTARG;;
+        s) SECONDS_PER_RUN=$OPTARG;;
+        *) echo "Usage: $0 [-d dir] [-m modes] [-w workloads] [-t threads] [-s seconds]"
+           exit 2;;
+    esac
+done
+
+BIN=$ANDROID_PRODUCT_OUT/system/bin/fuse_e2e_benchmark
+if [ ! -f "$BIN" ]; then
+    echo "Couldn't find fuse_e2e_benchmark, build it with 'm fuse_e2e_benchmark'"
+    exit 3
+fi
+
+function set-mode () {
+    local passthrough=false bpf=false uncached=false
+    case $1 in
+        default) ;;
+        passthrough) passthrough=true;;
+        bpf) bpf=true;;
+        uncached) uncached=true;;
+        *) echo "Unknown mode $1"; exit 2;;
+    esac
+
+    adb shell setprop persist.sys.fuse.passthrough.enable $passthrough
+    adb shell setprop persist.sys.fuse.bpf.override $bpf
+    adb shell setprop persist.sys.fuse.uncached_mode.override $uncached
+    adb reboot
+    adb wait-for-device
+    until [ "$(adb shell getprop sys.boot_completed | tr -d '\r')" == "1" ]; do
+        sleep 1
+    done
+    adb root > /dev/null && adb wait-for-device
+    # Give the media scan triggered by the boot a chance to settle.
+    sleep 30
+}
+
+PROPS="persist.sys.fuse.passthrough.enable persist.sys.fuse.bpf.override \
+    persist.sys.fuse.uncached_mode.override"
+
+adb root > /dev/null && adb wait-for-device
+declare -A ORIGINAL
+for prop in $PROPS; do
+    ORIGINAL[$prop]=$(adb shell getprop $prop | tr -d '\r')
+done
+adb push $BIN $DEVICE_BIN > /dev/null
+
+for mode in $MODES; do
+    set-mode $mode
+    for workload in $WORKLOADS; do
+        adb shell $DEVICE_BIN --threads=$THREADS --duration_s=$SECONDS_PER_RUN \
+            --label=$mode --drop_caches $workload $DIR
+    done
+done
+
+# Restore the original configuration, which takes effect on the next reboot.
+for prop in $PROPS; do
+    adb shell setprop $prop "'${ORIGINAL[$prop]}'"
+done
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_FUSE_STATS_H_
+#define MEDIA_PROVIDER_JNI_FUSE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Histogram of durations in power-of-two buckets of microseconds: bucket 0 counts durations
+ * below 2us, bucket i > 0 those in [2^i, 2^(i+1)) us, and the last bucket everything above.
+ *
+ * Recording is lock-free and only uses relaxed atomics, so it's cheap enough to be always on.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr int kNumBuckets = 32;
+
+    void Record(std::chrono::nanoseconds duration);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::chrono::nanoseconds total() const {
+        return std::chrono::nanoseconds(total_ns_.load(std::memory_order_relaxed));
+    }
+    uint64_t bucket(int i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+    /**
+     * Returns an upper bound of the |percentile|th percentile in microseconds, i.e. the upper
+     * end of the bucket it falls in, or 0 if nothing was recorded.
+     */
+    uint64_t PercentileUpperBoundUs(double percentile) const;
+
+  private:
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> total_ns_ = 0;
+    std::atomic<uint64_t> buckets_[kNumBuckets] = {};
+};
+
+/** FUSE operations whose latency is tracked, split by how they were served. */
+enum class FuseOpStat {
+    lookup,
+    getattr,
+    open,
+    open_passthrough,
+    read,
+    read_redacted,
+    write_buf,
+    copy_file_range,
+    readdir,
+    readdirplus,
+    create,
+    // Operations the kernel served through FUSE-BPF, only calling into the daemon to filter the
+    // result. Those it served without a postfilter never reach the daemon, so aren't counted.
+    lookup_postfilter,
+    readdir_postfilter,
+    count,
+};
+
+/**
+ * Always-on latency statistics of FUSE operations, including the part of it spent in JNI upcalls
+ * to MediaProvider.
+ */
+class FuseStats {
+  public:
+    void Record(FuseOpStat op, std::chrono::nanoseconds duration, std::chrono::nanoseconds jni);
+
+    const LatencyHistogram& latency(FuseOpStat op) const {
+        return stats_[static_cast<int>(op)].latency;
+    }
+    const LatencyHistogram& jni_latency(FuseOpStat op) const {
+        return stats_[static_cast<int>(op)].jni;
+    }
+
+    /**
+     * Returns a human readable dump of all statistics, one operation per line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct OpStats {
+        LatencyHistogram latency;
+        LatencyHistogram jni;
+    };
+    OpStats stats_[static_cast<int>(FuseOpStat::count)];
+};
+
+/** MediaProviderWrapper upcalls into MediaProvider whose latency is tracked. */
+enum class UpcallStat {
+    insert_file,
+    delete_file,
+    on_file_open,
+    on_cached_file_open,
+    is_creating_dir_allowed,
+    is_deleting_dir_allowed,
+    get_directory_entries,
+    is_opendir_allowed,
+    is_uid_allowed_access_to_data_or_obb_path,
+    rename,
+    on_file_created,
+    should_allow_lookup,
+    is_app_clone_user,
+    file_lookup,
+    file_lookup_batch,
+    transform,
+    count,
+};
+
+/**
+ * Always-on latency statistics of JNI upcalls to MediaProvider, and of how many of them threw.
+ */
+class UpcallStats {
+  public:
+    void Record(UpcallStat upcall, std::chrono::nanoseconds duration, bool threw);
+
+    const LatencyHistogram& latency(UpcallStat upcall) const {
+        return stats_[static_cast<int>(upcall)].latency;
+    }
+    uint64_t exceptions(UpcallStat upcall) const {
+        return stats_[static_cast<int>(upcall)].exceptions.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns a human readable dump of all statistics, one upcall per line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct Stats {
+        LatencyHistogram latency;
+        std::atomic<uint64_t> exceptions = 0;
+    };
+    Stats stats_[static_cast<int>(UpcallStat::count)];
+};
+
+/**
+ * Counts the worker threads of the FUSE session loop. libfuse starts a worker whenever a request
+ * arrives while all of them are busy, and stops workers beyond its idle thread limit, so under
+ * bursty load this measures the thread churn.
+ */
+class WorkerStats {
+  public:
+    void Started();
+    void Exited();
+
+    uint64_t started() const { return started_.load(std::memory_order_relaxed); }
+    uint64_t exited() const { return exited_.load(std::memory_order_relaxed); }
+    uint64_t live() const { return started() - exited(); }
+    uint64_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    std::atomic<uint64_t> started_ = 0;
+    std::atomic<uint64_t> exited_ = 0;
+    std::atomic<uint64_t> peak_ = 0;
+};
+
+/**
+ * Counts the requests of a kind being served at the same time, e.g. reads of the lower filesystem
+ * blocking their worker threads, and the concurrency each of them was started at.
+ */
+class InFlightStats {
+  public:
+    void Started();
+    void Finished();
+
+    uint64_t current() const { return current_.load(std::memory_order_relaxed); }
+    uint64_t peak() const { return peak_.load(std::memory_order_relaxed); }
+    uint64_t started() const { return started_.load(std::memory_order_relaxed); }
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line starting with |name|.
+     */
+    std::string Dump(const char* name) const;
+
+  private:
+    std::atomic<uint64_t> current_ = 0;
+    std::atomic<uint64_t> peak_ = 0;
+    std::atomic<uint64_t> started_ = 0;
+    // Sum of |current_| right after each start, for its average.
+    std::atomic<uint64_t> concurrency_sum_ = 0;
+};
+
+/** Accounts for the request it is alive for in an InFlightStats. */
+class ScopedInFlight {
+  public:
+    explicit ScopedInFlight(InFlightStats* stats) : stats_(stats) { stats_->Started(); }
+    ~ScopedInFlight() { stats_->Finished(); }
+
+    ScopedInFlight(const ScopedInFlight&) = delete;
+    ScopedInFlight& operator=(const ScopedInFlight&) = delete;
+
+  private:
+    InFlightStats* const stats_;
+};
+
+/**
+ * Counts the attribute timeouts handed out for files whose attributes are otherwise not cached,
+ * see getAdaptiveAttrTimeout(). The getattrs the kernel then doesn't send can't be counted, but
+ * every non-zero timeout is at least one.
+ */
+class AttrTimeoutStats {
+  public:
+    void Record(double timeout);
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    std::atomic<uint64_t> replies_ = 0;
+    // Replies with a non-zero timeout, and the sum of their timeouts.
+    std::atomic<uint64_t> cached_ = 0;
+    std::atomic<uint64_t> timeout_ms_sum_ = 0;
+};
+
+/**
+ * Times the phases of starting a FUSE session, up to serving its first request, as the time
+ * elapsed from the start until each phase was reached. Only the first time a phase is reached
+ * counts.
+ */
+class StartupStats {
+  public:
+    enum class Phase {
+        bpf_prog,
+        zero_addr,
+        session,
+        init,
+        warm_start,
+        first_request,
+        count,
+    };
+
+    StartupStats() : start_(std::chrono::steady_clock::now()) {}
+
+    StartupStats(const StartupStats&) = delete;
+    StartupStats& operator=(const StartupStats&) = delete;
+
+    void Reached(Phase phase);
+
+    /** Returns the time taken to reach |phase|, or 0 if it wasn't reached yet. */
+    std::chrono::nanoseconds elapsed(Phase phase) const {
+        return std::chrono::nanoseconds(
+                elapsed_ns_[static_cast<int>(phase)].load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Returns a human readable dump of the phases reached, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    const std::chrono::steady_clock::time_point start_;
+    std::atomic<int64_t> elapsed_ns_[static_cast<int>(Phase::count)] = {};
+};
+
+/**
+ * Returns the total time the calling thread has spent in JNI upcalls timed by ScopedUpcallTimer.
+ */
+std::chrono::nanoseconds CurrentThreadJniTime();
+
+/**
+ * Notes that a JNI upcall made by the calling thread threw, so that the enclosing
+ * ScopedUpcallTimer counts it as an exception.
+ */
+void NoteJniException();
+
+/**
+ * Records the duration of the upcall it is alive for into an UpcallStats, and adds it to the
+ * calling thread's JNI time.
+ */
+class ScopedUpcallTimer {
+  public:
+    ScopedUpcallTimer(UpcallStats* stats, UpcallStat upcall);
+    ~ScopedUpcallTimer();
+
+    ScopedUpcallTimer(const ScopedUpcallTimer&) = delete;
+    ScopedUpcallTimer& operator=(const ScopedUpcallTimer&) = delete;
+
+  private:
+    UpcallStats* const stats_;
+    const UpcallStat upcall_;
+    const std::chrono::steady_clock::time_point start_;
+    const uint64_t exceptions_start_;
+};
+
+/** Records the duration of the operation it is alive for into a FuseStats. */
+class ScopedOpTimer {
+  public:
+    ScopedOpTimer(FuseStats* stats, FuseOpStat op)
+        : stats_(stats),
+          op_(op),
+          start_(std::chrono::steady_clock::now()),
+          jni_start_(CurrentThreadJniTime()) {}
+    ~ScopedOpTimer() {
+        stats_->Record(op_, std::chrono::steady_clock::now() - start_,
+                       CurrentThreadJniTime() - jni_start_);
+    }
+
+    ScopedOpTimer(const ScopedOpTimer&) = delete;
+    ScopedOpTimer& operator=(const ScopedOpTimer&) = delete;
+
+    /** Changes the operation to record as, e.g. once it's known how it will be served. */
+    void set_op(FuseOpStat op) { op_ = op; }
+
+  private:
+    FuseStats* const stats_;
+    FuseOpStat op_;
+    const std::chrono::steady_clock::time_point start_;
+    const std::chrono::nanoseconds jni_start_;
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_FUSE_STATS_H_
@@ -17,7 +17,13 @@
 #ifndef MEDIAPROVIDER_JNI_UTILS_H_
 #define MEDIAPROVIDER_JNI_UTILS_H_
 
+#include <sys/stat.h>
+#include <time.h>
+
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace mediaprovider {
 namespace fuse {
@@ -35,11 +41,99 @@ static constexpr char PRIMARY_VOLUME_PREFIX[] = "/storage/emulated";
  */
 bool containsMount(const std::string& path);
 
+/**
+ * The parts of a path under /storage that access checks depend on, see classifyStoragePath().
+ */
+struct StoragePath {
+    enum class Kind {
+        // Not under /storage/<volume>.
+        other,
+        // /storage/<volume> or a path under it not covered below.
+        volume,
+        // /storage/<volume>[/<user id>]/Android
+        android_dir,
+        // /storage/<volume>[/<user id>]/Android/data or /storage/<volume>[/<user id>]/Android/obb
+        data_or_obb_dir,
+        // A path under one of the above, owned by |package| if not empty.
+        in_data_or_obb,
+    };
+
+    Kind kind = Kind::other;
+    // Views into the classified path.
+    std::string_view volume;
+    std::string_view package;
+    // The user id of /storage/<volume>/<user id> paths, or -1. Too large ids are clamped to
+    // INT_MAX rather than wrapping around.
+    int user_id = -1;
+
+    /** Same as matching ^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)/([^/]+)(/?.*)? */
+    bool IsPackageOwned() const { return kind == Kind::in_data_or_obb && !package.empty(); }
+
+    /** Same as matching ^/storage/[^/]+/(?:[0-9]+/)?Android/(?:data|obb)(/.*)?$ */
+    bool IsDataOrObb() const {
+        return kind == Kind::data_or_obb_dir || kind == Kind::in_data_or_obb;
+    }
+
+    /** Same as matching ^/storage/[^/]+/[0-9]+/Android/(data|obb)$ */
+    bool IsBpfBackingDir() const { return kind == Kind::data_or_obb_dir && user_id >= 0; }
+};
+
+/**
+ * Classifies |path| in a single pass over its first components, ignoring case like the regular
+ * expressions of FileUtils.java it replaces, but without allocating. Unlike those, '\n' is a
+ * regular character, so a path can't avoid being classified by containing one.
+ */
+StoragePath classifyStoragePath(std::string_view path);
+
+/**
+ * A set of prefixes, matched against paths ignoring ASCII case in a single walk over the path.
+ * Immutable once built, hence thread-safe.
+ */
+class PrefixTrie {
+  public:
+    PrefixTrie() = default;
+    explicit PrefixTrie(const std::vector<std::string>& prefixes);
+
+    /**
+     * Returns true if one of the prefixes is a prefix of |str| followed by |suffix|, ignoring
+     * case, as if matched with android::base::StartsWithIgnoreCase(). Never allocates.
+     */
+    bool MatchesPrefixOf(std::string_view str, std::string_view suffix = {}) const;
+
+    bool empty() const { return nodes_.empty(); }
+
+  private:
+    struct Node {
+        // Children by lower-cased character, usually only a few.
+        std::vector<std::pair<char, uint32_t>> children;
+        // Whether a prefix ends here.
+        bool terminal = false;
+    };
+
+    // Root first, or empty if there are no prefixes.
+    std::vector<Node> nodes_;
+};
+
 /**
  * Returns the volume name extracted from a given path.
  */
 std::string getVolumeNameFromPath(const std::string& path);
 
+/**
+ * Returns the index of the first byte of |str| that isn't ASCII, or std::string_view::npos if
+ * it's all ASCII.
+ */
+size_t findFirstNonAscii(const std::string_view& str);
+
+/**
+ * Returns for how long, in seconds, the kernel may cache the attributes |s| of a file whose
+ * attributes would otherwise not be cached at all: a tenth of the time elapsed since its ctime
+ * or mtime, whichever is later, up to |max_timeout|. Files that haven't changed for long are
+ * unlikely to change soon, while files being written get 0. |now| is CLOCK_REALTIME.
+ */
+double getAdaptiveAttrTimeout(const struct stat& s, const struct timespec& now,
+                              double max_timeout);
+
 /**
  * Removes any Unicode default ignorable codepoints from the provided string_view.
  * Returns an empty string if a decoding failure occurs.
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_INVALIDATION_QUEUE_H_
+#define MEDIA_PROVIDER_JNI_INVALIDATION_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Queues the kernel dentry invalidations and issues them in batches from a background thread, so
+ * that neither the FUSE workers nor MediaProvider wait for the kernel, and so that repeated
+ * invalidations of the same name are only issued once. This also keeps the invalidations off the
+ * threads serving FUSE requests, which would otherwise deadlock the kernel, see
+ * fuse_lowlevel_notify_inval_entry().
+ *
+ * Thread-safe.
+ */
+class InvalidationQueue {
+  public:
+    struct Invalidation {
+        uint64_t parent;
+        std::string name;
+        // Inode whose attributes to invalidate if |name| isn't in the dentry cache, or 0.
+        uint64_t child;
+    };
+
+    using Notify = std::function<void(const std::vector<Invalidation>&)>;
+
+    struct Stats {
+        // Number of invalidations pushed.
+        uint64_t pushed;
+        // Number of invalidations merged into one pushed earlier and not issued yet.
+        uint64_t deduped;
+        // Number of batches and invalidations issued.
+        uint64_t batches;
+        uint64_t issued;
+        // Number of invalidations waiting to be issued, and the highest it has been.
+        size_t depth;
+        size_t peak_depth;
+    };
+
+    /** |notify| issues a batch of invalidations, on the background thread. */
+    explicit InvalidationQueue(Notify notify) : notify_(std::move(notify)) {}
+
+    InvalidationQueue(const InvalidationQueue&) = delete;
+    InvalidationQueue& operator=(const InvalidationQueue&) = delete;
+
+    /** Stop()s the queue. */
+    ~InvalidationQueue();
+
+    /**
+     * Queues the invalidation of |name| in directory |parent|, and of the attributes of node
+     * |child| if non-zero. Does nothing once the queue is stopped.
+     */
+    void Push(uint64_t parent, const std::string& name, uint64_t child);
+
+    /**
+     * Waits until the invalidations pushed so far are issued. Must not be called while serving a
+     * FUSE request.
+     */
+    void Flush();
+
+    /** Issues the invalidations still queued, and drops those pushed from now on. */
+    void Stop();
+
+    Stats GetStats() const;
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct Key {
+        uint64_t parent;
+        std::string name;
+
+        bool operator==(const Key& other) const {
+            return parent == other.parent && name == other.name;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.name) ^ std::hash<uint64_t>()(key.parent);
+        }
+    };
+
+    void WorkerLoop();
+
+    const Notify notify_;
+
+    mutable std::mutex lock_;
+    // Signalled whenever something is pushed, issued, or the queue is stopped.
+    std::condition_variable cond_;
+    // Invalidations not taken by the background thread yet, in the order they were pushed, and
+    // where each of them is in |pending_|.
+    std::vector<Invalidation> pending_;
+    std::unordered_map<Key, size_t, KeyHash> pending_index_;
+    // Number of Push() calls so far, and how many of them were issued, for Flush().
+    uint64_t push_seq_ = 0;
+    uint64_t issued_seq_ = 0;
+    // Started by the first Push().
+    std::thread worker_;
+    bool stopping_ = false;
+    Stats stats_ = {};
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_INVALIDATION_QUEUE_H_
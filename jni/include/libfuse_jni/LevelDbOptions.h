@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_LEVEL_DB_OPTIONS_H_
+#define MEDIA_PROVIDER_JNI_LEVEL_DB_OPTIONS_H_
+
+#include "leveldb/options.h"
+
+namespace mediaprovider {
+namespace fuse {
+
+/** What a leveldb instance is used for, which decides the options it is opened with. */
+enum class LevelDbRole {
+    // The owner id to owner package relation and vice versa: small, read by key.
+    ownership,
+    // Backed up file metadata, one instance per volume: written in bulk on backup, then read by
+    // file path on restore, often for files that were never backed up.
+    backup,
+};
+
+/**
+ * Returns the options to open a leveldb instance for |role| with, including create_if_missing.
+ * Each can be overridden with the persist.sys.fuse.leveldb.<role>.bloom_bits (0 disables
+ * the bloom filter), .block_cache_kb, .write_buffer_kb and .compression properties.
+ *
+ * The block cache and filter policy are shared by all the instances of a role in the process,
+ * and are never freed since instances may outlive any owner.
+ */
+leveldb::Options GetLevelDbOptions(LevelDbRole role);
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_LEVEL_DB_OPTIONS_H_
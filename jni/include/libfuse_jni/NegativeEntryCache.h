@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_NEGATIVE_ENTRY_CACHE_H_
+#define MEDIA_PROVIDER_JNI_NEGATIVE_ENTRY_CACHE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Keeps track of the names the kernel was told don't exist, i.e. of its negative dentries, so
+ * that they can be invalidated when a name equal to them ignoring case is created. The kernel
+ * only replaces the negative dentry of the exact name being created, and would otherwise keep
+ * failing lookups of the other spellings until they time out.
+ *
+ * The kernel serves hits of negative dentries without calling into the daemon, so those can't be
+ * counted here. Instead, |reprobes| counts lookups of names that had already been answered
+ * negatively, which are the misses a longer timeout would have turned into hits.
+ *
+ * Thread-safe.
+ */
+class NegativeEntryCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        // Number of names currently tracked, including expired ones not pruned yet.
+        size_t entries;
+        // Number of negative entries handed out.
+        uint64_t replies;
+        // Number of negative entries handed out for names that already had one.
+        uint64_t reprobes;
+        // Number of negative entries invalidated because the name was created.
+        uint64_t invalidations;
+        // Number of negative entries refused because too many unexpired ones are tracked.
+        uint64_t rejected;
+    };
+
+    explicit NegativeEntryCache(size_t max_entries = 4096) : max_entries_(max_entries) {}
+
+    NegativeEntryCache(const NegativeEntryCache&) = delete;
+    NegativeEntryCache& operator=(const NegativeEntryCache&) = delete;
+
+    /**
+     * Records that the kernel is about to be told |name| doesn't exist in directory |parent|
+     * until |timeout| from |now|. Returns false if the entry couldn't be tracked, in which case
+     * the kernel must not be allowed to cache it.
+     */
+    bool Add(uint64_t parent, const std::string& name, Clock::duration timeout,
+             Clock::time_point now = Clock::now());
+
+    /**
+     * Stops tracking the unexpired names in directory |parent| equal to |name| ignoring case, and
+     * returns them so that the caller can invalidate them in the kernel.
+     */
+    std::vector<std::string> Remove(uint64_t parent, const std::string& name,
+                                    Clock::time_point now = Clock::now());
+
+    Stats GetStats() const;
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct Key {
+        uint64_t parent;
+        // |name| with ASCII upper case letters lower-cased, like node names are compared.
+        std::string folded_name;
+
+        bool operator==(const Key& other) const {
+            return parent == other.parent && folded_name == other.folded_name;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.folded_name) ^ std::hash<uint64_t>()(key.parent);
+        }
+    };
+
+    struct Entry {
+        std::string name;
+        Clock::time_point expiry;
+    };
+
+    static Key MakeKey(uint64_t parent, const std::string& name);
+    void PruneExpiredLocked(Clock::time_point now);
+
+    const size_t max_entries_;
+
+    mutable std::mutex lock_;
+    // All the spellings of each name, usually only one.
+    std::unordered_map<Key, std::vector<Entry>, KeyHash> entries_;
+    Stats stats_ = {};
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_NEGATIVE_ENTRY_CACHE_H_
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_OPEN_RESULT_CACHE_H_
+#define MEDIA_PROVIDER_JNI_OPEN_RESULT_CACHE_H_
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libfuse_jni/RedactionInfo.h"
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Keeps the results of the permission checks MediaProvider made when nodes were opened for
+ * reading, for a short while, so that apps reopening the same file in quick succession (e.g.
+ * media players probing and seeking) don't each make a JNI upcall. Only results that don't carry
+ * a file descriptor opened by MediaProvider can be cached.
+ *
+ * Results must be forgotten whenever the node changes, is renamed or goes away, and all of them
+ * whenever permissions may have changed. Results of checks made while forgotten aren't cached,
+ * see generation().
+ *
+ * Nodes are identified by their inode number, and callers by their uid. Opens made by
+ * |proxy_uid|, i.e. by MediaProvider on behalf of other apps, are never cached: MediaProvider
+ * resolves the real caller, and whether to redact for it, from the opening thread, so results
+ * depend on more than the uid.
+ *
+ * Thread-safe.
+ */
+class OpenResultCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        uid_t uid;
+        uid_t transforms_uid;
+        RedactionInfo redaction_info;
+    };
+
+    struct Stats {
+        // Number of results currently cached, including expired ones not pruned yet.
+        size_t entries;
+        // Number of opens served from, and not found in, the cache.
+        uint64_t hits;
+        uint64_t misses;
+        // Number of results dropped because their node changed or permissions may have.
+        uint64_t invalidations;
+    };
+
+    explicit OpenResultCache(uid_t proxy_uid, size_t max_entries = 1024)
+        : proxy_uid_(proxy_uid), max_entries_(max_entries) {}
+
+    OpenResultCache(const OpenResultCache&) = delete;
+    OpenResultCache& operator=(const OpenResultCache&) = delete;
+
+    /**
+     * Returns the current generation, to be passed to Put() with the result of the check made
+     * after it.
+     */
+    uint64_t generation() const;
+
+    /**
+     * Returns a copy of the unexpired result cached for node |ino| and |uid|, or nullptr. Always
+     * nullptr for the proxy uid.
+     */
+    std::unique_ptr<Result> Get(uint64_t ino, uid_t uid, Clock::time_point now = Clock::now());
+
+    /**
+     * Caches |result| for node |ino| and |uid| until |ttl| from |now|, unless anything was
+     * forgotten since |generation| or |uid| is the proxy uid.
+     */
+    void Put(uint64_t ino, uid_t uid, const Result& result, uint64_t generation,
+             Clock::duration ttl, Clock::time_point now = Clock::now());
+
+    /** Drops the results cached for node |ino|. */
+    void Forget(uint64_t ino);
+
+    /** Drops all cached results. */
+    void Clear();
+
+    Stats GetStats() const;
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct Entry {
+        uid_t uid;
+        Result result;
+        Clock::time_point expiry;
+    };
+
+    void PruneExpiredLocked(Clock::time_point now);
+
+    const uid_t proxy_uid_;
+    const size_t max_entries_;
+
+    mutable std::mutex lock_;
+    // Bumped by Forget() and Clear(). Guarded by |lock_|.
+    uint64_t generation_ = 0;
+    // The results of each node, one per uid, usually only one.
+    std::unordered_map<uint64_t, std::vector<Entry>> entries_;
+    Stats stats_ = {};
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_OPEN_RESULT_CACHE_H_
@@ -18,39 +18,105 @@
 #define MEDIA_PROVIDER_FUSE_READDIR_HELPER_H
 
 #include <dirent.h>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace mediaprovider {
 namespace fuse {
 
 /**
- * Holds a directory entry.
+ * Holds a list of directory entries.
  *
- * DirectoryEntry object holds information about the directory entry such as
- * name and type of the file or directory.
+ * Each directory entry has a name and the type of the file or directory, which corresponds to
+ * d_type of dirent structure defined in dirent.h. Entries are packed into one arena holding all
+ * names back to back and one array holding the offset of each name along with its type, so that
+ * adding entries doesn't allocate per entry and iterating over them stays cache friendly.
+ *
+ * An entry with an empty name indicates that an error occurred while listing the directory, its
+ * type holds the corresponding errno.
  */
-struct DirectoryEntry {
-    /**
-     * Create a directory entry.
-     *
-     * @param name directory entry name.
-     * @param type directory entry type. Directory entry type corresponds to
-     * d_type of dirent structure defined in dirent.h
-     */
-    DirectoryEntry(const std::string& name, int type) : d_name(name), d_type(type) {}
-    const std::string d_name;
-    const int d_type;
+class DirectoryEntries {
+  public:
+    /** Adds an entry named |name| of type |type|. */
+    void Add(std::string_view name, int type);
+
+    /** Adds an entry indicating |error| occurred. */
+    void AddError(int error) { Add("", error); }
+
+    /** Removes the entries from |size| on. */
+    void Truncate(size_t size);
+
+    void clear() { Truncate(0); }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    /** Returns the NUL-terminated name of entry |i|. */
+    const char* name(size_t i) const { return names_.data() + entries_[i].name_offset; }
+
+    int type(size_t i) const { return entries_[i].type; }
+
+    bool is_error(size_t i) const { return name(i)[0] == '\0'; }
+
+  private:
+    struct Entry {
+        uint32_t name_offset;
+        int32_t type;
+    };
+
+    std::vector<char> names_;
+    std::vector<Entry> entries_;
+};
+
+/**
+ * Position of an incremental listing of a directory, whose entries are fetched in chunks from
+ * MediaProvider and the lower file system as they are consumed.
+ */
+struct DirectoryEntryCursor {
+    enum class Phase {
+        // Nothing was fetched yet.
+        start,
+        // Fetching file names from MediaProvider.
+        media_provider,
+        // Fetching directory names from the lower file system, after the MediaProvider files.
+        lower_fs_directories,
+        // Fetching all entries from the lower file system, if MediaProvider is bypassed.
+        lower_fs,
+        // All entries were fetched.
+        done,
+    };
+
+    Phase phase = Phase::start;
+    // Row id of the last file returned by MediaProvider, the next page starts after it.
+    int64_t after_id = 0;
+
+    bool done() const { return phase == Phase::done; }
 };
 
 /**
  * Adds directory entries from lower file system to the list.
  *
- * If a filter is specified, directory entries must satisfy the given filter. If filter is null,
- * all directory entries(except '.' & '..') are returned.
+ * If an error occurs, the entries added so far are replaced by an error entry. If a filter is
+ * specified, directory entries must satisfy the given filter. If filter is null, all directory
+ * entries(except '.' & '..') are returned.
+ *
+ * Entries are read in bulk from the file descriptor of |dirp| with getdents64(2), so |dirp| must
+ * not also be read with readdir(3).
  */
 void addDirectoryEntriesFromLowerFs(DIR* dirp, bool (*const filter)(const dirent&),
-        std::vector<std::shared_ptr<DirectoryEntry>>* directory_entries);
+        DirectoryEntries* directory_entries);
+
+/**
+ * Same as above, but stops after adding |max_entries| entries, so that the listing can be
+ * continued from |dirp| later.
+ *
+ * Returns true if the end of the directory was reached or an error occurred.
+ */
+bool addDirectoryEntriesFromLowerFs(DIR* dirp, bool (*const filter)(const dirent&),
+                                    size_t max_entries, DirectoryEntries* directory_entries);
 
 /**
  * Checks if the given dirent is directory.
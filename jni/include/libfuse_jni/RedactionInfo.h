@@ -17,7 +17,10 @@
 #ifndef MEDIA_PROVIDER_FUSE_REDACTIONINFO_H_
 #define MEDIA_PROVIDER_FUSE_REDACTIONINFO_H_
 
+#include <algorithm>
+#include <atomic>
 #include <ostream>
+#include <utility>
 #include <vector>
 
 namespace mediaprovider {
@@ -67,6 +70,15 @@ class RedactionInfo {
      * Calls d'tor for redactionRanges (vector).
      */
     ~RedactionInfo() = default;
+    /**
+     * Copies the redaction ranges, but not the search hint of |other|.
+     */
+    RedactionInfo(const RedactionInfo& other) : redaction_ranges_(other.redaction_ranges_) {}
+    RedactionInfo& operator=(const RedactionInfo& other) {
+        redaction_ranges_ = other.redaction_ranges_;
+        read_cursor_.store(0, std::memory_order_relaxed);
+        return *this;
+    }
 
     /**
      * Returns a set of ranges to fulfill a read request starting at |off| of size
@@ -74,6 +86,18 @@ class RedactionInfo {
      */
     void getReadRanges(off64_t off, size_t size, std::vector<ReadRange>* out) const;
 
+    /**
+     * Calls |fn| with each of the ranges to fulfill a read request starting at |off| of size
+     * |size|, in the same order as getReadRanges(), without allocating.
+     */
+    template <typename Fn>
+    void forEachReadRange(off64_t off, size_t size, Fn&& fn) const;
+
+    /**
+     * Returns the number of ranges getReadRanges() would return for the same read request.
+     */
+    size_t getReadRangeCount(off64_t off, size_t size) const;
+
     /**
      * Returns whether any ranges need to be redacted.
      */
@@ -92,18 +116,53 @@ class RedactionInfo {
      *     * Non-overlapping (with each other)
      *     * Sorted in an ascending order of offset
      *
+     * <p>Takes O(log n + k) for n redaction ranges of which k overlap, and O(k) for reads that
+     * overlap the same or next range as the previous read.
+     *
      * @param size size of the read request
      * @param off offset of the first byte of the read request
-     * @return unique_ptr to a vector of RedactionRanges. If there are no
-     * relevant redaction ranges, the vector will be empty.
+     * @return [begin, end) iterators into redaction_ranges_. If there are no
+     * relevant redaction ranges, begin == end.
      */
-    std::unique_ptr<std::vector<RedactionRange>> getOverlappingRedactionRanges(size_t size,
-                                                                               off64_t off) const;
+    std::pair<std::vector<RedactionRange>::const_iterator,
+              std::vector<RedactionRange>::const_iterator>
+    getOverlappingRedactionRanges(size_t size, off64_t off) const;
     std::vector<RedactionRange> redaction_ranges_;
+    // Index of the last range that overlapped a read, a search hint for sequential readers.
+    // Reads from multiple threads may race on it, which is harmless.
+    mutable std::atomic<size_t> read_cursor_ = 0;
     void processRedactionRanges(int redaction_ranges_num, const off64_t* redaction_ranges);
     bool hasOverlapWithReadRequest(size_t size, off64_t off) const;
 };
 
+template <typename Fn>
+void RedactionInfo::forEachReadRange(off64_t off, size_t size, Fn&& fn) const {
+    const auto [first, last] = getOverlappingRedactionRanges(size, off);
+    if (first == last) {
+        return;
+    }
+
+    const off64_t read_end = static_cast<off64_t>(off + size);
+
+    // The overlapping redaction ranges are sorted and never touch each other, so the read ranges
+    // simply alternate between the (clamped) redaction ranges and the gaps between them. For
+    // ranges [10, 20) and [30, 40) and a read [15, 60), that's [15, 20) [20, 30) [30, 40) [40, 60)
+    // with only the first and third range redacted.
+    off64_t pos = off;
+    for (auto iter = first; iter != last; ++iter) {
+        const off64_t redaction_start = std::max(iter->first, off);
+        const off64_t redaction_end = std::min(iter->second, read_end);
+        if (pos < redaction_start) {
+            fn(ReadRange(pos, redaction_start - pos, false));
+        }
+        fn(ReadRange(redaction_start, redaction_end - redaction_start, true));
+        pos = redaction_end;
+    }
+    if (pos < read_end) {
+        fn(ReadRange(pos, read_end - pos, false));
+    }
+}
+
 }  // namespace fuse
 }  // namespace mediaprovider
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_SLAB_ALLOCATOR_H_
+#define MEDIA_PROVIDER_JNI_SLAB_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Allocates fixed-size objects out of large slabs, so that bursts of short-lived objects
+ * (e.g. the nodes created and forgotten during a media scan) don't fragment the heap and stay
+ * packed together in memory.
+ *
+ * Slabs are aligned to their size, which lets Free() find the slab (and allocator) owning an
+ * object from its address alone. Empty slabs beyond a small cache are returned to the system
+ * right away, so memory use tracks the number of live objects.
+ *
+ * Thread-safe.
+ */
+class SlabAllocator {
+  public:
+    // Size of each slab. Also its alignment.
+    static constexpr size_t kSlabSize = 64 * 1024;
+
+    struct Stats {
+        // Number of objects currently allocated.
+        size_t live_objects;
+        // Number of slabs currently held, including cached empty ones.
+        size_t slabs;
+        // Total number of Allocate() calls.
+        uint64_t allocations;
+    };
+
+    /**
+     * Creates an allocator for objects of |object_size| bytes, keeping up to |max_empty_slabs|
+     * empty slabs around for reuse.
+     */
+    explicit SlabAllocator(size_t object_size, size_t max_empty_slabs = 1);
+
+    /**
+     * Releases all slabs. Slabs that still hold live objects are leaked rather than freed under
+     * them.
+     */
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    /**
+     * Returns uninitialized memory for one object of |size| bytes, which must not be larger than
+     * object_size(). Aborts if out of memory.
+     */
+    void* Allocate(size_t size);
+
+    /**
+     * Returns |ptr|, previously returned by Allocate() on any SlabAllocator, to its allocator.
+     * Does nothing if |ptr| is nullptr.
+     */
+    static void Free(void* ptr);
+
+    /**
+     * Returns whether |ptr| is the address of an object handed out by this allocator, live or
+     * freed, so that the object's memory can be read.
+     */
+    bool Contains(const void* ptr) const;
+
+    size_t object_size() const { return object_size_; }
+
+    Stats GetStats() const;
+
+  private:
+    struct Slab;
+
+    Slab* NewSlab();
+    void FreeLocked(Slab* slab, void* ptr);
+    static void LinkLocked(Slab** list, Slab* slab);
+    static void UnlinkLocked(Slab** list, Slab* slab);
+
+    const size_t object_size_;
+    const size_t objects_per_slab_;
+    const size_t max_empty_slabs_;
+
+    mutable std::mutex lock_;
+    // Slabs with at least one free object, and slabs without any.
+    Slab* available_ = nullptr;
+    Slab* full_ = nullptr;
+    // All slabs in |available_| and |full_|, for Contains().
+    std::unordered_set<const Slab*> slabs_;
+    size_t empty_slabs_ = 0;
+    Stats stats_ = {};
+};
+
+/**
+ * Mixin routing allocations of T through a SlabAllocator. Use as
+ * `new (allocator) T(...)`; a plain `new T(...)` falls back to a process-wide allocator.
+ */
+template <typename T>
+class SlabAllocated {
+  public:
+    static void* operator new(size_t size, SlabAllocator* allocator) {
+        return allocator->Allocate(size);
+    }
+
+    static void* operator new(size_t size) { return operator new(size, &DefaultAllocator()); }
+
+    static void operator delete(void* ptr) { SlabAllocator::Free(ptr); }
+
+    // Called if a constructor invoked from the placement new above throws.
+    static void operator delete(void* ptr, SlabAllocator*) { SlabAllocator::Free(ptr); }
+
+  private:
+    static SlabAllocator& DefaultAllocator() {
+        // Never destroyed, since objects may be freed during static destruction.
+        static SlabAllocator* allocator = new SlabAllocator(sizeof(T));
+        return *allocator;
+    }
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_SLAB_ALLOCATOR_H_
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_PROVIDER_JNI_TRANSFORM_SCHEDULER_H_
+#define MEDIA_PROVIDER_JNI_TRANSFORM_SCHEDULER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "libfuse_jni/FuseStats.h"
+
+namespace mediaprovider {
+namespace fuse {
+
+/**
+ * Runs the transforms of nodes, e.g. transcoding, at most once at a time per node: concurrent
+ * readers of a node wait for the transform already in flight instead of each calling into
+ * MediaProvider. Transforms can also be started speculatively in the background, when a file is
+ * opened, so that its first read doesn't have to wait for all of it.
+ *
+ * Nodes are identified by their inode number.
+ *
+ * Thread-safe.
+ */
+class TransformScheduler {
+  public:
+    using Transform = std::function<bool()>;
+
+    struct Stats {
+        // Number of transforms run, in the background or not.
+        uint64_t runs;
+        // Number of transforms started speculatively.
+        uint64_t prefetches;
+        // Number of requests that waited for a transform already queued or in flight.
+        uint64_t coalesced;
+        // Number of transforms that failed.
+        uint64_t failures;
+        // Number of background transforms waiting for a thread.
+        size_t queue_depth;
+        // Highest |queue_depth| so far.
+        size_t peak_queue_depth;
+    };
+
+    explicit TransformScheduler(size_t max_threads = 2) : max_threads_(max_threads) {}
+
+    TransformScheduler(const TransformScheduler&) = delete;
+    TransformScheduler& operator=(const TransformScheduler&) = delete;
+
+    /** Cancels the queued transforms and waits for the background ones in flight. */
+    ~TransformScheduler();
+
+    /**
+     * Transforms node |ino| with |transform| on the calling thread, unless a transform of it is
+     * already in flight, in which case waits for it instead. A transform only queued so far is
+     * run right away. Returns whether the transform succeeded.
+     */
+    bool Run(uint64_t ino, Transform transform);
+
+    /**
+     * Queues |transform| of node |ino| to run in the background, unless a transform of it is
+     * already queued, in flight or done.
+     */
+    void Prefetch(uint64_t ino, Transform transform);
+
+    /** Drops the state kept for node |ino|, cancelling its transform if not started yet. */
+    void Forget(uint64_t ino);
+
+    Stats GetStats() const;
+    const LatencyHistogram& latency() const { return latency_; }
+
+    /**
+     * Returns a human readable dump of the statistics, on a single line.
+     */
+    std::string Dump() const;
+
+  private:
+    struct Task {
+        enum class State { queued, running, done };
+
+        Transform transform;
+        State state = State::queued;
+        bool result = false;
+        // Whether the task was started by Prefetch(), so that its result must be kept after it
+        // finishes for Run() to find it.
+        bool prefetched = false;
+    };
+
+    // Runs |task| of node |ino| with |lock_| released, and publishes its result.
+    bool RunTaskLocked(std::unique_lock<std::mutex>* lock, uint64_t ino,
+                       const std::shared_ptr<Task>& task);
+    void WorkerLoop();
+
+    const size_t max_threads_;
+
+    mutable std::mutex lock_;
+    // Signalled whenever a task is done and whenever a background thread exits.
+    std::condition_variable cond_;
+    // Tasks queued, in flight, or prefetched and done.
+    std::unordered_map<uint64_t, std::shared_ptr<Task>> tasks_;
+    // Background tasks in the order they were queued. Tasks that were run or cancelled while
+    // queued stay in here until a background thread skips them.
+    std::deque<std::pair<uint64_t, std::shared_ptr<Task>>> queue_;
+    size_t threads_ = 0;
+    bool stopping_ = false;
+    Stats stats_ = {};
+    LatencyHistogram latency_;
+};
+
+}  // namespace fuse
+}  // namespace mediaprovider
+
+#endif  // MEDIA_PROVIDER_JNI_TRANSFORM_SCHEDULER_H_
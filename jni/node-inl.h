@@ -19,29 +19,36 @@
 
 #include <android-base/logging.h>
 
+#include <strings.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
-#include <limits>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <mutex>
-#include <set>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "libfuse_jni/ReaddirHelper.h"
 #include "libfuse_jni/RedactionInfo.h"
+#include "libfuse_jni/SlabAllocator.h"
 
 class NodeTest;
 
 namespace mediaprovider {
 namespace fuse {
 
-struct handle {
+struct FileLookupResult;
+
+struct handle : public SlabAllocated<handle> {
     explicit handle(int fd, const RedactionInfo* ri, bool cached, bool passthrough, uid_t uid,
                     uid_t transforms_uid)
         : fd(fd),
@@ -59,20 +66,42 @@ struct handle {
     const bool passthrough;
     const uid_t uid;
     const uid_t transforms_uid;
+    // Upstream passthrough backing id this handle holds a reference to, see
+    // node::AcquireBackingId(), or 0.
+    int backing_id = 0;
+
+    // Sequential read and write detection, used to read ahead of sequential readers and write
+    // behind sequential writers. Guarded by |readahead_lock|.
+    std::mutex readahead_lock;
+    // End of the furthest read so far.
+    off_t next_read_off = 0;
+    // End of the range already advised to be read ahead.
+    off_t readahead_end = 0;
+    int sequential_reads = 0;
+    // End of the furthest write so far.
+    off_t next_write_off = 0;
+    // Start of the sequentially written range not written behind yet.
+    off_t writebehind_off = 0;
 
     ~handle() { close(fd); }
 };
 
-struct dirhandle {
+struct dirhandle : public SlabAllocated<dirhandle> {
     explicit dirhandle(DIR* dir) : d(dir), next_off(0) { CHECK(dir != nullptr); }
 
     DIR* const d;
     off_t next_off;
     // Fuse readdir() is called multiple times based on the size of the buffer and
     // number of directory entries in the given directory. 'de' holds the list
-    // of directory entries for the directory handle and this list is available
-    // across subsequent readdir() calls for the same directory handle.
-    std::vector<std::shared_ptr<DirectoryEntry>> de;
+    // of directory entries for the directory handle fetched so far and this list is
+    // available across subsequent readdir() calls for the same directory handle.
+    // More entries are fetched in chunks as readdir() reaches the end of it, 'cursor'
+    // tells where the next chunk starts.
+    DirectoryEntries de;
+    DirectoryEntryCursor cursor;
+    // FileLookupResults prefetched for readdirplus, indexed like 'de'. Entries that don't need
+    // one, or whose lookup failed, are nullptr. Each is used at most once.
+    std::vector<std::shared_ptr<const FileLookupResult>> lookups;
 
     ~dirhandle() { closedir(d); }
 };
@@ -88,36 +117,115 @@ struct FdAccessResult {
 
 // Whether inode tracking is enabled or not. When enabled, we maintain a
 // separate mapping from inode numbers to "live" nodes so we can detect when
-// we receive a request to a node that has been deleted.
+// we receive a request to a node that has been deleted, even if a new node reused its memory.
+// Regardless, every node carries a magic word checked without any lock, which catches requests
+// to deleted nodes in production builds at the cost of a load.
+#ifdef NDEBUG
+static constexpr bool kEnableInodeTracking = false;
+#else
 static constexpr bool kEnableInodeTracking = true;
+#endif
+
+// Reader-writer lock guarding a tree of nodes. Lookups and path builds take it in shared mode
+// and can run concurrently on multiple FUSE threads; anything that mutates the tree (node
+// creation, renames, deletes, dropping references) takes it in exclusive mode.
+//
+// Like the std::recursive_mutex it replaces, the lock is re-entrant: a thread holding it
+// exclusively may lock it again in either mode, and a thread holding it shared may lock it
+// shared again. Upgrading from shared to exclusive ownership is not supported and aborts, since
+// two readers attempting it concurrently would deadlock.
+//
+// A thread may hold shared ownership of at most one tree lock at a time. This holds for FUSE
+// worker threads since each of them serves a single mount.
+class RecursiveSharedMutex {
+  public:
+    void lock() {
+        const std::thread::id self = std::this_thread::get_id();
+        if (owner_.load(std::memory_order_relaxed) == self) {
+            exclusive_depth_++;
+            return;
+        }
+        CHECK(shared_owned_ != this) << "Cannot upgrade a shared lock to an exclusive lock";
+        mutex_.lock();
+        owner_.store(self, std::memory_order_relaxed);
+        exclusive_depth_ = 1;
+    }
+
+    void unlock() {
+        if (--exclusive_depth_ == 0) {
+            owner_.store(std::thread::id(), std::memory_order_relaxed);
+            mutex_.unlock();
+        }
+    }
+
+    void lock_shared() {
+        if (owner_.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+            // Shared ownership on top of exclusive ownership is just another level of recursion.
+            exclusive_depth_++;
+            return;
+        }
+        if (shared_owned_ == this) {
+            shared_depth_++;
+            return;
+        }
+        CHECK(shared_owned_ == nullptr) << "Cannot hold more than one node tree lock";
+        mutex_.lock_shared();
+        shared_owned_ = this;
+        shared_depth_ = 1;
+    }
+
+    void unlock_shared() {
+        if (owner_.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+            exclusive_depth_--;
+            return;
+        }
+        if (--shared_depth_ == 0) {
+            shared_owned_ = nullptr;
+            mutex_.unlock_shared();
+        }
+    }
+
+  private:
+    std::shared_mutex mutex_;
+    // Thread currently holding |mutex_| exclusively, if any.
+    std::atomic<std::thread::id> owner_;
+    // Recursion depth of the exclusive owner. Only accessed by |owner_|.
+    uint32_t exclusive_depth_ = 0;
+    // The lock the current thread holds in shared mode, and its recursion depth.
+    static inline thread_local const RecursiveSharedMutex* shared_owned_ = nullptr;
+    static inline thread_local uint32_t shared_depth_ = 0;
+};
 
 class node;
 
 // Tracks the set of active nodes associated with a FUSE instance so that we
 // can assert that we only ever return an active node in response to a lookup.
+// Also indexes the active nodes by their inode number on the lower filesystem, and owns the
+// slabs that nodes and their handles are allocated from.
 class NodeTracker {
   public:
-    explicit NodeTracker(std::recursive_mutex* lock) : lock_(lock) {}
+    explicit NodeTracker(RecursiveSharedMutex* lock);
+
+    // Counters exported for profiling.
+    struct Stats {
+        uint64_t lookups;
+        uint64_t nodes_created;
+        uint64_t nodes_deleted;
+        SlabAllocator::Stats node_slabs;
+        SlabAllocator::Stats handle_slabs;
+        SlabAllocator::Stats dirhandle_slabs;
+    };
 
-    bool Exists(__u64 ino) const {
-        if (kEnableInodeTracking) {
-            const node* node = reinterpret_cast<const class node*>(ino);
-            std::lock_guard<std::recursive_mutex> guard(*lock_);
-            return active_nodes_.find(node) != active_nodes_.end();
-        }
-    }
+    // Returns whether |ino| is the inode of an active node. |ino| may be any value.
+    bool Exists(__u64 ino) const;
 
-    void CheckTracked(__u64 ino) const {
-        if (kEnableInodeTracking) {
-            const node* node = reinterpret_cast<const class node*>(ino);
-            std::lock_guard<std::recursive_mutex> guard(*lock_);
-            CHECK(active_nodes_.find(node) != active_nodes_.end());
-        }
-    }
+    // Aborts unless |ino|, the inode of a node handed out to the kernel, is still active.
+    void CheckTracked(__u64 ino) const;
 
     void NodeDeleted(const node* node) {
+        nodes_deleted_.fetch_add(1, std::memory_order_relaxed);
         if (kEnableInodeTracking) {
-            std::lock_guard<std::recursive_mutex> guard(*lock_);
+            std::lock_guard<RecursiveSharedMutex> guard(*lock_);
             LOG(DEBUG) << "Node: " << reinterpret_cast<uintptr_t>(node) << " deleted.";
 
             CHECK(active_nodes_.find(node) != active_nodes_.end());
@@ -126,8 +234,9 @@ class NodeTracker {
     }
 
     void NodeCreated(const node* node) {
+        nodes_created_.fetch_add(1, std::memory_order_relaxed);
         if (kEnableInodeTracking) {
-            std::lock_guard<std::recursive_mutex> guard(*lock_);
+            std::lock_guard<RecursiveSharedMutex> guard(*lock_);
             LOG(DEBUG) << "Node: " << reinterpret_cast<uintptr_t>(node) << " created.";
 
             CHECK(active_nodes_.find(node) == active_nodes_.end());
@@ -135,33 +244,96 @@ class NodeTracker {
         }
     }
 
+    void InodeAdded(ino_t ino, const node* node) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        nodes_by_ino_.emplace(ino, node);
+    }
+
+    void InodeRemoved(ino_t ino, const node* node) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        auto range = nodes_by_ino_.equal_range(ino);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == node) {
+                nodes_by_ino_.erase(it);
+                return;
+            }
+        }
+        LOG(FATAL) << "Node: " << reinterpret_cast<uintptr_t>(node) << " not indexed by ino "
+                   << ino;
+    }
+
+    void NodeLookedUp() { lookups_.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats GetStats() const {
+        return Stats{lookups_.load(std::memory_order_relaxed),
+                     nodes_created_.load(std::memory_order_relaxed),
+                     nodes_deleted_.load(std::memory_order_relaxed),
+                     node_allocator_.GetStats(),
+                     handle_allocator_.GetStats(),
+                     dirhandle_allocator_.GetStats()};
+    }
+
+    SlabAllocator* node_allocator() { return &node_allocator_; }
+    SlabAllocator* handle_allocator() { return &handle_allocator_; }
+    SlabAllocator* dirhandle_allocator() { return &dirhandle_allocator_; }
+
+    // Generation of the cached paths of the nodes of this tracker, see node::BuildPath().
+    uint64_t PathGeneration() const { return path_generation_.load(std::memory_order_relaxed); }
+    void InvalidateCachedPaths() { path_generation_.fetch_add(1, std::memory_order_relaxed); }
+
+    using InodeIndex = std::unordered_multimap<ino_t, const node*>;
+
+    // Returns all active nodes with the inode number |ino|. Must be called with |lock_| held,
+    // and the returned range is only valid until it is released.
+    std::pair<InodeIndex::const_iterator, InodeIndex::const_iterator> NodesWithInode(
+            ino_t ino) const {
+        return nodes_by_ino_.equal_range(ino);
+    }
+
   private:
-    std::recursive_mutex* lock_;
+    RecursiveSharedMutex* lock_;
+    // Only maintained if |kEnableInodeTracking|.
     std::unordered_set<const node*> active_nodes_;
+    // Several nodes can share an inode number, e.g. the same file looked up with different
+    // transforms, or hard links.
+    InodeIndex nodes_by_ino_;
+
+    std::atomic<uint64_t> lookups_;
+    std::atomic<uint64_t> nodes_created_;
+    std::atomic<uint64_t> nodes_deleted_;
+    // Bumped whenever a node with children is renamed, invalidating all cached paths of this
+    // mount's nodes.
+    std::atomic<uint64_t> path_generation_{0};
+
+    SlabAllocator node_allocator_;
+    SlabAllocator handle_allocator_;
+    SlabAllocator dirhandle_allocator_;
 };
 
-class node {
+class node : public SlabAllocated<node> {
   public:
     // Creates a new node with the specified parent, name and lock.
     static node* Create(node* parent, const std::string& name, const std::string& io_path,
                         const bool transforms_complete, const int transforms,
-                        const int transforms_reason, std::recursive_mutex* lock, ino_t ino,
+                        const int transforms_reason, RecursiveSharedMutex* lock, ino_t ino,
                         NodeTracker* tracker) {
         // Place the entire constructor under a critical section to make sure
         // node creation, tracking (if enabled) and the addition to a parent are
         // atomic.
-        std::lock_guard<std::recursive_mutex> guard(*lock);
-        return new node(parent, name, io_path, transforms_complete, transforms, transforms_reason,
-                        lock, ino, tracker);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock);
+        return new (tracker->node_allocator()) node(parent, name, io_path, transforms_complete,
+                                                    transforms, transforms_reason, lock, ino,
+                                                    tracker);
     }
 
     // Creates a new root node. Root nodes have no parents by definition
     // and their "name" must signify an absolute path.
-    static node* CreateRoot(const std::string& path, std::recursive_mutex* lock, ino_t ino,
+    static node* CreateRoot(const std::string& path, RecursiveSharedMutex* lock, ino_t ino,
                             NodeTracker* tracker) {
-        std::lock_guard<std::recursive_mutex> guard(*lock);
-        node* root = new node(nullptr, path, path, true /* transforms_complete */,
-                              0 /* transforms */, 0 /* transforms_reason */, lock, ino, tracker);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock);
+        node* root = new (tracker->node_allocator())
+                node(nullptr, path, path, true /* transforms_complete */, 0 /* transforms */,
+                     0 /* transforms_reason */, lock, ino, tracker);
 
         // The root always has one extra reference to avoid it being
         // accidentally collected.
@@ -181,6 +353,10 @@ class node {
         return reinterpret_cast<node*>(static_cast<uintptr_t>(ino));
     }
 
+    // Returns whether this node hasn't been deleted. Doesn't need any lock, but the memory of the
+    // node must still be allocated, see NodeTracker::Exists().
+    bool IsLive() const { return magic_.load(std::memory_order_relaxed) == kLiveMagic; }
+
     // Maps a node to its associated inode.
     static __u64 ToInode(node* node) {
         return static_cast<__u64>(reinterpret_cast<uintptr_t>(node));
@@ -190,21 +366,53 @@ class node {
     // zero as a result of this call to Release, meaning that it's no longer
     // safe to perform any operations on references to this node.
     bool Release(uint32_t count) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
-        if (refcount_ >= count) {
-            refcount_ -= count;
-            if (refcount_ == 0) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        const uint32_t refcount = refcount_.load(std::memory_order_relaxed);
+        if (refcount >= count) {
+            refcount_.store(refcount - count, std::memory_order_relaxed);
+            if (refcount == count) {
                 delete this;
                 return true;
             }
         } else {
-            LOG(ERROR) << "Mismatched reference count: refcount_ = " << this->refcount_
+            LOG(ERROR) << "Mismatched reference count: refcount_ = " << refcount
+                       << " ,count = " << count;
+        }
+
+        return false;
+    }
+
+    // Like Release() but doesn't delete the nodes whose refcount dropped to zero, including the
+    // ancestors released as a result. Instead unlinks them from the tree, so that they can no
+    // longer be found, and appends them to |reclaimed| to be deleted with Reclaim() after
+    // |lock_| is released.
+    bool Release(uint32_t count, std::vector<node*>* reclaimed) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        const uint32_t refcount = refcount_.load(std::memory_order_relaxed);
+        if (refcount >= count) {
+            refcount_.store(refcount - count, std::memory_order_relaxed);
+            if (refcount == count) {
+                Unlink(reclaimed);
+                reclaimed->push_back(this);
+                return true;
+            }
+        } else {
+            LOG(ERROR) << "Mismatched reference count: refcount_ = " << refcount
                        << " ,count = " << count;
         }
 
         return false;
     }
 
+    // Deletes the nodes unlinked by Release(uint32_t, std::vector<node*>*). Must be called
+    // without |lock_| held, since freeing the nodes needn't block other operations.
+    static void Reclaim(std::vector<node*>* reclaimed) {
+        for (node* node : *reclaimed) {
+            delete node;
+        }
+        reclaimed->clear();
+    }
+
     // Builds the full path associated with this node, including all path segments
     // associated with its descendants.
     std::string BuildPath() const;
@@ -218,6 +426,7 @@ class node {
     // |transforms| is an opaque flag that is used to distinguish multiple nodes sharing the same
     // |name| but requiring different IO transformations as determined by the MediaProvider.
     node* LookupChildByName(const std::string& name, bool acquire, const int transforms = 0) const {
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
         return ForChild(name, [acquire, transforms](node* child) {
             if (child->transforms_ == transforms) {
                 if (acquire) {
@@ -233,18 +442,20 @@ class node {
     // all open handles etc. to the deleted nodes are preserved until their refcount goes
     // to zero.
     void SetDeletedForChild(const std::string& name) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         ForChild(name, [](node* child) {
-            child->SetDeleted();
+            child->deleted_ = true;
             return false;
         });
     }
 
     void SetDeleted() {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         deleted_ = true;
     }
 
     void RenameChild(const std::string& old_name, const std::string& new_name, node* new_parent) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         ForChild(old_name, [=](node* child) {
             child->Rename(new_name, new_parent);
             return false;
@@ -252,48 +463,47 @@ class node {
     }
 
     void Rename(const std::string& name, node* new_parent) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
 
         if (new_parent != parent_) {
             RemoveFromParent();
             name_ = name;
+            name_hash_ = CaseFoldedHash(name_);
             AddToParent(new_parent);
+            InvalidateCachedPath();
             return;
         }
 
-        // Changing name_ will change the expected position of this node in parent's set of
-        // children. Consider following scenario:
-        // 1. This node: "b"; parent's set: {"a", "b", "c"}
-        // 2. Rename("b", "d")
-        //
-        // After rename, parent's set should become: {"a", "b", "d"}, but if we simply change the
-        // name it will be {"a", "d", "b"}, which violates properties of the set.
+        // Changing name_ will change the key of this node in parent's index of children, so
+        // lookups by the new name would probe the wrong slot if we simply changed the name.
         //
-        // To make sure that parent's set is always valid, changing name is 3 steps procedure:
-        // 1. Remove this node from parent's set.
+        // To make sure that parent's index is always valid, changing name is 3 steps procedure:
+        // 1. Remove this node from parent's index.
         // 2  Change the name.
-        // 3. Add it back to the set.
+        // 3. Add it back to the index.
         // Rename of node without changing its parent. Still need to remove and re-add it to make
         // sure lookup index is correct.
         if (name_ != name) {
             // If this is a root node, simply rename it.
             if (parent_ == nullptr) {
                 name_ = name;
+                name_hash_ = CaseFoldedHash(name_);
+                InvalidateCachedPath();
                 return;
             }
 
-            auto it = parent_->children_.find(this);
-            CHECK(it != parent_->children_.end());
-            parent_->children_.erase(it);
+            parent_->children_.erase(this);
 
             name_ = name;
+            name_hash_ = CaseFoldedHash(name_);
 
             parent_->children_.insert(this);
+            InvalidateCachedPath();
         }
     }
 
     const std::string& GetName() const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
         return name_;
     }
 
@@ -312,12 +522,12 @@ class node {
     }
 
     node* GetParent() const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
         return parent_;
     }
 
     inline void AddHandle(handle* h) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         handles_.emplace_back(std::unique_ptr<handle>(h));
     }
 
@@ -339,7 +549,7 @@ class node {
     }
 
     bool HasCachedHandle() const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
 
         for (const auto& handle : handles_) {
             if (handle->cached) {
@@ -350,7 +560,7 @@ class node {
     }
 
     std::unique_ptr<FdAccessResult> CheckHandleForUid(const uid_t uid) const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
 
         bool found_handle = false;
         bool redaction_not_needed = false;
@@ -369,28 +579,40 @@ class node {
     }
 
     void SetName(std::string name) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        // Callers only change the case of the name, which keeps the key in the parent's index
+        // the same, but re-index anyway if that ever stops being true.
+        const uint32_t hash = CaseFoldedHash(name);
+        if (parent_ != nullptr && (hash != name_hash_ || !CaseFoldedEquals(name_, name))) {
+            parent_->children_.erase(this);
+            name_ = std::move(name);
+            name_hash_ = hash;
+            parent_->children_.insert(this);
+            InvalidateCachedPath();
+            return;
+        }
         name_ = std::move(name);
+        InvalidateCachedPath();
     }
 
     bool HasRedactedCache() const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
         return has_redacted_cache_;
     }
 
     void SetRedactedCache(bool state) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         has_redacted_cache_ = state;
     }
 
     inline void AddDirHandle(dirhandle* d) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
 
         dirhandles_.emplace_back(std::unique_ptr<dirhandle>(d));
     }
 
     void DestroyDirHandle(dirhandle* d) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
 
         auto comp = [d](const std::unique_ptr<dirhandle>& ptr) { return ptr.get() == d; };
         auto it = std::find_if(dirhandles_.begin(), dirhandles_.end(), comp);
@@ -406,26 +628,76 @@ class node {
     static const node* LookupAbsolutePath(const node* root, const std::string& absolute_path);
 
     // Looks up for the node with the given ino rooted at |root|, or nullptr if no such node exists.
+    // Only matches nodes that aren't deleted and have open handles. This is a hash lookup in the
+    // inode index of |root|'s NodeTracker rather than a walk over the tree.
     static const node* LookupInode(const node* root, ino_t ino);
 
-    int GetBackingId() {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
-        return backing_id_;
+    // Returns the upstream passthrough backing id registered for |io_path| opened with
+    // |access_mode| (O_RDONLY, O_WRONLY or O_RDWR) and takes a reference to it, or returns 0 if
+    // there is none yet.
+    int AcquireBackingId(const std::string& io_path, int access_mode) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        for (BackingId& backing_id : backing_ids_) {
+            if (backing_id.access_mode == access_mode && backing_id.io_path == io_path) {
+                backing_id.refcount++;
+                return backing_id.id;
+            }
+        }
+        return 0;
+    }
+
+    // Adds |id|, just registered for |io_path| opened with |access_mode|, with one reference and
+    // returns it. If another id was added for them in the meantime, takes a reference to that
+    // one and returns it instead, and the caller must close |id|.
+    int AddBackingId(const std::string& io_path, int access_mode, int id) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        const int existing = AcquireBackingId(io_path, access_mode);
+        if (existing) {
+            return existing;
+        }
+        backing_ids_.push_back({io_path, access_mode, id, 1 /* refcount */});
+        return id;
     }
 
-    // A Node should only have one backing id.
-    bool SetBackingId(int new_id) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
-        if (backing_id_) return false;
-        backing_id_ = new_id;
-        return true;
+    // Drops a reference to backing id |id|. Unused ids are kept around for the next open, so
+    // this only returns true, meaning that the caller must close |id|, if the node was deleted
+    // or already keeps enough unused ids.
+    bool ReleaseBackingId(int id) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        auto it = std::find_if(backing_ids_.begin(), backing_ids_.end(),
+                               [id](const BackingId& backing_id) { return backing_id.id == id; });
+        CHECK(it != backing_ids_.end());
+        CHECK(it->refcount > 0);
+        if (--it->refcount > 0) {
+            return false;
+        }
+        const size_t unused =
+                std::count_if(backing_ids_.begin(), backing_ids_.end(),
+                              [](const BackingId& backing_id) { return backing_id.refcount == 0; });
+        if (deleted_ || unused > kMaxUnusedBackingIds) {
+            backing_ids_.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    // Returns all backing ids, to be closed once the node is gone.
+    std::vector<int> GetBackingIds() const {
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
+        std::vector<int> ids;
+        for (const BackingId& backing_id : backing_ids_) {
+            ids.push_back(backing_id.id);
+        }
+        return ids;
     }
 
   private:
     node(node* parent, const std::string& name, const std::string& io_path,
          const bool transforms_complete, const int transforms, const int transforms_reason,
-         std::recursive_mutex* lock, ino_t ino, NodeTracker* tracker)
-        : name_(name),
+         RecursiveSharedMutex* lock, ino_t ino, NodeTracker* tracker)
+        : magic_(kLiveMagic),
+          name_(name),
+          name_hash_(CaseFoldedHash(name)),
           io_path_(io_path),
           transforms_complete_(transforms_complete),
           transforms_(transforms),
@@ -436,9 +708,9 @@ class node {
           deleted_(false),
           lock_(lock),
           ino_(ino),
-          backing_id_(0),
           tracker_(tracker) {
         tracker_->NodeCreated(this);
+        tracker_->InodeAdded(ino_, this);
         Acquire();
         // This is a special case for the root node. All other nodes will have a
         // non-null parent.
@@ -450,14 +722,13 @@ class node {
     // Acquires a reference to a node. This maps to the "lookup count" specified
     // by the FUSE documentation and must only happen under the circumstances
     // documented in libfuse/include/fuse_lowlevel.h.
-    inline void Acquire() {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
-        refcount_++;
-    }
+    // Only needs |lock_| to be held in shared mode, so that lookups can acquire the nodes they
+    // return while racing with other lookups. Dropping references requires exclusive ownership.
+    inline void Acquire() { refcount_.fetch_add(1, std::memory_order_relaxed); }
 
     // Adds this node to a specified parent.
     void AddToParent(node* parent) {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
         // This method assumes this node is currently unparented.
         CHECK(parent_ == nullptr);
         // Check that the new parent isn't nullptr either.
@@ -472,35 +743,53 @@ class node {
     }
 
     // Removes this node from its current parent, and set its parent to nullptr.
-    void RemoveFromParent() {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+    void RemoveFromParent(std::vector<node*>* reclaimed = nullptr) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
 
         if (parent_ != nullptr) {
-            auto it = parent_->children_.find(this);
-            CHECK(it != parent_->children_.end());
-            parent_->children_.erase(it);
+            parent_->children_.erase(this);
 
-            parent_->Release(1);
+            if (reclaimed != nullptr) {
+                parent_->Release(1, reclaimed);
+            } else {
+                parent_->Release(1);
+            }
             parent_ = nullptr;
         }
     }
 
+    // Removes this node from the tree and the inode index, before deleting it. Appends the
+    // ancestors whose refcount drops to zero as a result to |reclaimed|, or deletes them if
+    // |reclaimed| is nullptr.
+    void Unlink(std::vector<node*>* reclaimed) {
+        std::lock_guard<RecursiveSharedMutex> guard(*lock_);
+        RemoveFromParent(reclaimed);
+        tracker_->InodeRemoved(ino_, this);
+        unlinked_ = true;
+    }
+
     // Finds *all* non-deleted nodes matching |name| and runs the function |callback| on each
     // node until |callback| returns true.
     // When |callback| returns true, the matched node is returned
+    // Must be called with |lock_| held, in exclusive mode if |callback| modifies the tree.
     node* ForChild(const std::string& name, const std::function<bool(node*)>& callback) const {
-        std::lock_guard<std::recursive_mutex> guard(*lock_);
+        const ChildIndex::Slot* slot = children_.Find(name, CaseFoldedHash(name));
+        if (slot == nullptr) {
+            return nullptr;
+        }
 
-        // lower_bound will give us the first child with strcasecmp(child->name, name) >=0.
-        // For more context see comment on the NodeCompare struct.
-        auto start = children_.lower_bound(std::make_pair(name, 0));
-        // upper_bound will give us the first child with strcasecmp(child->name, name) > 0
-        auto end =
-                children_.upper_bound(std::make_pair(name, std::numeric_limits<uintptr_t>::max()));
+        if (slot->rest.empty()) {
+            // Fast path: only one child with this name, which is by far the most common case.
+            node* child = slot->first;
+            return (!child->deleted_ && callback(child)) ? child : nullptr;
+        }
 
-        // Make a copy of the matches because calling callback might modify the list which will
+        // Make a copy of the matches because calling callback might modify the index which will
         // cause issues while iterating over them.
-        std::vector<node*> children(start, end);
+        std::vector<node*> children;
+        children.reserve(slot->rest.size() + 1);
+        children.push_back(slot->first);
+        children.insert(children.end(), slot->rest.begin(), slot->rest.end());
 
         for (node* child : children) {
             if (!child->deleted_ && callback(child)) {
@@ -511,52 +800,247 @@ class node {
         return nullptr;
     }
 
-    // A custom heterogeneous comparator used for set of this node's children_ to speed up child
-    // node by name lookups.
-    //
-    // This comparator treats node* as pair (node->name_, node): two nodes* are first
-    // compared by their name using case-insenstive comparison function. If their names are equal,
-    // then pointers are compared as integers.
-    //
-    // See LookupChildByName function to see how this comparator is used.
+    // Hashes |name| ignoring ASCII case, consistently with the strcasecmp() comparison used to
+    // match child names. Uses 32-bit FNV-1a over the lower-cased bytes.
+    static uint32_t CaseFoldedHash(const std::string& name) {
+        uint32_t hash = 2166136261u;
+        for (const char c : name) {
+            const unsigned char folded = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+            hash = (hash ^ folded) * 16777619u;
+        }
+        return hash;
+    }
+
+    static bool CaseFoldedEquals(const std::string& lhs, const std::string& rhs) {
+        return lhs.size() == rhs.size() && strcasecmp(lhs.c_str(), rhs.c_str()) == 0;
+    }
+
+    // An index of a node's children keyed by case-folded name, used to speed up child node by
+    // name lookups.
     //
-    // Note that it's important to first compare by name_, since it will make all nodes with same
-    // name (compared using strcasecmp) together, which allows LookupChildByName function to find
-    // range of the candidate nodes by issuing two binary searches.
-    struct NodeCompare {
-        using is_transparent = void;
-
-        bool operator()(const node* lhs, const node* rhs) const {
-            int cmp = strcasecmp(lhs->name_.c_str(), rhs->name_.c_str());
-            if (cmp != 0) {
-                return cmp < 0;
+    // This is an open-addressing hash table with linear probing. Each slot holds every child
+    // whose name is equal to the others ignoring case, ordered by address, so that lookups visit
+    // same-name nodes (which differ only in their transforms) in a stable order. The first node
+    // of a slot is stored inline, so the common case of a single child per name never allocates.
+    class ChildIndex {
+      public:
+        struct Slot {
+            // nullptr if the slot is empty.
+            node* first = nullptr;
+            // Other children with the same case-folded name as |first|, ordered by address.
+            std::vector<node*> rest;
+            // Copy of first->name_hash_, to avoid dereferencing nodes while probing.
+            uint32_t hash = 0;
+        };
+
+        class const_iterator {
+          public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = node*;
+            using difference_type = std::ptrdiff_t;
+            using pointer = node* const*;
+            using reference = node* const&;
+
+            reference operator*() const { return pos_ == 0 ? slot_->first : slot_->rest[pos_ - 1]; }
+
+            const_iterator& operator++() {
+                if (pos_ < slot_->rest.size()) {
+                    ++pos_;
+                } else {
+                    pos_ = 0;
+                    ++slot_;
+                    SkipEmpty();
+                }
+                return *this;
+            }
+
+            bool operator==(const const_iterator& other) const {
+                return slot_ == other.slot_ && pos_ == other.pos_;
             }
-            return reinterpret_cast<uintptr_t>(lhs) < reinterpret_cast<uintptr_t>(rhs);
+            bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+          private:
+            const_iterator(const Slot* slot, const Slot* end) : slot_(slot), end_(end), pos_(0) {
+                SkipEmpty();
+            }
+
+            void SkipEmpty() {
+                while (slot_ != end_ && slot_->first == nullptr) {
+                    ++slot_;
+                }
+            }
+
+            const Slot* slot_;
+            const Slot* end_;
+            size_t pos_;
+
+            friend class ChildIndex;
+        };
+
+        const_iterator begin() const {
+            return const_iterator(slots_.data(), slots_.data() + slots_.size());
+        }
+        const_iterator end() const {
+            return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size());
+        }
+
+        bool empty() const { return size_ == 0; }
+        size_t size() const { return size_; }
+
+        // Returns the slot holding the children matching |name| (whose CaseFoldedHash() is
+        // |hash|), or nullptr if there are none.
+        const Slot* Find(const std::string& name, uint32_t hash) const {
+            if (slots_.empty()) {
+                return nullptr;
+            }
+            const size_t mask = slots_.size() - 1;
+            for (size_t i = hash & mask; slots_[i].first != nullptr; i = (i + 1) & mask) {
+                if (slots_[i].hash == hash && CaseFoldedEquals(slots_[i].first->name_, name)) {
+                    return &slots_[i];
+                }
+            }
+            return nullptr;
+        }
+
+        void insert(node* child) {
+            // Keep the load factor of occupied slots at or below 3/4.
+            if ((used_ + 1) * 4 > slots_.size() * 3) {
+                Rehash(std::max<size_t>(kMinCapacity, slots_.size() * 2));
+            }
+
+            Slot& slot = slots_[Probe(child->name_, child->name_hash_)];
+            if (slot.first == nullptr) {
+                slot.first = child;
+                slot.hash = child->name_hash_;
+                ++used_;
+            } else if (child < slot.first) {
+                slot.rest.insert(slot.rest.begin(), slot.first);
+                slot.first = child;
+            } else {
+                CHECK(child != slot.first);
+                auto it = std::lower_bound(slot.rest.begin(), slot.rest.end(), child);
+                CHECK(it == slot.rest.end() || *it != child);
+                slot.rest.insert(it, child);
+            }
+            ++size_;
+        }
+
+        void erase(node* child) {
+            CHECK(!slots_.empty());
+            const size_t i = Probe(child->name_, child->name_hash_);
+            Slot& slot = slots_[i];
+            CHECK(slot.first != nullptr);
+
+            if (slot.first == child) {
+                if (slot.rest.empty()) {
+                    RemoveSlot(i);
+                } else {
+                    slot.first = slot.rest.front();
+                    slot.rest.erase(slot.rest.begin());
+                }
+            } else {
+                auto it = std::lower_bound(slot.rest.begin(), slot.rest.end(), child);
+                CHECK(it != slot.rest.end() && *it == child);
+                slot.rest.erase(it);
+            }
+            --size_;
         }
 
-        bool operator()(const node* lhs, const std::pair<std::string, uintptr_t>& rhs) const {
-            int cmp = strcasecmp(lhs->name_.c_str(), rhs.first.c_str());
-            if (cmp != 0) {
-                return cmp < 0;
+      private:
+        static constexpr size_t kMinCapacity = 8;
+
+        // Returns the index of the slot for |name|: either the one already holding matching
+        // children or the empty slot where they should go.
+        size_t Probe(const std::string& name, uint32_t hash) const {
+            const size_t mask = slots_.size() - 1;
+            size_t i = hash & mask;
+            while (slots_[i].first != nullptr &&
+                   !(slots_[i].hash == hash && CaseFoldedEquals(slots_[i].first->name_, name))) {
+                i = (i + 1) & mask;
             }
-            return reinterpret_cast<uintptr_t>(lhs) < rhs.second;
+            return i;
         }
 
-        bool operator()(const std::pair<std::string, uintptr_t>& lhs, const node* rhs) const {
-            int cmp = strcasecmp(lhs.first.c_str(), rhs->name_.c_str());
-            if (cmp != 0) {
-                return cmp < 0;
+        // Empties slot |i| and shifts back any following entries of the probe sequence, so that
+        // lookups never need tombstones.
+        void RemoveSlot(size_t i) {
+            const size_t mask = slots_.size() - 1;
+            slots_[i] = Slot();
+            for (size_t j = (i + 1) & mask; slots_[j].first != nullptr; j = (j + 1) & mask) {
+                const size_t home = slots_[j].hash & mask;
+                // Move slot |j| into the hole unless its home lies cyclically in (i, j].
+                const bool home_in_between = (i <= j) ? (i < home && home <= j)
+                                                      : (i < home || home <= j);
+                if (!home_in_between) {
+                    slots_[i] = std::move(slots_[j]);
+                    slots_[j] = Slot();
+                    i = j;
+                }
+            }
+            --used_;
+        }
+
+        void Rehash(size_t capacity) {
+            std::vector<Slot> old_slots(capacity);
+            old_slots.swap(slots_);
+            const size_t mask = slots_.size() - 1;
+            for (Slot& slot : old_slots) {
+                if (slot.first == nullptr) {
+                    continue;
+                }
+                size_t i = slot.hash & mask;
+                while (slots_[i].first != nullptr) {
+                    i = (i + 1) & mask;
+                }
+                slots_[i] = std::move(slot);
             }
-            return lhs.second < reinterpret_cast<uintptr_t>(rhs);
         }
+
+        // Capacity is always zero or a power of two.
+        std::vector<Slot> slots_;
+        // Number of non-empty slots.
+        size_t used_ = 0;
+        // Number of children.
+        size_t size_ = 0;
     };
 
     // A helper function to recursively construct the absolute path of a given node.
     // If |safe| is true, builds a PII safe path instead
     void BuildPathForNodeRecursive(bool safe, const node* node, std::stringstream* path) const;
 
+    // The absolute path of a node, valid as long as |generation| matches its tracker's
+    // PathGeneration().
+    struct CachedPath {
+        uint64_t generation;
+        std::string path;
+    };
+
+    // Returns the cached absolute path of this node, building it (and the paths of any ancestors
+    // that aren't cached) if the cached one is missing or stale. Must be called with |lock_| held.
+    std::shared_ptr<const CachedPath> GetCachedPath(uint64_t generation) const;
+
+    // Invalidates the cached path of this node after its name or parent changed. Must be called
+    // with |lock_| held exclusively.
+    void InvalidateCachedPath() {
+        std::atomic_store(&cached_path_, std::shared_ptr<const CachedPath>());
+        if (!children_.empty()) {
+            // Every descendant path is now stale too. Rather than walking the subtree, bump the
+            // generation so that all cached paths are lazily rebuilt on next use. Directory
+            // renames are rare enough that dropping unrelated cached paths of the same mount
+            // doesn't matter.
+            tracker_->InvalidateCachedPaths();
+        }
+    }
+
+    // |kLiveMagic| until the node is deleted. First, so that the slab allocator's free list also
+    // overwrites it.
+    static constexpr uint32_t kLiveMagic = 0x65646f6e;  // "node"
+    std::atomic<uint32_t> magic_;
     // The name of this node. Non-const because it can change during renames.
     std::string name_;
+    // CaseFoldedHash() of |name_|, the key of this node in its parent's |children_|. Recomputed
+    // together with |name_|.
+    uint32_t name_hash_;
     // Filesystem path that will be used for IO (if it is non-empty) instead of node->BuildPath
     const std::string io_path_;
     // Whether any transforms required on |io_path_| are complete.
@@ -571,11 +1055,11 @@ class node {
     // This value should not be interpreted in native but should be passed to the MediaProvider
     // as part of a transform function
     const int transforms_reason_;
-    // The reference count for this node. Guarded by |lock_|.
-    uint32_t refcount_;
-    // Set of children of this node. All of them contain a back reference
+    // The reference count for this node. Guarded by |lock_|, see Acquire() for details.
+    std::atomic<uint32_t> refcount_;
+    // Index of children of this node. All of them contain a back reference
     // to their parent. Guarded by |lock_|.
-    std::set<node*, NodeCompare> children_;
+    ChildIndex children_;
     // Containing directory for this node. Guarded by |lock_|.
     node* parent_;
     // List of file handles associated with this node. Guarded by |lock_|.
@@ -584,16 +1068,35 @@ class node {
     std::vector<std::unique_ptr<dirhandle>> dirhandles_;
     bool has_redacted_cache_;
     bool deleted_;
-    std::recursive_mutex* lock_;
+    // Whether Unlink() was called, i.e. the node is only waiting to be deleted.
+    bool unlinked_ = false;
+    RecursiveSharedMutex* lock_;
     // Inode number of the file represented by this node.
     const ino_t ino_;
-    // Backing identifier for upstream passthrough
-    int backing_id_;
+    // An upstream passthrough backing file registered with the kernel, reference counted by the
+    // handles using it.
+    struct BackingId {
+        std::string io_path;
+        int access_mode;
+        int id;
+        uint32_t refcount;
+    };
+    // Maximum number of backing ids without references to keep around for reopens.
+    static constexpr size_t kMaxUnusedBackingIds = 1;
+    // Backing ids for upstream passthrough, usually at most one. Guarded by |lock_|.
+    std::vector<BackingId> backing_ids_;
 
     NodeTracker* const tracker_;
+    // Absolute path of this node, built lazily by BuildPath(). Only read and written through
+    // std::atomic_load/std::atomic_store because concurrent BuildPath() calls holding |lock_| in
+    // shared mode may race to fill it.
+    mutable std::shared_ptr<const CachedPath> cached_path_;
 
     ~node() {
-        RemoveFromParent();
+        magic_.store(0, std::memory_order_relaxed);
+        if (!unlinked_) {
+            Unlink(nullptr);
+        }
 
         handles_.clear();
         dirhandles_.clear();
@@ -604,6 +1107,30 @@ class node {
     friend class ::NodeTest;
 };
 
+inline bool NodeTracker::Exists(__u64 ino) const {
+    const node* node = reinterpret_cast<const class node*>(ino);
+    if (kEnableInodeTracking) {
+        std::shared_lock<RecursiveSharedMutex> guard(*lock_);
+        return active_nodes_.find(node) != active_nodes_.end();
+    }
+    // |ino| may not be a node at all, e.g. with FUSE BPF, so check that it can be read first.
+    return node_allocator_.Contains(node) && node->IsLive();
+}
+
+inline void NodeTracker::CheckTracked(__u64 ino) const {
+    // A stale or bogus |ino| from the kernel must hit the CHECK rather than be read.
+    CHECK(Exists(ino)) << "Node: " << ino << " was deleted";
+}
+
+inline NodeTracker::NodeTracker(RecursiveSharedMutex* lock)
+    : lock_(lock),
+      lookups_(0),
+      nodes_created_(0),
+      nodes_deleted_(0),
+      node_allocator_(sizeof(node)),
+      handle_allocator_(sizeof(handle)),
+      dirhandle_allocator_(sizeof(dirhandle)) {}
+
 }  // namespace fuse
 }  // namespace mediaprovider
 
@@ -49,7 +49,7 @@ void node::BuildPathForNodeRecursive(bool safe, const node* node, std::stringstr
     if (safe && node->parent_) {
         (*path) << reinterpret_cast<uintptr_t>(node);
     } else {
-        (*path) << node->GetName();
+        (*path) << node->name_;
     }
   
     if (node != this) {
@@ -58,16 +58,33 @@ void node::BuildPathForNodeRecursive(bool safe, const node* node, std::stringstr
     }
 }
 
+std::shared_ptr<const node::CachedPath> node::GetCachedPath(uint64_t generation) const {
+    std::shared_ptr<const CachedPath> cached = std::atomic_load(&cached_path_);
+    if (cached && cached->generation == generation) {
+        return cached;
+    }
+
+    std::string path;
+    if (parent_) {
+        const std::shared_ptr<const CachedPath> parent_path = parent_->GetCachedPath(generation);
+        path.reserve(parent_path->path.size() + 1 + name_.size());
+        path.append(parent_path->path).append("/");
+    }
+    path.append(name_);
+
+    cached = std::make_shared<const CachedPath>(CachedPath{generation, std::move(path)});
+    std::atomic_store(&cached_path_, cached);
+    return cached;
+}
+
 std::string node::BuildPath() const {
-    std::lock_guard<std::recursive_mutex> guard(*lock_);
-    std::stringstream path;
+    std::shared_lock<RecursiveSharedMutex> guard(*lock_);
 
-    BuildPathForNodeRecursive(false, this, &path);
-    return path.str();
+    return GetCachedPath(tracker_->PathGeneration())->path;
 }
 
 std::string node::BuildSafePath() const {
-    std::lock_guard<std::recursive_mutex> guard(*lock_);
+    std::shared_lock<RecursiveSharedMutex> guard(*lock_);
     std::stringstream path;
 
     BuildPathForNodeRecursive(true, this, &path);
@@ -81,7 +98,7 @@ const node* node::LookupAbsolutePath(const node* root, const std::string& absolu
 
     std::vector<std::string> segments = GetPathSegments(root->GetName().size(), absolute_path);
 
-    std::lock_guard<std::recursive_mutex> guard(*root->lock_);
+    std::shared_lock<RecursiveSharedMutex> guard(*root->lock_);
 
     const node* node = root;
     for (const std::string& segment : segments) {
@@ -96,15 +113,12 @@ const node* node::LookupAbsolutePath(const node* root, const std::string& absolu
 const node* node::LookupInode(const node* root, ino_t ino) {
     CHECK(root);
 
-    std::lock_guard<std::recursive_mutex> guard(*root->lock_);
-
-    if ((root->ino_ == ino) && !root->deleted_ && !(root->handles_.empty())) {
-        return root;
-    }
+    std::shared_lock<RecursiveSharedMutex> guard(*root->lock_);
 
-    for (node* child : root->children_) {
-        const node* node = LookupInode(child, ino);
-        if (node) {
+    auto range = root->tracker_->NodesWithInode(ino);
+    for (auto it = range.first; it != range.second; ++it) {
+        const node* node = it->second;
+        if (!node->deleted_ && !(node->handles_.empty())) {
             return node;
         }
     }
@@ -112,7 +126,7 @@ const node* node::LookupInode(const node* root, ino_t ino) {
 }
 
 void node::DeleteTree(node* tree) {
-    std::lock_guard<std::recursive_mutex> guard(*tree->lock_);
+    std::lock_guard<RecursiveSharedMutex> guard(*tree->lock_);
 
     if (tree) {
         // Guarantee this node not be released while deleting its children.
@@ -1,15 +1,21 @@
 #include <gtest/gtest.h>
 
+#include <fcntl.h>
+
 #include "node-inl.h"
 
 #include <algorithm>
-#include <limits>
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
 
 using mediaprovider::fuse::handle;
 using mediaprovider::fuse::node;
 using mediaprovider::fuse::NodeTracker;
+using mediaprovider::fuse::RecursiveSharedMutex;
 
 // Listed as a friend class to struct node so it can observe implementation
 // details if required. The only implementation detail that is worth writing
@@ -20,7 +26,7 @@ class NodeTest : public ::testing::Test {
 
     uint32_t GetRefCount(node* node) { return node->refcount_; }
 
-    std::recursive_mutex lock_;
+    RecursiveSharedMutex lock_;
     NodeTracker tracker_;
 
     // Forward destruction here, as NodeTest is a friend class.
@@ -40,9 +46,6 @@ class NodeTest : public ::testing::Test {
                                 const std::function<bool(class node*)>& callback) {
         return node->ForChild(name, callback);
     }
-
-    // Expose NodeCompare for testing.
-    node::NodeCompare cmp;
 };
 
 TEST_F(NodeTest, TestCreate) {
@@ -83,6 +86,28 @@ TEST_F(NodeTest, TestRelease) {
     ASSERT_TRUE(node->Release(2));
 }
 
+TEST_F(NodeTest, TestReleaseReclaimed) {
+    node* parent = node::Create(nullptr, "/path", "", true, 0, 0, &lock_, 0, &tracker_);
+    node* child = node::Create(parent, "subdir", "", true, 0, 0, &lock_, 0, &tracker_);
+    node* grandchild = node::Create(child, "file", "", true, 0, 0, &lock_, 0, &tracker_);
+    ASSERT_EQ(2, GetRefCount(parent));
+    ASSERT_FALSE(parent->Release(1));
+
+    std::vector<node*> reclaimed;
+    ASSERT_FALSE(child->Release(1, &reclaimed));
+    ASSERT_TRUE(reclaimed.empty());
+
+    // Releasing the last node of the chain unlinks all of its ancestors, without deleting them.
+    const uint64_t deleted = tracker_.GetStats().nodes_deleted;
+    ASSERT_TRUE(grandchild->Release(1, &reclaimed));
+    ASSERT_EQ(3, reclaimed.size());
+    ASSERT_EQ(deleted, tracker_.GetStats().nodes_deleted);
+
+    node::Reclaim(&reclaimed);
+    ASSERT_TRUE(reclaimed.empty());
+    ASSERT_EQ(deleted + 3, tracker_.GetStats().nodes_deleted);
+}
+
 TEST_F(NodeTest, TestRenameName) {
     unique_node_ptr parent = CreateNode(nullptr, "/path");
 
@@ -248,6 +273,63 @@ TEST_F(NodeTest, TestBuildPath) {
     ASSERT_EQ("/path/subdir2/subsubdir", subchild->BuildPath());
 }
 
+TEST_F(NodeTest, TestBuildPath_afterAncestorRename) {
+    unique_node_ptr root = CreateNode(nullptr, "/path");
+    unique_node_ptr other = CreateNode(root.get(), "other");
+    unique_node_ptr dir = CreateNode(root.get(), "dir");
+    unique_node_ptr subdir = CreateNode(dir.get(), "subdir");
+    unique_node_ptr file = CreateNode(subdir.get(), "file");
+
+    // Populate the cached paths.
+    ASSERT_EQ("/path/dir/subdir/file", file->BuildPath());
+    ASSERT_EQ("/path/other", other->BuildPath());
+
+    dir->Rename("dir_new", root.get());
+    ASSERT_EQ("/path/dir_new/subdir/file", file->BuildPath());
+    ASSERT_EQ("/path/dir_new/subdir", subdir->BuildPath());
+
+    subdir->Rename("subdir", other.get());
+    ASSERT_EQ("/path/other/subdir/file", file->BuildPath());
+
+    file->Rename("file_new", subdir.get());
+    ASSERT_EQ("/path/other/subdir/file_new", file->BuildPath());
+
+    file->SetName("FILE_NEW");
+    ASSERT_EQ("/path/other/subdir/FILE_NEW", file->BuildPath());
+
+    root->Rename("/root", nullptr);
+    ASSERT_EQ("/root/other/subdir/FILE_NEW", file->BuildPath());
+    ASSERT_EQ("/root/dir_new", dir->BuildPath());
+}
+
+TEST_F(NodeTest, TestBuildPath_renameOnOtherMount) {
+    RecursiveSharedMutex other_lock;
+    NodeTracker other_tracker(&other_lock);
+    unique_node_ptr other_root(
+            node::Create(nullptr, "/other", "", true, 0, 0, &other_lock, 0, &other_tracker),
+            &NodeTest::destroy);
+    unique_node_ptr other_dir(
+            node::Create(other_root.get(), "dir", "", true, 0, 0, &other_lock, 0, &other_tracker),
+            &NodeTest::destroy);
+    unique_node_ptr other_file(
+            node::Create(other_dir.get(), "file", "", true, 0, 0, &other_lock, 0, &other_tracker),
+            &NodeTest::destroy);
+    unique_node_ptr root = CreateNode(nullptr, "/path");
+    unique_node_ptr dir = CreateNode(root.get(), "dir");
+    unique_node_ptr file = CreateNode(dir.get(), "file");
+    ASSERT_EQ("/other/dir/file", other_file->BuildPath());
+    ASSERT_EQ("/path/dir/file", file->BuildPath());
+
+    // Renaming a directory only invalidates the cached paths of its own mount.
+    const uint64_t other_generation = other_tracker.PathGeneration();
+    const uint64_t generation = tracker_.PathGeneration();
+    dir->Rename("dir_new", root.get());
+    ASSERT_EQ(other_generation, other_tracker.PathGeneration());
+    ASSERT_NE(generation, tracker_.PathGeneration());
+    ASSERT_EQ("/other/dir/file", other_file->BuildPath());
+    ASSERT_EQ("/path/dir_new/file", file->BuildPath());
+}
+
 TEST_F(NodeTest, TestSetDeleted) {
     unique_node_ptr parent = CreateNode(nullptr, "/path");
     unique_node_ptr child = CreateNode(parent.get(), "subdir");
@@ -345,6 +427,42 @@ TEST_F(NodeTest, LookupAbsolutePath) {
     ASSERT_EQ(nullptr, node::LookupAbsolutePath(parent.get(), "/path/subdir/subsubdir"));
 }
 
+TEST_F(NodeTest, LookupInode) {
+    unique_node_ptr root(node::Create(nullptr, "/path", "", true, 0, 0, &lock_, 1, &tracker_),
+                         &NodeTest::destroy);
+    unique_node_ptr dir(node::Create(root.get(), "dir", "", true, 0, 0, &lock_, 2, &tracker_),
+                        &NodeTest::destroy);
+    unique_node_ptr file(node::Create(dir.get(), "file", "", true, 0, 0, &lock_, 3, &tracker_),
+                         &NodeTest::destroy);
+    unique_node_ptr file_transformed(
+            node::Create(dir.get(), "file", "", true, 1 /* transforms */, 0, &lock_, 3, &tracker_),
+            &NodeTest::destroy);
+
+    // Only nodes with open handles are found.
+    ASSERT_EQ(nullptr, node::LookupInode(root.get(), 3));
+
+    handle* h = new handle(-1, new mediaprovider::fuse::RedactionInfo, true /* cached */,
+                           false /* passthrough */, 0 /* uid */, 0 /* transforms_uid */);
+    file_transformed->AddHandle(h);
+    ASSERT_EQ(file_transformed.get(), node::LookupInode(root.get(), 3));
+    ASSERT_EQ(nullptr, node::LookupInode(root.get(), 2));
+    ASSERT_EQ(nullptr, node::LookupInode(root.get(), 4));
+
+    // Deleted nodes are skipped.
+    file_transformed->SetDeleted();
+    ASSERT_EQ(nullptr, node::LookupInode(root.get(), 3));
+    file_transformed->DestroyHandle(h);
+
+    // Destroyed nodes are removed from the index.
+    handle* h2 = new handle(-1, new mediaprovider::fuse::RedactionInfo, true /* cached */,
+                            false /* passthrough */, 0 /* uid */, 0 /* transforms_uid */);
+    file->AddHandle(h2);
+    ASSERT_EQ(file.get(), node::LookupInode(root.get(), 3));
+    file->DestroyHandle(h2);
+    file_transformed.reset();
+    ASSERT_EQ(nullptr, node::LookupInode(root.get(), 3));
+}
+
 TEST_F(NodeTest, AddDestroyHandle) {
     unique_node_ptr node = CreateNode(nullptr, "/path");
 
@@ -474,32 +592,6 @@ TEST_F(NodeTest, RenameRoot) {
     ASSERT_EQ(1, GetRefCount(root.get()));
 }
 
-TEST_F(NodeTest, NodeCompareDefinesLinearOrder) {
-    unique_node_ptr node_a = CreateNode(nullptr, "a");
-    unique_node_ptr node_b = CreateNode(nullptr, "B");
-    unique_node_ptr node_c = CreateNode(nullptr, "c");
-
-    ASSERT_FALSE(cmp.operator()(node_a.get(), node_a.get()));
-    ASSERT_FALSE(cmp.operator()(node_b.get(), node_b.get()));
-    ASSERT_FALSE(cmp.operator()(node_c.get(), node_c.get()));
-
-    auto check_fn = [&](const node* lhs_node, const node* rhs_node) {
-        ASSERT_TRUE(cmp.operator()(lhs_node, rhs_node));
-        ASSERT_FALSE(cmp.operator()(rhs_node, lhs_node));
-    };
-
-    check_fn(node_a.get(), node_b.get());
-    check_fn(node_b.get(), node_c.get());
-    check_fn(node_a.get(), node_c.get());
-
-    // ("A", 0) < node_a < ("a", max_uintptr_t) < node_b
-    ASSERT_TRUE(cmp.operator()(std::make_pair("A", 0), node_a.get()));
-    ASSERT_TRUE(cmp.operator()(node_a.get(),
-                               std::make_pair("A", std::numeric_limits<uintptr_t>::max())));
-    ASSERT_TRUE(cmp.operator()(std::make_pair("A", std::numeric_limits<uintptr_t>::max()),
-                               node_b.get()));
-}
-
 TEST_F(NodeTest, LookupChildByName_ChildrenWithSameName) {
     unique_node_ptr parent = CreateNode(nullptr, "/path");
     unique_node_ptr foo1 = CreateNode(parent.get(), "FoO");
@@ -526,6 +618,41 @@ TEST_F(NodeTest, LookupChildByName_ChildrenWithSameName) {
     test_fn("BaZ", baz1.get(), baz2.get());
 }
 
+TEST_F(NodeTest, LookupChildByName_manyChildren) {
+    unique_node_ptr parent = CreateNode(nullptr, "/path");
+    std::vector<unique_node_ptr> children;
+    for (int i = 0; i < 1000; ++i) {
+        children.push_back(CreateNode(parent.get(), "IMG_" + std::to_string(i) + ".JPG"));
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(children[i].get(), parent->LookupChildByName("img_" + std::to_string(i) + ".jpg",
+                                                               false /* acquire */));
+    }
+    ASSERT_EQ(nullptr, parent->LookupChildByName("img_1000.jpg", false /* acquire */));
+
+    // Removing children must keep the remaining ones reachable.
+    for (int i = 0; i < 1000; i += 2) {
+        children[i].reset();
+    }
+    for (int i = 0; i < 1000; ++i) {
+        node* expected = (i % 2 == 0) ? nullptr : children[i].get();
+        ASSERT_EQ(expected, parent->LookupChildByName("IMG_" + std::to_string(i) + ".jpg",
+                                                      false /* acquire */));
+    }
+}
+
+TEST_F(NodeTest, SetName_caseChangeKeepsChildReachable) {
+    unique_node_ptr parent = CreateNode(nullptr, "/path");
+    unique_node_ptr child = CreateNode(parent.get(), "dcim");
+
+    child->SetName("DCIM");
+
+    ASSERT_EQ("DCIM", child->GetName());
+    ASSERT_EQ(child.get(), parent->LookupChildByName("dcim", false /* acquire */));
+    ASSERT_EQ(child.get(), parent->LookupChildByName("DCIM", false /* acquire */));
+}
+
 TEST_F(NodeTest, DestroyDoesntDoubleFree) {
     node* root = node::Create(nullptr, "root", "", true, 0, 0, &lock_, 0, &tracker_);
     node* child = node::Create(root, "child", "", true, 0, 0, &lock_, 0, &tracker_);
@@ -582,3 +709,133 @@ TEST_F(NodeTest, ForChild) {
     ASSERT_EQ(nullptr, node_none);
     ASSERT_TRUE(match_none.empty());
 }
+
+TEST_F(NodeTest, RecursiveSharedMutex_reentrant) {
+    {
+        std::lock_guard<RecursiveSharedMutex> exclusive(lock_);
+        std::lock_guard<RecursiveSharedMutex> exclusive_again(lock_);
+        std::shared_lock<RecursiveSharedMutex> shared(lock_);
+    }
+    {
+        std::shared_lock<RecursiveSharedMutex> shared(lock_);
+        std::shared_lock<RecursiveSharedMutex> shared_again(lock_);
+    }
+
+    // Fully released, so another thread can take it exclusively.
+    std::thread t([this]() { std::lock_guard<RecursiveSharedMutex> exclusive(lock_); });
+    t.join();
+}
+
+TEST_F(NodeTest, RecursiveSharedMutex_upgradeCrashes) {
+    EXPECT_DEATH(
+            {
+                std::shared_lock<RecursiveSharedMutex> shared(lock_);
+                std::lock_guard<RecursiveSharedMutex> exclusive(lock_);
+            },
+            "");
+}
+
+TEST_F(NodeTest, LookupChildByName_concurrentReaders) {
+    unique_node_ptr parent = CreateNode(nullptr, "/path");
+    unique_node_ptr child = CreateNode(parent.get(), "subdir");
+
+    // While this thread holds the tree lock in shared mode, lookups and path builds from other
+    // threads must still make progress.
+    std::shared_lock<RecursiveSharedMutex> shared(lock_);
+    node* found = nullptr;
+    std::string path;
+    std::thread t([&]() {
+        found = parent->LookupChildByName("subdir", false /* acquire */);
+        path = found->BuildPath();
+    });
+    t.join();
+
+    ASSERT_EQ(child.get(), found);
+    ASSERT_EQ("/path/subdir", path);
+}
+
+TEST_F(NodeTest, LookupChildByName_concurrentWithRename) {
+    unique_node_ptr parent = CreateNode(nullptr, "/path");
+    unique_node_ptr child = CreateNode(parent.get(), "a");
+
+    std::atomic_bool done(false);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&]() {
+            while (!done.load()) {
+                node* a = parent->LookupChildByName("a", true /* acquire */);
+                node* b = parent->LookupChildByName("b", true /* acquire */);
+                for (node* n : {a, b}) {
+                    if (n) {
+                        const std::string path = n->BuildPath();
+                        ASSERT_TRUE(path == "/path/a" || path == "/path/b") << path;
+                        ASSERT_FALSE(n->Release(1));
+                    }
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        child->Rename(i % 2 ? "a" : "b", parent.get());
+    }
+    done.store(true);
+    for (std::thread& t : readers) {
+        t.join();
+    }
+
+    ASSERT_EQ(child.get(), parent->LookupChildByName("a", false /* acquire */));
+    ASSERT_EQ(1, GetRefCount(child.get()));
+    ASSERT_EQ(2, GetRefCount(parent.get()));
+}
+
+TEST_F(NodeTest, BackingIds_sharedByCompatibleOpens) {
+    unique_node_ptr node = CreateNode(nullptr, "/path/file.jpg");
+
+    ASSERT_EQ(0, node->AcquireBackingId("/path/file.jpg", O_RDONLY));
+    ASSERT_EQ(7, node->AddBackingId("/path/file.jpg", O_RDONLY, 7));
+    // A racing open registering another id for the same file gets the first one.
+    ASSERT_EQ(7, node->AddBackingId("/path/file.jpg", O_RDONLY, 8));
+    ASSERT_EQ(7, node->AcquireBackingId("/path/file.jpg", O_RDONLY));
+    // Other access modes and io paths need backing ids of their own.
+    ASSERT_EQ(0, node->AcquireBackingId("/path/file.jpg", O_RDWR));
+    ASSERT_EQ(0, node->AcquireBackingId("/path/.transforms/file.jpg", O_RDONLY));
+    ASSERT_EQ(9, node->AddBackingId("/path/file.jpg", O_RDWR, 9));
+
+    // Unused backing ids are kept for the next open, up to a limit.
+    ASSERT_FALSE(node->ReleaseBackingId(7));
+    ASSERT_FALSE(node->ReleaseBackingId(7));
+    ASSERT_FALSE(node->ReleaseBackingId(7));
+    ASSERT_TRUE(node->ReleaseBackingId(9));
+    ASSERT_EQ(std::vector<int>{7}, node->GetBackingIds());
+
+    // Backing ids of deleted files are closed once unused.
+    ASSERT_EQ(7, node->AcquireBackingId("/path/file.jpg", O_RDONLY));
+    node->SetDeleted();
+    ASSERT_TRUE(node->ReleaseBackingId(7));
+    ASSERT_TRUE(node->GetBackingIds().empty());
+}
+
+TEST_F(NodeTest, NodeTracker_stats) {
+    NodeTracker::Stats before = tracker_.GetStats();
+    {
+        unique_node_ptr parent = CreateNode(nullptr, "/path");
+        unique_node_ptr child = CreateNode(parent.get(), "child");
+
+        std::unique_ptr<handle> h(new (tracker_.handle_allocator()) handle(
+                -1, new mediaprovider::fuse::RedactionInfo, true /* cached */,
+                false /* passthrough */, 0 /* uid */, 0 /* transforms_uid */));
+
+        NodeTracker::Stats stats = tracker_.GetStats();
+        ASSERT_EQ(before.nodes_created + 2, stats.nodes_created);
+        ASSERT_EQ(before.nodes_deleted, stats.nodes_deleted);
+        ASSERT_EQ(before.node_slabs.live_objects + 2, stats.node_slabs.live_objects);
+        ASSERT_EQ(before.handle_slabs.live_objects + 1, stats.handle_slabs.live_objects);
+    }
+
+    NodeTracker::Stats after = tracker_.GetStats();
+    ASSERT_EQ(before.nodes_created + 2, after.nodes_created);
+    ASSERT_EQ(before.nodes_deleted + 2, after.nodes_deleted);
+    ASSERT_EQ(before.node_slabs.live_objects, after.node_slabs.live_objects);
+    ASSERT_EQ(before.handle_slabs.live_objects, after.handle_slabs.live_objects);
+}
@@ -30,6 +30,7 @@ import android.graphics.pdf.models.jni.MatchRects;
 import android.graphics.pdf.models.jni.PageSelection;
 import android.graphics.pdf.models.jni.SelectionBoundary;
 import android.graphics.pdf.utils.StrictModeUtils;
+import android.os.CancellationSignal;
 import android.os.ParcelFileDescriptor;
 
 import java.util.List;
@@ -147,6 +148,160 @@ public class PdfDocumentProxy {
             int showAnnotTypes,
             boolean renderFormFields);
 
+    /**
+     * Receives the tiles of a page from {@link #renderTiles} as they are rendered.
+     *
+     * <p>It is called while the document is still locked for the rest of the render: it must not
+     * call into the same {@link PdfDocumentProxy}, which would deadlock. Other documents can be
+     * used meanwhile.
+     */
+    public interface TileCallback {
+        /**
+         * Called once the tile with the given bounds, in bitmap coordinates, is in the bitmap.
+         *
+         * @return true to render the next tile, false to stop
+         */
+        boolean onTileRendered(int left, int top, int right, int bottom);
+    }
+
+    /**
+     * Renders a page to a bitmap like {@link #render}, but one tile at a time, so that slow pages
+     * can be shown partially while the rest is rendered. Tiles are rendered row by row on the
+     * calling thread, and {@code callback} is called after each of them.
+     *
+     * @param tileSize the maximum width and height of a tile, in pixels, or 0 for a single tile
+     * @param callback notified of each tile, can stop the rendering
+     * @return true if every tile was rendered into the destination bitmap
+     * @see #render
+     */
+    public native boolean renderTiles(
+            int pageNum,
+            Bitmap bitmap,
+            int clipLeft,
+            int clipTop,
+            int clipRight,
+            int clipBottom,
+            float[] transform,
+            int renderMode,
+            int showAnnotTypes,
+            boolean renderFormFields,
+            int tileSize,
+            @NonNull TileCallback callback);
+
+    /**
+     * Renders a page to a bitmap like {@link #render}, but progressively, so that it stops within
+     * a few milliseconds of {@code cancellationSignal} being cancelled. Meanwhile, other documents
+     * can use the native library whenever the render pauses.
+     *
+     * <p>The document itself stays locked while the render pauses, since PDFium keeps the state of
+     * the paused render in the page: other calls into the same {@link PdfDocumentProxy} wait for
+     * the render to finish or notice it was cancelled. {@code cancellationSignal} is only polled,
+     * so cancel it from another thread.
+     *
+     * @param cancellationSignal cancels the rendering, e.g. when the page goes off screen
+     * @return true if the page was completely rendered into the destination bitmap, false if the
+     *     rendering was cancelled or failed
+     * @see #render
+     */
+    public native boolean renderProgressive(
+            int pageNum,
+            Bitmap bitmap,
+            int clipLeft,
+            int clipTop,
+            int clipRight,
+            int clipBottom,
+            float[] transform,
+            int renderMode,
+            int showAnnotTypes,
+            boolean renderFormFields,
+            @NonNull CancellationSignal cancellationSignal);
+
+    /**
+     * Renders the whole of a page, scaled to the bitmap, as a thumbnail: faster than {@link
+     * #render} at the expense of quality, without LCD text or anti-aliasing, and with every
+     * annotation shown. Thumbnails make way for the renders of the pages being viewed, for a
+     * little while at most, so this is meant to be called off the UI thread.
+     *
+     * @param pageNum              the page number of the page to be rendered
+     * @param bitmap               an {@link Bitmap.Config#ARGB_8888} or, to use half the memory,
+     *                             {@link Bitmap.Config#RGB_565} bitmap
+     * @param useEmbeddedThumbnail true to scale the thumbnail the document has for the page, if
+     *                             any, rather than rendering it
+     * @return true if the thumbnail was rendered into the bitmap
+     */
+    public native boolean renderThumbnail(int pageNum, Bitmap bitmap,
+            boolean useEmbeddedThumbnail);
+
+    /** Receives the pages of {@link #renderPagesForPrint} in order, as they are rendered. */
+    public interface PrintCallback {
+        /**
+         * Called with each page, rendered into a bitmap that is only valid during the call: it's
+         * used again for the next pages of the same size.
+         *
+         * @return true to go on with the next page, false to stop
+         */
+        boolean onPageRendered(int pageNum, @NonNull Bitmap bitmap);
+    }
+
+    /**
+     * Renders a range of pages for printing, like {@link #render} in {@link
+     * RenderParams#RENDER_MODE_FOR_PRINT}, each of them whole, on white, at the given resolution.
+     * The next page is rendered in the background while {@code callback} handles the current
+     * one, and at most two pages are kept rendered at a time, so that large print jobs are
+     * faster than with a call per page without using more memory. The document can't be used
+     * from {@code callback}.
+     *
+     * @param firstPage        the first page to render
+     * @param lastPage         the last page to render, inclusive
+     * @param dpi              the resolution of the bitmaps, in pixels per inch
+     * @param showAnnotTypes   Bitmask of renderFlags to indicate the types of annotations to
+     *                         be rendered
+     * @param renderFormFields true to include PDF form content in the output
+     * @param callback         handed each page once it's rendered, can stop the rendering
+     * @return true if every page was rendered and handed to {@code callback}
+     */
+    public native boolean renderPagesForPrint(
+            int firstPage,
+            int lastPage,
+            int dpi,
+            int showAnnotTypes,
+            boolean renderFormFields,
+            @NonNull PrintCallback callback);
+
+    /**
+     * Registers a bitmap to render into with {@link #renderToTargets}, from any document. It is
+     * checked once, here, rather than on each render like with {@link #render}, and a single call
+     * renders into many of them, which makes a difference for many small renders, e.g. the tiles
+     * of a viewer. Its pixels are only locked while they are rendered into. The bitmap is kept
+     * until {@link #unregisterRenderTarget} is called.
+     *
+     * @param bitmap a mutable {@link Bitmap.Config#ARGB_8888} bitmap
+     * @return the handle of the render target, or -1 if the bitmap can't be used
+     */
+    public static native int registerRenderTarget(@NonNull Bitmap bitmap);
+
+    /** Releases a render target returned by {@link #registerRenderTarget}. */
+    public static native void unregisterRenderTarget(int target);
+
+    /**
+     * Renders a page into render targets, like {@link #render} into their bitmaps, in a single
+     * call. Each render takes 10 consecutive values of {@code renders}: the affine transform, as
+     * scaleX, skewY, skewX, scaleY, transX and transY, then the clip in bitmap coordinates, as
+     * left, top, right and bottom.
+     *
+     * @param targets the handles of the render targets, from {@link #registerRenderTarget}
+     * @param renders the transform and clip of the render into each of {@code targets}
+     * @return true if the page was rendered into every target
+     * @see #render
+     */
+    public native boolean renderToTargets(
+            int pageNum,
+            @NonNull int[] targets,
+            @NonNull float[] renders,
+            int renderMode,
+            int showAnnotTypes,
+            boolean renderFormFields);
+
     /**
      * Clones the currently loaded document using the provided file descriptor.
      * <p>You are required to detach the file descriptor as the native code will close it.
@@ -185,6 +340,43 @@ public class PdfDocumentProxy {
      */
     public native MatchRects searchPageText(int pageNum, String query);
 
+    /**
+     * Keeps the search text of the pages in the given file from now on, so that searching this
+     * document again, even once reopened, doesn't need to extract the text of the pages already
+     * searched. Pages are added to the file as they are first searched. The file is tied to the
+     * content of this document and is started over if used for another one.
+     *
+     * @param path a file private to the app, e.g. in its cache directory
+     * @return false if the file can't be used, searches still work without it
+     */
+    public native boolean openTextIndex(@NonNull String path);
+
+    /** Receives the matches of {@link #searchDocument} one page at a time. */
+    public interface SearchCallback {
+        /**
+         * Called with the matches on the given page, only for pages that have any.
+         *
+         * @return false to stop the search
+         */
+        boolean onPageSearched(int pageNum, @NonNull MatchRects matches);
+    }
+
+    /**
+     * Searches every page for the given string like {@link #searchPageText}, in a single call.
+     * The pages from {@code firstPriorityPage} to {@code lastPriorityPage}, e.g. the visible ones,
+     * are searched first, then those after and before them alternately, nearest first. Pages are
+     * searched one after the other on the calling thread, and {@code callback} is called with
+     * the matches of each page as soon as it has been searched.
+     *
+     * @param callback notified of the matches of each page, can stop the search
+     * @return true if every page was searched
+     */
+    public native boolean searchDocument(
+            String query,
+            int firstPriorityPage,
+            int lastPriorityPage,
+            @NonNull SearchCallback callback);
+
     /**
      * Get the text selection that spans between the two boundaries (inclusive of start and
      * exclusive of stop), both of which can be either exactly defined with text indexes, or
@@ -201,6 +393,36 @@ public class PdfDocumentProxy {
     /** Returns bookmarks and other goto links (within the current document) on a page */
     public native List<PdfPageGotoLinkContent> getPageGotoLinks(int pageNum);
 
+    /**
+     * Get the links of the pages from {@code firstPageNum} to {@code lastPageNum}, inclusive, in
+     * one call, as {@link #getPageLinks} would for each of them.
+     */
+    public native List<LinkRects> getPageLinksInRange(int firstPageNum, int lastPageNum);
+
+    /**
+     * Get the goto links of the pages from {@code firstPageNum} to {@code lastPageNum},
+     * inclusive, in one call, as {@link #getPageGotoLinks} would for each of them.
+     */
+    public native List<List<PdfPageGotoLinkContent>> getPageGotoLinksInRange(
+            int firstPageNum, int lastPageNum);
+
+    /**
+     * Loads the visible pages and up to {@code numNeighbors} pages on each side of them, with
+     * their text, ahead of text selection and search, nearest first. Pages that aren't
+     * downloaded yet are skipped, and no more pages are loaded once they don't fit in the page
+     * cache. Meant to be called off the UI thread while idle; returns the number of pages
+     * prefetched.
+     */
+    public native int prefetchPages(int firstVisiblePage, int lastVisiblePage, int numNeighbors);
+
+    /**
+     * Frees memory this document can do without, for a {@code level} of
+     * {@link android.content.ComponentCallbacks2#onTrimMemory}: cached renders, then the least
+     * recently used pages and what the others loaded, such as their text, then all of the pages
+     * that aren't retained. Returns the estimated number of bytes freed.
+     */
+    public native long trimMemory(int level);
+
     /** Loads a page object and retains it in memory when a page becomes visible. */
     public native void retainPage(int pageNum);
 
@@ -235,6 +457,40 @@ public class PdfDocumentProxy {
      */
     public native List<FormWidgetInfo> getFormWidgetInfos(int pageNum, int[] typeIds);
 
+    /** Receives the form widgets of {@link #getFormWidgetInfosInRange} one page at a time. */
+    public interface FormWidgetCallback {
+        /**
+         * Called with the widgets of the given page, only for pages that have any to report.
+         * Every page was read by then, so this can call into the same document, e.g. to fill in
+         * a field; changes made from here are reported by the next call.
+         *
+         * @param allWidgets true if these are all of the widgets of the page, which replace any
+         *                   received before, false if they are only those that changed, which
+         *                   replace those with the same widget index
+         * @return false to stop
+         */
+        boolean onPageWidgets(int pageNum, boolean allWidgets,
+                @NonNull List<FormWidgetInfo> widgetInfos);
+    }
+
+    /**
+     * Obtains information about the form widgets of every page from {@code firstPage} to
+     * {@code lastPage} like {@link #getFormWidgetInfos}, in a single call.
+     *
+     * <p>Passing the value returned by an earlier call for the same pages as {@code
+     * sinceGeneration} gets only the widgets that changed since, e.g. after filling in a field,
+     * which can change others too. Pages are then only read again if the form was edited in the
+     * meantime.
+     *
+     * @param typeIds         restricts the widgets to these types, unless empty
+     * @param sinceGeneration the value returned by an earlier call, or 0 for every widget
+     * @param callback        handed the widgets of each page, can stop the call
+     * @return the value to pass as {@code sinceGeneration} next time, 0 if {@code callback}
+     *     stopped the call
+     */
+    public native long getFormWidgetInfosInRange(int firstPage, int lastPage, int[] typeIds,
+            long sinceGeneration, @NonNull FormWidgetCallback callback);
+
     /**
      * Executes an interactive click on the page at the given point ({@code x}, {@code y}).
      *
@@ -343,4 +599,11 @@ public class PdfDocumentProxy {
      * @return true if remove was successful, false otherwise
      */
     public native boolean removePageObject(int pageNum, int objectIndex);
+
+    /**
+     * Returns the number of calls of each native method made so far, across documents, and how
+     * long they spent waiting for locks, in the native library and converting arguments and
+     * results, one method per line. Meant for dumpsys and debugging.
+     */
+    public static native String getNativeStats();
 }
@@ -78,7 +78,9 @@ public class PdfProcessor {
     public static final int PDF_FORM_TYPE_XFA_FOREGROUND = 3;
 
     private static final String TAG = "PdfProcessor";
-    private static final Object sPdfiumLock = new Object();
+    // Guards mPdfDocument and the id managers. The native code serializes the calls into PDFium
+    // itself, so documents held by different processors can be used concurrently.
+    private final Object mLock = new Object();
     private final PdfEventLogger mPdfEventLogger;
     private PdfDocumentProxy mPdfDocument;
     private final HashMap<Integer, PdfPageComponentsIdManager> mPageObjectIdManagerMap;
@@ -119,7 +121,7 @@ public class PdfProcessor {
         }
 
         String password = (params != null) ? params.getPassword() : null;
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             LoadPdfResult result = PdfDocumentProxy.createFromFd(fileDescriptor.detachFd(),
                     password);
             switch (result.status) {
@@ -176,7 +178,7 @@ public class PdfProcessor {
 
     /** Returns the number of pages in the PDF document */
     public int getNumPages() {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getNumPages();
         }
@@ -192,7 +194,7 @@ public class PdfProcessor {
      */
     @FlaggedApi(Flags.FLAG_ENABLE_PDF_VIEWER)
     public List<PdfPageTextContent> getPageTextContents(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             PdfPageTextContent content = new PdfPageTextContent(mPdfDocument.getPageText(pageNum));
             return List.of(content);
@@ -209,7 +211,7 @@ public class PdfProcessor {
      */
     @FlaggedApi(Flags.FLAG_ENABLE_PDF_VIEWER)
     public List<PdfPageImageContent> getPageImageContents(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getPageAltText(pageNum).stream().map(
                     PdfPageImageContent::new).collect(Collectors.toList());
@@ -221,7 +223,7 @@ public class PdfProcessor {
      * pages of the document will have the same dimensions
      */
     public int getPageWidth(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getPageWidth(pageNum);
         }
@@ -232,7 +234,7 @@ public class PdfProcessor {
      * pages of the document will have the same dimensions
      */
     public int getPageHeight(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getPageHeight(pageNum);
         }
@@ -275,7 +277,7 @@ public class PdfProcessor {
         float[] transformArr = new float[9];
         transform.getValues(transformArr);
 
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             mPdfDocument.render(
                     pageNum,
@@ -304,7 +306,7 @@ public class PdfProcessor {
     @FlaggedApi(Flags.FLAG_ENABLE_PDF_VIEWER)
     public List<PageMatchBounds> searchPageText(int pageNum, String query) {
         Preconditions.checkNotNull(query, "Search query cannot be null");
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             long searchStartTime = System.currentTimeMillis();
             List<PageMatchBounds> searchPageTextResult =
@@ -338,7 +340,7 @@ public class PdfProcessor {
             SelectionBoundary stop) {
         Preconditions.checkNotNull(start, "Start selection boundary cannot be null");
         Preconditions.checkNotNull(stop, "Stop selection boundary cannot be null");
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             android.graphics.pdf.models.jni.PageSelection legacyPageSelection =
                     mPdfDocument.selectPageText(pageNum,
@@ -359,7 +361,7 @@ public class PdfProcessor {
     /** Get the bounds and URLs of all the links on the given page. */
     @FlaggedApi(Flags.FLAG_ENABLE_PDF_VIEWER)
     public List<PdfPageLinkContent> getPageLinkContents(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getPageLinks(pageNum).unflattenToList();
         }
@@ -367,7 +369,7 @@ public class PdfProcessor {
 
     /** Returns bookmarks and other goto links (within the current document) on a page */
     public List<PdfPageGotoLinkContent> getPageGotoLinks(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getPageGotoLinks(pageNum);
         }
@@ -375,7 +377,7 @@ public class PdfProcessor {
 
     /** Retains object in memory related to a page when that page becomes visible. */
     public void retainPage(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             if (!mPageObjectIdManagerMap.containsKey(pageNum)) {
                 mPageObjectIdManagerMap.put(pageNum, new PdfPageComponentsIdManager());
@@ -389,7 +391,7 @@ public class PdfProcessor {
 
     /** Releases object in memory related to a page when that page is no longer visible. */
     public void releasePage(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             mPageObjectIdManagerMap.remove(pageNum);
             mPageAnnotationsIdManagerMap.remove(pageNum);
@@ -402,7 +404,7 @@ public class PdfProcessor {
      */
     @PdfLinearizationTypes.PdfLinearizationType
     public int getDocumentLinearizationType() {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.isPdfLinearized() ? PDF_DOCUMENT_TYPE_LINEARIZED
                     : PDF_DOCUMENT_TYPE_NON_LINEARIZED;
@@ -415,7 +417,7 @@ public class PdfProcessor {
      * @throws IllegalArgumentException if an unrecognized PDF form type is returned
      */
     public int getPdfFormType() {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int pdfFormType = mPdfDocument.getFormType();
             return switch (pdfFormType) {
@@ -428,7 +430,7 @@ public class PdfProcessor {
 
     /** Returns true if this PDF prefers to be scaled for printing. */
     public boolean scaleForPrinting() {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.scaleForPrinting();
         }
@@ -444,7 +446,7 @@ public class PdfProcessor {
     @NonNull
     public List<FormWidgetInfo> getFormWidgetInfos(int pageNum,
             @NonNull @FormWidgetInfo.WidgetType int[] types) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             return mPdfDocument.getFormWidgetInfos(pageNum, types);
         }
@@ -459,7 +461,7 @@ public class PdfProcessor {
      */
     @NonNull
     FormWidgetInfo getFormWidgetInfoAtIndex(int pageNum, int annotationIndex) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             FormWidgetInfo result = mPdfDocument.getFormWidgetInfo(pageNum, annotationIndex);
             if (result == null) {
@@ -472,7 +474,7 @@ public class PdfProcessor {
     /** Returns information about the widget at the given point. */
     @NonNull
     public FormWidgetInfo getFormWidgetInfoAtPosition(int pageNum, int x, int y) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             FormWidgetInfo result = mPdfDocument.getFormWidgetInfo(pageNum, x, y);
             if (result == null) {
@@ -513,7 +515,7 @@ public class PdfProcessor {
         Preconditions.checkNotNull(editRecord.getClickPoint(),
                 "Can't apply click edit record without point");
         Point clickPoint = editRecord.getClickPoint();
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             List<Rect> results = mPdfDocument.clickOnPage(pageNum, clickPoint.x, clickPoint.y);
             if (results == null) {
@@ -525,7 +527,7 @@ public class PdfProcessor {
 
     @FlaggedApi(Flags.FLAG_ENABLE_FORM_FILLING)
     private List<Rect> applyEditTypeSetIndices(int pageNum, @NonNull FormEditRecord editRecord) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int[] selectedIndices = editRecord.getSelectedIndices();
             List<Rect> results = mPdfDocument.setFormFieldSelectedIndices(pageNum,
@@ -542,7 +544,7 @@ public class PdfProcessor {
         Preconditions.checkNotNull(editRecord.getText(),
                 "Can't apply set text record without text");
         String text = editRecord.getText();
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             List<Rect> results = mPdfDocument.setFormFieldText(pageNum, editRecord.getWidgetIndex(),
                     text);
@@ -555,7 +557,7 @@ public class PdfProcessor {
 
     /** Ensures that any previous {@link PdfDocumentProxy} instance is closed. */
     public void ensurePdfDestroyed() {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             if (mPdfDocument != null) {
                 try {
                     mPdfDocument.destroy();
@@ -595,7 +597,7 @@ public class PdfProcessor {
      */
     @NonNull
     public List<Pair<Integer, PdfAnnotation>> getPageAnnotations(@IntRange(from = 0) int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             PdfPageComponentsIdManager pageAnnotationIdManager =
                     mPageAnnotationsIdManagerMap.get(pageNum);
@@ -626,7 +628,7 @@ public class PdfProcessor {
      */
     public int addPageAnnotation(@IntRange(from = 0) int pageNum,
             PdfAnnotation annotation) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int addedAnnotationIndex = mPdfDocument.addPageAnnotation(pageNum, annotation);
             if (addedAnnotationIndex == -1) {
@@ -645,7 +647,7 @@ public class PdfProcessor {
      */
     public void removePageAnnotation(@IntRange(from = 0) int pageNum,
             int annotationId) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             PdfPageComponentsIdManager pdfAnnotationsIdManager =
                     mPageAnnotationsIdManagerMap.get(pageNum);
@@ -674,7 +676,7 @@ public class PdfProcessor {
     @FlaggedApi(Flags.FLAG_ENABLE_EDIT_PDF_PAGE_OBJECTS)
     public boolean updatePageAnnotation(int pageNum, int annotationId,
             @NonNull PdfAnnotation annotation) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int annotationIndex = mPageAnnotationsIdManagerMap.get(pageNum)
                     .getIndexForId(annotationId);
@@ -704,7 +706,7 @@ public class PdfProcessor {
      */
     @FlaggedApi(Flags.FLAG_ENABLE_EDIT_PDF_PAGE_OBJECTS)
     public List<Pair<Integer, PdfPageObject>> getPageObjects(int pageNum) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             PdfPageComponentsIdManager pageObjectIdManager = mPageObjectIdManagerMap.get(pageNum);
             List<PdfPageObject> pageObjects = mPdfDocument.getPageObjects(pageNum);
@@ -730,7 +732,7 @@ public class PdfProcessor {
      */
     @FlaggedApi(Flags.FLAG_ENABLE_EDIT_PDF_PAGE_OBJECTS)
     public int addPageObject(int pageNum, @NonNull PdfPageObject pageObject) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int addedObjectIndex = mPdfDocument.addPageObject(pageNum, pageObject);
             if (addedObjectIndex == -1) {
@@ -752,7 +754,7 @@ public class PdfProcessor {
     @FlaggedApi(Flags.FLAG_ENABLE_EDIT_PDF_PAGE_OBJECTS)
     public boolean updatePageObject(int pageNum, int objectId,
             @NonNull PdfPageObject pageObject) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             int objectIndex = mPageObjectIdManagerMap.get(pageNum).getIndexForId(objectId);
             if (objectIndex == -1) {
@@ -776,7 +778,7 @@ public class PdfProcessor {
      */
     @FlaggedApi(Flags.FLAG_ENABLE_EDIT_PDF_PAGE_OBJECTS)
     public void removePageObject(int pageNum, int objectId) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             PdfPageComponentsIdManager pageObjectIdManager =
                     mPageObjectIdManagerMap.get(pageNum);
@@ -799,7 +801,7 @@ public class PdfProcessor {
      * @param destination points to where pdfclient should make a copy of the pdf without security.
      */
     private void cloneWithoutSecurity(ParcelFileDescriptor destination) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             mPdfDocument.cloneWithoutSecurity(destination);
         }
@@ -811,7 +813,7 @@ public class PdfProcessor {
      * @param destination where the currently open PDF should be written.
      */
     private void saveAs(ParcelFileDescriptor destination) {
-        synchronized (sPdfiumLock) {
+        synchronized (mLock) {
             assertPdfDocumentNotNull();
             mPdfDocument.saveAs(destination);
         }
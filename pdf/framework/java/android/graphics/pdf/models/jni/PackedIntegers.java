@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.graphics.pdf.models.jni;
+
+import android.graphics.pdf.utils.Preconditions;
+
+import androidx.annotation.NonNull;
+
+import java.util.AbstractList;
+import java.util.RandomAccess;
+
+/**
+ * A read-only {@code List<Integer>} backed by an {@code int[]} from the JNI
+ * layer, so that passing many integers doesn't box each of them up front.
+ *
+ * @hide
+ */
+public class PackedIntegers extends AbstractList<Integer> implements RandomAccess {
+    private final int[] mValues;
+
+    public PackedIntegers(@NonNull int[] values) {
+        this.mValues = Preconditions.checkNotNull(values, "values cannot be null");
+    }
+
+    @NonNull
+    @Override
+    public Integer get(int index) {
+        if (index < 0 || index >= mValues.length) {
+            throw new ArrayIndexOutOfBoundsException(index);
+        }
+        return mValues[index];
+    }
+
+    @Override
+    public int size() {
+        return mValues.length;
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.graphics.pdf.models.jni;
+
+import android.graphics.Rect;
+import android.graphics.pdf.utils.Preconditions;
+
+import androidx.annotation.NonNull;
+
+import java.util.AbstractList;
+import java.util.RandomAccess;
+
+/**
+ * A {@code List<Rect>} backed by an array of packed coordinates from the JNI
+ * layer, so that passing many rectangles doesn't create a Java object for each
+ * of them. Each {@link Rect} is only created when it is read, and is a copy:
+ * changing it doesn't change the list.
+ *
+ * @hide
+ */
+public class PackedRects extends AbstractList<Rect> implements RandomAccess {
+    private final int[] mCoordinates;
+
+    /**
+     * @param coordinates the left, top, right and bottom coordinates of each rectangle, one
+     *                    rectangle after another
+     */
+    public PackedRects(@NonNull int[] coordinates) {
+        this.mCoordinates = Preconditions.checkNotNull(coordinates, "coordinates cannot be null");
+        Preconditions.checkArgument(coordinates.length % 4 == 0,
+                "coordinates must have 4 values per rectangle");
+    }
+
+    @NonNull
+    @Override
+    public Rect get(int index) {
+        if (index < 0 || index >= size()) {
+            throw new ArrayIndexOutOfBoundsException(index);
+        }
+        int offset = index * 4;
+        return new Rect(mCoordinates[offset], mCoordinates[offset + 1],
+                mCoordinates[offset + 2], mCoordinates[offset + 3]);
+    }
+
+    @Override
+    public int size() {
+        return mCoordinates.length / 4;
+    }
+}
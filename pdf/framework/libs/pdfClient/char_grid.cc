@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "char_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "rect.h"
+
+namespace pdfClient {
+
+namespace {
+
+// Aim for a couple of boxes per cell, up to a grid of this many cells across.
+constexpr int kMaxCellsAcross = 64;
+constexpr size_t kBoxesPerCell = 2;
+
+}  // namespace
+
+void CharGrid::Build(const std::vector<Rectangle_d>& boxes) {
+    num_boxes_ = boxes.size();
+    cells_.clear();
+    if (boxes.empty()) {
+        bounds_ = Rectangle_d{0, 0, 0, 0};
+        columns_ = rows_ = 0;
+        return;
+    }
+    bounds_ = boxes[0];
+    for (const Rectangle_d& box : boxes) {
+        bounds_ = Union(bounds_, box);
+    }
+
+    const int across = std::clamp(
+            static_cast<int>(std::ceil(std::sqrt(static_cast<double>(boxes.size()) /
+                                                 kBoxesPerCell))),
+            1, kMaxCellsAcross);
+    columns_ = bounds_.Width() > 0 ? across : 1;
+    rows_ = bounds_.Height() > 0 ? across : 1;
+    cell_width_ = bounds_.Width() > 0 ? bounds_.Width() / columns_ : 1;
+    cell_height_ = bounds_.Height() > 0 ? bounds_.Height() / rows_ : 1;
+    cells_.resize(columns_ * rows_);
+
+    for (size_t i = 0; i < boxes.size(); i++) {
+        const Rectangle_d& box = boxes[i];
+        for (int row = Row(box.top); row <= Row(box.bottom); row++) {
+            for (int column = Column(box.left); column <= Column(box.right); column++) {
+                cells_[row * columns_ + column].push_back(i);
+            }
+        }
+    }
+}
+
+void CharGrid::Query(const Rectangle_d& area, std::vector<int>* indices) const {
+    if (cells_.empty() || area.right < bounds_.left || area.left > bounds_.right ||
+        area.bottom < bounds_.top || area.top > bounds_.bottom) {
+        return;
+    }
+    const size_t first = indices->size();
+    for (int row = Row(area.top); row <= Row(area.bottom); row++) {
+        for (int column = Column(area.left); column <= Column(area.right); column++) {
+            const std::vector<int>& cell = cells_[row * columns_ + column];
+            indices->insert(indices->end(), cell.begin(), cell.end());
+        }
+    }
+    std::sort(indices->begin() + first, indices->end());
+    indices->erase(std::unique(indices->begin() + first, indices->end()), indices->end());
+}
+
+int CharGrid::Column(double x) const {
+    const double column = (x - bounds_.left) / cell_width_;
+    return column > 0 ? static_cast<int>(std::min(column, columns_ - 1.0)) : 0;
+}
+
+int CharGrid::Row(double y) const {
+    const double row = (y - bounds_.top) / cell_height_;
+    return row > 0 ? static_cast<int>(std::min(row, rows_ - 1.0)) : 0;
+}
+
+}  // namespace pdfClient
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_CHAR_GRID_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_CHAR_GRID_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "rect.h"
+
+namespace pdfClient {
+
+// A uniform grid over a set of boxes, e.g. those of the chars of a page, to
+// find the ones near a point without going through all of them.
+class CharGrid {
+  public:
+    // Builds the grid over |boxes|, which must be sorted as by DoubleRect.
+    // Boxes are referred to by their index in |boxes|.
+    void Build(const std::vector<Rectangle_d>& boxes);
+
+    // Appends to |indices|, in increasing order, the index of every box that
+    // may intersect |area|, edges included. Boxes that don't may be there too.
+    void Query(const Rectangle_d& area, std::vector<int>* indices) const;
+
+    // Returns the rectangle around all of the boxes.
+    const Rectangle_d& Bounds() const { return bounds_; }
+
+    bool IsEmpty() const { return num_boxes_ == 0; }
+
+  private:
+    // Returns the column, or row, of the cell |x|, or |y|, falls in, clamped
+    // to within the grid.
+    int Column(double x) const;
+    int Row(double y) const;
+
+    size_t num_boxes_ = 0;
+    Rectangle_d bounds_ = {0, 0, 0, 0};
+    int columns_ = 0;
+    int rows_ = 0;
+    double cell_width_ = 0;
+    double cell_height_ = 0;
+    // The indices of the boxes intersecting each cell, row after row.
+    std::vector<std::vector<int>> cells_;
+};
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_CHAR_GRID_H_
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "char_grid.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "rect.h"
+
+using pdfClient::CharGrid;
+using pdfClient::DoubleRect;
+using pdfClient::Rectangle_d;
+
+namespace {
+
+bool Intersects(const Rectangle_d& a, const Rectangle_d& b) {
+    return a.left <= b.right && b.left <= a.right && a.top <= b.bottom && b.top <= a.bottom;
+}
+
+TEST(Test, EmptyGridTest) {
+    CharGrid grid;
+    grid.Build({});
+    EXPECT_TRUE(grid.IsEmpty());
+    std::vector<int> indices;
+    grid.Query(DoubleRect(0, 0, 100, 100), &indices);
+    EXPECT_TRUE(indices.empty());
+}
+
+TEST(Test, SinglePointTest) {
+    CharGrid grid;
+    grid.Build({DoubleRect(5, 5, 5, 5)});
+    std::vector<int> indices;
+    grid.Query(DoubleRect(5, 5, 5, 5), &indices);
+    EXPECT_EQ(std::vector<int>({0}), indices);
+    indices.clear();
+    grid.Query(DoubleRect(6, 6, 7, 7), &indices);
+    EXPECT_TRUE(indices.empty());
+}
+
+TEST(Test, QueryFindsIntersectingBoxesTest) {
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> coordinate(0, 600);
+    std::uniform_real_distribution<double> size(0, 20);
+    std::vector<Rectangle_d> boxes;
+    for (int i = 0; i < 2000; i++) {
+        const double x = coordinate(random);
+        const double y = coordinate(random);
+        boxes.push_back(DoubleRect(x, y, x + size(random), y + size(random)));
+    }
+    CharGrid grid;
+    grid.Build(boxes);
+
+    for (int i = 0; i < 200; i++) {
+        const double x = coordinate(random) - 50;
+        const double y = coordinate(random) - 50;
+        const Rectangle_d area = DoubleRect(x, y, x + size(random) * 5, y + size(random) * 5);
+        std::vector<int> indices;
+        grid.Query(area, &indices);
+        EXPECT_TRUE(std::is_sorted(indices.begin(), indices.end()));
+        EXPECT_EQ(indices.end(), std::adjacent_find(indices.begin(), indices.end()));
+        for (size_t box = 0; box < boxes.size(); box++) {
+            if (Intersects(boxes[box], area)) {
+                EXPECT_TRUE(std::binary_search(indices.begin(), indices.end(), box));
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dirty_region.h"
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "rect.h"
+
+namespace pdfClient {
+
+namespace {
+
+int64_t Area(const Rectangle_i& rect) {
+    return pdfClient::IsEmpty(rect) ? 0 : static_cast<int64_t>(rect.Width()) * rect.Height();
+}
+
+// How much more the union of |a| and |b| covers than they do.
+int64_t MergeCost(const Rectangle_i& a, const Rectangle_i& b) {
+    return Area(Union(a, b)) - Area(a) - Area(b) + Area(Intersect(a, b));
+}
+
+bool ShouldMerge(const Rectangle_i& a, const Rectangle_i& b) {
+    // Overlapping rectangles have to be merged to keep them disjoint. Others
+    // are when their union only adds up to a quarter of what they cover, e.g.
+    // the glyphs typed one after the other on a line.
+    return !pdfClient::IsEmpty(Intersect(a, b)) || MergeCost(a, b) * 4 <= Area(a) + Area(b);
+}
+
+}  // namespace
+
+void DirtyRegion::Add(const Rectangle_i& rect) {
+    if (pdfClient::IsEmpty(rect)) {
+        return;
+    }
+    // Merging can make the rectangle overlap others, so keep going until it
+    // doesn't merge with any of them anymore.
+    Rectangle_i added = rect;
+    for (size_t i = 0; i < rects_.size();) {
+        if (ShouldMerge(rects_[i], added)) {
+            added = Union(rects_[i], added);
+            rects_.erase(rects_.begin() + i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    rects_.push_back(added);
+
+    if (rects_.size() > kMaxRects) {
+        size_t best_i = 0;
+        size_t best_j = 1;
+        int64_t best_cost = MergeCost(rects_[0], rects_[1]);
+        for (size_t i = 0; i < rects_.size(); i++) {
+            for (size_t j = i + 1; j < rects_.size(); j++) {
+                const int64_t cost = MergeCost(rects_[i], rects_[j]);
+                if (cost < best_cost) {
+                    best_i = i;
+                    best_j = j;
+                    best_cost = cost;
+                }
+            }
+        }
+        Rectangle_i merged = Union(rects_[best_i], rects_[best_j]);
+        rects_.erase(rects_.begin() + best_j);
+        rects_.erase(rects_.begin() + best_i);
+        Add(merged);
+    }
+}
+
+Rectangle_i DirtyRegion::Bounds() const {
+    if (rects_.empty()) {
+        return Rectangle_i{0, 0, 0, 0};
+    }
+    Rectangle_i bounds = rects_[0];
+    for (const Rectangle_i& rect : rects_) {
+        bounds = Union(bounds, rect);
+    }
+    return bounds;
+}
+
+std::vector<Rectangle_i> DirtyRegion::Consume() {
+    return std::exchange(rects_, {});
+}
+
+}  // namespace pdfClient
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_DIRTY_REGION_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_DIRTY_REGION_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "rect.h"
+
+namespace pdfClient {
+
+// The parts of a page that need to be rendered again, kept as a few disjoint
+// rectangles rather than one rectangle around all of them, so that many small
+// changes far apart, e.g. while typing into several form fields, don't cause
+// most of the page to be rendered again.
+//
+// Rectangles are merged when they overlap or when their union doesn't cover
+// much more than they do, and the two cheapest to merge are merged whenever
+// there would be more than kMaxRects.
+class DirtyRegion {
+  public:
+    static constexpr size_t kMaxRects = 8;
+
+    // Adds |rect| to the region, ignored if it is empty.
+    void Add(const Rectangle_i& rect);
+
+    bool IsEmpty() const { return rects_.empty(); }
+
+    // Returns the rectangle around all of the region, or an empty one.
+    Rectangle_i Bounds() const;
+
+    // Returns the disjoint rectangles of the region, and empties it.
+    std::vector<Rectangle_i> Consume();
+
+    void Clear() { rects_.clear(); }
+
+  private:
+    std::vector<Rectangle_i> rects_;
+};
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_DIRTY_REGION_H_
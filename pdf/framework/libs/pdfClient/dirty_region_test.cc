@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dirty_region.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "rect.h"
+
+using pdfClient::DirtyRegion;
+using pdfClient::Rectangle_i;
+
+namespace {
+
+TEST(Test, MergesNearbyRects) {
+    DirtyRegion region;
+    EXPECT_TRUE(region.IsEmpty());
+    region.Add(Rectangle_i{10, 10, 10, 20});
+    EXPECT_TRUE(region.IsEmpty());
+
+    // Glyphs typed one after the other end up in a single rect.
+    for (int x = 10; x < 100; x += 10) {
+        region.Add(Rectangle_i{x, 10, x + 10, 20});
+    }
+    EXPECT_EQ(Rectangle_i({10, 10, 100, 20}), region.Bounds());
+    EXPECT_EQ(std::vector<Rectangle_i>({{10, 10, 100, 20}}), region.Consume());
+    EXPECT_TRUE(region.IsEmpty());
+}
+
+TEST(Test, KeepsDistantRectsApart) {
+    DirtyRegion region;
+    region.Add(Rectangle_i{0, 0, 10, 10});
+    region.Add(Rectangle_i{500, 500, 510, 510});
+    region.Add(Rectangle_i{5, 5, 15, 15});
+    EXPECT_EQ(Rectangle_i({0, 0, 510, 510}), region.Bounds());
+    EXPECT_EQ(std::vector<Rectangle_i>({{500, 500, 510, 510}, {0, 0, 15, 15}}),
+              region.Consume());
+}
+
+TEST(Test, MergesOverlapsFromMerging) {
+    DirtyRegion region;
+    region.Add(Rectangle_i{0, 0, 10, 10});
+    region.Add(Rectangle_i{0, 50, 10, 60});
+    // Overlaps both, once merged with the first.
+    region.Add(Rectangle_i{0, 5, 10, 55});
+    EXPECT_EQ(std::vector<Rectangle_i>({{0, 0, 10, 60}}), region.Consume());
+}
+
+TEST(Test, LimitsNumberOfRects) {
+    DirtyRegion region;
+    for (int i = 0; i < 20; i++) {
+        const int x = i % 5 * 100;
+        const int y = i / 5 * 100;
+        region.Add(Rectangle_i{x, y, x + 10, y + 10});
+    }
+    std::vector<Rectangle_i> rects = region.Consume();
+    EXPECT_LE(rects.size(), DirtyRegion::kMaxRects);
+    EXPECT_GT(rects.size(), 1u);
+    for (size_t i = 0; i < rects.size(); i++) {
+        for (size_t j = i + 1; j < rects.size(); j++) {
+            EXPECT_TRUE(pdfClient::IsEmpty(pdfClient::Intersect(rects[i], rects[j])));
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
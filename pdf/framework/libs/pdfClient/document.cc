@@ -16,11 +16,21 @@
 
 #include "document.h"
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "cpp/fpdf_scopers.h"
 #include "file.h"
@@ -91,12 +101,30 @@ Document::~Document() {
     for (const auto& entry : pages_) {
         entry.second->TerminateFormFilling();
     }
+    LOGV("Page cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions.",
+         page_cache_stats_.hits, page_cache_stats_.misses, page_cache_stats_.evictions);
+    const RenderCache::Stats render_stats = render_cache_.GetStats();
+    LOGV("Render cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions, %" PRIu64
+         " invalidations.",
+         render_stats.hits, render_stats.misses, render_stats.evictions,
+         render_stats.invalidations);
 }
 
 bool Document::SaveAs(LinuxFileOps::FDCloser fd) {
+    if (IsSourceFile(fd.get())) {
+        // |fd| may have truncated the file when it was opened already.
+        file_reader_->Unmap();
+        // PDFium reads the objects it hasn't loaded yet from the source file
+        // while it saves, and afterwards, so it can't be rewritten in place.
+        if (!SaveIncrementally(std::move(fd))) {
+            LOGW("Can't save incrementally, refusing to rewrite the source file.");
+            return false;
+        }
+        return true;
+    }
     FileWriter fw(std::move(fd));
     constexpr int flags = 0;
-    if (!FPDF_SaveAsCopy(document_.get(), &fw, flags)) {
+    if (!FPDF_SaveAsCopy(document_.get(), &fw, flags) || !fw.Flush()) {
         LOGW("Failed to save-as to fd %d.", fw.Fd());
         return false;
     }
@@ -105,24 +133,297 @@ bool Document::SaveAs(LinuxFileOps::FDCloser fd) {
     return true;
 }
 
+bool Document::IsSourceFile(int fd) const {
+    struct stat source;
+    struct stat dest;
+    return file_reader_ && file_reader_->Fd() >= 0 && fstat(file_reader_->Fd(), &source) == 0 &&
+           fstat(fd, &dest) == 0 && source.st_dev == dest.st_dev && source.st_ino == dest.st_ino;
+}
+
+bool Document::SaveIncrementally(LinuxFileOps::FDCloser fd) {
+    const off_t source_size = file_reader_->CompleteSize();
+    // PDFium's update covers all the changes since the document was loaded, so
+    // it replaces those of earlier saves. Appends then go to the right place
+    // too if |fd| was opened for append.
+    if (!file_reader_->IsComplete() || GetFileSize(fd.get()) < file_reader_->CompleteSize() ||
+        ftruncate(fd.get(), source_size) != 0 || lseek(fd.get(), source_size, SEEK_SET) == -1) {
+        return false;
+    }
+    FileWriter fw(std::move(fd), file_reader_.get());
+    if (!FPDF_SaveAsCopy(document_.get(), &fw, FPDF_INCREMENTAL) || !fw.Flush()) {
+        LOGW("Failed to save incrementally to fd %d.", fw.Fd());
+        ftruncate(fw.Fd(), source_size);
+        return false;
+    }
+    size_t destSize = lseek(fw.Fd(), 0, SEEK_END);
+    LOGV("Saved incrementally to fd %d [%zd bytes].", fw.Fd(), destSize);
+    return true;
+}
+
 std::shared_ptr<Page> Document::GetPage(int pageNum, bool retain) {
     if (pages_.find(pageNum) != pages_.end()) {
         return pages_.at(pageNum);
     }
 
-    IsPageAvailable(pageNum);
-    auto page = std::make_shared<Page>(document_.get(), pageNum, &form_filler_);
+    std::shared_ptr<Page> page = TakeCachedPage(pageNum);
+    if (page) {
+        page_cache_stats_.hits++;
+    } else {
+        page_cache_stats_.misses++;
+        IsPageAvailable(pageNum);
+        page = MakePage(pageNum);
+    }
 
     if (retain) {
         page->InitializeFormFilling();
         pages_.try_emplace(pageNum, page);
         fpdf_page_index_lookup_.try_emplace(page->Get(), pageNum);
+    } else {
+        CachePage(pageNum, page);
     }
 
     return page;
 }
 
+bool Document::PrefetchPage(int pageNum) {
+    if (pageNum < 0 || pageNum >= NumPages()) {
+        return true;
+    }
+    if (pages_.find(pageNum) != pages_.end()) {
+        pages_.at(pageNum)->Prefetch();
+        return true;
+    }
+    auto it = cached_page_index_.find(pageNum);
+    if (it != cached_page_index_.end()) {
+        it->second->second->Prefetch();
+        TrimPageCache();
+        return cached_page_index_.find(pageNum) != cached_page_index_.end();
+    }
+    if (!IsPageAvailable(pageNum)) {
+        return true;
+    }
+
+    // Unlike GetPage, the page goes to the back of the cache since it hasn't
+    // been used yet, so it is the first to be closed if it doesn't fit, and it
+    // doesn't count as a hit or a miss.
+    std::shared_ptr<Page> page = MakePage(pageNum);
+    page->Prefetch();
+    cached_pages_.emplace_back(pageNum, std::move(page));
+    cached_page_index_[pageNum] = std::prev(cached_pages_.end());
+    TrimPageCache();
+    return cached_page_index_.find(pageNum) != cached_page_index_.end();
+}
+
+void Document::SetPageCacheBudget(size_t bytes) {
+    page_cache_budget_ = bytes;
+    TrimPageCache();
+}
+
+size_t Document::TrimMemory(TrimLevel level) {
+    size_t bytes = render_cache_.GetStats().bytes;
+    render_cache_.Clear();
+    if (level == TrimLevel::RENDERS) {
+        return bytes;
+    }
+
+    const size_t pages_to_keep = level == TrimLevel::SOME_PAGES ? cached_pages_.size() / 2 : 0;
+    while (cached_pages_.size() > pages_to_keep) {
+        bytes += cached_pages_.back().second->EstimatedMemoryUsage();
+        EvictLeastRecentlyUsedPage();
+    }
+    for (const auto& entry : cached_pages_) {
+        bytes += entry.second->TrimMemory();
+    }
+    for (const auto& entry : pages_) {
+        bytes += entry.second->TrimMemory();
+    }
+    // Only updates the stats, the pages left fit.
+    TrimPageCache();
+    return bytes;
+}
+
+void Document::GetFormWidgetChanges(int first_page, int last_page,
+                                    const std::unordered_set<int>& type_ids,
+                                    uint64_t since_generation,
+                                    std::vector<PageFormWidgets>* widgets) {
+    first_page = std::max(first_page, 0);
+    last_page = std::min(last_page, NumPages() - 1);
+    for (int page_num = first_page; page_num <= last_page; page_num++) {
+        FormWidgetsSnapshot& snapshot = form_widgets_[page_num];
+        UpdateFormWidgetsSnapshot(page_num, &snapshot);
+
+        PageFormWidgets page_widgets;
+        page_widgets.page_num = page_num;
+        page_widgets.all_widgets = snapshot.all_changed_at > since_generation;
+        for (size_t i = 0; i < snapshot.widget_infos.size(); i++) {
+            const FormWidgetInfo& widget_info = snapshot.widget_infos[i];
+            if ((page_widgets.all_widgets || snapshot.changed_at[i] > since_generation) &&
+                (type_ids.empty() || type_ids.count(widget_info.widget_type()))) {
+                page_widgets.widget_infos.push_back(widget_info);
+            }
+        }
+        // A page whose widgets were all removed still replaces those from before, but there's
+        // nothing before the first call.
+        if (!page_widgets.widget_infos.empty() ||
+            (page_widgets.all_widgets && since_generation > 0)) {
+            widgets->push_back(std::move(page_widgets));
+        }
+    }
+}
+
+void Document::UpdateFormWidgetsSnapshot(int pageNum, FormWidgetsSnapshot* snapshot) {
+    if (snapshot->generation == form_generation_) {
+        return;
+    }
+    // Pages retained by the caller stay retained.
+    const bool retained = pages_.find(pageNum) != pages_.end();
+    std::shared_ptr<Page> page = GetPage(pageNum, true);
+    std::vector<FormWidgetInfo> widget_infos;
+    page->GetFormWidgetInfos({}, &widget_infos);
+    if (!retained) {
+        ReleaseRetainedPage(pageNum);
+    }
+
+    bool same_widgets = snapshot->generation > 0 &&
+                        widget_infos.size() == snapshot->widget_infos.size();
+    for (size_t i = 0; same_widgets && i < widget_infos.size(); i++) {
+        same_widgets = widget_infos[i].widget_index() == snapshot->widget_infos[i].widget_index();
+    }
+    if (same_widgets) {
+        for (size_t i = 0; i < widget_infos.size(); i++) {
+            if (widget_infos[i] != snapshot->widget_infos[i]) {
+                snapshot->changed_at[i] = form_generation_;
+            }
+        }
+    } else {
+        snapshot->changed_at.assign(widget_infos.size(), form_generation_);
+        snapshot->all_changed_at = form_generation_;
+    }
+    snapshot->widget_infos = std::move(widget_infos);
+    snapshot->generation = form_generation_;
+}
+
+bool Document::OpenTextIndex(const std::string& path, uint64_t content_hash) {
+    std::unique_ptr<TextIndex> text_index = TextIndex::Open(path, content_hash, NumPages());
+    if (!text_index) {
+        return false;
+    }
+    // Pages whose text was edited ignore it.
+    for (const auto& entry : pages_) {
+        entry.second->SetTextIndex(text_index.get());
+    }
+    for (const auto& entry : cached_pages_) {
+        entry.second->SetTextIndex(text_index.get());
+    }
+    // Any former index can go now that no page uses it.
+    text_index_ = std::move(text_index);
+    return true;
+}
+
+bool Document::HashContent(uint64_t* hash) const {
+    if (!file_reader_ || !file_reader_->IsComplete()) {
+        return false;
+    }
+    // std::hash is only stable within a build, which is enough for an index that's rebuilt if
+    // it doesn't match.
+    constexpr size_t kChunkSize = 64 * 1024;
+    std::vector<char> chunk(kChunkSize);
+    const size_t size = file_reader_->CompleteSize();
+    uint64_t result = std::hash<size_t>()(size);
+    for (size_t offset = 0; offset < size; offset += kChunkSize) {
+        const size_t length = std::min(kChunkSize, size - offset);
+        if (file_reader_->DoReadBlock(offset, chunk.data(), length) != length) {
+            return false;
+        }
+        result = result * 1099511628211ULL ^
+                 std::hash<std::string_view>()(std::string_view(chunk.data(), length));
+    }
+    *hash = result;
+    return true;
+}
+
+std::vector<int> Document::PagesNearestFirst(int first, int last) const {
+    const int num_pages = NumPages();
+    std::vector<int> pages;
+    if (num_pages <= 0) {
+        return pages;
+    }
+    pages.reserve(num_pages);
+    first = std::clamp(first, 0, num_pages - 1);
+    last = std::clamp(last, first, num_pages - 1);
+    for (int i = first; i <= last; i++) {
+        pages.push_back(i);
+    }
+    for (int after = last + 1, before = first - 1; after < num_pages || before >= 0;
+         after++, before--) {
+        if (after < num_pages) {
+            pages.push_back(after);
+        }
+        if (before >= 0) {
+            pages.push_back(before);
+        }
+    }
+    return pages;
+}
+
+std::shared_ptr<Page> Document::MakePage(int pageNum) {
+    std::shared_ptr<Page> page = std::make_shared<Page>(document_.get(), pageNum, &form_filler_);
+    if (text_edited_pages_.find(pageNum) == text_edited_pages_.end()) {
+        page->SetTextIndex(text_index_.get());
+    }
+    return page;
+}
+
+void Document::EvictLeastRecentlyUsedPage() {
+    const auto& [pageNum, page] = cached_pages_.back();
+    if (page->IsTextEdited()) {
+        text_edited_pages_.insert(pageNum);
+    }
+    cached_page_index_.erase(pageNum);
+    cached_pages_.pop_back();
+    page_cache_stats_.evictions++;
+}
+
+std::shared_ptr<Page> Document::TakeCachedPage(int pageNum) {
+    auto it = cached_page_index_.find(pageNum);
+    if (it == cached_page_index_.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<Page> page = std::move(it->second->second);
+    cached_pages_.erase(it->second);
+    cached_page_index_.erase(it);
+    return page;
+}
+
+void Document::CachePage(int pageNum, std::shared_ptr<Page> page) {
+    cached_pages_.emplace_front(pageNum, std::move(page));
+    cached_page_index_[pageNum] = cached_pages_.begin();
+    TrimPageCache();
+}
+
+void Document::TrimPageCache() {
+    // Text pages are loaded lazily, so the estimates are taken again each time.
+    size_t bytes = 0;
+    size_t pages_to_keep = 0;
+    for (const auto& entry : cached_pages_) {
+        const size_t page_bytes = entry.second->EstimatedMemoryUsage();
+        if (bytes + page_bytes > page_cache_budget_) {
+            break;
+        }
+        bytes += page_bytes;
+        pages_to_keep++;
+    }
+    while (cached_pages_.size() > pages_to_keep) {
+        EvictLeastRecentlyUsedPage();
+    }
+    page_cache_stats_.pages = cached_pages_.size();
+    page_cache_stats_.bytes = bytes;
+}
+
 void Document::NotifyInvalidRect(FPDF_PAGE page, Rectangle_i rect) {
+    // Fields can have widgets on several pages, which aren't all notified.
+    render_cache_.Clear();
+
     // invalid rects are only relevant to pages that are being retained
     // since pages save them until a caller asks for them
     if (fpdf_page_index_lookup_.find(page) != fpdf_page_index_lookup_.end()) {
@@ -137,6 +438,7 @@ void Document::ReleaseRetainedPage(int pageNum) {
         page->TerminateFormFilling();
         pages_.erase(pageNum);
         fpdf_page_index_lookup_.erase(page->Get());
+        CachePage(pageNum, std::move(page));
     }
 }
 
@@ -185,7 +487,7 @@ bool Document::CloneRawFile(int source, int dest) {
 bool Document::SaveAsCopyWithoutSecurity(LinuxFileOps::FDCloser dest) {
     FileWriter fw(std::move(dest));
     int flags = IsPasswordProtected() ? FPDF_REMOVE_SECURITY : 0;
-    bool success = FPDF_SaveAsCopy(document_.get(), &fw, flags);
+    bool success = FPDF_SaveAsCopy(document_.get(), &fw, flags) && fw.Flush();
 
     size_t destSize = lseek(fw.Fd(), 0, SEEK_END);
     if (success) {
@@ -19,18 +19,29 @@
 
 #define APPNAME "PdfViewerPdfClientLayer"
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "cpp/fpdf_scopers.h"
 #include "file.h"
 #include "form_filler.h"
+#include "form_widget_info.h"
 #include "fpdf_formfill.h"
 #include "fpdfview.h"
 #include "linux_fileops.h"
 #include "page.h"
 #include "rect.h"
+#include "render_cache.h"
+#include "text_index.h"
 
 namespace pdfClient {
 
@@ -44,6 +55,43 @@ void InitLibrary();
 // closes the FPDF_DOCUMENT when it is destroyed.
 class Document {
   public:
+    // Statistics of the cache of pages that aren't retained, see SetPageCacheBudget.
+    struct PageCacheStats {
+        // Number of GetPage calls served from, and not found in, the cache.
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Number of pages closed to stay within the budget.
+        uint64_t evictions = 0;
+        // Number of pages cached and their estimated memory usage, as of the last GetPage.
+        size_t pages = 0;
+        size_t bytes = 0;
+    };
+
+    // How much TrimMemory frees, from least to most.
+    enum class TrimLevel {
+        // The renders cached.
+        RENDERS,
+        // Also the least recently used half of the pages that aren't retained,
+        // and what the other pages loaded that can be loaded again.
+        SOME_PAGES,
+        // Also all of the pages that aren't retained.
+        ALL_PAGES,
+    };
+
+    // The form widgets of a page found by GetFormWidgetChanges.
+    struct PageFormWidgets {
+        int page_num = -1;
+        // True if these are all of the widgets of the page, which replace any
+        // found before, because some were added or removed since. Else these
+        // are only those that changed, and replace those of the same
+        // widget_index.
+        bool all_widgets = false;
+        std::vector<FormWidgetInfo> widget_infos;
+    };
+
+    // Default estimated memory usage allowed for pages that aren't retained.
+    static constexpr size_t kDefaultPageCacheBudget = 16 * 1024 * 1024;
+
     // Load the document from the given reader using the given password.
     // If the returned status is LOADED, then a new Document is returned which
     // now has ownership of the given FileReader.
@@ -69,9 +117,75 @@ class Document {
      * retain - Some operations will require the page be retained in memory.
      * This is relevant to form filling where pages must be held by document in
      * order to receive invalidated rectangles.
+     *
+     * Pages that aren't retained are kept in a least recently used cache, so
+     * that consecutive operations on the same page, with their text page, don't
+     * each load it again. A page is either retained or cached, never both.
      */
     std::shared_ptr<Page> GetPage(int pageNum, bool retain = false);
 
+    // Sets the estimated memory usage, in bytes, allowed for the pages that
+    // aren't retained, and closes those that don't fit anymore. 0 disables the
+    // cache.
+    void SetPageCacheBudget(size_t bytes);
+
+    PageCacheStats GetPageCacheStats() const { return page_cache_stats_; }
+
+    // Frees memory the document can do without, as much as |level| says, when
+    // the system is low on memory. Returns the estimated number of bytes freed,
+    // see Page::EstimatedMemoryUsage.
+    size_t TrimMemory(TrimLevel level);
+
+    // Loads page |pageNum| and its text ahead of use, see Page::Prefetch, and
+    // keeps it in the page cache. Meant to be called for the pages around the
+    // visible ones while idle. Pages that aren't available yet are skipped.
+    // Returns false if the page doesn't fit in the page cache without closing
+    // pages used more recently, in which case it isn't kept.
+    bool PrefetchPage(int pageNum);
+
+    // Hashes the content of the file the document was loaded from into |hash|.
+    // Returns false if there's none or it isn't completely available. Only
+    // reads the file, without PDFium.
+    bool HashContent(uint64_t* hash) const;
+
+    // Opens, or creates, the text index at |path| for this document, keyed by
+    // |content_hash| from HashContent, and searches pages with it from now on,
+    // see TextIndex. Returns false if the index can't be used.
+    bool OpenTextIndex(const std::string& path, uint64_t content_hash);
+
+    // Returns the numbers of all of the pages, starting with those from |first|
+    // to |last|, e.g. the visible ones, and then alternating between the pages
+    // after and before them, nearest first. |first| and |last| are clamped to
+    // the document.
+    std::vector<int> PagesNearestFirst(int first, int last) const;
+
+    // Returns the generation of the form widgets of this document, which goes
+    // up whenever they may have changed, see InvalidateFormWidgets. Starts at 1.
+    uint64_t FormGeneration() const { return form_generation_; }
+
+    // Tells the document that the form widgets of any of its pages may have
+    // changed: filling a field can change others, on other pages too, and
+    // editing the annotations of a page changes the indexes of its widgets.
+    void InvalidateFormWidgets() { form_generation_++; }
+
+    // Gets the form widgets of the pages from |first_page| to |last_page|, like
+    // Page::GetFormWidgetInfos for each of them, into |widgets|, one entry per
+    // page that has any. |first_page| and |last_page| are clamped to the
+    // document.
+    //
+    // If |since_generation| is the FormGeneration() of an earlier call for the
+    // same pages, only the widgets that changed since then are, and only the
+    // pages with any. Pages are only enumerated again once widgets may have
+    // changed, so that this is cheap to call after every form edit. 0 gets
+    // every widget.
+    void GetFormWidgetChanges(int first_page, int last_page,
+                              const std::unordered_set<int>& type_ids, uint64_t since_generation,
+                              std::vector<PageFormWidgets>* widgets);
+
+    // Renders of this document's pages. Those of a page must be invalidated
+    // whenever it is edited, form filling invalidates all of them.
+    RenderCache& GetRenderCache() { return render_cache_; }
+
     // @TODO(b/312222305): This call is only used for analytics, might go away when we
     // implement quicker loading of linearized PDFs.
     bool IsLinearized() const { return is_linearized_; }
@@ -87,7 +201,9 @@ class Document {
     bool CloneDocumentWithoutSecurity(LinuxFileOps::FDCloser fd);
 
     // Save this Document to the given file descriptor, presumably opened for
-    // write or append. Return true on success.
+    // write or append. Return true on success. If it is the file the document
+    // was loaded from, only the changes are appended to it, and nothing is
+    // saved if that isn't possible: the document still reads from the file.
     bool SaveAs(LinuxFileOps::FDCloser fd);
 
     // Informs the document that the |rect| of the page bitmap has been
@@ -96,9 +212,13 @@ class Document {
     void NotifyInvalidRect(FPDF_PAGE page, Rectangle_i rect);
 
     // Removes the page from |pages_| and |fpdf_page_index_lookup_|, if retained,
-    // else no-op.
+    // and moves it to the page cache, else no-op.
     void ReleaseRetainedPage(int pageNum);
 
+    // Serializes the operations on this document. Documents aren't thread-safe, but different
+    // ones can be used concurrently as long as the calls into PDFium itself are serialized too.
+    std::mutex& Mutex() const { return mutex_; }
+
   private:
     // Wrap a FPDF_DOCUMENT in this Document, auto-close when this is destroyed.
     Document(ScopedFPDFDocument document, bool is_password_protected,
@@ -125,15 +245,74 @@ class Document {
     // Saves the loaded document back to a file (with security removed).
     bool SaveAsCopyWithoutSecurity(LinuxFileOps::FDCloser dest);
 
+    // Returns true if |fd| is open on the file the document was loaded from.
+    bool IsSourceFile(int fd) const;
+
+    // Appends the changes to the document to |fd|, opened on the file it was
+    // loaded from, as an incremental update. Returns false, leaving the file
+    // as it was loaded, if that isn't possible.
+    bool SaveIncrementally(LinuxFileOps::FDCloser fd);
+
+    // The form widgets of a page as of the last GetFormWidgetChanges.
+    struct FormWidgetsSnapshot {
+        // The FormGeneration() they were enumerated at, 0 if never.
+        uint64_t generation = 0;
+        std::vector<FormWidgetInfo> widget_infos;
+        // The generation at which each of them, and the set of them, last
+        // changed.
+        std::vector<uint64_t> changed_at;
+        uint64_t all_changed_at = 0;
+    };
+
+    // Enumerates the widgets of page |pageNum| again into |snapshot|, and
+    // updates which changed, if they may have since it was taken.
+    void UpdateFormWidgetsSnapshot(int pageNum, FormWidgetsSnapshot* snapshot);
+
+    // Makes a new Page for |pageNum|, searched with the text index unless its
+    // text was edited.
+    std::shared_ptr<Page> MakePage(int pageNum);
+
+    // Closes the least recently used page of the page cache.
+    void EvictLeastRecentlyUsedPage();
+
+    // Removes the page from the page cache and returns it, or nullptr if not
+    // cached.
+    std::shared_ptr<Page> TakeCachedPage(int pageNum);
+
+    // Adds the page to the front of the page cache and closes the least
+    // recently used pages until the cache fits in |page_cache_budget_|.
+    void CachePage(int pageNum, std::shared_ptr<Page> page);
+    void TrimPageCache();
+
     // If not null, this will also be deleted when this document is destroyed.
     std::unique_ptr<FileReader> file_reader_;
 
+    // Used by the pages, so must outlive them.
+    std::unique_ptr<TextIndex> text_index_;
+
     // document_, form_filler_ and pages_ must be initialized and torn down
     // in this order for required resources to be available
     ScopedFPDFDocument document_;
     FormFiller form_filler_;
     std::unordered_map<int, std::shared_ptr<Page>> pages_;
 
+    // Pages that aren't retained, most recently used first, and where each of
+    // them is in |cached_pages_|.
+    std::list<std::pair<int, std::shared_ptr<Page>>> cached_pages_;
+    std::unordered_map<int, std::list<std::pair<int, std::shared_ptr<Page>>>::iterator>
+            cached_page_index_;
+    size_t page_cache_budget_ = kDefaultPageCacheBudget;
+    PageCacheStats page_cache_stats_;
+
+    RenderCache render_cache_;
+
+    uint64_t form_generation_ = 1;
+
+    // Pages whose text was edited and that were closed since, see
+    // Page::IsTextEdited. Their text isn't the one in the text index.
+    std::unordered_set<int> text_edited_pages_;
+    std::unordered_map<int, FormWidgetsSnapshot> form_widgets_;
+
     // Map relating FPDF_PAGE to Page index for lookup.
     // FPDF_PAGEs are not owned.
     std::unordered_map<void*, int> fpdf_page_index_lookup_;
@@ -146,6 +325,8 @@ class Document {
 
     // Whether this PDF should be scaled for printing.
     bool should_scale_for_printing_ = false;
+
+    mutable std::mutex mutex_;
 };
 
 }  // namespace pdfClient
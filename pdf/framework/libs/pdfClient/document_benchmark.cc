@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the main document and page operations, over the testdata PDFs
+// and over a large synthetic document of text pages, generated on first use.
+// Each benchmark is repeated and only the mean, median and deviation are
+// reported, so that runs before and after a change can be compared.
+//
+// Saving is in file_benchmark.cc and thumbnails are in render_benchmark.cc.
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpp/fpdf_scopers.h"
+#include "document.h"
+#include "file.h"
+#include "fpdf_edit.h"
+#include "fpdf_save.h"
+#include "fpdfview.h"
+#include "linux_fileops.h"
+#include "page.h"
+#include "rect.h"
+#include "utils/pdf_strings.h"
+
+using pdfClient::Document;
+using pdfClient::FileReader;
+using pdfClient::FileWriter;
+using pdfClient::LinuxFileOps;
+using pdfClient::Page;
+using pdfClient::Point_i;
+using pdfClient::Rectangle_i;
+using pdfClient::SelectionBoundary;
+using pdfClient::TextRange;
+
+namespace {
+
+// The synthetic document: US letter pages of lines of text in Helvetica.
+constexpr int kSyntheticPages = 200;
+constexpr int kLinesPerPage = 60;
+constexpr float kPageWidth = 612;
+constexpr float kPageHeight = 792;
+constexpr int kMargin = 72;
+constexpr float kFontSize = 9;
+constexpr float kLineHeight = 11;
+const wchar_t kLine[] =
+        L"The quick brown fox jumps over the lazy dog, then searches a long document for it.";
+
+// See RenderParams.java.
+constexpr int kRenderModeForDisplay = 1;
+
+// Passed instead of the name of a testdata PDF for the synthetic document.
+const char kSynthetic[] = "synthetic";
+
+// Writes the synthetic document next to the benchmark, once, and returns its path.
+const std::string& GetSyntheticFile() {
+    static const std::string path = [] {
+        const std::string file = android::base::GetExecutableDirectory() + "/synthetic.pdf";
+        pdfClient::InitLibrary();
+        ScopedFPDFDocument doc(FPDF_CreateNewDocument());
+        ScopedFPDFFont font(FPDFText_LoadStandardFont(doc.get(), "Helvetica"));
+        for (int page_num = 0; page_num < kSyntheticPages; page_num++) {
+            ScopedFPDFPage page(FPDFPage_New(doc.get(), page_num, kPageWidth, kPageHeight));
+            for (int line = 0; line < kLinesPerPage; line++) {
+                FPDF_PAGEOBJECT text = FPDFPageObj_CreateTextObj(doc.get(), font.get(), kFontSize);
+                ScopedFPDFWChar chars = pdfClient_utils::ToFPDFWideString(kLine);
+                FPDFText_SetText(text, chars.get());
+                FPDFPageObj_Transform(text, 1, 0, 0, 1, kMargin,
+                                      kPageHeight - kMargin - line * kLineHeight);
+                FPDFPage_InsertObject(page.get(), text);
+            }
+            FPDFPage_GenerateContent(page.get());
+        }
+        FileWriter writer(LinuxFileOps::FDCloser(
+                open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+        FPDF_SaveAsCopy(doc.get(), &writer, 0);
+        writer.Flush();
+        return file;
+    }();
+    return path;
+}
+
+std::string GetFile(const std::string& name) {
+    if (name == kSynthetic) {
+        return GetSyntheticFile();
+    }
+    return android::base::GetExecutableDirectory() + "/testdata/" + name;
+}
+
+// The point of the synthetic pages to select a word at, on the first word of
+// the first line, in page coordinates.
+constexpr Point_i kFirstWord = {kMargin + 5, kMargin - 3};
+
+std::unique_ptr<Document> LoadDocument(const std::string& name) {
+    pdfClient::InitLibrary();
+    LinuxFileOps::FDCloser fd(open(GetFile(name).c_str(), O_RDONLY | O_CLOEXEC));
+    std::unique_ptr<Document> doc;
+    Document::Load(std::make_unique<FileReader>(std::move(fd)), nullptr,
+                   /* closeFdOnFailure= */ true, &doc);
+    return doc;
+}
+
+void Stable(benchmark::internal::Benchmark* b) {
+    b->Repetitions(5)->ReportAggregatesOnly(true)->Unit(benchmark::kMicrosecond);
+}
+
+void BM_Load(benchmark::State& state, const std::string& name) {
+    // Generates the synthetic document, if that's the one, before measuring.
+    GetFile(name);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LoadDocument(name));
+    }
+}
+BENCHMARK_CAPTURE(BM_Load, sample_pdf, "sample_pdf.pdf")->Apply(Stable);
+BENCHMARK_CAPTURE(BM_Load, annotation, "annotation.pdf")->Apply(Stable);
+BENCHMARK_CAPTURE(BM_Load, synthetic, kSynthetic)->Apply(Stable);
+
+// Renders the first page for display, scaled by the argument in percent.
+void BM_Render(benchmark::State& state, const std::string& name) {
+    std::unique_ptr<Document> doc = LoadDocument(name);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    const float scale = state.range(0) / 100.0f;
+    const int width = page->Width() * scale;
+    const int height = page->Height() * scale;
+    std::vector<uint8_t> pixels(width * height * 4);
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(width, height, FPDFBitmap_BGRA, pixels.data(), width * 4));
+    for (auto _ : state) {
+        page->Render(bitmap.get(), FS_MATRIX{scale, 0, 0, scale, 0, 0}, 0, 0, width, height,
+                     kRenderModeForDisplay, /* show_annot_types= */ 0,
+                     /* render_form_fields= */ false);
+        benchmark::DoNotOptimize(pixels.data());
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK_CAPTURE(BM_Render, sample_pdf, "sample_pdf.pdf")
+        ->Arg(25)
+        ->Arg(100)
+        ->Arg(300)
+        ->Apply(Stable);
+BENCHMARK_CAPTURE(BM_Render, synthetic, kSynthetic)
+        ->Arg(25)
+        ->Arg(100)
+        ->Arg(300)
+        ->Apply(Stable);
+
+// Each thread renders the first page of its own document and then copies the
+// pixels out, as the JNI entry points hand them over to Java. PDFium isn't
+// thread-safe, so the renders are serialized, by a process-wide lock held for
+// the whole call with an argument of 0, like before documents were locked
+// individually, or only around the render with 1, like pdf_document_jni.cc.
+// Compares the throughput of several documents used at once.
+void BM_RenderConcurrently(benchmark::State& state) {
+    static std::mutex pdfium_mutex;
+    const bool only_pdfium_locked = state.range(0) != 0;
+    std::unique_lock<std::mutex> lock(pdfium_mutex);
+    std::unique_ptr<Document> doc = LoadDocument(kSynthetic);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    const int width = page->Width();
+    const int height = page->Height();
+    std::vector<uint8_t> pixels(width * height * 4);
+    std::vector<uint8_t> copied(pixels.size());
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(width, height, FPDFBitmap_BGRA, pixels.data(), width * 4));
+    lock.unlock();
+    for (auto _ : state) {
+        lock.lock();
+        page->Render(bitmap.get(), FS_MATRIX{1, 0, 0, 1, 0, 0}, 0, 0, width, height,
+                     kRenderModeForDisplay, /* show_annot_types= */ 0,
+                     /* render_form_fields= */ false);
+        if (only_pdfium_locked) {
+            lock.unlock();
+        }
+        copied = pixels;
+        benchmark::DoNotOptimize(copied.data());
+        if (lock.owns_lock()) {
+            lock.unlock();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    // Closing the page and the document calls into PDFium too.
+    lock.lock();
+    bitmap.reset();
+    page.reset();
+    doc.reset();
+}
+BENCHMARK(BM_RenderConcurrently)->Arg(0)->Arg(1)->ThreadRange(1, 4)->UseRealTime()->Apply(Stable);
+
+// Searches a page that was already searched, whose text is cached.
+void BM_FindMatchesUtf8(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument(kSynthetic);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    std::vector<TextRange> matches;
+    for (auto _ : state) {
+        matches.clear();
+        benchmark::DoNotOptimize(page->FindMatchesUtf8("lazy dog", &matches));
+    }
+}
+BENCHMARK(BM_FindMatchesUtf8)->Apply(Stable);
+
+// Searches every page of the document, loading each of them and its text.
+void BM_FindMatchesUtf8AllPages(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument(kSynthetic);
+    doc->SetPageCacheBudget(0);
+    std::vector<TextRange> matches;
+    for (auto _ : state) {
+        for (int page_num = 0; page_num < doc->NumPages(); page_num++) {
+            matches.clear();
+            benchmark::DoNotOptimize(doc->GetPage(page_num)->FindMatchesUtf8("lazy dog", &matches));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * doc->NumPages());
+}
+BENCHMARK(BM_FindMatchesUtf8AllPages)->Apply(Stable);
+
+void BM_SelectWordAt(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument(kSynthetic);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    SelectionBoundary start(-1, 0, 0, false);
+    SelectionBoundary stop(-1, 0, 0, false);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(page->SelectWordAt(kFirstWord, &start, &stop));
+    }
+}
+BENCHMARK(BM_SelectWordAt)->Apply(Stable);
+
+void BM_GetPageObjects(benchmark::State& state, const std::string& name) {
+    std::unique_ptr<Document> doc = LoadDocument(name);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(page->GetPageObjects(/* refetch= */ true));
+    }
+}
+BENCHMARK_CAPTURE(BM_GetPageObjects, page_object, "page_object.pdf")->Apply(Stable);
+BENCHMARK_CAPTURE(BM_GetPageObjects, synthetic, kSynthetic)->Apply(Stable);
+
+// What getPageLinks and searchPageText gather for the JNI conversion, which
+// needs a JVM and so isn't measured here.
+void BM_GetLinksUtf8(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument("sample_links.pdf");
+    doc->SetPageCacheBudget(0);
+    for (auto _ : state) {
+        std::vector<Rectangle_i> rects;
+        std::vector<int> link_to_rect;
+        std::vector<std::string> urls;
+        benchmark::DoNotOptimize(doc->GetPage(0)->GetLinksUtf8(&rects, &link_to_rect, &urls));
+    }
+}
+BENCHMARK(BM_GetLinksUtf8)->Apply(Stable);
+
+void BM_BoundsOfMatchesUtf8(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument(kSynthetic);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    for (auto _ : state) {
+        std::vector<Rectangle_i> rects;
+        std::vector<int> match_to_rect;
+        std::vector<int> char_indexes;
+        benchmark::DoNotOptimize(
+                page->BoundsOfMatchesUtf8("the", &rects, &match_to_rect, &char_indexes));
+    }
+}
+BENCHMARK(BM_BoundsOfMatchesUtf8)->Apply(Stable);
+
+}  // namespace
+
+BENCHMARK_MAIN();
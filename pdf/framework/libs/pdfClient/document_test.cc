@@ -27,6 +27,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "file.h"
 #include "fpdfview.h"
@@ -48,6 +49,7 @@ const std::string kTestdata = "testdata";
 const std::string kSekretNoPassword = "sekret_no_password.pdf";
 const std::string kSecretWithPassword = "sekret_password_banana.pdf";
 const std::string kPassword = "banana";
+const std::string kTwoPages = "sample_links.pdf";
 
 std::string GetTestDataDir() {
     return android::base::GetExecutableDirectory();
@@ -129,12 +131,60 @@ TEST(Test, SaveAs) {
     compareDocuments(doc_orig->GetPage(0), copied->GetPage(0));
 }
 
+TEST(Test, SaveAsToSourceFile) {
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(GetTestFile("page_object.pdf"), &content));
+    std::string path = GetTempFile("saved_incrementally.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+
+    std::unique_ptr<Document> doc = LoadDocument(path);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    const size_t num_objects = page->GetPageObjects().size();
+    ASSERT_TRUE(page->RemovePageObject(0));
+    LinuxFileOps::FDCloser out(open(path.c_str(), O_RDWR));
+    ASSERT_GT(out.get(), 0);
+    ASSERT_TRUE(doc->SaveAs(std::move(out)));
+
+    // Only the changes are appended to the file.
+    std::string saved;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &saved));
+    EXPECT_GT(saved.size(), content.size());
+    EXPECT_EQ(content, saved.substr(0, content.size()));
+    EXPECT_EQ(num_objects - 1, LoadDocument(path)->GetPage(0)->GetPageObjects().size());
+
+    // Saving again replaces the earlier update.
+    ASSERT_TRUE(doc->SaveAs(LinuxFileOps::FDCloser(open(path.c_str(), O_RDWR | O_APPEND))));
+    std::string saved_again;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &saved_again));
+    EXPECT_EQ(saved.size(), saved_again.size());
+    EXPECT_EQ(num_objects - 1, LoadDocument(path)->GetPage(0)->GetPageObjects().size());
+}
+
+TEST(Test, SaveAsDoesNotRewriteSourceFile) {
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(GetTestFile("page_object.pdf"), &content));
+    std::string path = GetTempFile("not_rewritten.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+
+    std::unique_ptr<Document> doc = LoadDocument(path);
+    ASSERT_TRUE(doc->GetPage(0)->RemovePageObject(0));
+    // The changes can't be appended to a file shorter than the one loaded.
+    const std::string truncated = content.substr(0, content.size() / 2);
+    ASSERT_TRUE(android::base::WriteStringToFile(truncated, path));
+    EXPECT_FALSE(doc->SaveAs(LinuxFileOps::FDCloser(open(path.c_str(), O_RDWR))));
+
+    std::string saved;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &saved));
+    EXPECT_EQ(truncated, saved);
+}
+
 /*
  * Tests the retention of std::shared_ptr<Page> as requested.
  */
 TEST(Test, GetPageTest) {
     std::unique_ptr<Document> doc = LoadDocument(GetTestFile(kSekretNoPassword), nullptr);
-    // retain == false so should be a new copy each time
+    doc->SetPageCacheBudget(0);
+    // retain == false and no page cache so should be a new copy each time
     std::shared_ptr<Page> page_zero_copy_one = doc->GetPage(0);
     std::shared_ptr<Page> page_zero_copy_two = doc->GetPage(0);
     EXPECT_NE(page_zero_copy_one, page_zero_copy_two);
@@ -150,6 +200,94 @@ TEST(Test, GetPageTest) {
     EXPECT_EQ(page_zero_copy_four, page_zero_copy_five);
 }
 
+/*
+ * Tests that pages which aren't retained are cached within the budget.
+ */
+TEST(Test, PageCacheTest) {
+    std::unique_ptr<Document> doc = LoadDocument(GetTestFile(kSekretNoPassword), nullptr);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    EXPECT_EQ(page, doc->GetPage(0));
+    EXPECT_EQ(1u, doc->GetPageCacheStats().hits);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().misses);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().pages);
+    const size_t bytes = doc->GetPageCacheStats().bytes;
+    EXPECT_EQ(page->EstimatedMemoryUsage(), bytes);
+
+    // Loading the text page counts towards the budget.
+    page->GetTextUtf8();
+    doc->GetPage(0);
+    EXPECT_GT(doc->GetPageCacheStats().bytes, bytes);
+
+    // Retaining the page takes it out of the cache, releasing it puts it back.
+    EXPECT_EQ(page, doc->GetPage(0, true));
+    EXPECT_EQ(0u, doc->GetPageCacheStats().pages);
+    doc->ReleaseRetainedPage(0);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().pages);
+    EXPECT_EQ(page, doc->GetPage(0));
+
+    // Pages that don't fit in the budget are closed.
+    doc->SetPageCacheBudget(bytes - 1);
+    EXPECT_EQ(0u, doc->GetPageCacheStats().pages);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().evictions);
+    EXPECT_NE(page, doc->GetPage(0));
+}
+
+/*
+ * Tests that prefetched pages go behind the pages in use in the cache.
+ */
+TEST(Test, PrefetchPageTest) {
+    std::unique_ptr<Document> doc = LoadDocument(GetTestFile(kTwoPages), nullptr);
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    EXPECT_TRUE(doc->PrefetchPage(1));
+    EXPECT_EQ(2u, doc->GetPageCacheStats().pages);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().misses);
+    EXPECT_TRUE(doc->GetPage(1)->IsPrefetched());
+    EXPECT_EQ(1u, doc->GetPageCacheStats().hits);
+    // Out of range pages are ignored.
+    EXPECT_TRUE(doc->PrefetchPage(2));
+
+    // A page that doesn't fit isn't kept, and doesn't close the one in use.
+    std::unique_ptr<Document> small = LoadDocument(GetTestFile(kTwoPages), nullptr);
+    page = small->GetPage(0);
+    small->SetPageCacheBudget(page->EstimatedMemoryUsage());
+    EXPECT_FALSE(small->PrefetchPage(1));
+    EXPECT_EQ(1u, small->GetPageCacheStats().pages);
+    EXPECT_EQ(page, small->GetPage(0));
+}
+
+TEST(Test, TrimMemoryTest) {
+    std::unique_ptr<Document> doc = LoadDocument(GetTestFile(kTwoPages), nullptr);
+    EXPECT_TRUE(doc->PrefetchPage(0));
+    EXPECT_TRUE(doc->PrefetchPage(1));
+    EXPECT_EQ(0u, doc->TrimMemory(Document::TrimLevel::RENDERS));
+    EXPECT_EQ(2u, doc->GetPageCacheStats().pages);
+
+    // The least recently used page is closed, the other one drops its text.
+    std::shared_ptr<Page> page = doc->GetPage(0);
+    const size_t page_bytes = page->EstimatedMemoryUsage();
+    EXPECT_GT(doc->TrimMemory(Document::TrimLevel::SOME_PAGES), page_bytes);
+    EXPECT_EQ(1u, doc->GetPageCacheStats().pages);
+    EXPECT_FALSE(page->IsPrefetched());
+    EXPECT_LT(page->EstimatedMemoryUsage(), page_bytes);
+    // It's loaded again when it's needed.
+    EXPECT_FALSE(page->GetTextUtf8().empty());
+
+    EXPECT_GT(doc->TrimMemory(Document::TrimLevel::ALL_PAGES), 0u);
+    EXPECT_EQ(0u, doc->GetPageCacheStats().pages);
+    EXPECT_NE(page, doc->GetPage(0));
+}
+
+TEST(Test, PagesNearestFirstTest) {
+    std::unique_ptr<Document> doc = LoadDocument(GetTestFile(kTwoPages), nullptr);
+    ASSERT_EQ(2, doc->NumPages());
+    EXPECT_EQ(std::vector<int>({0, 1}), doc->PagesNearestFirst(0, 0));
+    EXPECT_EQ(std::vector<int>({1, 0}), doc->PagesNearestFirst(1, 1));
+    EXPECT_EQ(std::vector<int>({0, 1}), doc->PagesNearestFirst(0, 1));
+    // Out of range pages are clamped to the document.
+    EXPECT_EQ(std::vector<int>({1, 0}), doc->PagesNearestFirst(5, 9));
+    EXPECT_EQ(std::vector<int>({0, 1}), doc->PagesNearestFirst(-3, -1));
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -18,6 +18,8 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -37,8 +39,11 @@
 namespace pdfClient {
 
 size_t GetFileSize(int fd) {
-    off_t end = lseek(fd, 0, SEEK_END);
-    return std::max(end, 0L);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return std::max(st.st_size, 0L);
 }
 
 FileReader::FileReader(LinuxFileOps::FDCloser fd) : fd_(std::move(fd)) {
@@ -54,40 +59,147 @@ FileReader::FileReader(LinuxFileOps::FDCloser fd, size_t completeSize)
 FileReader::FileReader(FileReader&& fr)
     : fpdf_avail_(std::move(fr.fpdf_avail_)),
       fd_(std::move(fr.fd_)),
-      complete_size_(fr.complete_size_) {}
+      complete_size_(fr.complete_size_),
+      mapped_(std::exchange(fr.mapped_, nullptr)),
+      cached_blocks_(std::move(fr.cached_blocks_)),
+      cached_block_index_(std::move(fr.cached_block_index_)) {}
 
-FileReader::~FileReader() {}
+FileReader::~FileReader() {
+    Unmap();
+}
 
 int FileReader::ReleaseFd() {
     return fd_.Release();
 }
 
 bool FileReader::IsComplete() const {
-    return GetFileSize(fd_.get()) >= complete_size_;
+    return mapped_ != nullptr || GetFileSize(fd_.get()) >= complete_size_;
 }
 
 bool FileReader::CanReadBlock(size_t pos, size_t size) const {
+    const size_t available = mapped_ != nullptr ? complete_size_ : GetFileSize(fd_.get());
     // Return false if pos + size overflows:
-    return pos + size >= pos && pos + size <= GetFileSize(fd_.get());
+    return pos + size >= pos && pos + size <= available;
 }
 
 size_t FileReader::DoReadBlock(size_t pos, void* buffer, size_t size) const {
     if (!CanReadBlock(pos, size)) {
         return 0;
     }
-    if (lseek(fd_.get(), pos, SEEK_SET) == -1) {
-        return 0;
+    if (mapped_ != nullptr) {
+        memcpy(buffer, mapped_ + pos, size);
+        return size;
+    }
+    // Large reads, e.g. of images, would only push everything else out of the
+    // cache.
+    if (size > kCacheBlockSize * kMaxCachedBlocks / 4) {
+        return ReadFromFd(pos, buffer, size);
+    }
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t total = 0;
+    while (total < size) {
+        const size_t offset = pos + total;
+        const size_t in_block = offset % kCacheBlockSize;
+        const size_t length = std::min(size - total, kCacheBlockSize - in_block);
+        const std::vector<uint8_t>* block = GetCachedBlock(offset / kCacheBlockSize);
+        if (block == nullptr) {
+            // The end of a file still being written.
+            return total + ReadFromFd(offset, out + total, size - total);
+        }
+        if (in_block + length > block->size()) {
+            break;
+        }
+        memcpy(out + total, block->data() + in_block, length);
+        total += length;
     }
-    return read(fd_.get(), buffer, size);
+    return total;
+}
+
+size_t FileReader::ReadFromFd(size_t pos, void* buffer, size_t size) const {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t bytes = TEMP_FAILURE_RETRY(
+                pread(fd_.get(), static_cast<uint8_t*>(buffer) + total, size - total, pos + total));
+        if (bytes <= 0) {
+            break;
+        }
+        total += bytes;
+    }
+    return total;
+}
+
+const std::vector<uint8_t>* FileReader::GetCachedBlock(size_t number) const {
+    auto it = cached_block_index_.find(number);
+    if (it != cached_block_index_.end()) {
+        cached_blocks_.splice(cached_blocks_.begin(), cached_blocks_, it->second);
+        return &it->second->data;
+    }
+
+    // Only the last block of the file is shorter, and blocks are only cached
+    // once all of it has been written, as it then won't change anymore.
+    const size_t start = number * kCacheBlockSize;
+    if (start >= complete_size_) {
+        return nullptr;
+    }
+    const size_t length = std::min(kCacheBlockSize, complete_size_ - start);
+    if (!CanReadBlock(start, length)) {
+        return nullptr;
+    }
+    std::vector<uint8_t> data(length);
+    if (ReadFromFd(start, data.data(), length) != length) {
+        return nullptr;
+    }
+
+    if (cached_blocks_.size() >= kMaxCachedBlocks) {
+        cached_block_index_.erase(cached_blocks_.back().number);
+        cached_blocks_.pop_back();
+    }
+    cached_blocks_.push_front(CachedBlock{number, std::move(data)});
+    cached_block_index_[number] = cached_blocks_.begin();
+    return &cached_blocks_.front().data;
 }
 
 void FileReader::RequestBlock(size_t offset, size_t size) {
     if (!CanReadBlock(offset, size)) {
         LOGI("pdfClient requests segment: offset=%zu, size=%zu", offset, size);
     }
+    if (mapped_ != nullptr || size == 0 || offset + size < offset) {
+        return;
+    }
+    // PDFium is about to read this segment, read ahead whatever of it is
+    // there already, as long as it fits in the cache.
+    const size_t first = offset / kCacheBlockSize;
+    const size_t last = std::min((offset + size - 1) / kCacheBlockSize,
+                                 first + kMaxCachedBlocks / 2 - 1);
+    for (size_t number = first; number <= last; number++) {
+        if (GetCachedBlock(number) == nullptr) {
+            break;
+        }
+    }
+}
+
+void FileReader::Unmap() {
+    if (mapped_ != nullptr) {
+        munmap(const_cast<uint8_t*>(mapped_), complete_size_);
+        mapped_ = nullptr;
+    }
+}
+
+void FileReader::MapIfComplete() {
+    if (complete_size_ == 0 || GetFileSize(fd_.get()) < complete_size_) {
+        return;
+    }
+    void* mapped = mmap(nullptr, complete_size_, PROT_READ, MAP_SHARED, fd_.get(), 0);
+    if (mapped == MAP_FAILED) {
+        LOGW("Can't map file, reading it instead: %s", strerror(errno));
+        return;
+    }
+    mapped_ = static_cast<const uint8_t*>(mapped);
 }
 
 void FileReader::InitImplementation() {
+    MapIfComplete();
+
     // Implements FPDF_FILEACCESS:
     FPDF_FILEACCESS::m_FileLen = complete_size_;
     FPDF_FILEACCESS::m_GetBlock = &StaticGetBlockImpl;
@@ -126,20 +238,81 @@ FileWriter::FileWriter(LinuxFileOps::FDCloser fd) : fd_(std::move(fd)) {
     // Implements FPDF_FILEWRITE:
     version = 1;
     WriteBlock = &StaticWriteBlockImpl;
+    buffer_.reserve(kBufferSize);
+}
+
+FileWriter::FileWriter(LinuxFileOps::FDCloser fd, const FileReader* existing)
+    : FileWriter(std::move(fd)) {
+    existing_ = existing;
 }
 
 FileWriter::~FileWriter() {
     if (fd_.get() >= 0) {
+        Flush();
         fsync(fd_.get());
     }
 }
 
 size_t FileWriter::DoWriteBlock(const void* data, size_t size) {
-    size_t written = write(fd_.get(), data, size);
-    if (written != size) {
-        LOGE("Error performing write to fd: %s", strerror(errno));
+    if (failed_) {
+        return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t remaining = size;
+    if (existing_ != nullptr && existing_checked_ < existing_->CompleteSize()) {
+        const size_t length = std::min(remaining, existing_->CompleteSize() - existing_checked_);
+        if (!CheckExisting(bytes, length)) {
+            return 0;
+        }
+        bytes += length;
+        remaining -= length;
+    }
+    if (buffer_.size() + remaining > kBufferSize && !Flush()) {
+        return 0;
+    }
+    if (remaining >= kBufferSize) {
+        return WriteFully(bytes, remaining) ? size : 0;
+    }
+    buffer_.insert(buffer_.end(), bytes, bytes + remaining);
+    return size;
+}
+
+bool FileWriter::CheckExisting(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> existing(size);
+    if (existing_->DoReadBlock(existing_checked_, existing.data(), size) != size ||
+        memcmp(existing.data(), data, size) != 0) {
+        LOGW("Incremental save doesn't start with the existing file");
+        failed_ = true;
+        return false;
+    }
+    existing_checked_ += size;
+    return true;
+}
+
+bool FileWriter::Flush() {
+    if (existing_ != nullptr && existing_checked_ < existing_->CompleteSize()) {
+        failed_ = true;
+    }
+    if (!failed_ && !buffer_.empty()) {
+        WriteFully(buffer_.data(), buffer_.size());
+    }
+    buffer_.clear();
+    return !failed_;
+}
+
+bool FileWriter::WriteFully(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd_.get(), bytes, size));
+        if (written <= 0) {
+            LOGE("Error performing write to fd: %s", strerror(errno));
+            failed_ = true;
+            return false;
+        }
+        bytes += written;
+        size -= written;
     }
-    return written;
+    return true;
 }
 
 int FileWriter::StaticWriteBlockImpl(FPDF_FILEWRITE* pThis, const void* data,
@@ -18,6 +18,11 @@
 #define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_FILE_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
 
 #include "cpp/fpdf_scopers.h"
 #include "fpdf_dataavail.h"
@@ -27,14 +32,23 @@
 
 namespace pdfClient {
 
-// Returns the actual current size of the given file, by seeking to the end.
-// Only works with seekable file descriptors.
+// Returns the actual current size of the given file, without moving its
+// offset. Only works with regular files.
 size_t GetFileSize(int fd);
 
 // A wrapper on a file-descriptor for reading - implements all the interfaces
 // needed to open a PDF as it downloads, using fpdf_dataavail.h
 // The data that is available is automatically updated as more data is written
 // to the file-descriptor (see CanReadBlock).
+//
+// Blocks are read with pread, which doesn't use the file offset, so the
+// file-descriptor can be shared. A file that has already been completely
+// written is mapped into memory instead, and blocks are copied from there
+// without checking its size again, see Unmap.
+//
+// Otherwise, small reads go through a cache of aligned blocks of the file, so
+// that PDFium's many small scattered reads don't each go to a slow fd, e.g.
+// one backed by a document provider. RequestBlock reads ahead into the cache.
 class FileReader : public FPDF_FILEACCESS, public FX_FILEAVAIL, public FX_DOWNLOADHINTS {
   public:
     // We implement this interface too, but not by subclassing it.
@@ -65,14 +79,46 @@ class FileReader : public FPDF_FILEACCESS, public FX_FILEAVAIL, public FX_DOWNLO
     virtual size_t DoReadBlock(size_t offset, void* buffer, size_t size) const;
     virtual void RequestBlock(size_t offset, size_t size);
 
+    // Reads the file with pread from now on, if it was mapped. Must be called
+    // before the file may be truncated, e.g. to save over it: reads of it then
+    // fail, where copying mapped pages past its end would raise SIGBUS.
+    void Unmap();
+
+    // Size and alignment of the blocks cached, and how many are kept at most.
+    static constexpr size_t kCacheBlockSize = 64 * 1024;
+    static constexpr size_t kMaxCachedBlocks = 32;
+
   protected:
     LinuxFileOps::FDCloser fd_;  // File-descriptor.
 
     // How big the file will be once completely written.
     size_t complete_size_;
 
+    // The whole file, if it was completely written when opened, see
+    // MapIfComplete. If so, it won't be checked for more data anymore.
+    const uint8_t* mapped_ = nullptr;
+
+    // Blocks read from the file, most recently used first, and where each of
+    // them is in |cached_blocks_| by block number.
+    struct CachedBlock {
+        size_t number;
+        std::vector<uint8_t> data;
+    };
+    mutable std::list<CachedBlock> cached_blocks_;
+    mutable std::unordered_map<size_t, std::list<CachedBlock>::iterator> cached_block_index_;
+
     void InitImplementation();
 
+    // Maps the file into memory if it is already completely written.
+    void MapIfComplete();
+
+    // Reads |size| bytes at |pos| with pread, returns how many were read.
+    size_t ReadFromFd(size_t pos, void* buffer, size_t size) const;
+
+    // Returns block |number| of the file, reading it into the cache if needed,
+    // or nullptr if it isn't all available yet.
+    const std::vector<uint8_t>* GetCachedBlock(size_t number) const;
+
     // Needed to implement FX_FILEAVAIL:
     static int StaticIsDataAvailImpl(struct _FX_FILEAVAIL* pThis, size_t offset, size_t size);
 
@@ -87,17 +133,48 @@ class FileReader : public FPDF_FILEACCESS, public FX_FILEAVAIL, public FX_DOWNLO
 
 // A wrapper on a filedescriptor for writing - used to save a copy of a PDF
 // with password-protection security removed (see document.h).
+// PDFium writes a PDF in many tiny blocks, so they are combined in a buffer
+// and written out once it is full, see Flush. The file is synced when the
+// FileWriter is destroyed.
 class FileWriter : public FPDF_FILEWRITE {
   public:
+    // Size of the buffer blocks are combined in.
+    static constexpr size_t kBufferSize = 256 * 1024;
+
     explicit FileWriter(LinuxFileOps::FDCloser fd);
+
+    // For an incremental save to the file |existing| reads, with |fd| opened on
+    // that same file: PDFium starts by writing all of the existing file, which
+    // is then only checked against it, and everything after that is written at
+    // the fd's offset, which should be the end of the existing file.
+    FileWriter(LinuxFileOps::FDCloser fd, const FileReader* existing);
+
     ~FileWriter();
 
     int Fd() { return fd_.get(); }
 
+    // Returns |size|, or 0 if this or an earlier write failed.
     size_t DoWriteBlock(const void* data, size_t size);
 
+    // Writes out what is buffered, returns false if any write failed.
+    bool Flush();
+
   private:
     LinuxFileOps::FDCloser fd_;  // File-descriptor.
+    std::vector<uint8_t> buffer_;
+    bool failed_ = false;
+
+    // See the constructor, and how many of the bytes PDFium wrote were checked
+    // against the existing file so far.
+    const FileReader* existing_ = nullptr;
+    size_t existing_checked_ = 0;
+
+    // Checks the next |size| bytes of the existing file are |data|, or sets
+    // |failed_|.
+    bool CheckExisting(const uint8_t* data, size_t size);
+
+    // Writes all of |data| to the fd, or sets |failed_|.
+    bool WriteFully(const void* data, size_t size);
 
     // Needed to implement FPDF_FILEWRITE
     static int StaticWriteBlockImpl(FPDF_FILEWRITE* pThis, const void* data,
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of saving documents. PDFium writes a saved PDF in many tiny
+// blocks, which FileWriter combines; the *Unbuffered benchmark is a plain
+// write per block, for comparison.
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "document.h"
+#include "file.h"
+#include "linux_fileops.h"
+
+using pdfClient::Document;
+using pdfClient::FileReader;
+using pdfClient::FileWriter;
+using pdfClient::LinuxFileOps;
+
+namespace {
+
+// About what PDFium writes at a time while saving, in total about 4MB.
+constexpr size_t kBlockSize = 16;
+constexpr size_t kNumBlocks = 256 * 1024;
+
+std::string GetTestFile(const std::string& filename) {
+    return android::base::GetExecutableDirectory() + "/testdata/" + filename;
+}
+
+std::string GetTempFile() {
+    return android::base::GetExecutableDirectory() + "/file_benchmark.pdf";
+}
+
+LinuxFileOps::FDCloser OpenForWriting() {
+    return LinuxFileOps::FDCloser(
+            open(GetTempFile().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+}
+
+std::unique_ptr<Document> LoadDocument(const std::string& filename, const char* password) {
+    LinuxFileOps::FDCloser fd(open(GetTestFile(filename).c_str(), O_RDONLY | O_CLOEXEC));
+    std::unique_ptr<Document> doc;
+    Document::Load(std::make_unique<FileReader>(std::move(fd)), password,
+                   /* closeFdOnFailure= */ true, &doc);
+    return doc;
+}
+
+void BM_WriteSmallBlocks(benchmark::State& state) {
+    const std::string block(kBlockSize, 'x');
+    for (auto _ : state) {
+        FileWriter writer(OpenForWriting());
+        for (size_t i = 0; i < kNumBlocks; i++) {
+            writer.DoWriteBlock(block.data(), block.size());
+        }
+        writer.Flush();
+    }
+    state.SetBytesProcessed(state.iterations() * kBlockSize * kNumBlocks);
+    unlink(GetTempFile().c_str());
+}
+BENCHMARK(BM_WriteSmallBlocks);
+
+void BM_WriteSmallBlocksUnbuffered(benchmark::State& state) {
+    const std::string block(kBlockSize, 'x');
+    for (auto _ : state) {
+        LinuxFileOps::FDCloser fd = OpenForWriting();
+        for (size_t i = 0; i < kNumBlocks; i++) {
+            benchmark::DoNotOptimize(write(fd.get(), block.data(), block.size()));
+        }
+        fsync(fd.get());
+    }
+    state.SetBytesProcessed(state.iterations() * kBlockSize * kNumBlocks);
+    unlink(GetTempFile().c_str());
+}
+BENCHMARK(BM_WriteSmallBlocksUnbuffered);
+
+void BM_SaveAs(benchmark::State& state) {
+    pdfClient::InitLibrary();
+    std::unique_ptr<Document> doc = LoadDocument("annotation.pdf", nullptr);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(doc->SaveAs(OpenForWriting()));
+    }
+    unlink(GetTempFile().c_str());
+}
+BENCHMARK(BM_SaveAs);
+
+void BM_CloneDocumentWithoutSecurity(benchmark::State& state) {
+    pdfClient::InitLibrary();
+    std::unique_ptr<Document> doc = LoadDocument("sekret_password_banana.pdf", "banana");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(doc->CloneDocumentWithoutSecurity(OpenForWriting()));
+    }
+    unlink(GetTempFile().c_str());
+}
+BENCHMARK(BM_CloneDocumentWithoutSecurity);
+
+}  // namespace
+
+BENCHMARK_MAIN();
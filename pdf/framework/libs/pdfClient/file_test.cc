@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "file.h"
+
+#include <android-base/file.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "linux_fileops.h"
+
+using pdfClient::FileReader;
+using pdfClient::FileWriter;
+using pdfClient::GetFileSize;
+using pdfClient::LinuxFileOps;
+
+namespace {
+
+const std::string kContent = "%PDF-1.7 not really a pdf";
+
+std::string GetTempFile(const std::string& filename) {
+    return android::base::GetExecutableDirectory() + "/" + filename;
+}
+
+LinuxFileOps::FDCloser OpenForReading(const std::string& path) {
+    return LinuxFileOps::FDCloser(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+}
+
+std::string ReadBlock(const FileReader& reader, size_t offset, size_t size) {
+    std::string block(size, '\0');
+    block.resize(reader.DoReadBlock(offset, block.data(), size));
+    return block;
+}
+
+TEST(Test, CompleteFileTest) {
+    const std::string path = GetTempFile("complete_file.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(kContent, path));
+    FileReader reader(OpenForReading(path));
+
+    EXPECT_EQ(kContent.size(), reader.CompleteSize());
+    EXPECT_TRUE(reader.IsComplete());
+    EXPECT_EQ("PDF", ReadBlock(reader, 1, 3));
+    EXPECT_EQ("pdf", ReadBlock(reader, kContent.size() - 3, 3));
+    // Reads don't depend on each other, nor on the file offset.
+    lseek(reader.Fd(), 0, SEEK_END);
+    EXPECT_EQ("%PDF", ReadBlock(reader, 0, 4));
+
+    EXPECT_FALSE(reader.CanReadBlock(kContent.size() - 3, 4));
+    EXPECT_FALSE(reader.CanReadBlock(1, static_cast<size_t>(-1)));
+    EXPECT_EQ("", ReadBlock(reader, kContent.size() - 3, 4));
+    unlink(path.c_str());
+}
+
+TEST(Test, TruncatedCompleteFileTest) {
+    const std::string path = GetTempFile("truncated_file.pdf");
+    const std::string content = kContent + std::string(3 * 4096, ' ');
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+    FileReader reader(OpenForReading(path));
+    EXPECT_EQ(content.size(), reader.CompleteSize());
+
+    // Reads past the end of the truncated file fail, those before it don't.
+    reader.Unmap();
+    ASSERT_EQ(0, truncate(path.c_str(), kContent.size()));
+    EXPECT_FALSE(reader.CanReadBlock(2 * 4096, 4));
+    EXPECT_EQ("", ReadBlock(reader, 2 * 4096, 4));
+    EXPECT_EQ("PDF", ReadBlock(reader, 1, 3));
+    unlink(path.c_str());
+}
+
+TEST(Test, PartialFileTest) {
+    const std::string path = GetTempFile("partial_file.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(kContent.substr(0, 8), path));
+    FileReader reader(OpenForReading(path), kContent.size());
+
+    EXPECT_FALSE(reader.IsComplete());
+    EXPECT_EQ("%PDF", ReadBlock(reader, 0, 4));
+    EXPECT_FALSE(reader.CanReadBlock(8, 3));
+
+    // More of the file is available as it is written.
+    ASSERT_TRUE(android::base::WriteStringToFile(kContent, path));
+    EXPECT_TRUE(reader.IsComplete());
+    EXPECT_EQ("not", ReadBlock(reader, 9, 3));
+    unlink(path.c_str());
+}
+
+TEST(Test, CachedBlocksTest) {
+    const std::string path = GetTempFile("cached_blocks.pdf");
+    std::string content(FileReader::kCacheBlockSize * 3 + 100, '\0');
+    for (size_t i = 0; i < content.size(); i++) {
+        content[i] = 'a' + i % 26;
+    }
+    const size_t boundary = FileReader::kCacheBlockSize;
+    ASSERT_TRUE(android::base::WriteStringToFile(content.substr(0, boundary * 2 + 10), path));
+    FileReader reader(OpenForReading(path), content.size());
+
+    // Reads across blocks, and up to the end of what is written so far.
+    EXPECT_EQ(content.substr(boundary - 5, 10), ReadBlock(reader, boundary - 5, 10));
+    EXPECT_EQ(content.substr(boundary * 2 - 5, 15), ReadBlock(reader, boundary * 2 - 5, 15));
+    reader.RequestBlock(0, content.size());
+
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+    EXPECT_EQ(content.substr(boundary * 3 - 5, 105), ReadBlock(reader, boundary * 3 - 5, 105));
+    EXPECT_EQ(content, ReadBlock(reader, 0, content.size()));
+
+    // Blocks that were all written are read once, and then kept.
+    std::string changed = content;
+    changed[boundary + 1] = '!';
+    ASSERT_TRUE(android::base::WriteStringToFile(changed, path));
+    EXPECT_EQ(content.substr(boundary, 4), ReadBlock(reader, boundary, 4));
+    unlink(path.c_str());
+}
+
+TEST(Test, FileWriterTest) {
+    const std::string path = GetTempFile("file_writer.pdf");
+    std::string expected;
+    {
+        FileWriter writer(LinuxFileOps::FDCloser(
+                open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+        for (int i = 0; i < 1000; i++) {
+            const std::string token = std::to_string(i) + " 0 obj ";
+            EXPECT_EQ(token.size(), writer.DoWriteBlock(token.data(), token.size()));
+            expected += token;
+        }
+        // Small blocks are only written out once the buffer is flushed.
+        EXPECT_EQ(0u, GetFileSize(writer.Fd()));
+        EXPECT_TRUE(writer.Flush());
+        EXPECT_EQ(expected.size(), GetFileSize(writer.Fd()));
+
+        const std::string large(FileWriter::kBufferSize + 10, 'x');
+        EXPECT_EQ(3u, writer.DoWriteBlock("abc", 3));
+        EXPECT_EQ(large.size(), writer.DoWriteBlock(large.data(), large.size()));
+        EXPECT_EQ(3u, writer.DoWriteBlock("def", 3));
+        expected += "abc" + large + "def";
+    }
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &content));
+    EXPECT_EQ(expected, content);
+    unlink(path.c_str());
+}
+
+TEST(Test, FileWriterFailsTest) {
+    // Writes to a read-only fd only fail once the buffer is flushed, and all
+    // writes fail after that.
+    const std::string path = GetTempFile("file_writer_fails.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(kContent, path));
+    FileWriter writer(OpenForReading(path));
+    EXPECT_EQ(3u, writer.DoWriteBlock("abc", 3));
+    EXPECT_FALSE(writer.Flush());
+    EXPECT_EQ(0u, writer.DoWriteBlock("abc", 3));
+    EXPECT_FALSE(writer.Flush());
+    unlink(path.c_str());
+}
+
+TEST(Test, IncrementalFileWriterTest) {
+    const std::string path = GetTempFile("incremental_file_writer.pdf");
+    ASSERT_TRUE(android::base::WriteStringToFile(kContent, path));
+    FileReader reader(OpenForReading(path));
+    {
+        LinuxFileOps::FDCloser fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+        lseek(fd.get(), kContent.size(), SEEK_SET);
+        FileWriter writer(std::move(fd), &reader);
+        // The existing file is only checked, then the update is appended.
+        EXPECT_EQ(4u, writer.DoWriteBlock(kContent.data(), 4));
+        const std::string rest = kContent.substr(4) + " update";
+        EXPECT_EQ(rest.size(), writer.DoWriteBlock(rest.data(), rest.size()));
+        EXPECT_TRUE(writer.Flush());
+    }
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &content));
+    EXPECT_EQ(kContent + " update", content);
+
+    // Anything else than the existing file first fails, without writing.
+    LinuxFileOps::FDCloser fd(open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    FileWriter writer(std::move(fd), &reader);
+    EXPECT_EQ(0u, writer.DoWriteBlock("%PDF-2.0", 8));
+    EXPECT_FALSE(writer.Flush());
+    writer.DoWriteBlock("abc", 3);
+    EXPECT_EQ(kContent.size() + 7, GetFileSize(writer.Fd()));
+    unlink(path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
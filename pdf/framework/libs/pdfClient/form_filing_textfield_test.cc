@@ -314,4 +314,40 @@ TEST(Test, TextFieldClickOnPointInvalidRects) {
     EXPECT_FALSE(page_zero->HasInvalidRect());
 }
 
+/**
+ * Get the text field widgets of the document, and then only the one whose text
+ * was set since.
+ */
+TEST(Test, TextFieldGetFormWidgetChanges) {
+    std::unique_ptr<Document> doc = LoadDocument(kTextForm);
+    std::vector<Document::PageFormWidgets> widgets;
+    doc->GetFormWidgetChanges(0, doc->NumPages() - 1, {}, 0, &widgets);
+    ASSERT_EQ(1, widgets.size());
+    EXPECT_EQ(0, widgets[0].page_num);
+    EXPECT_TRUE(widgets[0].all_widgets);
+    EXPECT_GT(widgets[0].widget_infos.size(), 2);
+
+    // Nothing changed, and the pages aren't enumerated again.
+    const uint64_t generation = doc->FormGeneration();
+    widgets.clear();
+    doc->GetFormWidgetChanges(0, doc->NumPages() - 1, {}, generation, &widgets);
+    EXPECT_TRUE(widgets.empty());
+
+    std::shared_ptr<Page> page_zero = doc->GetPage(0, true);
+    EXPECT_TRUE(page_zero->SetFormFieldText(1, "Gecko"));
+    doc->InvalidateFormWidgets();
+    doc->GetFormWidgetChanges(0, doc->NumPages() - 1, {}, generation, &widgets);
+    ASSERT_EQ(1, widgets.size());
+    EXPECT_FALSE(widgets[0].all_widgets);
+    ASSERT_EQ(1, widgets[0].widget_infos.size());
+    EXPECT_EQ(1, widgets[0].widget_infos[0].widget_index());
+    EXPECT_EQ("Gecko", widgets[0].widget_infos[0].text_value());
+
+    // Other types are filtered out, the page stays retained.
+    widgets.clear();
+    doc->GetFormWidgetChanges(0, 0, {FPDF_FORMFIELD_COMBOBOX}, 0, &widgets);
+    EXPECT_TRUE(widgets.empty());
+    EXPECT_EQ(page_zero, doc->GetPage(0));
+}
+
 }  // namespace
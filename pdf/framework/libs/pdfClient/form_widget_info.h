@@ -28,6 +28,8 @@ struct Option {
     int index;
     std::string label;
     bool selected;
+
+    bool operator==(const Option& other) const = default;
 };
 
 // Value class of relevant information about a single form widget.
@@ -66,6 +68,8 @@ class FormWidgetInfo {
     const std::vector<Option>& options() const;
     void set_options(const std::vector<Option>& options);
 
+    bool operator==(const FormWidgetInfo& other) const = default;
+
   private:
     int widget_type_;
     int widget_index_;
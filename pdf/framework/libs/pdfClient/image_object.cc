@@ -26,7 +26,7 @@
 
 namespace pdfClient {
 
-BitmapFormat GetBitmapFormat(int bitmap_format) {
+BitmapFormat ToBitmapFormat(int bitmap_format) {
     switch (bitmap_format) {
         case FPDFBitmap_BGR: {
             return BitmapFormat::BGR;
@@ -69,7 +69,7 @@ bool ImageObject::UpdateFPDFInstance(FPDF_PAGEOBJECT image_object, FPDF_PAGE pag
     }
 
     // Set the updated bitmap.
-    if (!FPDFImageObj_SetBitmap(nullptr, 0, image_object, bitmap_.get())) {
+    if (!FPDFImageObj_SetBitmap(nullptr, 0, image_object, GetBitmap())) {
         return false;
     }
 
@@ -79,42 +79,54 @@ bool ImageObject::UpdateFPDFInstance(FPDF_PAGEOBJECT image_object, FPDF_PAGE pag
     }
 
     // Set the updated dimensions.
-    width_ = FPDFBitmap_GetWidth(bitmap_.get());
-    height_ = FPDFBitmap_GetHeight(bitmap_.get());
-
-    // Set the updated bitmap format.
-    bitmap_format_ = GetBitmapFormat(FPDFBitmap_GetFormat(bitmap_.get()));
+    width_ = FPDFBitmap_GetWidth(GetBitmap());
+    height_ = FPDFBitmap_GetHeight(GetBitmap());
 
     return true;
 }
 
 bool ImageObject::PopulateFromFPDFInstance(FPDF_PAGEOBJECT image_object, FPDF_PAGE page) {
-    // Get bitmap.
-    bitmap_ = ScopedFPDFBitmap(FPDFImageObj_GetBitmap(image_object));
-    if (bitmap_.get() == nullptr) {
-        return false;
-    }
-
     // Get matrix.
     if (!GetPageToDeviceMatrix(image_object, page)) {
         return false;
     }
 
-    // Get dimensions.
-    width_ = FPDFBitmap_GetWidth(bitmap_.get());
-    height_ = FPDFBitmap_GetHeight(bitmap_.get());
-
-    // Get bitmap format.
-    bitmap_format_ = GetBitmapFormat(FPDFBitmap_GetFormat(bitmap_.get()));
-    if (bitmap_format_ == BitmapFormat::Unknown) {
-        LOGE("Bitmap format unknown");
+    // Get dimensions, which doesn't decode the image.
+    unsigned int width, height;
+    if (!FPDFImageObj_GetImagePixelSize(image_object, &width, &height)) {
         return false;
     }
+    width_ = width;
+    height_ = height;
+
+    image_object_ = image_object;
+    bitmap_.reset();
     return true;
 }
 
+FPDF_BITMAP ImageObject::GetBitmap() const {
+    if (!bitmap_ && image_object_ != nullptr) {
+        bitmap_ = ScopedFPDFBitmap(FPDFImageObj_GetBitmap(image_object_));
+        if (GetBitmapFormat() == BitmapFormat::Unknown) {
+            LOGE("Bitmap format unknown");
+        }
+    }
+    return bitmap_.get();
+}
+
+void ImageObject::ReleaseDecodedBitmap() const {
+    if (image_object_ != nullptr) {
+        bitmap_.reset();
+    }
+}
+
 void* ImageObject::GetBitmapBuffer() const {
-    return FPDFBitmap_GetBuffer(bitmap_.get());
+    return FPDFBitmap_GetBuffer(GetBitmap());
+}
+
+BitmapFormat ImageObject::GetBitmapFormat() const {
+    FPDF_BITMAP bitmap = GetBitmap();
+    return bitmap != nullptr ? ToBitmapFormat(FPDFBitmap_GetFormat(bitmap)) : BitmapFormat::Unknown;
 }
 
 ImageObject::~ImageObject() = default;
@@ -42,14 +42,30 @@ class ImageObject : public PageObject {
     bool UpdateFPDFInstance(FPDF_PAGEOBJECT image_object, FPDF_PAGE page) override;
     bool PopulateFromFPDFInstance(FPDF_PAGEOBJECT image_object, FPDF_PAGE page) override;
 
+    // Returns the bitmap of the image. For an image populated from a page, it
+    // is only decoded on first use, as most of the cost of the image is there.
+    FPDF_BITMAP GetBitmap() const;
+
+    // Frees the bitmap if it was decoded from the page, once it was handed
+    // over, so that decoded images aren't all kept at once. GetBitmap decodes
+    // it again if it's needed.
+    void ReleaseDecodedBitmap() const;
+
     void* GetBitmapBuffer() const;
 
+    BitmapFormat GetBitmapFormat() const;
+
     ~ImageObject();
 
     size_t width_ = 0;
     size_t height_ = 0;
-    BitmapFormat bitmap_format_ = BitmapFormat::Unknown;
-    ScopedFPDFBitmap bitmap_;
+    // Set for an image to add or update, decoded from |image_object_| for one
+    // populated from a page, see GetBitmap.
+    mutable ScopedFPDFBitmap bitmap_;
+
+  private:
+    // The image this was populated from, owned by its page.
+    FPDF_PAGEOBJECT image_object_ = nullptr;
 };
 
 }  // namespace pdfClient
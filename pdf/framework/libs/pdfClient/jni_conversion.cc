@@ -21,8 +21,10 @@
 
 #include "image_object.h"
 #include "logging.h"
+#include "print_pipeline.h"
 #include "rect.h"
 #include "text_object.h"
+#include "utils/pixels.h"
 
 using pdfClient::Annotation;
 using pdfClient::BitmapFormat;
@@ -36,9 +38,11 @@ using pdfClient::ICoordinateConverter;
 using pdfClient::ImageObject;
 using pdfClient::LinuxFileOps;
 using pdfClient::Matrix;
+using pdfClient::PageLinks;
 using pdfClient::PageObject;
 using pdfClient::PathObject;
 using pdfClient::Point_f;
+using pdfClient::PrintedPage;
 using pdfClient::Rectangle_f;
 using pdfClient::Rectangle_i;
 using pdfClient::SelectionBoundary;
@@ -59,6 +63,8 @@ static const char* kLinkRects = "android/graphics/pdf/models/jni/LinkRects";
 static const char* kMatchRects = "android/graphics/pdf/models/jni/MatchRects";
 static const char* kSelection = "android/graphics/pdf/models/jni/PageSelection";
 static const char* kBoundary = "android/graphics/pdf/models/jni/SelectionBoundary";
+static const char* kPackedRects = "android/graphics/pdf/models/jni/PackedRects";
+static const char* kPackedIntegers = "android/graphics/pdf/models/jni/PackedIntegers";
 static const char* kFormWidgetInfo = "android/graphics/pdf/models/FormWidgetInfo";
 static const char* kChoiceOption = "android/graphics/pdf/models/ListItem";
 static const char* kGotoLinkDestination =
@@ -124,14 +130,6 @@ inline jclass GetPermClassRef(JNIEnv* env, const std::string& classname) {
     return (jclass)env->NewGlobalRef(env->FindClass(classname.c_str()));
 }
 
-// Convert an int to a java.lang.Integer.
-jobject ToJavaInteger(JNIEnv* env, const int& i) {
-    static jclass integer_class = GetPermClassRef(env, kInteger);
-    static jmethodID value_of =
-            env->GetStaticMethodID(integer_class, "valueOf", funcsig(kInteger, "I").c_str());
-    return env->CallStaticObjectMethod(integer_class, value_of, i);
-}
-
 jobject ToJavaString(JNIEnv* env, const std::string& s) {
     return env->NewStringUTF(s.c_str());
 }
@@ -215,6 +213,37 @@ jobject ToJavaList(JNIEnv* env, const vector<T*>& input, ICoordinateConverter* c
     return java_list;
 }
 
+// Copy rectangles to a java PackedRects, a List<Rect> backed by a single
+// int[] of their coordinates, rather than creating a Rect for each of them.
+jobject ToJavaRectList(JNIEnv* env, const vector<Rectangle_i>& rects) {
+    static jclass packed_rects_class = GetPermClassRef(env, kPackedRects);
+    static jmethodID init = env->GetMethodID(packed_rects_class, "<init>", "([I)V");
+
+    vector<jint> coordinates;
+    coordinates.reserve(rects.size() * 4);
+    for (const Rectangle_i& rect : rects) {
+        coordinates.insert(coordinates.end(), {rect.left, rect.top, rect.right, rect.bottom});
+    }
+    jintArray java_coordinates = env->NewIntArray(coordinates.size());
+    env->SetIntArrayRegion(java_coordinates, 0, coordinates.size(), coordinates.data());
+    jobject java_list = env->NewObject(packed_rects_class, init, java_coordinates);
+    env->DeleteLocalRef(java_coordinates);
+    return java_list;
+}
+
+// Copy ints to a java PackedIntegers, a List<Integer> backed by an int[],
+// rather than boxing each of them.
+jobject ToJavaIntegerList(JNIEnv* env, const vector<int>& values) {
+    static jclass packed_integers_class = GetPermClassRef(env, kPackedIntegers);
+    static jmethodID init = env->GetMethodID(packed_integers_class, "<init>", "([I)V");
+
+    jintArray java_values = env->NewIntArray(values.size());
+    env->SetIntArrayRegion(java_values, 0, values.size(), values.data());
+    jobject java_list = env->NewObject(packed_integers_class, init, java_values);
+    env->DeleteLocalRef(java_values);
+    return java_list;
+}
+
 }  // namespace
 
 jobject ToJavaPdfDocument(JNIEnv* env, std::unique_ptr<Document> doc) {
@@ -319,7 +348,7 @@ Rectangle_f ToNativeRectF(JNIEnv* env, jobject java_rectF, ICoordinateConverter*
 }
 
 jobject ToJavaRects(JNIEnv* env, const vector<Rectangle_i>& rects) {
-    return ToJavaList(env, rects, &ToJavaRect);
+    return ToJavaRectList(env, rects);
 }
 
 jobject ToJavaDimensions(JNIEnv* env, const Rectangle_i& r) {
@@ -345,9 +374,9 @@ jobject ToJavaMatchRects(JNIEnv* env, const vector<Rectangle_i>& rects,
     if (rects.empty()) {
         return no_matches;
     }
-    jobject java_rects = ToJavaList(env, rects, &ToJavaRect);
-    jobject java_m2r = ToJavaList(env, match_to_rect, &ToJavaInteger);
-    jobject java_cidx = ToJavaList(env, char_indexes, &ToJavaInteger);
+    jobject java_rects = ToJavaRectList(env, rects);
+    jobject java_m2r = ToJavaIntegerList(env, match_to_rect);
+    jobject java_cidx = ToJavaIntegerList(env, char_indexes);
     return env->NewObject(match_rects_class, init, java_rects, java_m2r, java_cidx);
 }
 
@@ -371,7 +400,7 @@ jobject ToJavaSelection(JNIEnv* env, const int page, const SelectionBoundary& st
         return nullptr;
     }
 
-    jobject java_rects = ToJavaList(env, rects, &ToJavaRect);
+    jobject java_rects = ToJavaRectList(env, rects);
     return env->NewObject(selection_class, init, page, ToJavaBoundary(env, start),
                           ToJavaBoundary(env, stop), java_rects, env->NewStringUTF(text.c_str()));
 }
@@ -389,12 +418,27 @@ jobject ToJavaLinkRects(JNIEnv* env, const vector<Rectangle_i>& rects,
     if (rects.empty()) {
         return no_links;
     }
-    jobject java_rects = ToJavaList(env, rects, &ToJavaRect);
-    jobject java_l2r = ToJavaList(env, link_to_rect, &ToJavaInteger);
+    jobject java_rects = ToJavaRectList(env, rects);
+    jobject java_l2r = ToJavaIntegerList(env, link_to_rect);
     jobject java_urls = ToJavaList(env, urls, &ToJavaString);
     return env->NewObject(link_rects_class, init, java_rects, java_l2r, java_urls);
 }
 
+namespace {
+
+// ToJavaLinkRects for ToJavaList, which deletes the local ref of each element:
+// pages without links are given a local ref to NO_LINKS.
+jobject ToJavaPageLinks(JNIEnv* env, const PageLinks& links) {
+    jobject java_links = ToJavaLinkRects(env, links.rects, links.link_to_rect, links.urls);
+    return links.rects.empty() ? env->NewLocalRef(java_links) : java_links;
+}
+
+}  // namespace
+
+jobject ToJavaLinkRectsList(JNIEnv* env, const vector<PageLinks>& links) {
+    return ToJavaList(env, links, &ToJavaPageLinks);
+}
+
 jobject ToJavaChoiceOption(JNIEnv* env, const Option& option) {
     static jclass choice_option_class = GetPermClassRef(env, kChoiceOption);
     static jmethodID init =
@@ -451,41 +495,12 @@ jobject ToJavaGotoLinks(JNIEnv* env, const vector<GotoLink>& links) {
     return ToJavaList(env, links, &ToJavaGotoLink);
 }
 
-void ConvertBgrToRgba(uint32_t* rgba_pixel_array, uint8_t* bgr_pixel_array, size_t rgba_stride,
-                      size_t bgr_stride, size_t width, size_t height) {
-    for (size_t y = 0; y < height; y++) {
-        uint32_t* rgba_row_ptr = rgba_pixel_array + y * (rgba_stride / 4);
-        uint8_t* bgr_row_ptr = bgr_pixel_array + y * (bgr_stride);
-        for (size_t x = 0; x < width; x++) {
-            // Extract BGR components stored.
-            uint8_t blue = bgr_row_ptr[x * 3];
-            uint8_t green = bgr_row_ptr[x * 3 + 1];
-            uint8_t red = bgr_row_ptr[x * 3 + 2];
-            // Storing java bitmap components RGBA in little-endian.
-            rgba_row_ptr[x] = (0xFF << 24) | (blue << 16) | (green << 8) | red;
-        }
-    }
+jobject ToJavaGotoLinksList(JNIEnv* env, const vector<vector<GotoLink>>& links) {
+    return ToJavaList(env, links, &ToJavaGotoLinks);
 }
 
-void ConvertBgraToRgba(uint32_t* rgba_pixel_array, uint8_t* bgra_pixel_array, size_t rgba_stride,
-                       size_t bgra_stride, size_t width, size_t height, bool ignore_alpha) {
-    for (size_t y = 0; y < height; y++) {
-        uint32_t* rgba_row_ptr = rgba_pixel_array + y * (rgba_stride / 4);
-        uint8_t* bgra_row_ptr = bgra_pixel_array + y * (bgra_stride);
-        for (size_t x = 0; x < width; x++) {
-            // Extract BGR components and determine alpha based on ignore_alpha flag.
-            uint8_t blue = bgra_row_ptr[x * 4];
-            uint8_t green = bgra_row_ptr[x * 4 + 1];
-            uint8_t red = bgra_row_ptr[x * 4 + 2];
-            uint8_t alpha = ignore_alpha ? 0xFF : bgra_row_ptr[x * 4 + 3];
-            // Storing java bitmap components RGBA in little-endian.
-            rgba_row_ptr[x] = (alpha << 24) | (blue << 16) | (green << 8) | red;
-        }
-    }
-}
-
-jobject ToJavaBitmap(JNIEnv* env, void* buffer, BitmapFormat bitmap_format, size_t width,
-                     size_t height, size_t native_stride) {
+// Creates an ARGB_8888 Java Bitmap of the given size, or returns NULL if it can't be allocated.
+jobject NewJavaBitmap(JNIEnv* env, size_t width, size_t height) {
     // Find Java Bitmap class
     static jclass bitmap_class = GetPermClassRef(env, kBitmap);
 
@@ -503,6 +518,18 @@ jobject ToJavaBitmap(JNIEnv* env, void* buffer, BitmapFormat bitmap_format, size
     // Create a Java Bitmap object
     jobject java_bitmap =
             env->CallStaticObjectMethod(bitmap_class, create_bitmap, width, height, argb8888);
+    if (java_bitmap == NULL) {
+        LOGE("Java bitmap allocation failed!");
+    }
+    return java_bitmap;
+}
+
+jobject ToJavaBitmap(JNIEnv* env, void* buffer, BitmapFormat bitmap_format, size_t width,
+                     size_t height, size_t native_stride) {
+    jobject java_bitmap = NewJavaBitmap(env, width, height);
+    if (java_bitmap == NULL) {
+        return NULL;
+    }
 
     // Copy the buffer data into java bitmap.
     AndroidBitmapInfo bitmap_info;
@@ -514,22 +541,22 @@ jobject ToJavaBitmap(JNIEnv* env, void* buffer, BitmapFormat bitmap_format, size
         return NULL;
     }
 
-    uint32_t* java_pixel_array = static_cast<uint32_t*>(bitmap_pixels);
+    uint8_t* java_pixel_array = static_cast<uint8_t*>(bitmap_pixels);
     uint8_t* native_pixel_array = static_cast<uint8_t*>(buffer);
     switch (bitmap_format) {
         case BitmapFormat::BGR: {
-            ConvertBgrToRgba(java_pixel_array, native_pixel_array, java_stride, native_stride,
-                             width, height);
+            pdfClient_utils::ExpandBgrToRgba(native_pixel_array, native_stride, java_pixel_array,
+                                             java_stride, width, height);
             break;
         }
         case BitmapFormat::BGRA: {
-            ConvertBgraToRgba(java_pixel_array, native_pixel_array, java_stride, native_stride,
-                              width, height, false);
+            pdfClient_utils::SwapRedBlue(native_pixel_array, native_stride, java_pixel_array,
+                                         java_stride, width, height, false);
             break;
         }
         case BitmapFormat::BGRx: {
-            ConvertBgraToRgba(java_pixel_array, native_pixel_array, java_stride, native_stride,
-                              width, height, true);
+            pdfClient_utils::SwapRedBlue(native_pixel_array, native_stride, java_pixel_array,
+                                         java_stride, width, height, true);
             break;
         }
         default: {
@@ -544,6 +571,33 @@ jobject ToJavaBitmap(JNIEnv* env, void* buffer, BitmapFormat bitmap_format, size
     return java_bitmap;
 }
 
+jobject ToJavaPrintedPage(JNIEnv* env, const PrintedPage& page, jobject java_bitmap) {
+    AndroidBitmapInfo bitmap_info;
+    if (java_bitmap == NULL || AndroidBitmap_getInfo(env, java_bitmap, &bitmap_info) < 0 ||
+        bitmap_info.width != static_cast<uint32_t>(page.width) ||
+        bitmap_info.height != static_cast<uint32_t>(page.height)) {
+        java_bitmap = NewJavaBitmap(env, page.width, page.height);
+        if (java_bitmap == NULL) {
+            return NULL;
+        }
+        AndroidBitmap_getInfo(env, java_bitmap, &bitmap_info);
+    }
+
+    void* bitmap_pixels;
+    if (AndroidBitmap_lockPixels(env, java_bitmap, &bitmap_pixels) < 0) {
+        return NULL;
+    }
+    // Pages are rendered in the byte order of ARGB_8888 already.
+    uint8_t* java_pixel_array = static_cast<uint8_t*>(bitmap_pixels);
+    for (int y = 0; y < page.height; y++) {
+        memcpy(java_pixel_array + y * bitmap_info.stride, page.pixels.data() + y * page.Stride(),
+               page.Stride());
+    }
+    AndroidBitmap_unlockPixels(env, java_bitmap);
+
+    return java_bitmap;
+}
+
 int ToJavaColorInt(Color color) {
     // Get ARGB values from Native Color
     uint A = color.a;
@@ -743,12 +797,20 @@ jobject ToJavaPdfImageObject(JNIEnv* env, const ImageObject* image_object) {
             env->GetMethodID(image_object_class, "<init>", funcsig("V", kBitmap).c_str());
 
     // Create Java Bitmap from Native Bitmap Buffer.
-    void* buffer = image_object->GetBitmapBuffer();
-    BitmapFormat bitmap_format = image_object->bitmap_format_;
-    size_t width = image_object->width_;
-    size_t height = image_object->height_;
-    int stride = FPDFBitmap_GetStride(image_object->bitmap_.get());
+    FPDF_BITMAP bitmap = image_object->GetBitmap();
+    if (bitmap == nullptr) {
+        LOGE("Image bitmap decoding failed!");
+        return NULL;
+    }
+    void* buffer = FPDFBitmap_GetBuffer(bitmap);
+    BitmapFormat bitmap_format = image_object->GetBitmapFormat();
+    size_t width = FPDFBitmap_GetWidth(bitmap);
+    size_t height = FPDFBitmap_GetHeight(bitmap);
+    int stride = FPDFBitmap_GetStride(bitmap);
     jobject java_bitmap = ToJavaBitmap(env, buffer, bitmap_format, width, height, stride);
+    // The pixels are in the Java Bitmap now, so the decoded copy can go before the next image of
+    // the page is decoded.
+    image_object->ReleaseDecodedBitmap();
     if (java_bitmap == NULL) {
         LOGE("To java bitmap conversion failed!");
         return NULL;
@@ -1000,23 +1062,6 @@ std::unique_ptr<PathObject> ToNativePathObject(JNIEnv* env, jobject java_path_ob
     return path_object;
 }
 
-void CopyRgbaToBgra(uint8_t* rgba_pixel_array, size_t rgba_stride, uint32_t* bgra_pixel_array,
-                    size_t bgra_stride, size_t width, size_t height) {
-    for (size_t y = 0; y < height; y++) {
-        uint8_t* rgba_row_ptr = rgba_pixel_array + y * rgba_stride;
-        uint32_t* bgra_row_ptr = bgra_pixel_array + y * (bgra_stride / 4);
-        for (size_t x = 0; x < width; x++) {
-            // Extract RGBA components stored.
-            uint8_t red = rgba_row_ptr[x * 4];
-            uint8_t green = rgba_row_ptr[x * 4 + 1];
-            uint8_t blue = rgba_row_ptr[x * 4 + 2];
-            uint8_t alpha = rgba_row_ptr[x * 4 + 3];
-            // Storing native bitmap components BGRA in little-endian.
-            bgra_row_ptr[x] = (alpha << 24) | (red << 16) | (green << 8) | blue;
-        }
-    }
-}
-
 std::unique_ptr<ImageObject> ToNativeImageObject(JNIEnv* env, jobject java_image_object) {
     // Create ImageObject Data Instance.
     auto image_object = std::make_unique<ImageObject>();
@@ -1052,10 +1097,10 @@ std::unique_ptr<ImageObject> ToNativeImageObject(JNIEnv* env, jobject java_image
     }
 
     uint8_t* java_pixel_array = static_cast<uint8_t*>(bitmap_pixels);
-    uint32_t* native_pixel_array = static_cast<uint32_t*>(image_object->GetBitmapBuffer());
+    uint8_t* native_pixel_array = static_cast<uint8_t*>(image_object->GetBitmapBuffer());
 
-    CopyRgbaToBgra(java_pixel_array, java_stride, native_pixel_array, native_stride, bitmap_width,
-                   bitmap_height);
+    pdfClient_utils::SwapRedBlue(java_pixel_array, java_stride, native_pixel_array, native_stride,
+                                 bitmap_width, bitmap_height, false);
 
     AndroidBitmap_unlockPixels(env, java_bitmap);
 
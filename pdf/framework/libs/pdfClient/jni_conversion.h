@@ -27,6 +27,7 @@
 #include "page.h"
 #include "page_object.h"
 #include "path_object.h"
+#include "print_pipeline.h"
 #include "rect.h"
 
 using pdfClient::Annotation;
@@ -38,9 +39,11 @@ using pdfClient::GotoLinkDest;
 using pdfClient::ICoordinateConverter;
 using pdfClient::Matrix;
 using pdfClient::Option;
+using pdfClient::PageLinks;
 using pdfClient::PageObject;
 using pdfClient::PathObject;
 using pdfClient::Point_f;
+using pdfClient::PrintedPage;
 using pdfClient::Rectangle_i;
 using pdfClient::SelectionBoundary;
 using pdfClient::Status;
@@ -98,6 +101,9 @@ jobject ToJavaSelection(JNIEnv* env, const int page, const SelectionBoundary& st
 jobject ToJavaLinkRects(JNIEnv* env, const std::vector<Rectangle_i>& rects,
                         const vector<int>& link_to_rect, const vector<std::string>& urls);
 
+// Convert the links of a range of pages into a Java List of projector LinkRects.
+jobject ToJavaLinkRectsList(JNIEnv* env, const vector<PageLinks>& links);
+
 // Convert the pdfClient::Option into a projector ChoiceOption.
 jobject ToJavaChoiceOption(JNIEnv* env, const Option& option);
 
@@ -117,6 +123,15 @@ jobject ToJavaGotoLink(JNIEnv* env, const GotoLink link);
 
 jobject ToJavaGotoLinks(JNIEnv* env, const vector<GotoLink>& links);
 
+// Convert the goto links of a range of pages into a Java List of Lists of
+// PdfPageGotoLinkContent.
+jobject ToJavaGotoLinksList(JNIEnv* env, const vector<vector<GotoLink>>& links);
+
+// Copies the pixels of |page| into |java_bitmap|, if it's an android.graphics.Bitmap of the
+// page's size, and returns it, or else into a new ARGB_8888 Bitmap, which is returned instead.
+// Returns NULL if the Bitmap can't be allocated.
+jobject ToJavaPrintedPage(JNIEnv* env, const PrintedPage& page, jobject java_bitmap);
+
 jobject ToJavaColor(JNIEnv* env, Color color);
 
 jfloatArray ToJavaFloatArray(JNIEnv* env, const float arr[], size_t length);
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jni_stats.h"
+
+#include <android/trace.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace pdfClient {
+
+namespace {
+
+constexpr std::string_view kJniPrefix = "Java_android_graphics_pdf_PdfDocumentProxy_";
+
+const char* const kPhaseNames[JniEntryPoint::kNumPhases] = {"lock wait", "compute",
+                                                             "conversion"};
+
+thread_local JniCall* current_call = nullptr;
+
+std::mutex& EntryPointsMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::vector<const JniEntryPoint*>& EntryPoints() {
+    static std::vector<const JniEntryPoint*> entry_points;
+    return entry_points;
+}
+
+std::string ShortName(std::string_view name) {
+    if (name.substr(0, kJniPrefix.size()) == kJniPrefix) {
+        name.remove_prefix(kJniPrefix.size());
+    }
+    return std::string(name);
+}
+
+}  // namespace
+
+JniEntryPoint::JniEntryPoint(const char* name) : name_(ShortName(name)) {
+    std::lock_guard<std::mutex> lock(EntryPointsMutex());
+    EntryPoints().push_back(this);
+}
+
+JniEntryPoint::~JniEntryPoint() {
+    std::lock_guard<std::mutex> lock(EntryPointsMutex());
+    std::vector<const JniEntryPoint*>& entry_points = EntryPoints();
+    entry_points.erase(std::find(entry_points.begin(), entry_points.end(), this));
+}
+
+JniCall::JniCall(JniEntryPoint* entry_point)
+    : entry_point_(entry_point),
+      outer_(current_call),
+      tracing_(ATrace_isEnabled()),
+      phase_start_(std::chrono::steady_clock::now()) {
+    entry_point_->calls_++;
+    current_call = this;
+    if (tracing_) {
+        ATrace_beginSection(("pdfClient " + entry_point_->Name()).c_str());
+        ATrace_beginSection(kPhaseNames[static_cast<int>(phase_)]);
+    }
+}
+
+JniCall::~JniCall() {
+    EndPhase();
+    if (tracing_) {
+        ATrace_endSection();
+    }
+    current_call = outer_;
+}
+
+void JniCall::SetPhase(Phase phase) {
+    if (phase == phase_) {
+        return;
+    }
+    EndPhase();
+    phase_ = phase;
+    phase_start_ = std::chrono::steady_clock::now();
+    if (tracing_) {
+        ATrace_beginSection(kPhaseNames[static_cast<int>(phase_)]);
+    }
+}
+
+JniCall* JniCall::Current() {
+    return current_call;
+}
+
+void JniCall::EndPhase() {
+    const auto elapsed = std::chrono::steady_clock::now() - phase_start_;
+    entry_point_->nanos_[static_cast<int>(phase_)] +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (tracing_) {
+        ATrace_endSection();
+    }
+}
+
+void SetJniPhase(JniEntryPoint::Phase phase) {
+    if (JniCall* call = JniCall::Current()) {
+        call->SetPhase(phase);
+    }
+}
+
+std::string DumpJniStats() {
+    using Phase = JniEntryPoint::Phase;
+    std::lock_guard<std::mutex> lock(EntryPointsMutex());
+    std::string dump;
+    for (const JniEntryPoint* entry_point : EntryPoints()) {
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "%s: %" PRIu64 " calls, %" PRIu64 "us lock wait, %" PRIu64 "us compute, %" PRIu64
+                 "us conversion\n",
+                 entry_point->Name().c_str(), entry_point->Calls(),
+                 entry_point->Nanos(Phase::LOCK_WAIT) / 1000,
+                 entry_point->Nanos(Phase::COMPUTE) / 1000,
+                 entry_point->Nanos(Phase::CONVERSION) / 1000);
+        dump += line;
+    }
+    return dump;
+}
+
+}  // namespace pdfClient
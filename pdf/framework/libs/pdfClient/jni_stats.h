@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_JNI_STATS_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_JNI_STATS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace pdfClient {
+
+// Counters of one JNI entry point, shared by all of its calls, see JniCall.
+// Listed by DumpJniStats for as long as they exist, normally statics.
+class JniEntryPoint {
+  public:
+    // What the time of a call is spent on: waiting for the document and PDFium
+    // locks, working in PDFium, and everything else, mostly converting
+    // arguments and results between Java and C++.
+    enum class Phase { LOCK_WAIT, COMPUTE, CONVERSION };
+    static constexpr int kNumPhases = 3;
+
+    // |name| is the name of the JNI function, the Java class is left out.
+    explicit JniEntryPoint(const char* name);
+    ~JniEntryPoint();
+
+    JniEntryPoint(const JniEntryPoint&) = delete;
+    JniEntryPoint& operator=(const JniEntryPoint&) = delete;
+
+    const std::string& Name() const { return name_; }
+
+    uint64_t Calls() const { return calls_; }
+
+    uint64_t Nanos(Phase phase) const { return nanos_[static_cast<int>(phase)]; }
+
+  private:
+    friend class JniCall;
+
+    const std::string name_;
+    std::atomic<uint64_t> calls_ = 0;
+    std::atomic<uint64_t> nanos_[kNumPhases] = {};
+};
+
+// Counts and times a call of |entry_point| for as long as it is in scope, and
+// shows it in traces as an ATrace section, with a nested section for each
+// phase. Calls start in the CONVERSION phase.
+//
+// The call in progress on the current thread is available from Current(), so
+// that the lock helpers can set the phase. A call made from a Java callback of
+// another one is timed on its own and within the other one too.
+class JniCall {
+  public:
+    using Phase = JniEntryPoint::Phase;
+
+    explicit JniCall(JniEntryPoint* entry_point);
+    ~JniCall();
+
+    JniCall(const JniCall&) = delete;
+    JniCall& operator=(const JniCall&) = delete;
+
+    // Ends the current phase and starts |phase|.
+    void SetPhase(Phase phase);
+
+    // Returns the call in progress on the current thread, or nullptr.
+    static JniCall* Current();
+
+  private:
+    void EndPhase();
+
+    JniEntryPoint* const entry_point_;
+    JniCall* const outer_;
+    const bool tracing_;
+    Phase phase_ = Phase::CONVERSION;
+    std::chrono::steady_clock::time_point phase_start_;
+};
+
+// Sets the phase of the call in progress on the current thread, if any.
+void SetJniPhase(JniEntryPoint::Phase phase);
+
+// Returns the counters of every entry point called so far, one per line.
+std::string DumpJniStats();
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_JNI_STATS_H_
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jni_stats.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using pdfClient::DumpJniStats;
+using pdfClient::JniCall;
+using pdfClient::JniEntryPoint;
+using pdfClient::SetJniPhase;
+
+using Phase = JniEntryPoint::Phase;
+
+namespace {
+
+constexpr std::chrono::milliseconds kSleep(5);
+
+TEST(Test, StripsClassName) {
+    JniEntryPoint entry_point("Java_android_graphics_pdf_PdfDocumentProxy_getPageWidth");
+    EXPECT_EQ("getPageWidth", entry_point.Name());
+}
+
+TEST(Test, CountsCalls) {
+    JniEntryPoint entry_point("countsCalls");
+    for (int i = 0; i < 3; i++) {
+        JniCall call(&entry_point);
+    }
+    EXPECT_EQ(3, entry_point.Calls());
+}
+
+TEST(Test, TimesEachPhase) {
+    JniEntryPoint entry_point("timesEachPhase");
+    {
+        JniCall call(&entry_point);
+        EXPECT_EQ(&call, JniCall::Current());
+        SetJniPhase(Phase::LOCK_WAIT);
+        std::this_thread::sleep_for(kSleep);
+        SetJniPhase(Phase::COMPUTE);
+        std::this_thread::sleep_for(2 * kSleep);
+        SetJniPhase(Phase::CONVERSION);
+    }
+    EXPECT_EQ(nullptr, JniCall::Current());
+    EXPECT_GE(entry_point.Nanos(Phase::LOCK_WAIT), std::chrono::nanoseconds(kSleep).count());
+    EXPECT_GE(entry_point.Nanos(Phase::COMPUTE), std::chrono::nanoseconds(2 * kSleep).count());
+    EXPECT_LT(entry_point.Nanos(Phase::CONVERSION), entry_point.Nanos(Phase::COMPUTE));
+}
+
+TEST(Test, NestedCallRestoresOuterCall) {
+    JniEntryPoint outer_entry_point("outer");
+    JniEntryPoint inner_entry_point("inner");
+    JniCall outer(&outer_entry_point);
+    {
+        JniCall inner(&inner_entry_point);
+        EXPECT_EQ(&inner, JniCall::Current());
+        SetJniPhase(Phase::COMPUTE);
+        std::this_thread::sleep_for(kSleep);
+    }
+    EXPECT_EQ(&outer, JniCall::Current());
+    EXPECT_GE(inner_entry_point.Nanos(Phase::COMPUTE), std::chrono::nanoseconds(kSleep).count());
+}
+
+TEST(Test, SetJniPhaseWithoutCall) {
+    EXPECT_EQ(nullptr, JniCall::Current());
+    SetJniPhase(Phase::COMPUTE);
+}
+
+TEST(Test, DumpListsEntryPoints) {
+    JniEntryPoint entry_point("dumpListsEntryPoints");
+    { JniCall call(&entry_point); }
+    const std::string dump = DumpJniStats();
+    EXPECT_NE(std::string::npos, dump.find("dumpListsEntryPoints: 1 calls, "));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
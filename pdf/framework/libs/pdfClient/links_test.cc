@@ -73,6 +73,28 @@ TEST(Test, GetLinksUtf8) {
     EXPECT_EQ(0, link_to_rect[0]);
 }
 
+TEST(Test, GetLinksUtf8Again) {
+    Document doc(LoadTestDocument(kLinksFile), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+
+    std::vector<Rectangle_i> rects;
+    std::vector<int> link_to_rect;
+    std::vector<std::string> urls;
+    EXPECT_EQ(1, page->GetLinksUtf8(&rects, &link_to_rect, &urls));
+    // The links are cached, and appended after what is already there.
+    EXPECT_EQ(1, page->GetLinksUtf8(&rects, &link_to_rect, &urls));
+
+    EXPECT_EQ(2, rects.size());
+    EXPECT_EQ(rects[0], rects[1]);
+
+    EXPECT_EQ(2, urls.size());
+    EXPECT_EQ(urls[0], urls[1]);
+
+    EXPECT_EQ(2, link_to_rect.size());
+    EXPECT_EQ(0, link_to_rect[0]);
+    EXPECT_EQ(1, link_to_rect[1]);
+}
+
 }  // namespace
 
 // int main(int argc, char** argv) {
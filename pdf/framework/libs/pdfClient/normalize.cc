@@ -19,6 +19,7 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <array>
 #include <string>
 
 #include "utf.h"
@@ -33,7 +34,7 @@ const char32_t kBrokenWordMarker = '\x2';
 const char32_t kCarriageReturn = '\r';
 const char32_t kLineFeed = '\n';
 
-const char* kGroups[] = {
+constexpr const char* kGroups[] = {
         // Treat the broken word marker the same as a hyphen when searching.
         "-\x2",
         // Space, tab and newline are all treated as equivalent when searching.
@@ -61,42 +62,100 @@ const char* kGroups[] = {
         "ҧҦ", "ҩҨ", "ҫҪ", "ҭҬ", "үҮ", "ұҰ", "ҳҲ", "ҵҴ", "ҷҶ", "ҹҸ", "һҺ", "ҽҼ", "ҿҾ", "ӄӃ", "ӆӅ",
         "ӈӇ", "ӊӉ", "ӌӋ", "ӎӍ", "ӏӀ", "ӕӔ", "әӘӚӛ", "ӡӠ", "өӨӪӫ", "ӷӶ", "ӻӺ", "ӽӼ"};
 
-const size_t kNumGroups = sizeof(kGroups) / sizeof(kGroups[0]);
-
 // All of the characters that are normalized have codepoints of < 0x500.
-const size_t kTableSize = 0x500;
+constexpr size_t kTableSize = 0x500;
+
+// Decodes the UTF-8 character at |*utf8|, and moves |*utf8| past it. Only
+// needs to handle the characters of kGroups, which are at most 2 bytes long.
+constexpr char32_t DecodeUtf8(const char** utf8) {
+    const uint8_t lead = **utf8;
+    (*utf8)++;
+    if (lead < 0x80) {
+        return lead;
+    }
+    const uint8_t trail = **utf8;
+    (*utf8)++;
+    return ((lead & 0x1F) << 6) | (trail & 0x3F);
+}
 
-const uint16_t* CreateTable() {
-    static uint16_t table[kTableSize];
+constexpr std::array<uint16_t, kTableSize> CreateTable() {
+    std::array<uint16_t, kTableSize> table{};
     for (size_t i = 0; i < kTableSize; i++) {
-        table[i] = i;
+        table[i] = static_cast<uint16_t>(i);
     }
-    for (size_t i = 0; i < kNumGroups; i++) {
-        std::u32string group = Utf8ToUtf32(kGroups[i]);
-        for (size_t j = 0; j < group.length(); j++) {
-            table[group[j]] = group[0];
+    for (const char* group : kGroups) {
+        const char* utf8 = group;
+        const char32_t first = DecodeUtf8(&utf8);
+        while (*utf8 != '\0') {
+            table[DecodeUtf8(&utf8)] = static_cast<uint16_t>(first);
         }
     }
     return table;
 }
 
+// Built at compile time, so that lookups don't check whether it was built.
+constexpr std::array<uint16_t, kTableSize> kTable = CreateTable();
+
+// What kTable maps ASCII to, as arithmetic rather than lookups so that the
+// compiler can vectorize it over a run of ASCII characters.
+constexpr char32_t NormalizeAsciiForSearch(char32_t codepoint) {
+    codepoint = codepoint - 'A' < 26u ? codepoint + ('a' - 'A') : codepoint;
+    codepoint = codepoint == '\t' || codepoint == kCarriageReturn || codepoint == kLineFeed
+                        ? ' '
+                        : codepoint;
+    return codepoint == kBrokenWordMarker ? '-' : codepoint;
+}
+
+constexpr bool AsciiMatchesTable() {
+    for (char32_t codepoint = 0; codepoint < 0x80; codepoint++) {
+        if (NormalizeAsciiForSearch(codepoint) != kTable[codepoint]) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(AsciiMatchesTable(), "NormalizeAsciiForSearch must agree with kGroups");
+
+// How many characters NormalizeBufferForSearch checks at once for being ASCII.
+constexpr size_t kBlockSize = 8;
+
 }  // namespace
 
 char32_t NormalizeForSearch(char32_t codepoint) {
-    // Table is created on first use and cached.
-    static const uint16_t* table = CreateTable();
     if (codepoint < kTableSize) {
-        return table[codepoint];
+        return kTable[codepoint];
     }
     return codepoint;
 }
 
+void NormalizeBufferForSearch(const char32_t* input, size_t length, char32_t* output) {
+    size_t i = 0;
+    for (; i + kBlockSize <= length; i += kBlockSize) {
+        char32_t all_bits = 0;
+        for (size_t j = 0; j < kBlockSize; j++) {
+            all_bits |= input[i + j];
+        }
+        if (all_bits < 0x80) {
+            for (size_t j = 0; j < kBlockSize; j++) {
+                output[i + j] = NormalizeAsciiForSearch(input[i + j]);
+            }
+        } else {
+            for (size_t j = 0; j < kBlockSize; j++) {
+                output[i + j] = NormalizeForSearch(input[i + j]);
+            }
+        }
+    }
+    for (; i < length; i++) {
+        output[i] = NormalizeForSearch(input[i]);
+    }
+}
+
 bool BothAreSpaces(char32_t left_codepoint, char32_t right_codepoint) {
     return left_codepoint == '\x20' && right_codepoint == '\x20';
 }
 
 void NormalizeStringForSearch(std::u32string* utf32) {
-    std::transform(utf32->begin(), utf32->end(), utf32->begin(), NormalizeForSearch);
+    NormalizeBufferForSearch(utf32->data(), utf32->length(), utf32->data());
     // Collapse repeated whitespace into a single space:
     utf32->erase(std::unique(utf32->begin(), utf32->end(), BothAreSpaces), utf32->end());
 }
@@ -136,4 +195,15 @@ void AppendpdfClientCodepointAsUtf8(char32_t codepoint, std::string* output) {
     }
 }
 
+void AppendpdfClientTextAsUtf8(std::u32string_view text, std::string* output) {
+    size_t start = 0;
+    for (size_t marker = text.find(kBrokenWordMarker); marker != std::u32string_view::npos;
+         marker = text.find(kBrokenWordMarker, start)) {
+        AppendUtf32AsUtf8(text.data() + start, marker - start, output);
+        AppendpdfClientCodepointAsUtf8(kBrokenWordMarker, output);
+        start = marker + 1;
+    }
+    AppendUtf32AsUtf8(text.data() + start, text.length() - start, output);
+}
+
 }  // namespace pdfClient
\ No newline at end of file
@@ -17,7 +17,10 @@
 #ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_NORMALIZE_H_
 #define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_NORMALIZE_H_
 
+#include <stddef.h>
+
 #include <string>
+#include <string_view>
 
 namespace pdfClient {
 
@@ -26,6 +29,11 @@ namespace pdfClient {
 // For example, 'a' is returned for 'a', 'A', 'ä', 'Ä' and other 'a' variants.
 char32_t NormalizeForSearch(char32_t codepoint);
 
+// Normalizes |length| codepoints from |input| into |output|, the same as
+// NormalizeForSearch does one by one, but faster over runs of ASCII. |output|
+// can be |input|.
+void NormalizeBufferForSearch(const char32_t* input, size_t length, char32_t* output);
+
 // Normalize the entire string for case/accent-insensitive searching.
 void NormalizeStringForSearch(std::u32string* search_str);
 
@@ -47,6 +55,10 @@ bool IsWordBreak(char32_t codepoint);
 // these codepoints are not appended verbatim.
 void AppendpdfClientCodepointAsUtf8(char32_t codepoint, std::string* output);
 
+// Same as AppendpdfClientCodepointAsUtf8 for each codepoint of |text|, but
+// converts the text between the special codepoints in one go.
+void AppendpdfClientTextAsUtf8(std::u32string_view text, std::string* output);
+
 }  // namespace pdfClient
 
 #endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_NORMALIZE_H_
\ No newline at end of file
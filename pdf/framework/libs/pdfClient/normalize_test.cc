@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "normalize.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using pdfClient::NormalizeBufferForSearch;
+using pdfClient::NormalizeForSearch;
+using pdfClient::NormalizeStringForSearch;
+
+namespace {
+
+std::u32string NormalizeEachForSearch(const std::u32string& input) {
+    std::u32string output;
+    for (char32_t codepoint : input) {
+        output.push_back(NormalizeForSearch(codepoint));
+    }
+    return output;
+}
+
+TEST(Test, NormalizeForSearch) {
+    EXPECT_EQ(U'a', NormalizeForSearch(U'A'));
+    EXPECT_EQ(U'a', NormalizeForSearch(U'Ä'));
+    EXPECT_EQ(U'a', NormalizeForSearch(U'ǻ'));
+    EXPECT_EQ(U'-', NormalizeForSearch(U'\x2'));
+    EXPECT_EQ(U' ', NormalizeForSearch(U' '));
+    EXPECT_EQ(U'σ', NormalizeForSearch(U'Σ'));
+    EXPECT_EQ(U'я', NormalizeForSearch(U'Я'));
+    EXPECT_EQ(U'7', NormalizeForSearch(U'7'));
+    EXPECT_EQ(U'中', NormalizeForSearch(U'中'));
+}
+
+TEST(Test, NormalizeBufferMatchesEachCodepoint) {
+    std::u32string all;
+    for (char32_t codepoint = 0; codepoint < 0x600; codepoint++) {
+        all.push_back(codepoint);
+    }
+    std::u32string output(all.length(), 0);
+    NormalizeBufferForSearch(all.data(), all.length(), output.data());
+    EXPECT_EQ(NormalizeEachForSearch(all), output);
+}
+
+TEST(Test, NormalizeBufferMixedRuns) {
+    const std::u32string text =
+            U"The Quick\tBROWN fox\r\nJUMPS över\x2the Lazy DOG, Ελληνικά и Кириллица.";
+    // Every length, so that the runs of ASCII start and end at every offset of
+    // the blocks the buffer is checked in.
+    for (size_t length = 0; length <= text.length(); length++) {
+        const std::u32string input = text.substr(0, length);
+        std::u32string output(length, 0);
+        NormalizeBufferForSearch(input.data(), length, output.data());
+        EXPECT_EQ(NormalizeEachForSearch(input), output);
+    }
+}
+
+TEST(Test, NormalizeBufferInPlace) {
+    std::u32string text = U"ÀBCDEFGHIJKLMNOPQRSTUVWXYZ";
+    NormalizeBufferForSearch(text.data(), text.length(), text.data());
+    EXPECT_EQ(U"abcdefghijklmnopqrstuvwxyz", text);
+}
+
+TEST(Test, NormalizeStringCollapsesSpaces) {
+    std::u32string text = U"Two  Spaces\t\tand\r\nLines";
+    NormalizeStringForSearch(&text);
+    EXPECT_EQ(U"two spaces and lines", text);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -20,9 +20,11 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "cpp/fpdf_scopers.h"
@@ -30,7 +32,9 @@
 #include "form_widget_info.h"
 #include "fpdf_annot.h"
 #include "fpdf_doc.h"
+#include "fpdf_progressive.h"
 #include "fpdf_text.h"
+#include "fpdf_thumbnail.h"
 #include "fpdfview.h"
 #include "image_object.h"
 #include "logging.h"
@@ -39,7 +43,9 @@
 #include "rect.h"
 #include "text_object.h"
 #include "utf.h"
+#include "utils/annot.h"
 #include "utils/annot_hider.h"
+#include "utils/pixels.h"
 #include "utils/text.h"
 
 #define LOG_TAG "page"
@@ -51,19 +57,27 @@ namespace pdfClient {
 
 static const int kBytesPerPixel = 4;
 
-static const Rectangle_i kEmptyIntRectangle = IntRect(0, 0, 0, 0);
-
 // The acceptable fatness / inaccuracy of a user's finger in points.
 static const int kFingerTolerance = 10;
 
+// Rough costs of a loaded page, of each of its objects and of each character
+// of its text page, for EstimatedMemoryUsage().
+static const size_t kPageBaseBytes = 64 * 1024;
+static const size_t kBytesPerPageObject = 512;
+static const size_t kBytesPerChar = 256;
+
 static const int RENDER_MODE_FOR_DISPLAY = 1;
 static const int RENDER_MODE_FOR_PRINT = 2;
 
+// Thumbnails are too small for LCD text or anti-aliasing to show, and are
+// drawn with every annotation that has an appearance rather than hiding some.
+static const int kThumbnailRenderFlags = FPDF_ANNOT | FPDF_RENDER_NO_SMOOTHTEXT |
+                                         FPDF_RENDER_NO_SMOOTHIMAGE | FPDF_RENDER_NO_SMOOTHPATH;
+
 Page::Page(FPDF_DOCUMENT doc, int page_num, FormFiller* form_filler)
     : document_(doc),
       page_(FPDF_LoadPage(doc, page_num)),
       form_filler_(form_filler),
-      invalid_rect_(kEmptyIntRectangle),
       page_num_(page_num) {}
 
 Page::Page(Page&& p) = default;
@@ -85,6 +99,154 @@ Rectangle_i Page::Dimensions() const {
 void Page::Render(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int clip_top,
                   int clip_right, int clip_bottom, int render_mode, int show_annot_types,
                   bool render_form_fields) {
+    pdfClient_utils::AnnotHider annot_hider(GetAnnotsToHide(show_annot_types, render_form_fields));
+    FS_RECTF clip = {(float)clip_left, (float)clip_top, (float)clip_right, (float)clip_bottom};
+    RenderClip(bitmap, transform, clip, GetRenderFlags(render_mode), render_form_fields);
+}
+
+bool Page::RenderTiles(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int clip_top,
+                       int clip_right, int clip_bottom, int tile_size, int render_mode,
+                       int show_annot_types, bool render_form_fields,
+                       const std::function<bool(const Rectangle_i&)>& on_tile) {
+    if (tile_size <= 0) {
+        tile_size = std::max(clip_right - clip_left, clip_bottom - clip_top);
+    }
+    pdfClient_utils::AnnotHider annot_hider(GetAnnotsToHide(show_annot_types, render_form_fields));
+    const int render_flags = GetRenderFlags(render_mode);
+
+    for (int top = clip_top; top < clip_bottom; top += tile_size) {
+        const int bottom = std::min(top + tile_size, clip_bottom);
+        for (int left = clip_left; left < clip_right; left += tile_size) {
+            const int right = std::min(left + tile_size, clip_right);
+            FS_RECTF clip = {(float)left, (float)top, (float)right, (float)bottom};
+            RenderClip(bitmap, transform, clip, render_flags, render_form_fields);
+            if (!on_tile(IntRect(left, top, right, bottom))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Page::RenderThumbnail(FPDF_BITMAP bitmap, bool use_embedded) {
+    if (use_embedded && RenderEmbeddedThumbnail(bitmap)) {
+        return;
+    }
+    const int width = FPDFBitmap_GetWidth(bitmap);
+    const int height = FPDFBitmap_GetHeight(bitmap);
+    FPDFBitmap_FillRect(bitmap, 0, 0, width, height, 0xFFFFFFFF);
+    FPDF_RenderPageBitmap(bitmap, page_.get(), 0, 0, width, height, /* rotate= */ 0,
+                          kThumbnailRenderFlags);
+}
+
+bool Page::RenderEmbeddedThumbnail(FPDF_BITMAP bitmap) {
+    ScopedFPDFBitmap thumbnail(FPDFPage_GetThumbnailAsBitmap(page_.get()));
+    if (!thumbnail) {
+        return false;
+    }
+    int bytes_per_pixel;
+    switch (FPDFBitmap_GetFormat(thumbnail.get())) {
+        case FPDFBitmap_BGR:
+            bytes_per_pixel = 3;
+            break;
+        case FPDFBitmap_BGRx:
+        case FPDFBitmap_BGRA:
+            bytes_per_pixel = 4;
+            break;
+        default:
+            return false;
+    }
+    pdfClient_utils::ScaleToBgrx(
+            static_cast<const uint8_t*>(FPDFBitmap_GetBuffer(thumbnail.get())),
+            FPDFBitmap_GetStride(thumbnail.get()), FPDFBitmap_GetWidth(thumbnail.get()),
+            FPDFBitmap_GetHeight(thumbnail.get()), bytes_per_pixel,
+            static_cast<uint8_t*>(FPDFBitmap_GetBuffer(bitmap)), FPDFBitmap_GetStride(bitmap),
+            FPDFBitmap_GetWidth(bitmap), FPDFBitmap_GetHeight(bitmap));
+    return true;
+}
+
+static FPDF_BOOL NeedToPauseNow(IFSDK_PAUSE* pause) {
+    return (*static_cast<const std::function<bool()>*>(pause->user))();
+}
+
+bool Page::RenderProgressive(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int clip_top,
+                             int clip_right, int clip_bottom, int render_mode,
+                             int show_annot_types, bool render_form_fields,
+                             const std::function<bool()>& should_pause,
+                             const std::function<bool()>& on_pause) {
+    // The progressive API maps the page onto an upright rectangle of the
+    // bitmap, rather than taking a matrix and a clip. The clip is rendered
+    // into a bitmap sharing the pixels within it instead.
+    const int format = FPDFBitmap_GetFormat(bitmap);
+    clip_left = std::max(clip_left, 0);
+    clip_top = std::max(clip_top, 0);
+    clip_right = std::min(clip_right, FPDFBitmap_GetWidth(bitmap));
+    clip_bottom = std::min(clip_bottom, FPDFBitmap_GetHeight(bitmap));
+    if (transform.b != 0 || transform.c != 0 || transform.a <= 0 || transform.d <= 0 ||
+        (format != FPDFBitmap_BGRA && format != FPDFBitmap_BGRx) || !page_) {
+        Render(bitmap, transform, clip_left, clip_top, clip_right, clip_bottom, render_mode,
+               show_annot_types, render_form_fields);
+        return true;
+    }
+    if (clip_left >= clip_right || clip_top >= clip_bottom) {
+        return true;
+    }
+
+    const int stride = FPDFBitmap_GetStride(bitmap);
+    uint8_t* clip_pixels = static_cast<uint8_t*>(FPDFBitmap_GetBuffer(bitmap)) +
+                           clip_top * stride + clip_left * kBytesPerPixel;
+    ScopedFPDFBitmap clip_bitmap(FPDFBitmap_CreateEx(clip_right - clip_left,
+                                                     clip_bottom - clip_top, format, clip_pixels,
+                                                     stride));
+
+    const int start_x = std::lround(transform.e) - clip_left;
+    const int start_y = std::lround(transform.f) - clip_top;
+    const int size_x = std::lround(FPDF_GetPageWidthF(page_.get()) * transform.a);
+    const int size_y = std::lround(FPDF_GetPageHeightF(page_.get()) * transform.d);
+
+    pdfClient_utils::AnnotHider annot_hider(GetAnnotsToHide(show_annot_types, render_form_fields));
+    const int render_flags = GetRenderFlags(render_mode);
+
+    IFSDK_PAUSE pause = {};
+    pause.version = 1;
+    pause.NeedToPauseNow = &NeedToPauseNow;
+    pause.user = const_cast<std::function<bool()>*>(&should_pause);
+
+    int status = FPDF_RenderPageBitmapWithColorScheme_Start(
+            clip_bitmap.get(), page_.get(), start_x, start_y, size_x, size_y, /* rotate= */ 0,
+            render_flags, /* color_scheme= */ nullptr, &pause);
+    while (status == FPDF_RENDER_TOBECONTINUED) {
+        if (!on_pause()) {
+            FPDF_RenderPage_Close(page_.get());
+            return false;
+        }
+        status = FPDF_RenderPage_Continue(page_.get(), &pause);
+    }
+    FPDF_RenderPage_Close(page_.get());
+    if (status != FPDF_RENDER_DONE) {
+        LOGE("Progressive render failed (status=%d) for (page_num=%d)", status, page_num_);
+        return false;
+    }
+
+    if (render_form_fields) {
+        FS_RECTF clip = {(float)clip_left, (float)clip_top, (float)clip_right,
+                         (float)clip_bottom};
+        form_filler_->RenderTile(page_.get(), bitmap, transform, clip, render_flags);
+    }
+    return true;
+}
+
+int Page::GetRenderFlags(int render_mode) {
+    int renderFlags = FPDF_REVERSE_BYTE_ORDER;
+    if (render_mode == RENDER_MODE_FOR_DISPLAY) {
+        renderFlags |= FPDF_LCD_TEXT | FPDF_ANNOT;
+    } else if (render_mode == RENDER_MODE_FOR_PRINT) {
+        renderFlags |= FPDF_PRINTING;
+    }
+    return renderFlags;
+}
+
+std::unordered_set<int> Page::GetShownAnnotTypes(int show_annot_types, bool render_form_fields) {
     std::unordered_set<int> types;
     for (auto renderFlag_annot : renderFlagsAnnotsMap) {
         if ((renderFlag_annot.first & show_annot_types) != 0) {
@@ -94,19 +256,28 @@ void Page::Render(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int cl
         }
     }
     if (render_form_fields) types.insert(FPDF_ANNOT_WIDGET);
-    pdfClient_utils::AnnotHider annot_hider(page_.get(), types);
-    int renderFlags = FPDF_REVERSE_BYTE_ORDER;
-    if (render_mode == RENDER_MODE_FOR_DISPLAY) {
-        renderFlags |= FPDF_LCD_TEXT | FPDF_ANNOT;
-    } else if (render_mode == RENDER_MODE_FOR_PRINT) {
-        renderFlags |= FPDF_PRINTING;
+    return types;
+}
+
+std::span<const ScopedFPDFAnnotation> Page::GetAnnotsToHide(int show_annot_types,
+                                                           bool render_form_fields) {
+    const int key = show_annot_types << 1 | render_form_fields;
+    auto it = annots_to_hide_.find(key);
+    if (it == annots_to_hide_.end()) {
+        std::vector<ScopedFPDFAnnotation> annots;
+        pdfClient_utils::GetVisibleAnnots(
+                page_.get(), GetShownAnnotTypes(show_annot_types, render_form_fields), &annots);
+        it = annots_to_hide_.emplace(key, std::move(annots)).first;
     }
+    return it->second;
+}
 
-    FS_RECTF clip = {(float)clip_left, (float)clip_top, (float)clip_right, (float)clip_bottom};
-    FPDF_RenderPageBitmapWithMatrix(bitmap, page_.get(), &transform, &clip, renderFlags);
+void Page::RenderClip(FPDF_BITMAP bitmap, const FS_MATRIX& transform, const FS_RECTF& clip,
+                      int render_flags, bool render_form_fields) {
+    FPDF_RenderPageBitmapWithMatrix(bitmap, page_.get(), &transform, &clip, render_flags);
 
     if (render_form_fields) {
-        form_filler_->RenderTile(page_.get(), bitmap, transform, clip, renderFlags);
+        form_filler_->RenderTile(page_.get(), bitmap, transform, clip, render_flags);
     }
 }
 
@@ -157,11 +328,74 @@ Point_f Page::DeviceToPage(const Point_f& in) const {
     return {static_cast<float>(out.x), static_cast<float>(out.y)};
 }
 
+size_t Page::EstimatedMemoryUsage() const {
+    if (!page_) {
+        return 0;
+    }
+    size_t bytes = kPageBaseBytes;
+    bytes += std::max(0, FPDFPage_CountObjects(page_.get())) * kBytesPerPageObject;
+    if (text_page_) {
+        bytes += std::max(0, FPDFText_CountChars(text_page_.get())) * kBytesPerChar;
+    }
+    bytes += chars_.size() * sizeof(CharInfo) + boundaries_.size() * sizeof(SelectionBoundary);
+    return bytes;
+}
+
+void Page::Prefetch() {
+    EnsureTextPageInitialized();
+    EnsureCharsInitialized();
+    EnsureBoundariesInitialized();
+}
+
+bool Page::IsPrefetched() const {
+    return text_page_ && chars_initialized_ && boundaries_initialized_;
+}
+
+size_t Page::TrimMemory() {
+    const size_t bytes = EstimatedMemoryUsage();
+    ResetText();
+    InvalidateLinks();
+    page_objects_populated_ = false;
+    page_objects_ = vector<PageObjectSlot>();
+    annotations_ = vector<std::unique_ptr<Annotation>>();
+    annots_to_hide_.clear();
+    return bytes - EstimatedMemoryUsage();
+}
+
+void Page::ResetText() {
+    text_page_.reset();
+    search_text_initialized_ = false;
+    search_text_ = std::u32string();
+    search_skippable_ = vector<bool>();
+    search_unskipped_ = vector<int>();
+    chars_initialized_ = false;
+    chars_ = vector<CharInfo>();
+    char_grid_ = CharGrid();
+    boundaries_initialized_ = false;
+    boundaries_ = vector<SelectionBoundary>();
+    boundary_grid_ = CharGrid();
+}
+
+void Page::InvalidateText() {
+    ResetText();
+    text_edited_ = true;
+    text_index_ = nullptr;
+}
+
+void Page::SetTextIndex(TextIndex* text_index) {
+    if (!text_edited_) {
+        text_index_ = text_index;
+    }
+}
+
 int Page::NumChars() {
     return FPDFText_CountChars(text_page());
 }
 
 uint32_t Page::GetUnicode(int char_index) {
+    if (char_index >= 0 && static_cast<size_t>(char_index) < chars_.size()) {
+        return chars_[char_index].unicode;
+    }
     return FPDFText_GetUnicode(text_page(), char_index);
 }
 
@@ -170,10 +404,13 @@ std::string Page::GetTextUtf8() {
 }
 
 std::string Page::GetTextUtf8(const int start_index, const int stop_index) {
-    std::string result;
+    std::u32string text;
+    text.reserve(std::max(0, stop_index - start_index));
     for (int i = start_index; i < stop_index; i++) {
-        AppendpdfClientCodepointAsUtf8(GetUnicode(i), &result);
+        text.push_back(GetUnicode(i));
     }
+    std::string result;
+    AppendpdfClientTextAsUtf8(text, &result);
     return result;
 }
 
@@ -185,18 +422,7 @@ int Page::FindMatchesUtf8(std::string_view utf8, vector<TextRange>* matches) {
     std::u32string query(Utf8ToUtf32(utf8));
     // Normalize characters of string for searching - ignore case and accents.
     NormalizeStringForSearch(&query);
-    TextRange match;
-    int page_start = first_printable_char_index();
-    int page_stop = last_printable_char_index() + 1;
-    int num_matches = 0;
-    while (FindMatch(query, page_start, page_stop, &match)) {
-        if (matches != nullptr) {
-            matches->push_back(match);
-        }
-        num_matches++;
-        page_start = match.second;
-    }
-    return num_matches;
+    return FindMatches(query, matches);
 }
 
 int Page::BoundsOfMatchesUtf8(std::string_view utf8, vector<Rectangle_i>* rects,
@@ -227,14 +453,13 @@ int Page::GetTextBounds(const int start_index, const int stop_index, vector<Rect
     int num_rects = 0;
     Rectangle_d rect = DoubleRect(0, 0, 0, 0);
     for (int index = start_index; index < stop_index; index++) {
-        double x1, x2, y1, y2;
-        // This call doesn't apply the page transform - have to apply later.
-        FPDFText_GetCharBox(text_page(), index, &x1, &x2, &y1, &y2);
-        if (x1 != x2 && y1 != y2) {
+        // The page transform isn't applied yet - have to apply later.
+        const Rectangle_d char_rect = GetRawCharBounds(index);
+        if (char_rect.left != char_rect.right && char_rect.top != char_rect.bottom) {
             if (IsEmpty(rect)) {
-                rect = DoubleRect(x1, y1, x2, y2);
+                rect = char_rect;
             } else {
-                rect = Union(rect, DoubleRect(x1, y1, x2, y2));
+                rect = Union(rect, char_rect);
             }
         }
         // Starting a new line - push current rect, start a new rect.
@@ -256,8 +481,7 @@ int Page::GetTextBounds(const int start_index, const int stop_index, vector<Rect
 
 bool Page::SelectWordAt(const Point_i& point, SelectionBoundary* start, SelectionBoundary* stop) {
     Point_d char_point = UnapplyPageTransform(point);
-    int char_index = FPDFText_GetCharIndexAtPos(text_page(), char_point.x, char_point.y,
-                                                kFingerTolerance, kFingerTolerance);
+    int char_index = GetCharIndexAtPoint(char_point, kFingerTolerance);
     if (char_index < 0 || IsWordBreak(GetUnicode(char_index))) {
         return false;  // No word at the given point to select.
     }
@@ -285,12 +509,38 @@ int Page::GetFontSize(int index) {
 }
 
 int Page::GetLinksUtf8(vector<Rectangle_i>* rects, vector<int>* link_to_rect,
-                       vector<std::string>* urls) const {
-    return GetAnnotatedLinksUtf8(rects, link_to_rect, urls) +
-           GetInferredLinksUtf8(rects, link_to_rect, urls);
+                       vector<std::string>* urls) {
+    if (!links_initialized_) {
+        GetAnnotatedLinksUtf8(&links_.rects, &links_.link_to_rect, &links_.urls);
+        GetInferredLinksUtf8(&links_.rects, &links_.link_to_rect, &links_.urls);
+        links_initialized_ = true;
+    }
+    // Indexes into the cached rects are shifted past the rects already given.
+    const int rect_offset = rects->size();
+    rects->insert(rects->end(), links_.rects.begin(), links_.rects.end());
+    for (int rect_index : links_.link_to_rect) {
+        link_to_rect->push_back(rect_offset + rect_index);
+    }
+    urls->insert(urls->end(), links_.urls.begin(), links_.urls.end());
+    return links_.urls.size();
 }
 
-vector<GotoLink> Page::GetGotoLinks() const {
+vector<GotoLink> Page::GetGotoLinks() {
+    if (!goto_links_initialized_) {
+        goto_links_ = FindGotoLinks();
+        goto_links_initialized_ = true;
+    }
+    return goto_links_;
+}
+
+void Page::InvalidateLinks() {
+    links_initialized_ = false;
+    links_ = PageLinks();
+    goto_links_initialized_ = false;
+    goto_links_.clear();
+}
+
+vector<GotoLink> Page::FindGotoLinks() const {
     vector<GotoLink> links;
 
     FPDF_LINK link = nullptr;
@@ -304,7 +554,7 @@ vector<GotoLink> Page::GetGotoLinks() const {
         Rectangle_i rect = GetRect(link);
         goto_link_rects.push_back(rect);
 
-        GotoLinkDest* goto_link_dest = new GotoLinkDest();
+        GotoLinkDest goto_link_dest;
 
         // Get and parse the destination
         FPDF_DEST fpdf_dest = FPDFLink_GetDest(document_, link);
@@ -313,7 +563,7 @@ vector<GotoLink> Page::GetGotoLinks() const {
             LOGE("Goto Link has invalid destination page index");
             continue;
         }
-        goto_link_dest->set_page_number(dest_page_index);
+        goto_link_dest.set_page_number(dest_page_index);
 
         FPDF_BOOL has_x_coord;
         FPDF_BOOL has_y_coord;
@@ -330,25 +580,25 @@ vector<GotoLink> Page::GetGotoLinks() const {
         if (has_x_coord) {
             auto point = DoublePoint(x, 0);
             auto tPoint = ApplyPageTransform(point);
-            goto_link_dest->set_x(tPoint.x);
+            goto_link_dest.set_x(tPoint.x);
         }
         if (has_y_coord) {
             auto point = DoublePoint(0, y);
             auto tPoint = ApplyPageTransform(point);
-            goto_link_dest->set_y(tPoint.y);
+            goto_link_dest.set_y(tPoint.y);
         }
         if (has_zoom) {
-            goto_link_dest->set_zoom(zoom);
+            goto_link_dest.set_zoom(zoom);
         }
 
-        GotoLink goto_link = GotoLink{goto_link_rects, *goto_link_dest};
+        GotoLink goto_link = GotoLink{goto_link_rects, goto_link_dest};
 
         // Ensure that links are within page bounds
-        if (goto_link_dest->x >= 0 && goto_link_dest->y >= 0) {
+        if (goto_link_dest.x >= 0 && goto_link_dest.y >= 0) {
             links.push_back(goto_link);
         } else {
             LOGE("Goto Link out of bound (x=%f, y=%f). Page width=%d, height =%d",
-                 goto_link_dest->x, goto_link_dest->y, Width(), Height());
+                 goto_link_dest.x, goto_link_dest.y, Width(), Height());
         }
     }
     return links;
@@ -427,25 +677,21 @@ void Page::NotifyInvalidRect(Rectangle_i rect) {
         return;
     }
 
-    Rectangle_i device_rect = ApplyPageTransform(rect);
-    // If invalid_rect_ is currently empty, avoid unioning so we don't extend
-    // |rect|'s top left corner to (0,0) for no reason.
-    if (IsEmpty(invalid_rect_)) {
-        invalid_rect_ = device_rect;
-        return;
-    }
-
-    invalid_rect_ = Union(invalid_rect_, device_rect);
+    invalid_region_.Add(ApplyPageTransform(rect));
 }
 
 bool Page::HasInvalidRect() {
-    return !IsEmpty(invalid_rect_);
+    return !invalid_region_.IsEmpty();
 }
 
 Rectangle_i Page::ConsumeInvalidRect() {
-    Rectangle_i copy = invalid_rect_;
-    invalid_rect_ = kEmptyIntRectangle;
-    return copy;
+    Rectangle_i bounds = invalid_region_.Bounds();
+    invalid_region_.Clear();
+    return bounds;
+}
+
+std::vector<Rectangle_i> Page::ConsumeInvalidRects() {
+    return invalid_region_.Consume();
 }
 
 void* Page::Get() {
@@ -456,13 +702,27 @@ std::vector<PageObject*> Page::GetPageObjects(bool refetch) {
     PopulatePageObjects(refetch);
 
     std::vector<PageObject*> page_objects;
-    for (const auto& page_object : page_objects_) {
-        page_objects.push_back(page_object.get());
+    page_objects.reserve(page_objects_.size());
+    for (int index = 0; index < static_cast<int>(page_objects_.size()); ++index) {
+        page_objects.push_back(GetPageObject(index));
     }
 
     return page_objects;
 }
 
+PageObject* Page::GetPageObject(int index) {
+    PopulatePageObjects(/* refetch= */ false);
+    if (index < 0 || index >= static_cast<int>(page_objects_.size())) {
+        return nullptr;
+    }
+    PageObjectSlot& slot = page_objects_[index];
+    if (!slot.made) {
+        slot.page_object = MakePageObject(index);
+        slot.made = true;
+    }
+    return slot.page_object.get();
+}
+
 int Page::AddPageObject(std::unique_ptr<PageObject> pageObject) {
     // Create a scoped PDFium page object.
     ScopedFPDFPageObject scoped_page_object(pageObject->CreateFPDFInstance(document_, page_.get()));
@@ -475,10 +735,13 @@ int Page::AddPageObject(std::unique_ptr<PageObject> pageObject) {
     // Insert the FPDF page object into the FPDF page.
     FPDFPage_InsertObject(page_.get(), scoped_page_object.release());
     FPDFPage_GenerateContent(page_.get());
+    InvalidateText();
+    InvalidateLinks();
 
-    // Add pageObject in stored list if populated.
-    if (!page_objects_.empty()) {
-        page_objects_.push_back(std::move(pageObject));
+    // Add a slot to the stored list if populated, the PageObject is made again
+    // from what PDFium stored.
+    if (page_objects_populated_) {
+        page_objects_.emplace_back();
     }
 
     return FPDFPage_CountObjects(page_.get()) - 1;
@@ -493,9 +756,11 @@ bool Page::RemovePageObject(int index) {
 
     FPDFPageObj_Destroy(page_object);
     FPDFPage_GenerateContent(page_.get());
+    InvalidateText();
+    InvalidateLinks();
 
     // Remove pageObject from stored list if populated.
-    if (!page_objects_.empty()) {
+    if (page_objects_populated_) {
         page_objects_.erase(page_objects_.begin() + index);
     }
 
@@ -517,6 +782,13 @@ bool Page::UpdatePageObject(int index, std::unique_ptr<PageObject> pageObject) {
     }
 
     FPDFPage_GenerateContent(page_.get());
+    InvalidateText();
+    InvalidateLinks();
+
+    // Reset pageObject in stored list if populated, to be made again on next use.
+    if (page_objects_populated_) {
+        page_objects_[index] = PageObjectSlot();
+    }
 
     return true;
 }
@@ -573,56 +845,164 @@ void Page::EnsureTextPageInitialized() {
 }
 
 void Page::InPlaceSwapRedBlueChannels(void* pixels, const int num_pixels) const {
-    uint8_t* channels = static_cast<uint8_t*>(pixels);
-    uint8_t* channel1 = channels;
-    uint8_t* channel3 = channels + 2;
+    pdfClient_utils::SwapRedBlueInPlace(static_cast<uint8_t*>(pixels), num_pixels);
+}
+
+void Page::EnsureSearchTextInitialized() {
+    if (search_text_initialized_) {
+        return;
+    }
+    if (text_index_ == nullptr || !text_index_->Get(page_num_, &search_text_start_,
+                                                    &search_text_, &search_skippable_)) {
+        const int start = first_printable_char_index();
+        const int stop = last_printable_char_index() + 1;
+        if (!text_page_) {
+            return;
+        }
+        search_text_start_ = start;
+        std::u32string page_text;
+        page_text.reserve(std::max(0, stop - start));
+        for (int i = start; i < stop; i++) {
+            page_text.push_back(GetUnicode(i));
+        }
+        // Normalized in one pass, see NormalizeBufferForSearch.
+        search_text_.resize(page_text.length());
+        NormalizeBufferForSearch(page_text.data(), page_text.length(), search_text_.data());
+        search_skippable_.reserve(page_text.length());
+        char32_t prev_char = 0;
+        for (char32_t page_char : page_text) {
+            search_skippable_.push_back(IsSkippableForSearch(page_char, prev_char));
+            prev_char = page_char;
+        }
+        if (text_index_ != nullptr) {
+            text_index_->Put(page_num_, search_text_start_, search_text_, search_skippable_);
+        }
+    }
+    search_text_initialized_ = true;
 
-    for (int i = 0; i < num_pixels; ++i, channel1 += kBytesPerPixel, channel3 += kBytesPerPixel) {
-        std::swap(*channel1, *channel3);
+    for (size_t i = 0; i < search_skippable_.size(); i++) {
+        if (!search_skippable_[i]) {
+            search_unskipped_.push_back(i);
+        }
     }
 }
 
-bool Page::FindMatch(const std::u32string& query, const int page_start, const int page_stop,
-                     TextRange* match) {
+int Page::FindMatches(const std::u32string& query, vector<TextRange>* matches) {
     if (query.empty()) {
-        return false;
+        return 0;
+    }
+    EnsureSearchTextInitialized();
+    if (query.find(U'-') == std::u32string::npos) {
+        return FindMatchesLinear(query, matches);
+    }
+
+    const int page_start = search_text_start_;
+    int num_matches = 0;
+    size_t offset = 0;
+    size_t stop;
+    while (offset + query.length() <= search_text_.length()) {
+        if (!IsMatchAt(query, offset, &stop)) {
+            offset++;
+            continue;
+        }
+        if (matches != nullptr) {
+            matches->push_back(TextRange(page_start + offset, page_start + stop));
+        }
+        num_matches++;
+        offset = stop;
+    }
+    return num_matches;
+}
+
+int Page::FindMatchesLinear(const std::u32string& query, vector<TextRange>* matches) {
+    // The query never has repeated spaces, see NormalizeStringForSearch, and
+    // here no '-' either. So after its first char a match can't include a
+    // skippable char: the only ones that a char of the query could be equal to
+    // are spaces following a space, but then the previous char of the query
+    // would have been a space too. A match at offset m is then the first char
+    // of the query at m, followed by the rest of it in the unskipped chars
+    // after m. The rest of the query is looked for with KMP, and the first
+    // char in the skippable chars before it, plus the unskipped one.
+    const int page_start = search_text_start_;
+    const std::u32string_view rest = std::u32string_view(query).substr(1);
+    int num_matches = 0;
+    size_t earliest = 0;
+    auto add_match = [&](size_t start, size_t stop) {
+        if (matches != nullptr) {
+            matches->push_back(TextRange(page_start + start, page_start + stop));
+        }
+        num_matches++;
+        earliest = stop;
+    };
+
+    if (rest.empty()) {
+        for (size_t i = 0; i < search_text_.length(); i++) {
+            if (search_text_[i] == query[0]) {
+                add_match(i, i + 1);
+            }
+        }
+        return num_matches;
+    }
+
+    // failure[k] is the length of the longest proper prefix of rest[0..k] that
+    // is also a suffix of it.
+    vector<size_t> failure(rest.length(), 0);
+    for (size_t k = 1, len = 0; k < rest.length(); k++) {
+        while (len > 0 && rest[k] != rest[len]) {
+            len = failure[len - 1];
+        }
+        if (rest[k] == rest[len]) {
+            len++;
+        }
+        failure[k] = len;
     }
 
-    int max_match_start = page_stop - query.length();
-    for (int m = page_start; m <= max_match_start; m++) {
-        if (IsMatch(query, m, page_stop, match)) {
-            return true;
+    size_t matched = 0;
+    for (size_t t = 0; t < search_unskipped_.size(); t++) {
+        const char32_t page_char = search_text_[search_unskipped_[t]];
+        while (matched > 0 && page_char != rest[matched]) {
+            matched = failure[matched - 1];
+        }
+        if (page_char == rest[matched]) {
+            matched++;
+        }
+        if (matched < rest.length()) {
+            continue;
         }
+        const size_t rest_start = t + 1 - rest.length();
+        if (rest_start > 0) {
+            const size_t first = std::max<size_t>(search_unskipped_[rest_start - 1], earliest);
+            for (size_t i = first; i < static_cast<size_t>(search_unskipped_[rest_start]); i++) {
+                if (search_text_[i] == query[0]) {
+                    add_match(i, search_unskipped_[t] + 1);
+                    break;
+                }
+            }
+        }
+        matched = failure[matched - 1];
     }
-    return false;
+    return num_matches;
 }
 
-bool Page::IsMatch(const std::u32string& query, const int match_start, const int page_stop,
-                   TextRange* match) {
-    int page_index = match_start;
+bool Page::IsMatchAt(const std::u32string& query, size_t offset, size_t* stop) const {
+    size_t text_index = offset;
     size_t query_index = 0;
-    uint32_t page_char = 0, prev_char = 0;
     while (query_index < query.length()) {
-        prev_char = page_char;
-        page_char = GetUnicode(page_index);
-
-        if (NormalizeForSearch(page_char) == query[query_index]) {
+        if (search_text_.length() - text_index < query.length() - query_index) {
+            return false;  // Not enough room for query string before the end.
+        }
+        if (search_text_[text_index] == query[query_index]) {
             // This codepoint matches (ignoring case and accents). Move to next.
             query_index++;
-            page_index++;
-        } else if (IsSkippableForSearch(page_char, prev_char) && query_index > 0) {
+            text_index++;
+        } else if (query_index > 0 && search_skippable_[text_index]) {
             // Don't increment query index - skip over skippable character.
-            page_index++;
-            if ((page_stop - page_index) < (query.length() - query_index)) {
-                return false;  // Not enough room for query string before page_stop.
-            }
+            text_index++;
         } else {
             return false;
         }
     }
-    // Update match to contain page indices of match start and match stop.
-    match->first = match_start;
-    match->second = page_index;
+    *stop = text_index;
     return true;
 }
 
@@ -666,8 +1046,54 @@ SelectionBoundary Page::GetBoundaryAtIndex(const int index, bool is_rtl) {
 }
 
 SelectionBoundary Page::GetBoundaryAtPoint(const Point_i& point) {
+    EnsureBoundariesInitialized();
     SelectionBoundary best_boundary(0, point.x, point.y, false);
-    int best_distance_sq = std::numeric_limits<int>::max();
+    if (boundary_grid_.IsEmpty()) {
+        return best_boundary;
+    }
+
+    // Look for the nearest boundary in ever larger squares around |point|,
+    // until it is within the square's inscribed circle: any boundary outside
+    // the square is farther away.
+    const Rectangle_d& bounds = boundary_grid_.Bounds();
+    double radius = std::max(1.0, std::max(bounds.Width(), bounds.Height()) / 64);
+    vector<int> candidates;
+    while (true) {
+        const Rectangle_d square =
+                DoubleRect(point.x - radius, point.y - radius, point.x + radius, point.y + radius);
+        candidates.clear();
+        boundary_grid_.Query(square, &candidates);
+        int best_index = -1;
+        int64_t best_distance_sq = std::numeric_limits<int64_t>::max();
+        // Candidates are in index order, so the first one is kept among the
+        // nearest.
+        for (int index : candidates) {
+            const int64_t dx = boundaries_[index].point.x - point.x;
+            const int64_t dy = boundaries_[index].point.y - point.y;
+            const int64_t distance_sq = dx * dx + dy * dy;
+            if (distance_sq < best_distance_sq) {
+                best_index = index;
+                best_distance_sq = distance_sq;
+            }
+        }
+        const bool covers_all = square.left <= bounds.left && square.right >= bounds.right &&
+                                square.top <= bounds.top && square.bottom >= bounds.bottom;
+        if (best_index >= 0 && (best_distance_sq <= radius * radius || covers_all)) {
+            return boundaries_[best_index];
+        }
+        if (covers_all) {
+            return best_boundary;
+        }
+        radius *= 2;
+    }
+}
+
+void Page::EnsureBoundariesInitialized() {
+    if (boundaries_initialized_) {
+        return;
+    }
+    boundaries_initialized_ = true;
+    EnsureCharsInitialized();
 
     bool prev_char_is_word_char = false;
     bool is_rtl = false;
@@ -682,18 +1108,75 @@ SelectionBoundary Page::GetBoundaryAtPoint(const Point_i& point) {
             is_rtl = IsRtlAtIndex(index);
         }
         if (cur_char_is_word_char || prev_char_is_word_char) {
-            SelectionBoundary boundary = GetBoundaryAtIndex(index, is_rtl);
-            int dx = boundary.point.x - point.x;
-            int dy = boundary.point.y - point.y;
-            int distance_sq = dx * dx + dy * dy;
-            if (distance_sq < best_distance_sq) {
-                best_boundary = boundary;
-                best_distance_sq = distance_sq;
-            }
+            boundaries_.push_back(GetBoundaryAtIndex(index, is_rtl));
         }
         prev_char_is_word_char = cur_char_is_word_char;
     }
-    return best_boundary;
+
+    vector<Rectangle_d> points;
+    points.reserve(boundaries_.size());
+    for (const SelectionBoundary& boundary : boundaries_) {
+        points.push_back(DoubleRect(boundary.point.x, boundary.point.y, boundary.point.x,
+                                    boundary.point.y));
+    }
+    boundary_grid_.Build(points);
+}
+
+void Page::EnsureCharsInitialized() {
+    if (chars_initialized_) {
+        return;
+    }
+    chars_initialized_ = true;
+    FPDF_TEXTPAGE text = text_page();
+    if (!text) {
+        return;
+    }
+
+    vector<CharInfo> chars(std::max(0, NumChars()));
+    vector<Rectangle_d> boxes(chars.size());
+    for (size_t i = 0; i < chars.size(); i++) {
+        chars[i].unicode = FPDFText_GetUnicode(text, i);
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        FPDFText_GetCharBox(text, i, &x1, &x2, &y1, &y2);
+        boxes[i] = DoubleRect(x1, y1, x2, y2);
+        chars[i].box = boxes[i];
+        FPDFText_GetCharOrigin(text, i, &chars[i].origin.x, &chars[i].origin.y);
+    }
+    chars_ = std::move(chars);
+    char_grid_.Build(boxes);
+}
+
+int Page::GetCharIndexAtPoint(const Point_d& point, double tolerance) {
+    EnsureCharsInitialized();
+    // Same as FPDFText_GetCharIndexAtPos: the first char whose box contains
+    // |point|, or else the one with the nearest edges among those whose box
+    // grown by half of |tolerance| does.
+    const double margin = tolerance / 2;
+    vector<int> candidates;
+    char_grid_.Query(DoubleRect(point.x - margin, point.y - margin, point.x + margin,
+                                point.y + margin),
+                     &candidates);
+    int nearest = -1;
+    double nearest_distance = 10000;
+    for (int index : candidates) {
+        const Rectangle_d& box = chars_[index].box;
+        if (box.left <= point.x && point.x <= box.right && box.top <= point.y &&
+            point.y <= box.bottom) {
+            return index;
+        }
+        if (tolerance <= 0 || point.x < box.left - margin || point.x > box.right + margin ||
+            point.y < box.top - margin || point.y > box.bottom + margin) {
+            continue;
+        }
+        const double distance =
+                std::min(std::abs(point.x - box.left), std::abs(point.x - box.right)) +
+                std::min(std::abs(point.y - box.top), std::abs(point.y - box.bottom));
+        if (distance < nearest_distance) {
+            nearest = index;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
 }
 
 int Page::GetWordStartIndex(const int index) {
@@ -714,9 +1197,11 @@ int Page::GetWordStopIndex(const int index) {
 }
 
 Rectangle_d Page::GetRawCharBounds(const int char_index) {
-    double x1, x2, y1, y2;
-    FPDFText_GetCharBox(text_page(), char_index, &x1, &x2, &y1, &y2);
-    return DoubleRect(x1, y1, x2, y2);
+    EnsureCharsInitialized();
+    if (char_index < 0 || static_cast<size_t>(char_index) >= chars_.size()) {
+        return DoubleRect(0, 0, 0, 0);
+    }
+    return chars_[char_index].box;
 }
 
 Rectangle_i Page::GetCharBounds(const int char_index) {
@@ -724,9 +1209,11 @@ Rectangle_i Page::GetCharBounds(const int char_index) {
 }
 
 Point_i Page::GetCharOrigin(const int char_index) {
-    double x = 0.0, y = 0.0;
-    FPDFText_GetCharOrigin(text_page(), char_index, &x, &y);
-    return ApplyPageTransform(DoublePoint(x, y));
+    EnsureCharsInitialized();
+    if (char_index < 0 || static_cast<size_t>(char_index) >= chars_.size()) {
+        return ApplyPageTransform(DoublePoint(0, 0));
+    }
+    return ApplyPageTransform(chars_[char_index].origin);
 }
 
 int Page::GetAnnotatedLinksUtf8(vector<Rectangle_i>* rects, vector<int>* link_to_rect,
@@ -792,43 +1279,45 @@ bool Page::IsUrlLink(FPDF_LINK link) const {
 }
 
 void Page::PopulatePageObjects(bool refetch) {
-    if (!refetch && !page_objects_.empty()) {
+    if (!refetch && page_objects_populated_) {
         return;
     }
 
-    int object_count = FPDFPage_CountObjects(page_.get());
-    // Resize PageObjects
-    page_objects_.resize(object_count);
+    // Only the slots, the PageObjects are made as they're asked for.
+    page_objects_.clear();
+    page_objects_.resize(std::max(0, FPDFPage_CountObjects(page_.get())));
+    page_objects_populated_ = true;
+}
 
-    for (int index = 0; index < object_count; ++index) {
-        FPDF_PAGEOBJECT page_object = FPDFPage_GetObject(page_.get(), index);
-        int type = FPDFPageObj_GetType(page_object);
+std::unique_ptr<PageObject> Page::MakePageObject(int index) {
+    FPDF_PAGEOBJECT page_object = FPDFPage_GetObject(page_.get(), index);
+    int type = FPDFPageObj_GetType(page_object);
 
-        // Pointer to PageObject
-        std::unique_ptr<PageObject> page_object_ = nullptr;
+    // Pointer to PageObject
+    std::unique_ptr<PageObject> page_object_ = nullptr;
 
-        switch (type) {
-            case FPDF_PAGEOBJ_TEXT: {
-                page_object_ = std::make_unique<TextObject>();
-                break;
-            }
-            case FPDF_PAGEOBJ_PATH: {
-                page_object_ = std::make_unique<PathObject>();
-                break;
-            }
-            case FPDF_PAGEOBJ_IMAGE: {
-                page_object_ = std::make_unique<ImageObject>();
-                break;
-            }
-            default:
-                break;
+    switch (type) {
+        case FPDF_PAGEOBJ_TEXT: {
+            page_object_ = std::make_unique<TextObject>();
+            break;
         }
-
-        // Populate PageObject From Page
-        if (page_object_ && page_object_->PopulateFromFPDFInstance(page_object, page_.get())) {
-            page_objects_[index] = std::move(page_object_);
+        case FPDF_PAGEOBJ_PATH: {
+            page_object_ = std::make_unique<PathObject>();
+            break;
         }
+        case FPDF_PAGEOBJ_IMAGE: {
+            page_object_ = std::make_unique<ImageObject>();
+            break;
+        }
+        default:
+            break;
+    }
+
+    // Populate PageObject From Page
+    if (page_object_ && page_object_->PopulateFromFPDFInstance(page_object, page_.get())) {
+        return page_object_;
     }
+    return nullptr;
 }
 
 std::vector<Annotation*> Page::GetPageAnnotations() {
@@ -927,6 +1416,8 @@ int Page::AddPageAnnotation(std::unique_ptr<Annotation> annotation) {
     }
 
     FPDFPage_GenerateContent(page_.get());
+    annots_to_hide_.clear();
+    InvalidateLinks();
 
     // Add the object to the annotations_ list
     annotations_.push_back(std::move(annotation));
@@ -948,6 +1439,8 @@ bool Page::RemovePageAnnotation(int index) {
     }
 
     FPDFPage_GenerateContent(page_.get());
+    annots_to_hide_.clear();
+    InvalidateLinks();
 
     // Remove from annotations_ list
     annotations_.erase(annotations_.begin() + index);
@@ -981,6 +1474,8 @@ bool Page::UpdatePageAnnotation(int index, std::unique_ptr<Annotation> annotatio
     }
 
     FPDFPage_GenerateContent(page_.get());
+    annots_to_hide_.clear();
+    InvalidateLinks();
 
     return true;
 }
@@ -17,8 +17,10 @@
 #ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_PAGE_H_
 #define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_PAGE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <functional>
 #include <span>
 #include <string>
 #include <unordered_map>
@@ -27,12 +29,15 @@
 #include <vector>
 
 #include "annotation.h"
+#include "char_grid.h"
 #include "cpp/fpdf_scopers.h"
+#include "dirty_region.h"
 #include "form_filler.h"
 #include "form_widget_info.h"
 #include "fpdfview.h"
 #include "page_object.h"
 #include "rect.h"
+#include "text_index.h"
 
 namespace pdfClient {
 
@@ -88,6 +93,13 @@ struct GotoLink {
     GotoLinkDest dest;
 };
 
+// The URL links of a page, see Page::GetLinksUtf8.
+struct PageLinks {
+    std::vector<Rectangle_i> rects;
+    std::vector<int> link_to_rect;
+    std::vector<std::string> urls;
+};
+
 // Interface for converting coordinates between two spaces.
 class ICoordinateConverter {
   public:
@@ -123,6 +135,34 @@ class Page : public ICoordinateConverter {
          int clip_right, int clip_bottom, int render_mode, int show_annot_types,
          bool render_form_fields);
 
+    // Same as Render, but splits the clip into tiles of at most |tile_size|
+    // pixels a side and renders them one at a time, row by row, calling
+    // |on_tile| with the bounds of each tile in bitmap coordinates once it is
+    // in the bitmap. This lets callers show partial results of slow pages.
+    // Stops early if |on_tile| returns false. Returns whether every tile was
+    // rendered.
+    bool RenderTiles(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int clip_top,
+                     int clip_right, int clip_bottom, int tile_size, int render_mode,
+                     int show_annot_types, bool render_form_fields,
+                     const std::function<bool(const Rectangle_i&)>& on_tile);
+
+    // Same as Render, but renders progressively so that it can be abandoned.
+    // PDFium polls |should_pause| while rendering; once it returns true the
+    // render pauses and |on_pause| is called, which returns whether to resume.
+    // Returns true if the page was completely rendered, false if abandoned or
+    // failed. Transforms that scale and translate only are rendered
+    // progressively, others fall back to the blocking Render.
+    bool RenderProgressive(FPDF_BITMAP bitmap, FS_MATRIX transform, int clip_left, int clip_top,
+                           int clip_right, int clip_bottom, int render_mode, int show_annot_types,
+                           bool render_form_fields, const std::function<bool()>& should_pause,
+                           const std::function<bool()>& on_pause);
+
+    // Renders the whole page, scaled to |bitmap|, a 4-byte BGRx bitmap, as a
+    // thumbnail: with reduced quality and without hiding any annotations, see
+    // kThumbnailRenderFlags. If |use_embedded| and the document has a thumbnail
+    // for the page, that is scaled to the bitmap instead.
+    void RenderThumbnail(FPDF_BITMAP bitmap, bool use_embedded);
+
     // The page has a transform that must be applied to all characters and objects
     // on the page. This transforms from the page's internal co-ordinate system
     // to the external co-ordinate system from (0, 0) to (Width(), Height()).
@@ -143,6 +183,15 @@ class Page : public ICoordinateConverter {
 
     uint32_t GetUnicode(int char_index);
 
+    // Makes searches use the text of this page in |text_index|, if it's there,
+    // and add it otherwise. |text_index| isn't owned and must outlive the page.
+    // No-op once the text of the page was edited, see IsTextEdited.
+    void SetTextIndex(TextIndex* text_index);
+
+    // Returns true if page objects of this page were added, removed or updated,
+    // so that its text may not be the one of the file it was loaded from.
+    bool IsTextEdited() const { return text_edited_; }
+
     // Returns the entire text of the given page in UTF-8.
     std::string GetTextUtf8();
 
@@ -185,12 +234,14 @@ class Page : public ICoordinateConverter {
     void ConstrainBoundary(SelectionBoundary* boundary);
 
     int GetFontSize(int index);
-    // Get the URLs and bounding rectangles for all links on the page.
+    // Get the URLs and bounding rectangles for all links on the page. Links are
+    // computed once and kept until the page is edited.
     int GetLinksUtf8(std::vector<Rectangle_i>* rects, std::vector<int>* link_to_rect,
-                     std::vector<std::string>* urls) const;
+                     std::vector<std::string>* urls);
 
-    // Returns the list of GotoLink for all GotoLinks on the page.
-    std::vector<GotoLink> GetGotoLinks() const;
+    // Returns the list of GotoLink for all GotoLinks on the page. Also computed
+    // once and kept until the page is edited.
+    std::vector<GotoLink> GetGotoLinks();
 
     // Perform any operations required to prepare this page for form filling.
     void InitializeFormFilling();
@@ -241,6 +292,27 @@ class Page : public ICoordinateConverter {
     // field. Rect returned in device coordinates.
     Rectangle_i ConsumeInvalidRect();
 
+    // Returns the disjoint areas of the page that have been invalidated, see
+    // DirtyRegion, and resets the field. Rects returned in device coordinates.
+    std::vector<Rectangle_i> ConsumeInvalidRects();
+
+    // Returns a rough estimate, in bytes, of the memory held by this page and
+    // its text page if loaded. PDFium doesn't report the real figure, so this is
+    // based on the number of page objects and characters.
+    size_t EstimatedMemoryUsage() const;
+
+    // Loads the text page and the caches of chars and boundaries selection
+    // uses, so that the first text query on the page doesn't pay for them.
+    void Prefetch();
+
+    // Whether everything Prefetch loads is already loaded.
+    bool IsPrefetched() const;
+
+    // Drops everything loaded on first use that can be loaded again: the text
+    // page and what was found from it, links, page objects, and annotations.
+    // Returns the estimated number of bytes freed, see EstimatedMemoryUsage.
+    size_t TrimMemory();
+
     // Returns FPDF_PAGE. This Page retains ownership. All operations that wish
     // to access FPDF_PAGE should to call methods of this class instead of
     // requesting the FPDF_PAGE directly through this method.
@@ -249,6 +321,11 @@ class Page : public ICoordinateConverter {
     // Get all PageObjects on this Page. Ownership of PageObjects is with Page.
     std::vector<PageObject*> GetPageObjects(bool refetch = false);
 
+    // Get the PageObject at |index|, made from the PDFium object on first use.
+    // Returns nullptr if there's no such object or if its type isn't supported.
+    // Ownership of the PageObject is with Page.
+    PageObject* GetPageObject(int index);
+
     // Add PageObject to Page.
     int AddPageObject(std::unique_ptr<PageObject> page_object);
 
@@ -274,6 +351,26 @@ class Page : public ICoordinateConverter {
     bool UpdatePageAnnotation(int index, std::unique_ptr<Annotation> annotation);
 
   private:
+    // Returns the PDFium render flags for |render_mode|.
+    static int GetRenderFlags(int render_mode);
+
+    // Returns the annotation types to keep visible for |show_annot_types|.
+    static std::unordered_set<int> GetShownAnnotTypes(int show_annot_types,
+                                                      bool render_form_fields);
+
+    // Scales the thumbnail embedded for the page, if any, to |bitmap| and
+    // returns true, or returns false if there is none that can be used.
+    bool RenderEmbeddedThumbnail(FPDF_BITMAP bitmap);
+
+    // Returns the annotations to hide to render the page with |show_annot_types|,
+    // found once for each value and kept until annotations are edited.
+    std::span<const ScopedFPDFAnnotation> GetAnnotsToHide(int show_annot_types,
+                                                          bool render_form_fields);
+
+    // Renders the part of the page within |clip|.
+    void RenderClip(FPDF_BITMAP bitmap, const FS_MATRIX& transform, const FS_RECTF& clip,
+                    int render_flags, bool render_form_fields);
+
     // Convenience methods to access the variables dependent on an initialized
     // ScopedFPDFTextPage. We lazy init text_page_ for efficiency because many
     // page operations do not require it.
@@ -290,17 +387,24 @@ class Page : public ICoordinateConverter {
     // NOTE: This might rely on little-endian architecture.
     void InPlaceSwapRedBlueChannels(void* pixels, const int num_pixels) const;
 
-    // Looks for an instance of the given UTF32 string on the given page, starting
-    // not before the page_start index and ending before the page_stop index.
-    // If found, returns true and updates the TextRange. Case/accent insensitive.
-    bool FindMatch(const std::u32string& query, const int page_start, const int page_stop,
-                   TextRange* match);
+    // Check that the search text below has been initialized and do so if not,
+    // so that searching the page doesn't call PDFium for each char again.
+    void EnsureSearchTextInitialized();
+
+    // Appends the matches of the normalized |query| in the search text to
+    // |matches|, if not null, and returns their number. Matches don't overlap,
+    // and are looked for from the start, as though by IsMatchAt at each offset.
+    int FindMatches(const std::u32string& query, std::vector<TextRange>* matches);
+
+    // Same as above in time linear in the length of the page, with KMP. This
+    // only matches like IsMatchAt if |query| has no '-', which skippable
+    // broken word markers would match; see the comment in the implementation.
+    int FindMatchesLinear(const std::u32string& query, std::vector<TextRange>* matches);
 
-    // Checks if the page matches the given UTF32 string at the given match_start
-    // index that ends before the page_stop index. If it matches, returns true
-    // and updates the TextRange. Case/accent insensitive.
-    bool IsMatch(const std::u32string& query, const int match_start, const int page_stop,
-                 TextRange* match);
+    // Checks if the search text matches |query| at |offset|, ignoring the
+    // chars IsSkippableForSearch after the first one. If it matches, returns
+    // true and updates |stop| to the offset after the match.
+    bool IsMatchAt(const std::u32string& query, size_t offset, size_t* stop) const;
 
     // Returns a SelectionBoundary at a particular index - 0 means before the char
     // at index 0, 1 means after char 0 but before the char at index 1, and so on.
@@ -316,6 +420,19 @@ class Page : public ICoordinateConverter {
     // Returns a SelectionBoundary as near as possible to the given point.
     SelectionBoundary GetBoundaryAtPoint(const Point_i& point);
 
+    // Check that the boundaries GetBoundaryAtPoint chooses from, those at the
+    // start and stop of words, have been initialized and do so if not.
+    void EnsureBoundariesInitialized();
+
+    // Check that the chars below have been initialized and do so if not, so
+    // that selection and hit testing don't call PDFium for each char again.
+    void EnsureCharsInitialized();
+
+    // Returns the index of the char at |point|, in page coordinates, or near
+    // it within |tolerance|, as FPDFText_GetCharIndexAtPos does. Returns -1 if
+    // there is none.
+    int GetCharIndexAtPoint(const Point_d& point, double tolerance);
+
     // Given a boundary index to the middle or either end of a word, returns
     // the boundary index of the start of that word - which is the index of the
     // first char that is part of that word.
@@ -357,34 +474,96 @@ class Page : public ICoordinateConverter {
     // Get the bounds of the given link, in page co-ordinates.
     Rectangle_i GetRect(FPDF_LINK link) const;
 
+    // Computes the goto links of the page, see GetGotoLinks.
+    std::vector<GotoLink> FindGotoLinks() const;
+
+    // Drops the links computed for the page, after an edit.
+    void InvalidateLinks();
+
+    // Drops the text page and everything found from its text.
+    void ResetText();
+
+    // Drops the text of the page, after an edit of its page objects. The text
+    // index has the text from before, so it isn't used by the page anymore.
+    void InvalidateText();
+
     FPDF_DOCUMENT document_;  // Not owned.
 
     ScopedFPDFPage page_;
 
     FormFiller* const form_filler_;  // Not owned.
 
+    // See GetAnnotsToHide, by show_annot_types << 1 | render_form_fields.
+    std::unordered_map<int, std::vector<ScopedFPDFAnnotation>> annots_to_hide_;
+
     // these variables lazily initialized, should be accessed via corresponding
     // accessor methods
     ScopedFPDFTextPage text_page_;
     int first_printable_char_index_;
     int last_printable_char_index_;
 
-    // Rectangle representing an area of the bitmap for this page that has been
-    // reported as invalidated. Will be coalesced from all rectangles that are
-    // reported as invalidated since the last time this rectangle was consumed.
-    // Rectangles are invalidated due to form filling operations.
-    // Rectangle is in Device Coordinates.
-    Rectangle_i invalid_rect_;
+    // The chars from first_printable_char_index() to last_printable_char_index(),
+    // normalized for searching, and whether each of them IsSkippableForSearch
+    // after the previous one. Offsets in these are relative to the first
+    // printable char, |search_text_start_|, so that pages found in the text
+    // index don't need a text page to be searched. Also the offsets of the
+    // chars that aren't skippable.
+    bool search_text_initialized_ = false;
+    bool text_edited_ = false;
+    TextIndex* text_index_ = nullptr;  // Not owned.
+    int search_text_start_ = 0;
+    std::u32string search_text_;
+    std::vector<bool> search_skippable_;
+    std::vector<int> search_unskipped_;
+
+    // The unicode, box and origin of every char of the text page, without the
+    // page transform, and a grid over the boxes. Also the boundaries
+    // GetBoundaryAtPoint chooses from, in order, and a grid over their points.
+    struct CharInfo {
+        uint32_t unicode;
+        Rectangle_d box;
+        Point_d origin;
+    };
+    bool chars_initialized_ = false;
+    std::vector<CharInfo> chars_;
+    CharGrid char_grid_;
+    bool boundaries_initialized_ = false;
+    std::vector<SelectionBoundary> boundaries_;
+    CharGrid boundary_grid_;
+
+    // The links of the page, as returned by GetLinksUtf8 and GetGotoLinks.
+    bool links_initialized_ = false;
+    PageLinks links_;
+    bool goto_links_initialized_ = false;
+    std::vector<GotoLink> goto_links_;
+
+    // Areas of the bitmap for this page that have been reported as invalidated.
+    // Will be coalesced from all rectangles that are reported as invalidated
+    // since the last time they were consumed. Rectangles are invalidated due to
+    // form filling operations. Rectangles are in Device Coordinates.
+    DirtyRegion invalid_region_;
 
     // Page number that is opened.
     int page_num_;
 
+    // A PageObject in page_objects_, made when it's first asked for, see
+    // GetPageObject. Edits of the page reset the ones they change.
+    struct PageObjectSlot {
+        bool made = false;
+        // Null if the type of the object isn't supported.
+        std::unique_ptr<PageObject> page_object;
+    };
+
     // Page Objects
-    std::vector<std::unique_ptr<PageObject>> page_objects_;
+    bool page_objects_populated_ = false;
+    std::vector<PageObjectSlot> page_objects_;
 
-    // Populates page_objects_ with PageObjects on Page.
+    // Populates page_objects_ with a slot for each PageObject on Page.
     void PopulatePageObjects(bool refetch);
 
+    // Makes the PageObject for the PDFium object at |index|.
+    std::unique_ptr<PageObject> MakePageObject(int index);
+
     // Annotations
     std::vector<std::unique_ptr<Annotation>> annotations_;
 
@@ -32,6 +32,7 @@
 #include "text_object.h"
 // #include "file/base/path.h"
 #include "cpp/fpdf_scopers.h"
+#include "fpdf_annot.h"
 #include "fpdfview.h"
 
 namespace {
@@ -53,6 +54,7 @@ using ::pdfClient::Rectangle_i;
 using ::pdfClient::StampAnnotation;
 using ::pdfClient::Symbol;
 using ::pdfClient::TextObject;
+using ::pdfClient::TextRange;
 using ::pdfClient::TimesNewRoman;
 
 static const std::string kTestdata = "testdata";
@@ -220,6 +222,126 @@ TEST(Test, InvalidPageNumberTest) {
     page->TerminateFormFilling();
 }
 
+/*
+ * Test that RenderTiles covers the clip with tiles of at most the requested
+ * size, row by row, and stops when asked to.
+ */
+TEST(Test, RenderTilesTest) {
+    Document doc(LoadTestDocument(kSekretNoPassword), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    ScopedFPDFBitmap bitmap(FPDFBitmap_Create(200, 300, 1));
+    FS_MATRIX transform = {200.0f / page->Width(), 0, 0, 300.0f / page->Height(), 0, 0};
+
+    std::vector<Rectangle_i> tiles;
+    EXPECT_TRUE(page->RenderTiles(bitmap.get(), transform, 0, 0, 200, 300, 128,
+                                  /* render_mode= */ 1, /* show_annot_types= */ 0,
+                                  /* render_form_fields= */ false, [&](const Rectangle_i& tile) {
+                                      tiles.push_back(tile);
+                                      return true;
+                                  }));
+    ASSERT_EQ(6, tiles.size());
+    EXPECT_EQ((Rectangle_i{0, 0, 128, 128}), tiles[0]);
+    EXPECT_EQ((Rectangle_i{128, 0, 200, 128}), tiles[1]);
+    EXPECT_EQ((Rectangle_i{0, 128, 128, 256}), tiles[2]);
+    EXPECT_EQ((Rectangle_i{128, 256, 200, 300}), tiles[5]);
+
+    int rendered = 0;
+    EXPECT_FALSE(page->RenderTiles(bitmap.get(), transform, 0, 0, 200, 300, 128,
+                                   /* render_mode= */ 1, /* show_annot_types= */ 0,
+                                   /* render_form_fields= */ false,
+                                   [&](const Rectangle_i& tile) { return ++rendered < 2; }));
+    EXPECT_EQ(2, rendered);
+}
+
+/*
+ * Test that RenderProgressive runs to completion when resumed after every
+ * pause, gives up when not, and falls back to Render for rotations.
+ */
+TEST(Test, RenderProgressiveTest) {
+    Document doc(LoadTestDocument(kSekretNoPassword), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    ScopedFPDFBitmap bitmap(FPDFBitmap_Create(200, 300, 1));
+    FS_MATRIX transform = {200.0f / page->Width(), 0, 0, 300.0f / page->Height(), 0, 0};
+
+    EXPECT_TRUE(page->RenderProgressive(
+            bitmap.get(), transform, 0, 0, 200, 300, /* render_mode= */ 1,
+            /* show_annot_types= */ 0, /* render_form_fields= */ false,
+            /* should_pause= */ [] { return true; }, /* on_pause= */ [] { return true; }));
+
+    int pauses = 0;
+    bool rendered = page->RenderProgressive(
+            bitmap.get(), transform, 0, 0, 200, 300, /* render_mode= */ 1,
+            /* show_annot_types= */ 0, /* render_form_fields= */ false,
+            /* should_pause= */ [] { return true; },
+            /* on_pause= */ [&] {
+                pauses++;
+                return false;
+            });
+    EXPECT_EQ(pauses == 0, rendered);
+    EXPECT_LE(pauses, 1);
+
+    FS_MATRIX rotation = {0, 1, -1, 0, 300, 0};
+    EXPECT_TRUE(page->RenderProgressive(
+            bitmap.get(), rotation, 0, 0, 200, 300, /* render_mode= */ 1,
+            /* show_annot_types= */ 0, /* render_form_fields= */ false,
+            /* should_pause= */ [] { return true; }, /* on_pause= */ [] { return false; }));
+}
+
+/*
+ * Test that RenderThumbnail draws the whole page over an opaque background,
+ * and falls back to rendering it when there is no embedded thumbnail.
+ */
+TEST(Test, RenderThumbnailTest) {
+    Document doc(LoadTestDocument(kSekretNoPassword), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    for (bool use_embedded : {false, true}) {
+        ScopedFPDFBitmap bitmap(FPDFBitmap_Create(60, 80, 0));
+        FPDFBitmap_FillRect(bitmap.get(), 0, 0, 60, 80, 0);
+        page->RenderThumbnail(bitmap.get(), use_embedded);
+
+        const uint8_t* pixels = static_cast<const uint8_t*>(FPDFBitmap_GetBuffer(bitmap.get()));
+        const int stride = FPDFBitmap_GetStride(bitmap.get());
+        // The bitmap starts out black, the page is white with some text.
+        int white = 0;
+        int other = 0;
+        for (int y = 0; y < 80; y++) {
+            for (int x = 0; x < 60; x++) {
+                const uint8_t* pixel = pixels + y * stride + x * 4;
+                if (pixel[0] == 0xFF && pixel[1] == 0xFF && pixel[2] == 0xFF) {
+                    white++;
+                } else {
+                    other++;
+                }
+            }
+        }
+        EXPECT_GT(white, other) << use_embedded;
+        EXPECT_GT(other, 0) << use_embedded;
+    }
+}
+
+/*
+ * Test that the annotations hidden for a render are shown again afterwards,
+ * including when the annotations to hide are reused from an earlier render,
+ * and that they are found again once annotations are edited.
+ */
+TEST(Test, RenderHidesAnnotationsTest) {
+    Document doc(LoadTestDocument(kAnnotation), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    ScopedFPDFBitmap bitmap(FPDFBitmap_Create(200, 300, 1));
+    FS_MATRIX transform = {200.0f / page->Width(), 0, 0, 300.0f / page->Height(), 0, 0};
+
+    for (int i = 0; i < 2; i++) {
+        page->Render(bitmap.get(), transform, 0, 0, 200, 300, /* render_mode= */ 1,
+                     /* show_annot_types= */ 0, /* render_form_fields= */ false);
+        ScopedFPDFAnnotation annot(FPDFPage_GetAnnot(static_cast<FPDF_PAGE>(page->Get()), 0));
+        EXPECT_EQ(0, FPDFAnnot_GetFlags(annot.get()) & FPDF_ANNOT_FLAG_HIDDEN);
+    }
+
+    ASSERT_TRUE(page->RemovePageAnnotation(0));
+    page->Render(bitmap.get(), transform, 0, 0, 200, 300, /* render_mode= */ 1,
+                 /* show_annot_types= */ 0, /* render_form_fields= */ false);
+}
+
 TEST(Test, GetPageObjectsTest) {
     Document doc(LoadTestDocument(kPageObject), false);
 
@@ -531,6 +653,108 @@ TEST(Test, UpdateTextPageObjectTest) {
     ASSERT_LT(updatedPageObjects[2]->device_matrix_ - update_matrix, 0.01f);
 }
 
+TEST(Test, EditsInvalidateTextTest) {
+    Document doc(LoadTestDocument(kPageObject), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    std::vector<TextRange> matches;
+    ASSERT_EQ(1, page->FindMatchesUtf8("world", &matches));
+    ASSERT_FALSE(page->IsTextEdited());
+
+    // Searching after an update finds the new text only.
+    auto textObject = std::make_unique<TextObject>();
+    textObject->text_ = L"Hello PDF!";
+    textObject->device_matrix_ = {1.0f, 0, 0, 1.0f, 0, 0};
+    ASSERT_TRUE(page->UpdatePageObject(2, std::move(textObject)));
+    EXPECT_TRUE(page->IsTextEdited());
+    matches.clear();
+    EXPECT_EQ(0, page->FindMatchesUtf8("world", &matches));
+    EXPECT_EQ(1, page->FindMatchesUtf8("pdf", &matches));
+    EXPECT_NE(std::string::npos, page->GetTextUtf8().find("PDF"));
+
+    // And none once it's removed.
+    ASSERT_TRUE(page->RemovePageObject(2));
+    matches.clear();
+    EXPECT_EQ(0, page->FindMatchesUtf8("pdf", &matches));
+    EXPECT_EQ(std::string::npos, page->GetTextUtf8().find("Hello"));
+}
+
+TEST(Test, GetPageObjectTest) {
+    Document doc(LoadTestDocument(kPageObject), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+
+    // Objects are made once and kept.
+    PageObject* imageObject = page->GetPageObject(0);
+    ASSERT_NE(nullptr, imageObject);
+    EXPECT_EQ(imageObject, page->GetPageObject(0));
+    EXPECT_EQ(imageObject, page->GetPageObjects()[0]);
+    EXPECT_EQ(nullptr, page->GetPageObject(-1));
+    EXPECT_EQ(nullptr, page->GetPageObject(3));
+
+    // The dimensions are known before the image is decoded.
+    ASSERT_EQ(PageObject::Type::Image, imageObject->GetType());
+    ImageObject* image = static_cast<ImageObject*>(imageObject);
+    EXPECT_GT(image->width_, 0);
+    EXPECT_EQ(nullptr, image->bitmap_.get());
+    ASSERT_NE(nullptr, image->GetBitmap());
+    EXPECT_EQ(image->width_, FPDFBitmap_GetWidth(image->GetBitmap()));
+    EXPECT_EQ(image->height_, FPDFBitmap_GetHeight(image->GetBitmap()));
+}
+
+TEST(Test, ReleaseDecodedBitmapTest) {
+    Document doc(LoadTestDocument(kPageObject), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+
+    // A decoded image is decoded again after it's released.
+    ImageObject* image = static_cast<ImageObject*>(page->GetPageObject(0));
+    ASSERT_NE(nullptr, image->GetBitmap());
+    image->ReleaseDecodedBitmap();
+    EXPECT_EQ(nullptr, image->bitmap_.get());
+    ASSERT_NE(nullptr, image->GetBitmap());
+    EXPECT_EQ(image->width_, FPDFBitmap_GetWidth(image->GetBitmap()));
+
+    // The bitmap of an image to add is all there is of it, so it's kept.
+    ImageObject imageToAdd;
+    imageToAdd.bitmap_ = ScopedFPDFBitmap(FPDFBitmap_Create(10, 10, 1));
+    imageToAdd.ReleaseDecodedBitmap();
+    EXPECT_NE(nullptr, imageToAdd.GetBitmap());
+}
+
+TEST(Test, EditsPatchStoredPageObjectsTest) {
+    Document doc(LoadTestDocument(kPageObject), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+    ASSERT_EQ(3, page->GetPageObjects().size());
+    PageObject* textObject = page->GetPageObject(2);
+
+    // Updating an object makes it again, without refetching.
+    auto pathObject = std::make_unique<PathObject>();
+    Color update_fill_color = Color(255, 0, 0, 255);
+    pathObject->fill_color_ = update_fill_color;
+    pathObject->is_fill_ = true;
+    pathObject->device_matrix_ = {1.0f, 0, 0, 1.0f, 0, 0};
+    EXPECT_TRUE(page->UpdatePageObject(1, std::move(pathObject)));
+    EXPECT_EQ(update_fill_color, page->GetPageObjects()[1]->fill_color_);
+    EXPECT_EQ(textObject, page->GetPageObject(2));
+
+    // Removing an object leaves the others as they were.
+    EXPECT_TRUE(page->RemovePageObject(0));
+    std::vector<PageObject*> pageObjects = page->GetPageObjects();
+    ASSERT_EQ(2, pageObjects.size());
+    EXPECT_EQ(PageObject::Type::Path, pageObjects[0]->GetType());
+    EXPECT_EQ(textObject, pageObjects[1]);
+
+    // Adding an object makes it from what PDFium stored.
+    auto imageObject = std::make_unique<ImageObject>();
+    imageObject->bitmap_ = ScopedFPDFBitmap(FPDFBitmap_Create(100, 50, 1));
+    imageObject->device_matrix_ = {1.0f, 0, 0, 1.0f, 0, 0};
+    ASSERT_EQ(2, page->AddPageObject(std::move(imageObject)));
+    pageObjects = page->GetPageObjects();
+    ASSERT_EQ(3, pageObjects.size());
+    EXPECT_EQ(textObject, pageObjects[1]);
+    ASSERT_EQ(PageObject::Type::Image, pageObjects[2]->GetType());
+    EXPECT_EQ(100, static_cast<ImageObject*>(pageObjects[2])->width_);
+    EXPECT_EQ(50, static_cast<ImageObject*>(pageObjects[2])->height_);
+}
+
 TEST(Test, GetPageAnnotationsTest) {
     Document doc(LoadTestDocument(kAnnotation), false);
 
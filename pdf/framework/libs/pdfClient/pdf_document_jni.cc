@@ -19,23 +19,33 @@
 #include <android/bitmap.h>
 #include <assert.h>
 #include <jni.h>
+#include <math.h>
 #include <stdio.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
+#include "cpp/fpdf_scopers.h"
 #include "document.h"
 #include "fcntl.h"
 #include "file.h"
 #include "form_widget_info.h"
 #include "jni_conversion.h"
+#include "jni_stats.h"
 #include "logging.h"
 #include "page.h"
+#include "print_pipeline.h"
 #include "rect.h"
+#include "render_cache.h"
+#include "utils/pixels.h"
 // #include "util/java/scoped_local_ref.h"
 #include <unistd.h>
 
@@ -46,17 +56,28 @@ using pdfClient::Document;
 using pdfClient::FileReader;
 using pdfClient::GotoLink;
 using pdfClient::Page;
+using pdfClient::PageLinks;
 using pdfClient::Point_f;
 using pdfClient::Point_i;
+using pdfClient::PrintedPage;
+using pdfClient::PrintPipeline;
 using pdfClient::Rectangle_i;
+using pdfClient::RenderCache;
 using pdfClient::SelectionBoundary;
+using pdfClient::SetJniPhase;
 using pdfClient::Status;
 using std::vector;
+using Phase = pdfClient::JniEntryPoint::Phase;
 
 using pdfClient::LinuxFileOps;
 
 namespace {
-std::mutex mutex_;
+// PDFium keeps process-wide state (fonts, caches, allocators) and isn't thread-safe even across
+// documents, so every call into it is serialized by |pdfium_mutex_|. Each Document also has its
+// own lock, held for the whole of an entry point and always taken before |pdfium_mutex_|, so that
+// |pdfium_mutex_| can be released while marshalling arguments and results to and from Java. That
+// way only the PDFium work itself, and not the JNI work around it, is serialized across documents.
+std::mutex pdfium_mutex_;
 
 /** Matrix organizes its values in row-major order. These constants correspond to each
  * value in Matrix.
@@ -70,10 +91,115 @@ constexpr int kMTransY = 5;  // vertical translation
 constexpr int kMPersp0 = 6;  // input x perspective factor
 constexpr int kMPersp1 = 7;  // input y perspective factor
 constexpr int kMPersp2 = 8;  // perspective bias
+
+// How long a progressive render goes on before it pauses, to check whether it was cancelled and to
+// let other documents use PDFium.
+constexpr std::chrono::milliseconds kRenderTimeSlice(4);
+
+// How long a thumbnail waits at most, in steps of kThumbnailWaitStep, for the renders of the pages
+// being viewed, see DisplayRender.
+constexpr std::chrono::milliseconds kThumbnailWaitStep(1);
+constexpr int kMaxThumbnailWaitSteps = 50;
+
+// See RenderParams.java.
+constexpr int kRenderModeForPrint = 2;
+
+constexpr float kPointsPerInch = 72;
+
+// How many pages a print keeps rendered at most: one being handed over to Java while the next one
+// is rendered.
+constexpr int kPrintBuffers = 2;
+
+// Levels of ComponentCallbacks2.onTrimMemory, see ToTrimLevel.
+constexpr int kTrimMemoryRunningCritical = 15;
+constexpr int kTrimMemoryModerate = 60;
+
+// Number of render calls for the pages being viewed in progress, across documents. Thumbnails
+// make way for them, so that a strip of thumbnails doesn't starve the main render of PDFium.
+std::atomic<int> display_renders_(0);
+
+// Counts a render call in |display_renders_| for as long as it is in scope.
+class DisplayRender {
+  public:
+    DisplayRender() { display_renders_++; }
+    ~DisplayRender() { display_renders_--; }
+};
+
+// How many floats each render of renderToTargets takes: a transform, as the values of an FS_MATRIX,
+// and a clip.
+constexpr int kTargetRenderSize = 10;
+
+// A bitmap registered by registerRenderTarget, and what it's checked against once. Its pixels
+// are only locked, and wrapped in an FPDF_BITMAP, for each renderToTargets, so that unlocking them
+// tells the bitmap's users they changed.
+struct RenderTarget {
+    // A global reference, which keeps the bitmap alive.
+    jobject jbitmap;
+    AndroidBitmapInfo info;
+};
+
+// The render targets of every document, by handle: their index. Handles of unregistered targets,
+// which are null, are used again. |render_targets_mutex_| is never held with |pdfium_mutex_|, it
+// is taken to register or unregister them, and to lock the pixels of those rendered into.
+std::mutex render_targets_mutex_;
+std::vector<std::unique_ptr<RenderTarget>> render_targets_;
+
+// Only renders are dropped while the app is running and the system isn't critically low on memory,
+// pages are closed once the app is in the background too, and all of them once it's about to be
+// killed.
+Document::TrimLevel ToTrimLevel(int level) {
+    if (level >= kTrimMemoryModerate) {
+        return Document::TrimLevel::ALL_PAGES;
+    }
+    if (level >= kTrimMemoryRunningCritical) {
+        return Document::TrimLevel::SOME_PAGES;
+    }
+    return Document::TrimLevel::RENDERS;
+}
+
+// The locks are taken through these, so that the entry point in progress, see TIME_JNI_CALL, times
+// the wait for them as lock wait, and the time |pdfium_mutex_| is held as compute. Everything else
+// counts as conversion.
+std::unique_lock<std::mutex> LockDocument(Document* doc) {
+    SetJniPhase(Phase::LOCK_WAIT);
+    std::unique_lock<std::mutex> doc_lock(doc->Mutex());
+    SetJniPhase(Phase::CONVERSION);
+    return doc_lock;
+}
+
+std::unique_lock<std::mutex> LockPdfium() {
+    SetJniPhase(Phase::LOCK_WAIT);
+    std::unique_lock<std::mutex> pdfium_lock(pdfium_mutex_);
+    SetJniPhase(Phase::COMPUTE);
+    return pdfium_lock;
+}
+
+void RelockPdfium(std::unique_lock<std::mutex>* pdfium_lock) {
+    SetJniPhase(Phase::LOCK_WAIT);
+    pdfium_lock->lock();
+    SetJniPhase(Phase::COMPUTE);
+}
+
+void UnlockPdfium(std::unique_lock<std::mutex>* pdfium_lock) {
+    pdfium_lock->unlock();
+    SetJniPhase(Phase::CONVERSION);
+}
+
+// Drops |page|, which closes it unless it is retained, and then |pdfium_lock|, so that the results
+// can be marshalled back to Java without holding up other documents.
+void ReleasePdfium(std::shared_ptr<Page>* page, std::unique_lock<std::mutex>* pdfium_lock) {
+    page->reset();
+    UnlockPdfium(pdfium_lock);
+}
 }  // namespace
 
+// Counts and times the entry point it's at the top of, see JniCall.
+#define TIME_JNI_CALL()                                        \
+    static pdfClient::JniEntryPoint jni_entry_point(__func__); \
+    pdfClient::JniCall jni_call(&jni_entry_point)
+
 JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(pdfium_mutex_);
     pdfClient::InitLibrary();
     // NOTE(olsen): We never call FPDF_DestroyLibrary. Would it add any benefit?
     return JNI_VERSION_1_6;
@@ -81,7 +207,7 @@ JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_createFromFd(
         JNIEnv* env, jobject obj, jint jfd, jstring jpassword) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     LinuxFileOps::FDCloser fd(jfd);
     const char* password = jpassword == NULL ? NULL : env->GetStringUTFChars(jpassword, NULL);
     LOGD("Creating FPDF_DOCUMENT from fd: %d", fd.get());
@@ -89,20 +215,26 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_createFromF
 
     auto fileReader = std::make_unique<FileReader>(std::move(fd));
     size_t pdfSizeInBytes = fileReader->CompleteSize();
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     Status status = Document::Load(std::move(fileReader), password,
                                    /* closeFdOnFailure= */ true, &doc);
 
     if (password) {
         env->ReleaseStringUTFChars(jpassword, password);
     }
-    // doc is owned by the LoadPdfResult in java.
+    // doc is owned by the LoadPdfResult in java. Still under |pdfium_mutex_| as this counts pages.
     return convert::ToJavaLoadPdfResult(env, status, std::move(doc), pdfSizeInBytes);
 }
 
 JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_destroy(JNIEnv* env,
                                                                           jobject jPdfDocument) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    {
+        // Wait for any operation still using the document, its lock goes away with it.
+        std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    }
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     LOGD("Deleting Document: %p", doc);
     delete doc;
     LOGD("Destroyed Document: %p", doc);
@@ -111,9 +243,11 @@ JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_destroy(JNIEnv
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_saveToFd(JNIEnv* env,
                                                                                jobject jPdfDocument,
                                                                                jint jfd) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     LinuxFileOps::FDCloser fd(jfd);
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     LOGD("Saving Document %p to fd %d", doc, fd.get());
     return doc->SaveAs(std::move(fd));
 }
@@ -121,22 +255,27 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_saveToFd(J
 // TODO(b/321979602): Cleanup Dimensions, reusing `android.util.Size`
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageDimensions(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
     Rectangle_i dimensions = page->Dimensions();
     if (pdfClient::IsEmpty(dimensions)) {
         LOGE("pdfClient returned 0x0 page dimensions for page %d", pageNum);
         dimensions = pdfClient::IntRect(0, 0, 612, 792);  // Default to Letter size.
     }
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaDimensions(env, dimensions);
 }
 
 JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageWidth(JNIEnv* env,
                                                                                jobject jPdfDocument,
                                                                                jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
     return page->Width();
 }
@@ -144,8 +283,10 @@ JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageWidth(J
 JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageHeight(JNIEnv* env,
                                                                                jobject jPdfDocument,
                                                                                jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
     return page->Height();
 }
@@ -154,8 +295,10 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_render(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap, jint clipLeft,
         jint clipTop, jint clipRight, jint clipBottom, jfloatArray jTransform, jint renderMode,
         jint showAnnotTypes, jboolean renderFormFields) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
+    DisplayRender display_render;
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
 
     // android.graphics.Bitmap -> FPDF_Bitmap
     void* bitmap_pixels;
@@ -166,8 +309,6 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_render(
     AndroidBitmapInfo info;
     AndroidBitmap_getInfo(env, jbitmap, &info);
     const int stride = info.width * 4;
-    FPDF_BITMAP bitmap =
-            FPDFBitmap_CreateEx(info.width, info.height, FPDFBitmap_BGRA, bitmap_pixels, stride);
 
     // android.graphics.Matrix (SkMatrix) -> FS_Matrix
     float transform[9];
@@ -180,10 +321,214 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_render(
     FS_MATRIX pdfiumTransform = {transform[kMScaleX], transform[kMSkewY],  transform[kMSkewX],
                                  transform[kMScaleY], transform[kMTransX], transform[kMTransY]};
 
-    // Actually render via Page
+    // Identical renders are served from the render cache, without PDFium.
+    uint8_t* pixels = static_cast<uint8_t*>(bitmap_pixels);
+    const Rectangle_i clip{std::max(clipLeft, 0), std::max(clipTop, 0),
+                           std::min<int>(clipRight, info.width),
+                           std::min<int>(clipBottom, info.height)};
+    const bool cacheable = clip.Width() > 0 && clip.Height() > 0;
+    RenderCache::Key key{pageNum,        pdfiumTransform, clip, renderMode, showAnnotTypes,
+                         static_cast<bool>(renderFormFields), 0};
+    if (cacheable) {
+        key.background = RenderCache::HashPixels(pixels, stride, clip);
+    }
+    if (!cacheable || !doc->GetRenderCache().Get(key, pixels, stride)) {
+        // Actually render via Page
+        std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+        FPDF_BITMAP bitmap = FPDFBitmap_CreateEx(info.width, info.height, FPDFBitmap_BGRA,
+                                                 bitmap_pixels, stride);
+        std::shared_ptr<Page> page = doc->GetPage(pageNum);
+        page->Render(bitmap, pdfiumTransform, clipLeft, clipTop, clipRight, clipBottom,
+                     renderMode, showAnnotTypes, renderFormFields);
+        ReleasePdfium(&page, &pdfium_lock);
+        if (cacheable) {
+            doc->GetRenderCache().Put(key, pixels, stride);
+        }
+    }
+    if (AndroidBitmap_unlockPixels(env, jbitmap) < 0) {
+        LOGE("Couldn't unlock bitmap pixel address");
+        return false;
+    }
+    return true;
+}
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderTiles(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap, jint clipLeft,
+        jint clipTop, jint clipRight, jint clipBottom, jfloatArray jTransform, jint renderMode,
+        jint showAnnotTypes, jboolean renderFormFields, jint tileSize, jobject jCallback) {
+    TIME_JNI_CALL();
+    DisplayRender display_render;
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+
+    // android.graphics.Matrix (SkMatrix) -> FS_Matrix
+    float transform[9];
+    env->GetFloatArrayRegion(jTransform, 0, 9, transform);
+    if (transform[kMPersp0] != 0 || transform[kMPersp1] != 0 || transform[kMPersp2] != 1) {
+        LOGE("Non-affine transform provided");
+        return false;
+    }
+
+    FS_MATRIX pdfiumTransform = {transform[kMScaleX], transform[kMSkewY],  transform[kMSkewX],
+                                 transform[kMScaleY], transform[kMTransX], transform[kMTransY]};
+
+    jmethodID on_tile_rendered =
+            env->GetMethodID(env->GetObjectClass(jCallback), "onTileRendered", "(IIII)Z");
+
+    // android.graphics.Bitmap -> FPDF_Bitmap
+    void* bitmap_pixels;
+    if (AndroidBitmap_lockPixels(env, jbitmap, &bitmap_pixels) < 0) {
+        LOGE("Couldn't get bitmap pixel address");
+        return false;
+    }
+    AndroidBitmapInfo info;
+    AndroidBitmap_getInfo(env, jbitmap, &info);
+    const int stride = info.width * 4;
+
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(info.width, info.height, FPDFBitmap_BGRA, bitmap_pixels, stride));
+    std::shared_ptr<Page> page = doc->GetPage(pageNum);
+    bool rendered = page->RenderTiles(
+            bitmap.get(), pdfiumTransform, clipLeft, clipTop, clipRight, clipBottom, tileSize,
+            renderMode, showAnnotTypes, renderFormFields, [&](const Rectangle_i& tile) {
+                // Other documents can use PDFium while the viewer takes the tile, this one
+                // stays locked: the page is rendered with some of its annotations hidden until
+                // the last tile. So the callback mustn't call into this document.
+                UnlockPdfium(&pdfium_lock);
+                bool keep_going = env->CallBooleanMethod(jCallback, on_tile_rendered, tile.left,
+                                                         tile.top, tile.right, tile.bottom);
+                if (env->ExceptionCheck()) {
+                    keep_going = false;
+                }
+                RelockPdfium(&pdfium_lock);
+                return keep_going;
+            });
+    bitmap.reset();
+    ReleasePdfium(&page, &pdfium_lock);
+    if (AndroidBitmap_unlockPixels(env, jbitmap) < 0) {
+        LOGE("Couldn't unlock bitmap pixel address");
+        return false;
+    }
+    return rendered;
+}
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderProgressive(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap, jint clipLeft,
+        jint clipTop, jint clipRight, jint clipBottom, jfloatArray jTransform, jint renderMode,
+        jint showAnnotTypes, jboolean renderFormFields, jobject jCancellationSignal) {
+    TIME_JNI_CALL();
+    DisplayRender display_render;
+    jmethodID is_canceled = env->GetMethodID(env->GetObjectClass(jCancellationSignal),
+                                             "isCanceled", "()Z");
+    auto canceled = [&] {
+        return env->CallBooleanMethod(jCancellationSignal, is_canceled) || env->ExceptionCheck();
+    };
+
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    if (canceled()) {
+        return false;
+    }
+
+    // android.graphics.Matrix (SkMatrix) -> FS_Matrix
+    float transform[9];
+    env->GetFloatArrayRegion(jTransform, 0, 9, transform);
+    if (transform[kMPersp0] != 0 || transform[kMPersp1] != 0 || transform[kMPersp2] != 1) {
+        LOGE("Non-affine transform provided");
+        return false;
+    }
+
+    FS_MATRIX pdfiumTransform = {transform[kMScaleX], transform[kMSkewY],  transform[kMSkewX],
+                                 transform[kMScaleY], transform[kMTransX], transform[kMTransY]};
+
+    // android.graphics.Bitmap -> FPDF_Bitmap
+    void* bitmap_pixels;
+    if (AndroidBitmap_lockPixels(env, jbitmap, &bitmap_pixels) < 0) {
+        LOGE("Couldn't get bitmap pixel address");
+        return false;
+    }
+    AndroidBitmapInfo info;
+    AndroidBitmap_getInfo(env, jbitmap, &info);
+    const int stride = info.width * 4;
+
+    using Clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    Clock::time_point slice_end = Clock::now() + kRenderTimeSlice;
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(info.width, info.height, FPDFBitmap_BGRA, bitmap_pixels, stride));
+    std::shared_ptr<Page> page = doc->GetPage(pageNum);
+    bool rendered = page->RenderProgressive(
+            bitmap.get(), pdfiumTransform, clipLeft, clipTop, clipRight, clipBottom, renderMode,
+            showAnnotTypes, renderFormFields,
+            /* should_pause= */ [&] { return Clock::now() >= slice_end; },
+            /* on_pause= */
+            [&] {
+                // Only PDFium is released, PDFium keeps the state of the paused render in the
+                // page, so the document stays locked.
+                UnlockPdfium(&pdfium_lock);
+                bool resume = !canceled();
+                RelockPdfium(&pdfium_lock);
+                slice_end = Clock::now() + kRenderTimeSlice;
+                return resume;
+            });
+    bitmap.reset();
+    ReleasePdfium(&page, &pdfium_lock);
+    if (AndroidBitmap_unlockPixels(env, jbitmap) < 0) {
+        LOGE("Couldn't unlock bitmap pixel address");
+        return false;
+    }
+    return rendered;
+}
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderThumbnail(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap,
+        jboolean useEmbeddedThumbnail) {
+    TIME_JNI_CALL();
+    SetJniPhase(Phase::LOCK_WAIT);
+    for (int i = 0; i < kMaxThumbnailWaitSteps && display_renders_ > 0; i++) {
+        std::this_thread::sleep_for(kThumbnailWaitStep);
+    }
+
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+
+    AndroidBitmapInfo info;
+    AndroidBitmap_getInfo(env, jbitmap, &info);
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 &&
+        info.format != ANDROID_BITMAP_FORMAT_RGB_565) {
+        LOGE("Unsupported thumbnail bitmap format %d", info.format);
+        return false;
+    }
+    void* bitmap_pixels;
+    if (AndroidBitmap_lockPixels(env, jbitmap, &bitmap_pixels) < 0) {
+        LOGE("Couldn't get bitmap pixel address");
+        return false;
+    }
+    uint8_t* pixels = static_cast<uint8_t*>(bitmap_pixels);
+
+    // PDFium only renders 4-byte pixels, RGB_565 thumbnails are packed from a
+    // buffer of them.
+    const bool rgb565 = info.format == ANDROID_BITMAP_FORMAT_RGB_565;
+    vector<uint8_t> buffer(rgb565 ? info.width * info.height * 4 : 0);
+    const int stride = rgb565 ? info.width * 4 : info.stride;
+    uint8_t* bgrx = rgb565 ? buffer.data() : pixels;
+
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(info.width, info.height, FPDFBitmap_BGRx, bgrx, stride));
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
-    page->Render(bitmap, pdfiumTransform, clipLeft, clipTop, clipRight, clipBottom, renderMode,
-                 showAnnotTypes, renderFormFields);
+    page->RenderThumbnail(bitmap.get(), useEmbeddedThumbnail);
+    bitmap.reset();
+    ReleasePdfium(&page, &pdfium_lock);
+
+    if (rgb565) {
+        pdfClient_utils::PackBgrxToRgb565(bgrx, stride, pixels, info.stride, info.width,
+                                          info.height);
+    } else {
+        pdfClient_utils::SwapRedBlue(pixels, stride, pixels, stride, info.width, info.height,
+                                     /* opaque= */ true);
+    }
     if (AndroidBitmap_unlockPixels(env, jbitmap) < 0) {
         LOGE("Couldn't unlock bitmap pixel address");
         return false;
@@ -191,39 +536,236 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_render(
     return true;
 }
 
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderPagesForPrint(
+        JNIEnv* env, jobject jPdfDocument, jint firstPage, jint lastPage, jint dpi,
+        jint showAnnotTypes, jboolean renderFormFields, jobject jCallback) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    jmethodID on_page_rendered = env->GetMethodID(env->GetObjectClass(jCallback), "onPageRendered",
+                                                  "(ILandroid/graphics/Bitmap;)Z");
+
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    const int num_pages = doc->NumPages();
+    UnlockPdfium(&pdfium_lock);
+    if (firstPage < 0 || lastPage >= num_pages || dpi <= 0) {
+        LOGE("Invalid print of pages %d to %d of %d at %d dpi", firstPage, lastPage, num_pages,
+             dpi);
+        return false;
+    }
+
+    // The pages are rendered on the pipeline's thread, which takes |pdfium_mutex_| for each of
+    // them, while this one hands them over to Java. This document stays locked throughout, so
+    // nothing else uses it meanwhile.
+    const float scale = dpi / kPointsPerInch;
+    PrintPipeline pipeline(
+            firstPage, lastPage, kPrintBuffers,
+            [doc, scale, showAnnotTypes, renderFormFields](int page_num, PrintedPage* printed) {
+                std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+                std::shared_ptr<Page> page = doc->GetPage(page_num);
+                printed->width = lroundf(page->Width() * scale);
+                printed->height = lroundf(page->Height() * scale);
+                if (printed->width <= 0 || printed->height <= 0) {
+                    LOGE("Page %d can't be printed", page_num);
+                    ReleasePdfium(&page, &pdfium_lock);
+                    return false;
+                }
+                printed->pixels.resize(printed->Stride() * printed->height);
+                ScopedFPDFBitmap bitmap(FPDFBitmap_CreateEx(printed->width, printed->height,
+                                                            FPDFBitmap_BGRA,
+                                                            printed->pixels.data(),
+                                                            printed->Stride()));
+                FPDFBitmap_FillRect(bitmap.get(), 0, 0, printed->width, printed->height,
+                                    0xFFFFFFFF);
+                page->Render(bitmap.get(), FS_MATRIX{scale, 0, 0, scale, 0, 0}, 0, 0,
+                             printed->width, printed->height, kRenderModeForPrint,
+                             showAnnotTypes, renderFormFields);
+                bitmap.reset();
+                ReleasePdfium(&page, &pdfium_lock);
+                return true;
+            });
+
+    // Pages of the same size are copied into the same Java bitmap.
+    jobject jbitmap = NULL;
+    while (true) {
+        // Waiting for the pipeline is waiting for the render of the page.
+        SetJniPhase(Phase::COMPUTE);
+        std::unique_ptr<PrintedPage> page = pipeline.Next();
+        SetJniPhase(Phase::CONVERSION);
+        if (!page) {
+            return !pipeline.Failed();
+        }
+        const int page_num = page->page_num;
+        jobject page_bitmap = convert::ToJavaPrintedPage(env, *page, jbitmap);
+        pipeline.Recycle(std::move(page));
+        if (page_bitmap == NULL) {
+            return false;
+        }
+        if (jbitmap != NULL && jbitmap != page_bitmap) {
+            env->DeleteLocalRef(jbitmap);
+        }
+        jbitmap = page_bitmap;
+        bool keep_going = env->CallBooleanMethod(jCallback, on_page_rendered, page_num, jbitmap);
+        if (env->ExceptionCheck() || !keep_going) {
+            return false;
+        }
+    }
+}
+
+JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_registerRenderTarget(
+        JNIEnv* env, jobject obj, jobject jbitmap) {
+    TIME_JNI_CALL();
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, jbitmap, &info) < 0 ||
+        info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        LOGE("Unsupported render target");
+        return -1;
+    }
+    auto target = std::make_unique<RenderTarget>();
+    target->jbitmap = env->NewGlobalRef(jbitmap);
+    target->info = info;
+
+    std::lock_guard<std::mutex> targets_lock(render_targets_mutex_);
+    auto free_slot = std::find(render_targets_.begin(), render_targets_.end(), nullptr);
+    if (free_slot == render_targets_.end()) {
+        free_slot = render_targets_.insert(free_slot, nullptr);
+    }
+    *free_slot = std::move(target);
+    return free_slot - render_targets_.begin();
+}
+
+JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_unregisterRenderTarget(
+        JNIEnv* env, jobject obj, jint target) {
+    TIME_JNI_CALL();
+    jobject jbitmap;
+    {
+        std::lock_guard<std::mutex> targets_lock(render_targets_mutex_);
+        if (target < 0 || target >= static_cast<int>(render_targets_.size()) ||
+            !render_targets_[target]) {
+            LOGE("Unknown render target %d", target);
+            return;
+        }
+        jbitmap = render_targets_[target]->jbitmap;
+        render_targets_[target].reset();
+    }
+    env->DeleteGlobalRef(jbitmap);
+}
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderToTargets(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jintArray jTargets,
+        jfloatArray jRenders, jint renderMode, jint showAnnotTypes, jboolean renderFormFields) {
+    TIME_JNI_CALL();
+    DisplayRender display_render;
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+
+    const int num_targets = env->GetArrayLength(jTargets);
+    if (env->GetArrayLength(jRenders) != num_targets * kTargetRenderSize) {
+        LOGE("Expected %d values for %d render targets", num_targets * kTargetRenderSize,
+             num_targets);
+        return false;
+    }
+    vector<int> targets(num_targets);
+    env->GetIntArrayRegion(jTargets, 0, num_targets, targets.data());
+    vector<float> renders(num_targets * kTargetRenderSize);
+    env->GetFloatArrayRegion(jRenders, 0, renders.size(), renders.data());
+
+    // The pixels are locked outside of |pdfium_mutex_|, which only PDFium calls are made under.
+    // Local references keep the bitmaps alive if their targets are unregistered meanwhile.
+    struct LockedTarget {
+        jobject jbitmap;
+        AndroidBitmapInfo info;
+        void* pixels;
+        const float* render;
+    };
+    vector<LockedTarget> locked;
+    locked.reserve(num_targets);
+    bool rendered = true;
+    {
+        std::lock_guard<std::mutex> targets_lock(render_targets_mutex_);
+        for (int i = 0; i < num_targets; i++) {
+            const int target = targets[i];
+            if (target < 0 || target >= static_cast<int>(render_targets_.size()) ||
+                !render_targets_[target]) {
+                LOGE("Unknown render target %d", target);
+                rendered = false;
+                continue;
+            }
+            const RenderTarget& render_target = *render_targets_[target];
+            void* bitmap_pixels;
+            if (AndroidBitmap_lockPixels(env, render_target.jbitmap, &bitmap_pixels) < 0) {
+                LOGE("Couldn't get bitmap pixel address");
+                rendered = false;
+                continue;
+            }
+            locked.push_back({env->NewLocalRef(render_target.jbitmap), render_target.info,
+                              bitmap_pixels, renders.data() + i * kTargetRenderSize});
+        }
+    }
+
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    std::shared_ptr<Page> page = doc->GetPage(pageNum);
+    for (const LockedTarget& target : locked) {
+        ScopedFPDFBitmap bitmap(FPDFBitmap_CreateEx(target.info.width, target.info.height,
+                                                    FPDFBitmap_BGRA, target.pixels,
+                                                    target.info.stride));
+        const float* render = target.render;
+        FS_MATRIX transform = {render[0], render[1], render[2], render[3], render[4], render[5]};
+        page->Render(bitmap.get(), transform, render[6], render[7], render[8], render[9],
+                     renderMode, showAnnotTypes, renderFormFields);
+    }
+    ReleasePdfium(&page, &pdfium_lock);
+
+    for (const LockedTarget& target : locked) {
+        AndroidBitmap_unlockPixels(env, target.jbitmap);
+        env->DeleteLocalRef(target.jbitmap);
+    }
+    return rendered;
+}
+
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_cloneWithoutSecurity(
         JNIEnv* env, jobject jPdfDocument, jint destination) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     LinuxFileOps::FDCloser fd(destination);
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     return doc->CloneDocumentWithoutSecurity(std::move(fd));
 }
 
 JNIEXPORT jstring JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
 
     std::string text = page->GetTextUtf8();
+    ReleasePdfium(&page, &pdfium_lock);
     return env->NewStringUTF(text.c_str());
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageAltText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
 
     vector<std::string> alt_texts;
     page->GetAltTextUtf8(&alt_texts);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaStrings(env, alt_texts);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_searchPageText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jstring query) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
     const char* query_native = env->GetStringUTFChars(query, NULL);
 
@@ -231,16 +773,76 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_searchPageT
     vector<int> match_to_rect;
     vector<int> char_indexes;
     page->BoundsOfMatchesUtf8(query_native, &rects, &match_to_rect, &char_indexes);
+    ReleasePdfium(&page, &pdfium_lock);
     jobject match_rects = convert::ToJavaMatchRects(env, rects, match_to_rect, char_indexes);
 
     env->ReleaseStringUTFChars(query, query_native);
     return match_rects;
 }
 
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_openTextIndex(
+        JNIEnv* env, jobject jPdfDocument, jstring jPath) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    // The whole file is read to hash it, which doesn't hold up other documents.
+    uint64_t content_hash;
+    if (!doc->HashContent(&content_hash)) {
+        return false;
+    }
+    const char* path = env->GetStringUTFChars(jPath, nullptr);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    bool opened = doc->OpenTextIndex(path, content_hash);
+    UnlockPdfium(&pdfium_lock);
+    env->ReleaseStringUTFChars(jPath, path);
+    return opened;
+}
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_searchDocument(
+        JNIEnv* env, jobject jPdfDocument, jstring query, jint firstPriorityPage,
+        jint lastPriorityPage, jobject jCallback) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    jmethodID on_page_searched = env->GetMethodID(
+            env->GetObjectClass(jCallback), "onPageSearched",
+            "(ILandroid/graphics/pdf/models/jni/MatchRects;)Z");
+    const char* query_native = env->GetStringUTFChars(query, NULL);
+
+    bool searched = true;
+    for (int pageNum : doc->PagesNearestFirst(firstPriorityPage, lastPriorityPage)) {
+        // PDFium is only locked for one page at a time, so that other documents can use it in
+        // between, and while the matches are handed over. The document stays locked.
+        std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+        std::shared_ptr<Page> page = doc->GetPage(pageNum);
+        vector<Rectangle_i> rects;
+        vector<int> match_to_rect;
+        vector<int> char_indexes;
+        const int num_matches =
+                page->BoundsOfMatchesUtf8(query_native, &rects, &match_to_rect, &char_indexes);
+        ReleasePdfium(&page, &pdfium_lock);
+        if (num_matches == 0) {
+            continue;
+        }
+        jobject match_rects = convert::ToJavaMatchRects(env, rects, match_to_rect, char_indexes);
+        bool keep_going = env->CallBooleanMethod(jCallback, on_page_searched, pageNum, match_rects);
+        env->DeleteLocalRef(match_rects);
+        if (env->ExceptionCheck() || !keep_going) {
+            searched = false;
+            break;
+        }
+    }
+
+    env->ReleaseStringUTFChars(query, query_native);
+    return searched;
+}
+
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_selectPageText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject start, jobject stop) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
 
     SelectionBoundary native_start = convert::ToNativeBoundary(env, start);
@@ -266,72 +868,174 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_selectPageT
     vector<Rectangle_i> rects;
     page->GetTextBounds(native_start.index, native_stop.index, &rects);
     std::string text(page->GetTextUtf8(native_start.index, native_stop.index));
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaSelection(env, pageNum, native_start, native_stop, rects, text);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageLinks(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
 
     vector<Rectangle_i> rects;
     vector<int> link_to_rect;
     vector<std::string> urls;
     page->GetLinksUtf8(&rects, &link_to_rect, &urls);
+    ReleasePdfium(&page, &pdfium_lock);
 
     return convert::ToJavaLinkRects(env, rects, link_to_rect, urls);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageGotoLinks(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum);
 
     vector<GotoLink> links = page->GetGotoLinks();
+    ReleasePdfium(&page, &pdfium_lock);
 
     return convert::ToJavaGotoLinks(env, links);
 }
 
+JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageLinksInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPageNum, jint lastPageNum) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    firstPageNum = std::max(firstPageNum, 0);
+    lastPageNum = std::min(lastPageNum, doc->NumPages() - 1);
+
+    vector<PageLinks> links;
+    for (int page_num = firstPageNum; page_num <= lastPageNum; page_num++) {
+        std::shared_ptr<Page> page = doc->GetPage(page_num);
+        PageLinks page_links;
+        page->GetLinksUtf8(&page_links.rects, &page_links.link_to_rect, &page_links.urls);
+        links.push_back(std::move(page_links));
+    }
+    UnlockPdfium(&pdfium_lock);
+
+    return convert::ToJavaLinkRectsList(env, links);
+}
+
+JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageGotoLinksInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPageNum, jint lastPageNum) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    firstPageNum = std::max(firstPageNum, 0);
+    lastPageNum = std::min(lastPageNum, doc->NumPages() - 1);
+
+    vector<vector<GotoLink>> links;
+    for (int page_num = firstPageNum; page_num <= lastPageNum; page_num++) {
+        links.push_back(doc->GetPage(page_num)->GetGotoLinks());
+    }
+    UnlockPdfium(&pdfium_lock);
+
+    return convert::ToJavaGotoLinksList(env, links);
+}
+
+JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_prefetchPages(
+        JNIEnv* env, jobject jPdfDocument, jint firstVisiblePage, jint lastVisiblePage,
+        jint numNeighbors) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    vector<int> pages;
+    {
+        std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+        std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+        for (int pageNum : doc->PagesNearestFirst(firstVisiblePage, lastVisiblePage)) {
+            if (pageNum >= firstVisiblePage - numNeighbors &&
+                pageNum <= lastVisiblePage + numNeighbors) {
+                pages.push_back(pageNum);
+            }
+        }
+    }
+
+    // The locks are taken again for each page, so that calls for the visible
+    // pages don't wait for the whole of the prefetch.
+    int prefetched = 0;
+    for (int pageNum : pages) {
+        std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+        std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+        if (!doc->PrefetchPage(pageNum)) {
+            break;
+        }
+        prefetched++;
+    }
+    return prefetched;
+}
+
+JNIEXPORT jlong JNICALL Java_android_graphics_pdf_PdfDocumentProxy_trimMemory(JNIEnv* env,
+                                                                              jobject jPdfDocument,
+                                                                              jint level) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    return doc->TrimMemory(ToTrimLevel(level));
+}
+
 JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_retainPage(JNIEnv* env,
                                                                              jobject jPdfDocument,
                                                                              jint pageNum) {
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     doc->GetPage(pageNum, true);
 }
 
 JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_releasePage(JNIEnv* env,
                                                                               jobject jPdfDocument,
                                                                               jint pageNum) {
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     doc->ReleaseRetainedPage(pageNum);
 }
 
 JNIEXPORT jboolean JNICALL
 Java_android_graphics_pdf_PdfDocumentProxy_scaleForPrinting(JNIEnv* env, jobject jPdfDocument) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     return doc->ShouldScaleForPrinting();
 }
 
 JNIEXPORT jboolean JNICALL
 Java_android_graphics_pdf_PdfDocumentProxy_isPdfLinearized(JNIEnv* env, jobject jPdfDocument) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     return doc->IsLinearized();
 }
 
 JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormType(JNIEnv* env,
                                                                        jobject jPdfDocument) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     return doc->GetFormType();
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfo__III(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint x, jint y) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     Point_i point{x, y};
@@ -343,13 +1047,16 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidg
     }
 
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaFormWidgetInfo(env, result);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfo__II(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     FormWidgetInfo result = page->GetFormWidgetInfo(index);
@@ -360,13 +1067,16 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidg
     }
 
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaFormWidgetInfo(env, result);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfos(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jintArray jTypeIds) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::unordered_set<int> type_ids = convert::ToNativeIntegerUnorderedSet(env, jTypeIds);
@@ -375,13 +1085,47 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidg
     page->GetFormWidgetInfos(type_ids, &widget_infos);
 
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaFormWidgetInfos(env, widget_infos);
 }
 
+JNIEXPORT jlong JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfosInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPage, jint lastPage, jintArray jTypeIds,
+        jlong sinceGeneration, jobject jCallback) {
+    TIME_JNI_CALL();
+    Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    jmethodID on_page_widgets = env->GetMethodID(env->GetObjectClass(jCallback), "onPageWidgets",
+                                                 "(IZLjava/util/List;)Z");
+    std::unordered_set<int> type_ids = convert::ToNativeIntegerUnorderedSet(env, jTypeIds);
+
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
+    vector<Document::PageFormWidgets> widgets;
+    doc->GetFormWidgetChanges(firstPage, lastPage, type_ids, sinceGeneration, &widgets);
+    const uint64_t generation = doc->FormGeneration();
+    UnlockPdfium(&pdfium_lock);
+    // Nothing of the document is used from here on, so the callback can call into it.
+    doc_lock.unlock();
+
+    for (const Document::PageFormWidgets& page_widgets : widgets) {
+        jobject widget_infos = convert::ToJavaFormWidgetInfos(env, page_widgets.widget_infos);
+        bool keep_going = env->CallBooleanMethod(jCallback, on_page_widgets, page_widgets.page_num,
+                                                 page_widgets.all_widgets, widget_infos);
+        env->DeleteLocalRef(widget_infos);
+        if (env->ExceptionCheck() || !keep_going) {
+            // The caller doesn't have all of the changes, the next call gets every widget.
+            return 0;
+        }
+    }
+    return generation;
+}
+
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_clickOnPage(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint x, jint y) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     Point_i point{x, y};
@@ -391,19 +1135,20 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_clickOnPage
         doc->ReleaseRetainedPage(pageNum);
         return NULL;
     }
+    doc->InvalidateFormWidgets();
 
-    vector<Rectangle_i> invalid_rects;
-    if (page->HasInvalidRect()) {
-        invalid_rects.push_back(page->ConsumeInvalidRect());
-    }
+    vector<Rectangle_i> invalid_rects = page->ConsumeInvalidRects();
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaRects(env, invalid_rects);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_setFormFieldText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint annotationIndex, jstring jText) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     const char* text = jText == nullptr ? "" : env->GetStringUTFChars(jText, nullptr);
@@ -413,24 +1158,25 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_setFormFiel
         doc->ReleaseRetainedPage(pageNum);
         return NULL;
     }
+    doc->InvalidateFormWidgets();
 
     if (jText) {
         env->ReleaseStringUTFChars(jText, text);
     }
 
-    vector<Rectangle_i> invalid_rects;
-    if (page->HasInvalidRect()) {
-        invalid_rects.push_back(page->ConsumeInvalidRect());
-    }
+    vector<Rectangle_i> invalid_rects = page->ConsumeInvalidRects();
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaRects(env, invalid_rects);
 }
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_setFormFieldSelectedIndices(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint annotationIndex,
         jintArray jSelectedIndices) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     vector<int> selected_indices = convert::ToNativeIntegerVector(env, jSelectedIndices);
@@ -440,19 +1186,20 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_setFormFiel
         doc->ReleaseRetainedPage(pageNum);
         return NULL;
     }
+    doc->InvalidateFormWidgets();
 
-    vector<Rectangle_i> invalid_rects;
-    if (page->HasInvalidRect()) {
-        invalid_rects.push_back(page->ConsumeInvalidRect());
-    }
+    vector<Rectangle_i> invalid_rects = page->ConsumeInvalidRects();
     doc->ReleaseRetainedPage(pageNum);
+    ReleasePdfium(&page, &pdfium_lock);
     return convert::ToJavaRects(env, invalid_rects);
 }
 
 JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageObject(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jPageObject) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::unique_ptr<PageObject> page_object =
@@ -463,6 +1210,7 @@ JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageObject(
     }
 
     int new_object_index = page->AddPageObject(std::move(page_object));
+    doc->GetRenderCache().InvalidatePage(pageNum);
 
     doc->ReleaseRetainedPage(pageNum);
     return new_object_index;
@@ -470,8 +1218,10 @@ JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageObject(
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageObjects(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::vector<PageObject*> page_objects = page->GetPageObjects();
@@ -482,11 +1232,14 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageObje
 
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_removePageObject(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     bool removed = page->RemovePageObject(index);
+    doc->GetRenderCache().InvalidatePage(pageNum);
 
     doc->ReleaseRetainedPage(pageNum);
     return removed;
@@ -494,8 +1247,10 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_removePage
 
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePageObject(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index, jobject jPageObject) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::unique_ptr<PageObject> page_object =
@@ -506,6 +1261,7 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePage
     }
 
     bool updated = page->UpdatePageObject(index, std::move(page_object));
+    doc->GetRenderCache().InvalidatePage(pageNum);
 
     doc->ReleaseRetainedPage(pageNum);
     return updated;
@@ -513,8 +1269,10 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePage
 
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageAnnotations(
         JNIEnv* env, jobject jPdfDocument, jint pageNum) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::vector<Annotation*> annotations = page->GetPageAnnotations();
@@ -525,8 +1283,10 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageAnno
 
 JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageAnnotation(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jPageAnnotation) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::unique_ptr<Annotation> annotation =
@@ -537,6 +1297,8 @@ JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageAnnotat
     }
 
     int new_annotation_index = page->AddPageAnnotation(std::move(annotation));
+    doc->GetRenderCache().InvalidatePage(pageNum);
+    doc->InvalidateFormWidgets();
 
     doc->ReleaseRetainedPage(pageNum);
     return new_annotation_index;
@@ -544,11 +1306,15 @@ JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_addPageAnnotat
 
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_removePageAnnotation(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     bool removed = page->RemovePageAnnotation(index);
+    doc->GetRenderCache().InvalidatePage(pageNum);
+    doc->InvalidateFormWidgets();
 
     doc->ReleaseRetainedPage(pageNum);
     return removed;
@@ -556,8 +1322,10 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_removePage
 
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePageAnnotation(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index, jobject jPageAnnotation) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    TIME_JNI_CALL();
     Document* doc = convert::GetPdfDocPtr(env, jPdfDocument);
+    std::unique_lock<std::mutex> doc_lock = LockDocument(doc);
+    std::unique_lock<std::mutex> pdfium_lock = LockPdfium();
     std::shared_ptr<Page> page = doc->GetPage(pageNum, true);
 
     std::unique_ptr<Annotation> annotation =
@@ -568,7 +1336,14 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePage
     }
 
     bool updated = page->UpdatePageAnnotation(index, std::move(annotation));
+    doc->GetRenderCache().InvalidatePage(pageNum);
+    doc->InvalidateFormWidgets();
 
     doc->ReleaseRetainedPage(pageNum);
     return updated;
 }
+
+JNIEXPORT jstring JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getNativeStats(JNIEnv* env,
+                                                                                    jobject obj) {
+    return env->NewStringUTF(pdfClient::DumpJniStats().c_str());
+}
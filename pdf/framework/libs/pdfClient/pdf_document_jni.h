@@ -52,6 +52,34 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_render(
         jint clipTop, jint clipRight, int clipBottom, jfloatArray jTransform, jint renderMode,
         jint showAnnotTypes, jboolean renderFormFields);
 
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderTiles(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap, jint clipLeft,
+        jint clipTop, jint clipRight, jint clipBottom, jfloatArray jTransform, jint renderMode,
+        jint showAnnotTypes, jboolean renderFormFields, jint tileSize, jobject jCallback);
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderProgressive(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap, jint clipLeft,
+        jint clipTop, jint clipRight, jint clipBottom, jfloatArray jTransform, jint renderMode,
+        jint showAnnotTypes, jboolean renderFormFields, jobject jCancellationSignal);
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderThumbnail(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject jbitmap,
+        jboolean useEmbeddedThumbnail);
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderPagesForPrint(
+        JNIEnv* env, jobject jPdfDocument, jint firstPage, jint lastPage, jint dpi,
+        jint showAnnotTypes, jboolean renderFormFields, jobject jCallback);
+
+JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_registerRenderTarget(
+        JNIEnv* env, jobject obj, jobject jbitmap);
+
+JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_unregisterRenderTarget(
+        JNIEnv* env, jobject obj, jint target);
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_renderToTargets(
+        JNIEnv* env, jobject jPdfDocument, jint pageNum, jintArray jTargets,
+        jfloatArray jRenders, jint renderMode, jint showAnnotTypes, jboolean renderFormFields);
+
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_cloneWithoutSecurity(
         JNIEnv* env, jobject jPdfDocument, jint destination);
 
@@ -64,6 +92,13 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageAltT
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_searchPageText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jstring query);
 
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_openTextIndex(
+        JNIEnv* env, jobject jPdfDocument, jstring jPath);
+
+JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_searchDocument(
+        JNIEnv* env, jobject jPdfDocument, jstring query, jint firstPriorityPage,
+        jint lastPriorityPage, jobject jCallback);
+
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_selectPageText(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jobject start, jobject stop);
 
@@ -73,6 +108,20 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageLink
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageGotoLinks(
         JNIEnv* env, jobject jPdfDocument, jint pageNum);
 
+JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageLinksInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPageNum, jint lastPageNum);
+
+JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getPageGotoLinksInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPageNum, jint lastPageNum);
+
+JNIEXPORT jint JNICALL Java_android_graphics_pdf_PdfDocumentProxy_prefetchPages(
+        JNIEnv* env, jobject jPdfDocument, jint firstVisiblePage, jint lastVisiblePage,
+        jint numNeighbors);
+
+JNIEXPORT jlong JNICALL Java_android_graphics_pdf_PdfDocumentProxy_trimMemory(JNIEnv* env,
+                                                                              jobject jPdfDocument,
+                                                                              jint level);
+
 JNIEXPORT void JNICALL Java_android_graphics_pdf_PdfDocumentProxy_retainPage(JNIEnv* env,
                                                                              jobject jPdfDocument,
                                                                              jint pageNum);
@@ -99,6 +148,10 @@ JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidg
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfos(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jintArray jTypeIds);
 
+JNIEXPORT jlong JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getFormWidgetInfosInRange(
+        JNIEnv* env, jobject jPdfDocument, jint firstPage, jint lastPage, jintArray jTypeIds,
+        jlong sinceGeneration, jobject jCallback);
+
 JNIEXPORT jobject JNICALL Java_android_graphics_pdf_PdfDocumentProxy_clickOnPage(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint x, jint y);
 
@@ -133,6 +186,9 @@ JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_removePage
 JNIEXPORT jboolean JNICALL Java_android_graphics_pdf_PdfDocumentProxy_updatePageAnnotation(
         JNIEnv* env, jobject jPdfDocument, jint pageNum, jint index, jobject jPageAnnotation);
 
+JNIEXPORT jstring JNICALL Java_android_graphics_pdf_PdfDocumentProxy_getNativeStats(JNIEnv* env,
+                                                                                    jobject obj);
+
 #ifdef __cplusplus
 }
 #endif
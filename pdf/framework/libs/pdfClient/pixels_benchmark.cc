@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of the bitmap format conversions, on one megapixel each, so
+// that the reported time is the cost per megapixel. The *Scalar benchmarks are
+// plain per-pixel loops, for comparison.
+
+#include <benchmark/benchmark.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "utils/pixels.h"
+
+namespace {
+
+constexpr size_t kWidth = 1000;
+constexpr size_t kHeight = 1000;
+
+void SwapRedBlueScalar(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                       size_t width, size_t height) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t* in = src + y * src_stride;
+        uint32_t* out = reinterpret_cast<uint32_t*>(dst + y * dst_stride);
+        for (size_t x = 0; x < width; x++) {
+            out[x] = (in[x * 4 + 3] << 24) | (in[x * 4] << 16) | (in[x * 4 + 1] << 8) |
+                     in[x * 4 + 2];
+        }
+    }
+}
+
+void ExpandBgrToRgbaScalar(const uint8_t* src, size_t src_stride, uint8_t* dst,
+                           size_t dst_stride, size_t width, size_t height) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t* in = src + y * src_stride;
+        uint32_t* out = reinterpret_cast<uint32_t*>(dst + y * dst_stride);
+        for (size_t x = 0; x < width; x++) {
+            out[x] = (0xFFu << 24) | (in[x * 3] << 16) | (in[x * 3 + 1] << 8) | in[x * 3 + 2];
+        }
+    }
+}
+
+void SetProcessed(benchmark::State& state) {
+    state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+}
+
+void BM_SwapRedBlue(benchmark::State& state) {
+    const std::vector<uint8_t> src(kWidth * kHeight * 4, 0x7F);
+    std::vector<uint8_t> dst(src.size());
+    for (auto _ : state) {
+        pdfClient_utils::SwapRedBlue(src.data(), kWidth * 4, dst.data(), kWidth * 4, kWidth,
+                                     kHeight, false);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    SetProcessed(state);
+}
+BENCHMARK(BM_SwapRedBlue);
+
+void BM_SwapRedBlueScalar(benchmark::State& state) {
+    const std::vector<uint8_t> src(kWidth * kHeight * 4, 0x7F);
+    std::vector<uint8_t> dst(src.size());
+    for (auto _ : state) {
+        SwapRedBlueScalar(src.data(), kWidth * 4, dst.data(), kWidth * 4, kWidth, kHeight);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    SetProcessed(state);
+}
+BENCHMARK(BM_SwapRedBlueScalar);
+
+void BM_SwapRedBlueInPlace(benchmark::State& state) {
+    std::vector<uint8_t> pixels(kWidth * kHeight * 4, 0x7F);
+    for (auto _ : state) {
+        pdfClient_utils::SwapRedBlueInPlace(pixels.data(), kWidth * kHeight);
+        benchmark::DoNotOptimize(pixels.data());
+        benchmark::ClobberMemory();
+    }
+    SetProcessed(state);
+}
+BENCHMARK(BM_SwapRedBlueInPlace);
+
+void BM_ExpandBgrToRgba(benchmark::State& state) {
+    const std::vector<uint8_t> src(kWidth * kHeight * 3, 0x7F);
+    std::vector<uint8_t> dst(kWidth * kHeight * 4);
+    for (auto _ : state) {
+        pdfClient_utils::ExpandBgrToRgba(src.data(), kWidth * 3, dst.data(), kWidth * 4, kWidth,
+                                         kHeight);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    SetProcessed(state);
+}
+BENCHMARK(BM_ExpandBgrToRgba);
+
+void BM_ExpandBgrToRgbaScalar(benchmark::State& state) {
+    const std::vector<uint8_t> src(kWidth * kHeight * 3, 0x7F);
+    std::vector<uint8_t> dst(kWidth * kHeight * 4);
+    for (auto _ : state) {
+        ExpandBgrToRgbaScalar(src.data(), kWidth * 3, dst.data(), kWidth * 4, kWidth, kHeight);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    SetProcessed(state);
+}
+BENCHMARK(BM_ExpandBgrToRgbaScalar);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/pixels.h"
+
+#include <gtest/gtest.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace {
+
+constexpr size_t kHeight = 3;
+// Rows are padded, as they are in PDFium and Android bitmaps.
+constexpr size_t kPadding = 5;
+
+std::vector<uint8_t> MakePixels(size_t size) {
+    std::vector<uint8_t> pixels(size);
+    for (size_t i = 0; i < size; i++) {
+        pixels[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    return pixels;
+}
+
+// Widths around the 4 and 16 pixels handled at once by the vectorized loops.
+TEST(Test, SwapRedBlueTest) {
+    for (size_t width = 1; width <= 40; width++) {
+        const size_t src_stride = width * 4 + kPadding;
+        const size_t dst_stride = width * 4 + kPadding + 3;
+        const std::vector<uint8_t> src = MakePixels(src_stride * kHeight);
+        for (bool opaque : {false, true}) {
+            std::vector<uint8_t> dst(dst_stride * kHeight, 0);
+            pdfClient_utils::SwapRedBlue(src.data(), src_stride, dst.data(), dst_stride, width,
+                                         kHeight, opaque);
+            for (size_t y = 0; y < kHeight; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    const uint8_t* in = &src[y * src_stride + x * 4];
+                    const uint8_t* out = &dst[y * dst_stride + x * 4];
+                    ASSERT_EQ(in[2], out[0]) << width << " " << x;
+                    ASSERT_EQ(in[1], out[1]) << width << " " << x;
+                    ASSERT_EQ(in[0], out[2]) << width << " " << x;
+                    ASSERT_EQ(opaque ? 0xFF : in[3], out[3]) << width << " " << x;
+                }
+                // The padding is left alone.
+                for (size_t i = width * 4; i < dst_stride; i++) {
+                    ASSERT_EQ(0, dst[y * dst_stride + i]) << width;
+                }
+            }
+        }
+    }
+}
+
+TEST(Test, SwapRedBlueInPlaceTest) {
+    for (size_t num_pixels = 1; num_pixels <= 40; num_pixels++) {
+        const std::vector<uint8_t> original = MakePixels(num_pixels * 4);
+        std::vector<uint8_t> pixels(original);
+        pdfClient_utils::SwapRedBlueInPlace(pixels.data(), num_pixels);
+        pdfClient_utils::SwapRedBlueInPlace(pixels.data(), num_pixels);
+        ASSERT_EQ(original, pixels) << num_pixels;
+    }
+}
+
+TEST(Test, ExpandBgrToRgbaTest) {
+    for (size_t width = 1; width <= 40; width++) {
+        const size_t src_stride = width * 3 + kPadding;
+        const size_t dst_stride = width * 4 + kPadding + 3;
+        // Nothing is read past the last row.
+        const std::vector<uint8_t> src = MakePixels(src_stride * (kHeight - 1) + width * 3);
+        std::vector<uint8_t> dst(dst_stride * kHeight, 0);
+        pdfClient_utils::ExpandBgrToRgba(src.data(), src_stride, dst.data(), dst_stride, width,
+                                         kHeight);
+        for (size_t y = 0; y < kHeight; y++) {
+            for (size_t x = 0; x < width; x++) {
+                const uint8_t* in = &src[y * src_stride + x * 3];
+                const uint8_t* out = &dst[y * dst_stride + x * 4];
+                ASSERT_EQ(in[2], out[0]) << width << " " << x;
+                ASSERT_EQ(in[1], out[1]) << width << " " << x;
+                ASSERT_EQ(in[0], out[2]) << width << " " << x;
+                ASSERT_EQ(0xFF, out[3]) << width << " " << x;
+            }
+            for (size_t i = width * 4; i < dst_stride; i++) {
+                ASSERT_EQ(0, dst[y * dst_stride + i]) << width;
+            }
+        }
+    }
+}
+
+TEST(Test, PackBgrxToRgb565Test) {
+    const size_t width = 7;
+    const size_t src_stride = width * 4 + kPadding;
+    const size_t dst_stride = width * 2 + kPadding + 1;
+    const std::vector<uint8_t> src = MakePixels(src_stride * kHeight);
+    std::vector<uint8_t> dst(dst_stride * kHeight, 0);
+    pdfClient_utils::PackBgrxToRgb565(src.data(), src_stride, dst.data(), dst_stride, width,
+                                      kHeight);
+    for (size_t y = 0; y < kHeight; y++) {
+        for (size_t x = 0; x < width; x++) {
+            const uint8_t* in = &src[y * src_stride + x * 4];
+            const uint16_t out = dst[y * dst_stride + x * 2] | dst[y * dst_stride + x * 2 + 1] << 8;
+            ASSERT_EQ(in[2] >> 3, out >> 11) << x;
+            ASSERT_EQ(in[1] >> 2, (out >> 5) & 0x3F) << x;
+            ASSERT_EQ(in[0] >> 3, out & 0x1F) << x;
+        }
+        for (size_t i = width * 2; i < dst_stride; i++) {
+            ASSERT_EQ(0, dst[y * dst_stride + i]);
+        }
+    }
+}
+
+TEST(Test, ScaleToBgrxTest) {
+    // 2x2 BGR pixels scaled up to 4x4, each one becoming a 2x2 block.
+    const size_t src_stride = 2 * 3 + kPadding;
+    const std::vector<uint8_t> src = MakePixels(src_stride * 2);
+    const size_t dst_stride = 4 * 4 + kPadding;
+    std::vector<uint8_t> dst(dst_stride * 4, 0);
+    pdfClient_utils::ScaleToBgrx(src.data(), src_stride, 2, 2, 3, dst.data(), dst_stride, 4, 4);
+    for (size_t y = 0; y < 4; y++) {
+        for (size_t x = 0; x < 4; x++) {
+            const uint8_t* in = &src[(y / 2) * src_stride + (x / 2) * 3];
+            const uint8_t* out = &dst[y * dst_stride + x * 4];
+            ASSERT_EQ(in[0], out[0]) << x << " " << y;
+            ASSERT_EQ(in[1], out[1]) << x << " " << y;
+            ASSERT_EQ(in[2], out[2]) << x << " " << y;
+            ASSERT_EQ(0xFF, out[3]) << x << " " << y;
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "print_pipeline.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace pdfClient {
+
+PrintPipeline::PrintPipeline(int first_page, int last_page, int num_buffers,
+                             RenderFunction render)
+    : num_buffers_(std::max(num_buffers, 1)),
+      render_(std::move(render)),
+      thread_(&PrintPipeline::Run, this, first_page, last_page) {}
+
+PrintPipeline::~PrintPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        canceled_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+std::unique_ptr<PrintedPage> PrintPipeline::Next() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !rendered_.empty() || done_; });
+    if (rendered_.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<PrintedPage> page = std::move(rendered_.front());
+    rendered_.pop_front();
+    return page;
+}
+
+void PrintPipeline::Recycle(std::unique_ptr<PrintedPage> page) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(std::move(page));
+    }
+    changed_.notify_all();
+}
+
+bool PrintPipeline::Failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+void PrintPipeline::Run(int first_page, int last_page) {
+    for (int page_num = first_page; page_num <= last_page; page_num++) {
+        std::unique_ptr<PrintedPage> page;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] {
+                return canceled_ || !free_.empty() || num_allocated_ < num_buffers_;
+            });
+            if (canceled_) {
+                break;
+            }
+            if (!free_.empty()) {
+                page = std::move(free_.back());
+                free_.pop_back();
+            } else {
+                page = std::make_unique<PrintedPage>();
+                num_allocated_++;
+            }
+        }
+
+        page->page_num = page_num;
+        const bool rendered = render_(page_num, page.get());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!rendered) {
+            failed_ = true;
+            break;
+        }
+        rendered_.push_back(std::move(page));
+        changed_.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    changed_.notify_all();
+}
+
+}  // namespace pdfClient
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_PRINT_PIPELINE_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_PRINT_PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pdfClient {
+
+// A page rendered by PrintPipeline, in 4-byte pixels with no padding.
+struct PrintedPage {
+    int page_num = -1;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t Stride() const { return width * 4; }
+};
+
+// Renders the pages from |first_page| to |last_page| in order on a thread of its
+// own, while the caller takes the rendered ones from Next(), so that handing a
+// page over, e.g. encoding it, overlaps with rendering the next one.
+//
+// At most |num_buffers| pages are rendered and not yet recycled at any time:
+// the thread waits for the caller to Recycle() a page before rendering more.
+// Recycled pages keep their pixels allocated, so that the pages after them,
+// usually of the same size, don't allocate any.
+class PrintPipeline {
+  public:
+    // Renders |page_num| into |page|, resizing its pixels as needed, or returns
+    // false if it can't, which ends the pipeline. Called on the pipeline's
+    // thread, so whatever it uses has to be safe to use from there.
+    using RenderFunction = std::function<bool(int page_num, PrintedPage* page)>;
+
+    PrintPipeline(int first_page, int last_page, int num_buffers, RenderFunction render);
+
+    // Cancels the pages not rendered yet, and waits for the one being rendered.
+    ~PrintPipeline();
+
+    PrintPipeline(const PrintPipeline&) = delete;
+    PrintPipeline& operator=(const PrintPipeline&) = delete;
+
+    // Waits for the next page, and returns it, or nullptr once every page was
+    // returned or a page couldn't be rendered, see Failed().
+    std::unique_ptr<PrintedPage> Next();
+
+    // Gives a page returned by Next() back, to be rendered into again.
+    void Recycle(std::unique_ptr<PrintedPage> page);
+
+    // Returns true if a page couldn't be rendered. Only final once Next()
+    // returned nullptr.
+    bool Failed() const;
+
+  private:
+    void Run(int first_page, int last_page);
+
+    const int num_buffers_;
+    const RenderFunction render_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    // Pages returned by Recycle(), to be rendered into.
+    std::vector<std::unique_ptr<PrintedPage>> free_;
+    // Pages rendered and not yet returned by Next(), in order.
+    std::deque<std::unique_ptr<PrintedPage>> rendered_;
+    int num_allocated_ = 0;
+    bool done_ = false;
+    bool failed_ = false;
+    bool canceled_ = false;
+
+    // Last, so that it starts once everything else is initialized.
+    std::thread thread_;
+};
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_PRINT_PIPELINE_H_
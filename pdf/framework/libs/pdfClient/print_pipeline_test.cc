@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "print_pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <vector>
+
+using pdfClient::PrintedPage;
+using pdfClient::PrintPipeline;
+
+namespace {
+
+// Renders each page as a 2x1 page whose pixels are all its page number.
+bool RenderPageNum(int page_num, PrintedPage* page) {
+    page->width = 2;
+    page->height = 1;
+    page->pixels.assign(page->Stride() * page->height, page_num);
+    return true;
+}
+
+TEST(Test, ReturnsPagesInOrder) {
+    PrintPipeline pipeline(3, 7, 2, RenderPageNum);
+    for (int page_num = 3; page_num <= 7; page_num++) {
+        std::unique_ptr<PrintedPage> page = pipeline.Next();
+        ASSERT_NE(nullptr, page);
+        EXPECT_EQ(page_num, page->page_num);
+        EXPECT_EQ(8u, page->pixels.size());
+        EXPECT_EQ(page_num, page->pixels[7]);
+        pipeline.Recycle(std::move(page));
+    }
+    EXPECT_EQ(nullptr, pipeline.Next());
+    EXPECT_FALSE(pipeline.Failed());
+}
+
+TEST(Test, EmptyRange) {
+    PrintPipeline pipeline(1, 0, 2, RenderPageNum);
+    EXPECT_EQ(nullptr, pipeline.Next());
+    EXPECT_FALSE(pipeline.Failed());
+}
+
+TEST(Test, RendersIntoRecycledBuffers) {
+    std::set<const uint8_t*> buffers;
+    PrintPipeline pipeline(0, 9, 2, [&](int page_num, PrintedPage* page) {
+        RenderPageNum(page_num, page);
+        // Only the pipeline's thread changes |buffers| until it's done.
+        buffers.insert(page->pixels.data());
+        return true;
+    });
+    int num_pages = 0;
+    while (std::unique_ptr<PrintedPage> page = pipeline.Next()) {
+        num_pages++;
+        pipeline.Recycle(std::move(page));
+    }
+    EXPECT_EQ(10, num_pages);
+    EXPECT_LE(buffers.size(), 2u);
+}
+
+TEST(Test, WaitsForBuffersToBeRecycled) {
+    std::atomic<int> num_rendered = 0;
+    PrintPipeline pipeline(0, 9, 3, [&](int page_num, PrintedPage* page) {
+        num_rendered++;
+        return RenderPageNum(page_num, page);
+    });
+    // None of them are recycled, so only as many as there are buffers are rendered.
+    std::vector<std::unique_ptr<PrintedPage>> pages;
+    for (int i = 0; i < 3; i++) {
+        pages.push_back(pipeline.Next());
+        ASSERT_NE(nullptr, pages.back());
+    }
+    EXPECT_EQ(3, num_rendered);
+
+    pipeline.Recycle(std::move(pages[0]));
+    std::unique_ptr<PrintedPage> page = pipeline.Next();
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(3, page->page_num);
+    EXPECT_EQ(4, num_rendered);
+}
+
+TEST(Test, StopsAtFailedPage) {
+    PrintPipeline pipeline(0, 9, 2, [](int page_num, PrintedPage* page) {
+        return page_num != 2 && RenderPageNum(page_num, page);
+    });
+    for (int page_num = 0; page_num < 2; page_num++) {
+        std::unique_ptr<PrintedPage> page = pipeline.Next();
+        ASSERT_NE(nullptr, page);
+        EXPECT_EQ(page_num, page->page_num);
+        pipeline.Recycle(std::move(page));
+    }
+    EXPECT_EQ(nullptr, pipeline.Next());
+    EXPECT_TRUE(pipeline.Failed());
+}
+
+TEST(Test, DestroyedBeforeTheLastPage) {
+    std::atomic<int> num_rendered = 0;
+    {
+        PrintPipeline pipeline(0, 99, 2, [&](int page_num, PrintedPage* page) {
+            num_rendered++;
+            return RenderPageNum(page_num, page);
+        });
+        std::unique_ptr<PrintedPage> page = pipeline.Next();
+        ASSERT_NE(nullptr, page);
+    }
+    EXPECT_LE(num_rendered, 2);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
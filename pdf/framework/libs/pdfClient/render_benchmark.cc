@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of rendering thumbnails, reported as thumbnails per second. The
+// *ForDisplay benchmark renders the same thumbnail the way pages being viewed
+// are rendered, for comparison.
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpp/fpdf_scopers.h"
+#include "document.h"
+#include "file.h"
+#include "fpdfview.h"
+#include "linux_fileops.h"
+#include "page.h"
+#include "utils/pixels.h"
+
+using pdfClient::Document;
+using pdfClient::FileReader;
+using pdfClient::LinuxFileOps;
+using pdfClient::Page;
+
+namespace {
+
+// About the size of a thumbnail in a strip or a grid.
+constexpr int kWidth = 120;
+constexpr int kHeight = 160;
+
+// See RenderParams.java.
+constexpr int kRenderModeForDisplay = 1;
+constexpr int kShowAllAnnotTypes = pdfClient::FLAG_RENDER_TEXT_ANNOTATIONS |
+                                   pdfClient::FLAG_RENDER_HIGHLIGHT_ANNOTATIONS |
+                                   pdfClient::FLAG_RENDER_STAMP_ANNOTATIONS |
+                                   pdfClient::FLAG_RENDER_FREETEXT_ANNOTATIONS;
+
+std::unique_ptr<Document> LoadDocument(const std::string& filename) {
+    pdfClient::InitLibrary();
+    LinuxFileOps::FDCloser fd(open(
+            (android::base::GetExecutableDirectory() + "/testdata/" + filename).c_str(),
+            O_RDONLY | O_CLOEXEC));
+    std::unique_ptr<Document> doc;
+    Document::Load(std::make_unique<FileReader>(std::move(fd)), nullptr,
+                   /* closeFdOnFailure= */ true, &doc);
+    return doc;
+}
+
+void BM_RenderThumbnail(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument("annotation.pdf");
+    std::vector<uint8_t> pixels(kWidth * kHeight * 4);
+    std::vector<uint8_t> rgb565(kWidth * kHeight * 2);
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(kWidth, kHeight, FPDFBitmap_BGRx, pixels.data(), kWidth * 4));
+    for (auto _ : state) {
+        doc->GetPage(0)->RenderThumbnail(bitmap.get(), /* use_embedded= */ false);
+        pdfClient_utils::PackBgrxToRgb565(pixels.data(), kWidth * 4, rgb565.data(), kWidth * 2,
+                                          kWidth, kHeight);
+        benchmark::DoNotOptimize(rgb565.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RenderThumbnail);
+
+void BM_RenderThumbnailForDisplay(benchmark::State& state) {
+    std::unique_ptr<Document> doc = LoadDocument("annotation.pdf");
+    std::vector<uint8_t> pixels(kWidth * kHeight * 4);
+    ScopedFPDFBitmap bitmap(
+            FPDFBitmap_CreateEx(kWidth, kHeight, FPDFBitmap_BGRA, pixels.data(), kWidth * 4));
+    for (auto _ : state) {
+        std::shared_ptr<Page> page = doc->GetPage(0);
+        const float scale = static_cast<float>(kWidth) / page->Width();
+        page->Render(bitmap.get(), FS_MATRIX{scale, 0, 0, scale, 0, 0}, 0, 0, kWidth, kHeight,
+                     kRenderModeForDisplay, kShowAllAnnotTypes, /* render_form_fields= */ true);
+        benchmark::DoNotOptimize(pixels.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RenderThumbnailForDisplay);
+
+}  // namespace
+
+BENCHMARK_MAIN();
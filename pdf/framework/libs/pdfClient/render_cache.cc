@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render_cache.h"
+
+#include <string.h>
+
+#include <functional>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace pdfClient {
+
+namespace {
+
+size_t HashCombine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+}  // namespace
+
+bool RenderCache::Key::operator==(const Key& other) const {
+    return page_num == other.page_num && transform.a == other.transform.a &&
+           transform.b == other.transform.b && transform.c == other.transform.c &&
+           transform.d == other.transform.d && transform.e == other.transform.e &&
+           transform.f == other.transform.f && clip.left == other.clip.left &&
+           clip.top == other.clip.top && clip.right == other.clip.right &&
+           clip.bottom == other.clip.bottom && render_mode == other.render_mode &&
+           show_annot_types == other.show_annot_types &&
+           render_form_fields == other.render_form_fields && background == other.background;
+}
+
+size_t RenderCache::KeyHash::operator()(const Key& key) const {
+    std::hash<float> hash_float;
+    size_t hash = std::hash<uint64_t>()(key.background);
+    hash = HashCombine(hash, key.page_num);
+    for (float value : {key.transform.a, key.transform.b, key.transform.c, key.transform.d,
+                        key.transform.e, key.transform.f}) {
+        hash = HashCombine(hash, hash_float(value));
+    }
+    for (int value : {key.clip.left, key.clip.top, key.clip.right, key.clip.bottom,
+                      key.render_mode, key.show_annot_types}) {
+        hash = HashCombine(hash, value);
+    }
+    return HashCombine(hash, key.render_form_fields);
+}
+
+uint64_t RenderCache::HashPixels(const uint8_t* pixels, int stride, const Rectangle_i& clip) {
+    std::hash<std::string_view> hash_row;
+    const size_t row_bytes = clip.Width() * kBytesPerPixel;
+    uint64_t hash = 0;
+    for (int y = clip.top; y < clip.bottom; y++) {
+        const char* row = reinterpret_cast<const char*>(pixels) + y * stride +
+                          clip.left * kBytesPerPixel;
+        hash = HashCombine(hash, hash_row(std::string_view(row, row_bytes)));
+    }
+    return hash;
+}
+
+bool RenderCache::Get(const Key& key, uint8_t* pixels, int stride) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        stats_.misses++;
+        return false;
+    }
+    stats_.hits++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    const size_t row_bytes = key.clip.Width() * kBytesPerPixel;
+    const uint8_t* cached = it->second->pixels.data();
+    for (int y = key.clip.top; y < key.clip.bottom; y++) {
+        memcpy(pixels + y * stride + key.clip.left * kBytesPerPixel, cached, row_bytes);
+        cached += row_bytes;
+    }
+    return true;
+}
+
+void RenderCache::Put(const Key& key, const uint8_t* pixels, int stride) {
+    const size_t row_bytes = key.clip.Width() * kBytesPerPixel;
+    const size_t bytes = row_bytes * key.clip.Height();
+    if (bytes == 0 || bytes > budget_ || index_.find(key) != index_.end()) {
+        return;
+    }
+
+    std::vector<uint8_t> copy(bytes);
+    uint8_t* cached = copy.data();
+    for (int y = key.clip.top; y < key.clip.bottom; y++) {
+        memcpy(cached, pixels + y * stride + key.clip.left * kBytesPerPixel, row_bytes);
+        cached += row_bytes;
+    }
+
+    entries_.push_front(Entry{key, std::move(copy)});
+    index_[key] = entries_.begin();
+    stats_.entries++;
+    stats_.bytes += bytes;
+    Trim();
+}
+
+void RenderCache::InvalidatePage(int page_num) {
+    auto it = entries_.begin();
+    while (it != entries_.end()) {
+        auto next = std::next(it);
+        if (it->key.page_num == page_num) {
+            Erase(it);
+            stats_.invalidations++;
+        }
+        it = next;
+    }
+}
+
+void RenderCache::Clear() {
+    stats_.invalidations += entries_.size();
+    entries_.clear();
+    index_.clear();
+    stats_.entries = 0;
+    stats_.bytes = 0;
+}
+
+void RenderCache::SetBudget(size_t bytes) {
+    budget_ = bytes;
+    Trim();
+}
+
+void RenderCache::Erase(std::list<Entry>::iterator it) {
+    stats_.entries--;
+    stats_.bytes -= it->pixels.size();
+    index_.erase(it->key);
+    entries_.erase(it);
+}
+
+void RenderCache::Trim() {
+    while (stats_.bytes > budget_) {
+        Erase(std::prev(entries_.end()));
+        stats_.evictions++;
+    }
+}
+
+}  // namespace pdfClient
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_RENDER_CACHE_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_RENDER_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "fpdfview.h"
+#include "rect.h"
+
+namespace pdfClient {
+
+// Keeps the pixels of recent renders, so that rendering the same clip of the
+// same page the same way again is a copy rather than a rasterization. Pages
+// are rendered on top of what the bitmap already holds, so what was under the
+// clip is part of the key too, see HashPixels.
+//
+// Renders must be invalidated whenever what they show may have changed: page
+// object and annotation edits, and form filling.
+//
+// Not thread-safe, guarded by the lock of the Document owning it.
+class RenderCache {
+  public:
+    struct Key {
+        int page_num;
+        FS_MATRIX transform;
+        // In bitmap coordinates, and within the bitmap.
+        Rectangle_i clip;
+        int render_mode;
+        int show_annot_types;
+        bool render_form_fields;
+        // HashPixels of the clip before rendering.
+        uint64_t background;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct Stats {
+        // Number of renders served from, and not found in, the cache.
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Number of renders dropped to stay within the budget, and because
+        // their page changed.
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+        // Number of renders cached and the size of their pixels.
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    // Default size of the pixels cached, in bytes.
+    static constexpr size_t kDefaultBudget = 16 * 1024 * 1024;
+
+    // Bitmaps are always 4 bytes per pixel, see Page::Render.
+    static constexpr int kBytesPerPixel = 4;
+
+    explicit RenderCache(size_t budget = kDefaultBudget) : budget_(budget) {}
+
+    RenderCache(const RenderCache&) = delete;
+    RenderCache& operator=(const RenderCache&) = delete;
+
+    // Returns a hash of the pixels within |clip| of the bitmap at |pixels|.
+    static uint64_t HashPixels(const uint8_t* pixels, int stride, const Rectangle_i& clip);
+
+    // Copies the render cached for |key| into the bitmap at |pixels| and
+    // returns true, or returns false if there is none.
+    bool Get(const Key& key, uint8_t* pixels, int stride);
+
+    // Caches what was rendered for |key| into the bitmap at |pixels|, and drops
+    // the least recently used renders until the cache fits in the budget.
+    // Renders larger than the budget aren't cached.
+    void Put(const Key& key, const uint8_t* pixels, int stride);
+
+    // Drops the renders of page |page_num|.
+    void InvalidatePage(int page_num);
+
+    // Drops all renders.
+    void Clear();
+
+    // Sets the size of the pixels cached, in bytes, and drops the renders that
+    // don't fit anymore. 0 disables the cache.
+    void SetBudget(size_t bytes);
+
+    Stats GetStats() const { return stats_; }
+
+  private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<uint8_t> pixels;
+    };
+
+    void Erase(std::list<Entry>::iterator it);
+    void Trim();
+
+    size_t budget_;
+    // Most recently used first, and where each of them is in |entries_|.
+    std::list<Entry> entries_;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    Stats stats_;
+};
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_RENDER_CACHE_H_
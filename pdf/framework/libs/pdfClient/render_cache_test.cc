@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render_cache.h"
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "rect.h"
+
+using pdfClient::Rectangle_i;
+using pdfClient::RenderCache;
+
+namespace {
+
+constexpr int kWidth = 8;
+constexpr int kHeight = 8;
+constexpr int kStride = kWidth * RenderCache::kBytesPerPixel;
+
+RenderCache::Key MakeKey(int page_num, const std::vector<uint8_t>& background) {
+    const Rectangle_i clip{2, 2, 6, 6};
+    return RenderCache::Key{page_num,
+                            {1, 0, 0, 1, 0, 0},
+                            clip,
+                            0,
+                            0,
+                            false,
+                            RenderCache::HashPixels(background.data(), kStride, clip)};
+}
+
+TEST(Test, GetCopiesCachedPixels) {
+    RenderCache cache;
+    std::vector<uint8_t> bitmap(kStride * kHeight, 0);
+    const RenderCache::Key key = MakeKey(0, bitmap);
+    EXPECT_FALSE(cache.Get(key, bitmap.data(), kStride));
+
+    std::vector<uint8_t> rendered(bitmap);
+    rendered[3 * kStride + 3 * RenderCache::kBytesPerPixel] = 0xff;
+    cache.Put(key, rendered.data(), kStride);
+    EXPECT_EQ(1u, cache.GetStats().entries);
+    EXPECT_EQ(16u * RenderCache::kBytesPerPixel, cache.GetStats().bytes);
+
+    EXPECT_TRUE(cache.Get(key, bitmap.data(), kStride));
+    EXPECT_EQ(rendered, bitmap);
+    EXPECT_EQ(1u, cache.GetStats().hits);
+    EXPECT_EQ(1u, cache.GetStats().misses);
+}
+
+TEST(Test, BackgroundIsPartOfTheKey) {
+    RenderCache cache;
+    std::vector<uint8_t> bitmap(kStride * kHeight, 0);
+    cache.Put(MakeKey(0, bitmap), bitmap.data(), kStride);
+
+    // Only what is under the clip matters.
+    bitmap[0] = 0xff;
+    EXPECT_TRUE(cache.Get(MakeKey(0, bitmap), bitmap.data(), kStride));
+    bitmap[2 * kStride + 2 * RenderCache::kBytesPerPixel] = 0xff;
+    EXPECT_FALSE(cache.Get(MakeKey(0, bitmap), bitmap.data(), kStride));
+}
+
+TEST(Test, InvalidateAndEvict) {
+    RenderCache cache;
+    const std::vector<uint8_t> bitmap(kStride * kHeight, 0);
+    cache.Put(MakeKey(0, bitmap), bitmap.data(), kStride);
+    cache.Put(MakeKey(1, bitmap), bitmap.data(), kStride);
+    EXPECT_EQ(2u, cache.GetStats().entries);
+
+    cache.InvalidatePage(0);
+    EXPECT_EQ(1u, cache.GetStats().entries);
+    EXPECT_EQ(1u, cache.GetStats().invalidations);
+    std::vector<uint8_t> out(bitmap);
+    EXPECT_FALSE(cache.Get(MakeKey(0, bitmap), out.data(), kStride));
+    EXPECT_TRUE(cache.Get(MakeKey(1, bitmap), out.data(), kStride));
+
+    // The least recently used render goes first.
+    cache.Put(MakeKey(2, bitmap), bitmap.data(), kStride);
+    EXPECT_TRUE(cache.Get(MakeKey(1, bitmap), out.data(), kStride));
+    cache.SetBudget(cache.GetStats().bytes / 2);
+    EXPECT_EQ(1u, cache.GetStats().evictions);
+    EXPECT_TRUE(cache.Get(MakeKey(1, bitmap), out.data(), kStride));
+    EXPECT_FALSE(cache.Get(MakeKey(2, bitmap), out.data(), kStride));
+
+    cache.Clear();
+    EXPECT_EQ(0u, cache.GetStats().entries);
+    EXPECT_EQ(0u, cache.GetStats().bytes);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
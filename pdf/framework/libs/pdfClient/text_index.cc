@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "text_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+#include <vector>
+
+#include "logging.h"
+
+#define LOG_TAG "text_index"
+
+namespace pdfClient {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x49544350;  // "PCTI"
+constexpr uint32_t kVersion = 1;
+
+bool WriteFully(int fd, const void* data, size_t size, uint64_t offset) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(pwrite(fd, bytes, size, offset));
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::unique_ptr<TextIndex> TextIndex::Open(const std::string& path, uint64_t key,
+                                           int num_pages) {
+    if (num_pages < 0) {
+        return nullptr;
+    }
+    LinuxFileOps::FDCloser fd(
+            TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)));
+    if (fd.get() < 0) {
+        LOGE("Can't open text index: %s", strerror(errno));
+        return nullptr;
+    }
+    // Only one document at a time appends to the file.
+    if (flock(fd.get(), LOCK_EX | LOCK_NB) != 0) {
+        LOGW("Text index is in use: %s", strerror(errno));
+        return nullptr;
+    }
+    std::unique_ptr<TextIndex> index(new TextIndex(std::move(fd), num_pages));
+
+    struct stat st;
+    Header header;
+    const uint64_t data_start = sizeof(Header) + static_cast<uint64_t>(num_pages) * sizeof(Entry);
+    const bool valid = fstat(index->fd_.get(), &st) == 0 &&
+                       static_cast<uint64_t>(st.st_size) >= data_start &&
+                       TEMP_FAILURE_RETRY(pread(index->fd_.get(), &header, sizeof(header), 0)) ==
+                               sizeof(header) &&
+                       header.magic == kMagic && header.version == kVersion &&
+                       header.key == key && header.num_pages == static_cast<uint32_t>(num_pages);
+    if (valid) {
+        index->end_ = st.st_size;
+    } else if (!index->Reset(key)) {
+        LOGE("Can't write text index: %s", strerror(errno));
+        return nullptr;
+    }
+    if (!index->Map()) {
+        return nullptr;
+    }
+    return index;
+}
+
+TextIndex::TextIndex(LinuxFileOps::FDCloser fd, int num_pages)
+    : fd_(std::move(fd)), num_pages_(num_pages) {}
+
+TextIndex::~TextIndex() {
+    if (mapped_ != nullptr) {
+        munmap(const_cast<uint8_t*>(mapped_), mapped_size_);
+    }
+}
+
+bool TextIndex::Reset(uint64_t key) {
+    if (ftruncate(fd_.get(), 0) != 0) {
+        return false;
+    }
+    const Header header{kMagic, kVersion, key, static_cast<uint32_t>(num_pages_), 0};
+    const std::vector<Entry> entries(num_pages_, Entry{0, 0, 0});
+    if (!WriteFully(fd_.get(), &header, sizeof(header), 0) ||
+        !WriteFully(fd_.get(), entries.data(), entries.size() * sizeof(Entry), sizeof(header))) {
+        return false;
+    }
+    end_ = sizeof(header) + entries.size() * sizeof(Entry);
+    return true;
+}
+
+bool TextIndex::Map() {
+    if (mapped_size_ == end_) {
+        return true;
+    }
+    void* mapped = mmap(nullptr, end_, PROT_READ, MAP_SHARED, fd_.get(), 0);
+    if (mapped == MAP_FAILED) {
+        LOGE("Can't map text index: %s", strerror(errno));
+        return false;
+    }
+    if (mapped_ != nullptr) {
+        munmap(const_cast<uint8_t*>(mapped_), mapped_size_);
+    }
+    mapped_ = static_cast<const uint8_t*>(mapped);
+    mapped_size_ = end_;
+    return true;
+}
+
+const TextIndex::Entry& TextIndex::GetEntry(int page_num) const {
+    return reinterpret_cast<const Entry*>(mapped_ + sizeof(Header))[page_num];
+}
+
+bool TextIndex::Get(int page_num, int* start, std::u32string* text, std::vector<bool>* skippable) {
+    if (page_num < 0 || page_num >= num_pages_ || !Map()) {
+        return false;
+    }
+    // The entry is read from the file, which may be corrupt, so its text must be after the
+    // entries and within the mapping, without overflowing even where size_t is 32 bits.
+    const Entry entry = GetEntry(page_num);
+    const uint64_t data_start = sizeof(Header) + static_cast<uint64_t>(num_pages_) * sizeof(Entry);
+    const uint64_t size = static_cast<uint64_t>(entry.num_chars) * (sizeof(char32_t) + 1);
+    if (entry.offset < data_start || entry.offset > mapped_size_ ||
+        size > mapped_size_ - entry.offset) {
+        return false;
+    }
+    const uint8_t* data = mapped_ + entry.offset;
+    *start = entry.start;
+    text->resize(entry.num_chars);
+    memcpy(text->data(), data, entry.num_chars * sizeof(char32_t));
+    const uint8_t* flags = data + entry.num_chars * sizeof(char32_t);
+    skippable->assign(flags, flags + entry.num_chars);
+    return true;
+}
+
+void TextIndex::Put(int page_num, int start, const std::u32string& text,
+                    const std::vector<bool>& skippable) {
+    if (page_num < 0 || page_num >= num_pages_ || GetEntry(page_num).offset != 0) {
+        return;
+    }
+    // The text is written before the entry pointing at it, so that a partial
+    // write leaves the page out rather than corrupted.
+    std::vector<uint8_t> data(text.length() * sizeof(char32_t));
+    if (!data.empty()) {
+        memcpy(data.data(), text.data(), data.size());
+    }
+    data.insert(data.end(), skippable.begin(), skippable.end());
+    const uint64_t offset = end_;
+    if (!WriteFully(fd_.get(), data.data(), data.size(), offset)) {
+        LOGW("Can't add page %d to text index: %s", page_num, strerror(errno));
+        return;
+    }
+    end_ = offset + data.size();
+    const Entry entry{offset, static_cast<uint32_t>(text.length()), start};
+    if (!WriteFully(fd_.get(), &entry, sizeof(entry), sizeof(Header) + page_num * sizeof(Entry))) {
+        LOGW("Can't add page %d to text index: %s", page_num, strerror(errno));
+    }
+}
+
+}  // namespace pdfClient
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_TEXT_INDEX_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_TEXT_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "linux_fileops.h"
+
+namespace pdfClient {
+
+// A file keeping the search text of the pages of a document, see
+// Page::EnsureSearchTextInitialized, so that searching a document opened again
+// doesn't extract the text of every page with PDFium again. Pages are added as
+// they are first searched, and the file is memory-mapped to read them back.
+//
+// The file is made for one |key|, normally a hash of the content of the
+// document, and is started over when opened with another one. It can only be
+// open once at a time.
+//
+// Layout, in native byte order: a Header, then an Entry per page, then the
+// text of each page that was added, as char32_t, followed by a byte per char
+// whether it is skippable.
+//
+// Not thread-safe, guarded by the lock of the Document owning it.
+class TextIndex {
+  public:
+    // Opens the index at |path|, or creates it, for a document of |num_pages|
+    // pages. Returns nullptr if the file can't be used.
+    static std::unique_ptr<TextIndex> Open(const std::string& path, uint64_t key, int num_pages);
+
+    TextIndex(const TextIndex&) = delete;
+    TextIndex& operator=(const TextIndex&) = delete;
+
+    ~TextIndex();
+
+    // Returns false if page |page_num| isn't in the index, else fills in the
+    // char index its text starts at, the text and which chars are skippable.
+    bool Get(int page_num, int* start, std::u32string* text, std::vector<bool>* skippable);
+
+    // Adds the text of page |page_num|, unless it's already there.
+    void Put(int page_num, int start, const std::u32string& text,
+             const std::vector<bool>& skippable);
+
+    int NumPages() const { return num_pages_; }
+
+  private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t num_pages;
+        uint32_t reserved;
+    };
+
+    struct Entry {
+        // Where the text of the page is in the file, 0 if it wasn't added.
+        uint64_t offset;
+        uint32_t num_chars;
+        int32_t start;
+    };
+
+    TextIndex(LinuxFileOps::FDCloser fd, int num_pages);
+
+    // Truncates the file and writes an empty index for |key|.
+    bool Reset(uint64_t key);
+
+    // Maps the whole of the file, if it grew since it was last mapped.
+    bool Map();
+
+    const Entry& GetEntry(int page_num) const;
+
+    LinuxFileOps::FDCloser fd_;
+    const int num_pages_;
+    // Where anything added next is written, i.e. the size of the file.
+    uint64_t end_ = 0;
+    const uint8_t* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+};
+
+}  // namespace pdfClient
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_TEXT_INDEX_H_
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "text_index.h"
+
+#include <android-base/file.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using pdfClient::TextIndex;
+
+namespace {
+
+constexpr uint64_t kKey = 0x1234;
+
+std::string GetTempFile(const std::string& filename) {
+    return android::base::GetExecutableDirectory() + "/" + filename;
+}
+
+struct PageText {
+    int start = -1;
+    std::u32string text;
+    std::vector<bool> skippable;
+};
+
+TEST(Test, PutAndGetTest) {
+    const std::string path = GetTempFile("put_and_get.index");
+    unlink(path.c_str());
+    const PageText page{2, U"hello  world", {0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0}};
+    {
+        std::unique_ptr<TextIndex> index = TextIndex::Open(path, kKey, 3);
+        ASSERT_NE(nullptr, index);
+        PageText got;
+        EXPECT_FALSE(index->Get(1, &got.start, &got.text, &got.skippable));
+
+        index->Put(1, page.start, page.text, page.skippable);
+        index->Put(2, 0, U"", {});
+        ASSERT_TRUE(index->Get(1, &got.start, &got.text, &got.skippable));
+        EXPECT_EQ(page.start, got.start);
+        EXPECT_EQ(page.text, got.text);
+        EXPECT_EQ(page.skippable, got.skippable);
+
+        // The file can only be open once at a time.
+        EXPECT_EQ(nullptr, TextIndex::Open(path, kKey, 3));
+    }
+
+    // Pages are still there once the index is opened again.
+    std::unique_ptr<TextIndex> index = TextIndex::Open(path, kKey, 3);
+    ASSERT_NE(nullptr, index);
+    PageText got;
+    ASSERT_TRUE(index->Get(1, &got.start, &got.text, &got.skippable));
+    EXPECT_EQ(page.text, got.text);
+    EXPECT_EQ(page.skippable, got.skippable);
+    ASSERT_TRUE(index->Get(2, &got.start, &got.text, &got.skippable));
+    EXPECT_TRUE(got.text.empty());
+    EXPECT_FALSE(index->Get(0, &got.start, &got.text, &got.skippable));
+    EXPECT_FALSE(index->Get(3, &got.start, &got.text, &got.skippable));
+    unlink(path.c_str());
+}
+
+TEST(Test, OtherDocumentTest) {
+    const std::string path = GetTempFile("other_document.index");
+    unlink(path.c_str());
+    TextIndex::Open(path, kKey, 3)->Put(0, 0, U"a", {false});
+
+    // Another key or number of pages starts the index over.
+    PageText got;
+    EXPECT_FALSE(TextIndex::Open(path, kKey + 1, 3)->Get(0, &got.start, &got.text,
+                                                         &got.skippable));
+    TextIndex::Open(path, kKey, 3)->Put(0, 0, U"a", {false});
+    EXPECT_FALSE(TextIndex::Open(path, kKey, 4)->Get(0, &got.start, &got.text, &got.skippable));
+    unlink(path.c_str());
+}
+
+TEST(Test, CorruptEntryTest) {
+    const std::string path = GetTempFile("corrupt_entry.index");
+    // Overwrites the entry of page 0, right after the 24 byte header, with |offset| and
+    // |num_chars|.
+    auto corrupt_entry = [&path](uint64_t offset, uint32_t num_chars) {
+        unlink(path.c_str());
+        TextIndex::Open(path, kKey, 1)->Put(0, 0, U"abc", {false, false, false});
+        const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(8, pwrite(fd, &offset, sizeof(offset), 24));
+        ASSERT_EQ(4, pwrite(fd, &num_chars, sizeof(num_chars), 32));
+        close(fd);
+    };
+    PageText got;
+
+    // Text past the end of the file, sizes larger than 32 bits, and offsets that overflow.
+    corrupt_entry(40, 1000);
+    EXPECT_FALSE(TextIndex::Open(path, kKey, 1)->Get(0, &got.start, &got.text, &got.skippable));
+    corrupt_entry(40, UINT32_MAX);
+    EXPECT_FALSE(TextIndex::Open(path, kKey, 1)->Get(0, &got.start, &got.text, &got.skippable));
+    corrupt_entry(UINT64_MAX - 2, 3);
+    EXPECT_FALSE(TextIndex::Open(path, kKey, 1)->Get(0, &got.start, &got.text, &got.skippable));
+    // Text within the header and entries.
+    corrupt_entry(8, 3);
+    EXPECT_FALSE(TextIndex::Open(path, kKey, 1)->Get(0, &got.start, &got.text, &got.skippable));
+
+    // Where Put wrote it.
+    corrupt_entry(40, 3);
+    EXPECT_TRUE(TextIndex::Open(path, kKey, 1)->Get(0, &got.start, &got.text, &got.skippable));
+    EXPECT_EQ(U"abc", got.text);
+    unlink(path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -34,6 +34,7 @@ namespace {
 using ::pdfClient::Document;
 using ::pdfClient::Page;
 using ::pdfClient::Rectangle_i;
+using ::pdfClient::TextRange;
 
 static const std::string kTestdata = "testdata";
 static const std::string kChineseFile = "chinese.pdf";
@@ -139,6 +140,27 @@ TEST(Test, SearchPageText_hyphens) {
     EXPECT_EQ(0, page->FindMatchesUtf8("s-upport", nullptr));
 }
 
+TEST(Test, SearchPageText_matchRanges) {
+    Document doc(LoadTestDocument(kSamplePdfFile), false);
+    std::shared_ptr<Page> page = doc.GetPage(0);
+
+    std::vector<TextRange> matches;
+    EXPECT_EQ(4, page->FindMatchesUtf8("support", &matches));
+    for (size_t i = 0; i < matches.size(); i++) {
+        // Each match covers at least the query, more if it is broken onto two lines.
+        EXPECT_GE(matches[i].second - matches[i].first, 7);
+        // And they are in order, without overlapping.
+        if (i > 0) {
+            EXPECT_LE(matches[i - 1].second, matches[i].first);
+        }
+    }
+
+    // Searching again, with the search text already cached, finds the same.
+    std::vector<TextRange> again;
+    EXPECT_EQ(4, page->FindMatchesUtf8("SUPPORT", &again));
+    EXPECT_EQ(matches, again);
+}
+
 TEST(Test, GetTextBounds_hyphens) {
     Document doc(LoadTestDocument(kSamplePdfFile), false);
     std::shared_ptr<Page> page = doc.GetPage(0);
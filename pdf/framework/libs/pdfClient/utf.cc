@@ -16,7 +16,9 @@
 
 #include "utf.h"
 
-#include <cstring>
+#include <stdint.h>
+
+#include <algorithm>
 #include <iterator>
 #include <string>
 
@@ -24,24 +26,168 @@
 
 namespace pdfClient {
 
+namespace {
+
+// How many code units are checked at once for being ASCII. All-ASCII blocks
+// are copied with loops of fixed length, which the compiler turns into vector
+// instructions of whichever architecture it builds for.
+constexpr size_t kBlockSize = 16;
+
+template <typename T>
+bool IsAsciiBlock(const T* input) {
+    uint32_t all_bits = 0;
+    for (size_t i = 0; i < kBlockSize; i++) {
+        all_bits |= input[i];
+    }
+    return all_bits < 0x80;
+}
+
+template <typename From, typename To>
+void CopyAsciiBlock(const From* input, To* output) {
+    for (size_t i = 0; i < kBlockSize; i++) {
+        output[i] = static_cast<To>(input[i]);
+    }
+}
+
+// Each of these converts |length| code units from |input| to |output|, which
+// must have room for the result, and returns the end of what was written.
+// Blocks that aren't all ASCII are converted codepoint by codepoint, so that
+// the block isn't checked again for every codepoint of non-Latin text.
+
+// Writes at most |length| codepoints.
+char32_t* TranscodeUtf8ToUtf32(const uint8_t* input, size_t length, char32_t* output) {
+    const uint8_t* end = input + length;
+    while (input < end) {
+        if (static_cast<size_t>(end - input) >= kBlockSize && IsAsciiBlock(input)) {
+            CopyAsciiBlock(input, output);
+            input += kBlockSize;
+            output += kBlockSize;
+            continue;
+        }
+        const uint8_t* block_end = std::min(input + kBlockSize, end);
+        while (input < block_end) {
+            *output++ = unchecked::next(input);
+        }
+    }
+    return output;
+}
+
+// Writes at most |length| code units.
+char16_t* TranscodeUtf8ToUtf16(const uint8_t* input, size_t length, char16_t* output) {
+    const uint8_t* end = input + length;
+    while (input < end) {
+        if (static_cast<size_t>(end - input) >= kBlockSize && IsAsciiBlock(input)) {
+            CopyAsciiBlock(input, output);
+            input += kBlockSize;
+            output += kBlockSize;
+            continue;
+        }
+        const uint8_t* block_end = std::min(input + kBlockSize, end);
+        while (input < block_end) {
+            const uint32_t codepoint = unchecked::next(input);
+            if (codepoint > 0xffff) {
+                *output++ = static_cast<char16_t>((codepoint >> 10) + utf8::LEAD_OFFSET);
+                *output++ = static_cast<char16_t>((codepoint & 0x3ff) + utf8::TRAIL_SURROGATE_MIN);
+            } else {
+                *output++ = static_cast<char16_t>(codepoint);
+            }
+        }
+    }
+    return output;
+}
+
+// Writes at most 3 bytes per code unit.
+char* TranscodeUtf16ToUtf8(const char16_t* input, size_t length, char* output) {
+    const char16_t* end = input + length;
+    while (input < end) {
+        if (static_cast<size_t>(end - input) >= kBlockSize && IsAsciiBlock(input)) {
+            CopyAsciiBlock(input, output);
+            input += kBlockSize;
+            output += kBlockSize;
+            continue;
+        }
+        const char16_t* block_end = std::min(input + kBlockSize, end);
+        while (input < block_end) {
+            uint32_t codepoint = *input++;
+            if (utf8::is_lead_surrogate(codepoint)) {
+                if (input == end) {
+                    break;
+                }
+                codepoint = (codepoint << 10) + *input++ + utf8::SURROGATE_OFFSET;
+            }
+            output = unchecked::append(codepoint, output);
+        }
+    }
+    return output;
+}
+
+// Writes exactly Utf8Length(input, length) bytes.
+char* TranscodeUtf32ToUtf8(const char32_t* input, size_t length, char* output) {
+    const char32_t* end = input + length;
+    while (input < end) {
+        if (static_cast<size_t>(end - input) >= kBlockSize && IsAsciiBlock(input)) {
+            CopyAsciiBlock(input, output);
+            input += kBlockSize;
+            output += kBlockSize;
+            continue;
+        }
+        const char32_t* block_end = std::min(input + kBlockSize, end);
+        while (input < block_end) {
+            output = unchecked::append(*input++, output);
+        }
+    }
+    return output;
+}
+
+// The number of bytes of |length| codepoints from |input| in UTF-8, the same
+// as unchecked::append writes.
+size_t Utf8Length(const char32_t* input, size_t length) {
+    size_t utf8_length = 0;
+    for (size_t i = 0; i < length; i++) {
+        utf8_length += 1 + (input[i] >= 0x80) + (input[i] >= 0x800) + (input[i] >= 0x10000);
+    }
+    return utf8_length;
+}
+
+}  // namespace
+
 std::u32string Utf8ToUtf32(std::string_view utf8) {
-    std::u32string result;
-    unchecked::utf8to32(utf8.begin(), utf8.end(), std::back_inserter(result));
+    std::u32string result(utf8.length(), U'\0');
+    const char32_t* end = TranscodeUtf8ToUtf32(reinterpret_cast<const uint8_t*>(utf8.data()),
+                                               utf8.length(), result.data());
+    result.resize(end - result.data());
     return result;
 }
 
 std::u32string Utf8ToUtf32(const char* utf8) {
-    std::u32string result;
-    unchecked::utf8to32(utf8, utf8 + strlen(utf8), std::back_inserter(result));
+    return Utf8ToUtf32(std::string_view(utf8));
+}
+
+std::u16string Utf8ToUtf16(std::string_view utf8) {
+    std::u16string result(utf8.length(), u'\0');
+    const char16_t* end = TranscodeUtf8ToUtf16(reinterpret_cast<const uint8_t*>(utf8.data()),
+                                               utf8.length(), result.data());
+    result.resize(end - result.data());
     return result;
 }
 
 std::string Utf16ToUtf8(const std::u16string& utf16) {
-    std::string result;
-    unchecked::utf16to8(utf16.begin(), utf16.end(), std::back_inserter(result));
+    return Utf16ToUtf8(utf16.data(), utf16.length());
+}
+
+std::string Utf16ToUtf8(const char16_t* utf16, size_t length) {
+    std::string result(length * 3, '\0');
+    const char* end = TranscodeUtf16ToUtf8(utf16, length, result.data());
+    result.resize(end - result.data());
     return result;
 }
 
+void AppendUtf32AsUtf8(const char32_t* utf32, size_t length, std::string* output) {
+    const size_t start = output->length();
+    output->resize(start + Utf8Length(utf32, length));
+    TranscodeUtf32ToUtf8(utf32, length, output->data() + start);
+}
+
 void AppendCodepointAsUtf8(const char32_t codepoint, std::string* output) {
     unchecked::append(codepoint, std::back_inserter(*output));
 }
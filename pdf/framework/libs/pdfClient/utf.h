@@ -17,7 +17,10 @@
 #ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTF_H_
 #define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTF_H_
 
+#include <stddef.h>
+
 #include <string>
+#include <string_view>
 
 namespace std {
 // Typedef std::u16string and std::u32string in case they are missing.
@@ -27,15 +30,29 @@ typedef std::basic_string<char32_t> u32string;
 
 namespace pdfClient {
 
+// Conversions between UTF-8, UTF-16 and UTF-32, for all of pdfClient. Each of
+// them sizes its output once up front, and copies runs of ASCII in blocks that
+// the compiler vectorizes. Like unchecked.h, they expect valid input.
+
 // Converts a string from UTF-8 to UTF-32.
 std::u32string Utf8ToUtf32(std::string_view utf8);
 
 // Converts a C-string from UTF-8 to UTF-32.
 std::u32string Utf8ToUtf32(const char* utf8);
 
+// Converts a string from UTF-8 to UTF-16, in host byte order.
+std::u16string Utf8ToUtf16(std::string_view utf8);
+
 // Converts a string from UTF-16 to UTF-8.
 std::string Utf16ToUtf8(const std::u16string& utf16);
 
+// Converts |length| UTF-16 code units from |utf16| to UTF-8. A leading
+// surrogate at the very end is dropped.
+std::string Utf16ToUtf8(const char16_t* utf16, size_t length);
+
+// Appends |length| codepoints from |utf32| to |output| as UTF-8.
+void AppendUtf32AsUtf8(const char32_t* utf32, size_t length, std::string* output);
+
 // Converts an individual unicode codepoint to one or more UTF-8 chars,
 // and appends them to the output string.
 void AppendCodepointAsUtf8(const char32_t codepoint, std::string* output);
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utf.h"
+
+#include <gtest/gtest.h>
+
+#include <iterator>
+#include <string>
+
+#include "normalize.h"
+#include "unchecked.h"
+
+using pdfClient::AppendpdfClientTextAsUtf8;
+using pdfClient::AppendUtf32AsUtf8;
+using pdfClient::Utf16ToUtf8;
+using pdfClient::Utf8ToUtf16;
+using pdfClient::Utf8ToUtf32;
+
+namespace {
+
+// Runs of ASCII longer and shorter than a block, and text in 2, 3 and 4 bytes
+// of UTF-8.
+const char kText[] =
+        "Plain ASCII text that is longer than a block. Ünïcödé, Ελληνικά, Кириллица, "
+        "中文字符 and emoji 😀😃 mixed in with short runs: a1 b2 c3 - end.";
+
+TEST(Test, Utf8ToUtf32MatchesUnchecked) {
+    const std::string text(kText);
+    // Every prefix of whole codepoints, so that the runs of ASCII start and end
+    // at every offset of the blocks.
+    for (size_t length = 0; length <= text.length(); length++) {
+        if (length < text.length() && (text[length] & 0xC0) == 0x80) {
+            continue;
+        }
+        const std::string prefix = text.substr(0, length);
+        std::u32string expected;
+        pdfClient::unchecked::utf8to32(prefix.data(), prefix.data() + prefix.length(),
+                                       std::back_inserter(expected));
+        EXPECT_EQ(expected, Utf8ToUtf32(prefix));
+    }
+}
+
+TEST(Test, Utf8ToUtf16MatchesUnchecked) {
+    const std::string text(kText);
+    std::u16string expected;
+    pdfClient::unchecked::utf8to16(text.data(), text.data() + text.length(),
+                                   std::back_inserter(expected));
+    EXPECT_EQ(expected, Utf8ToUtf16(text));
+}
+
+TEST(Test, Utf16ToUtf8RoundTrips) {
+    const std::string text(kText);
+    EXPECT_EQ(text, Utf16ToUtf8(Utf8ToUtf16(text)));
+    EXPECT_EQ("", Utf16ToUtf8(std::u16string()));
+}
+
+TEST(Test, Utf16ToUtf8DropsTrailingLeadSurrogate) {
+    const std::u16string text = u"ab\xD83D";
+    EXPECT_EQ("ab", Utf16ToUtf8(text.data(), text.length()));
+}
+
+TEST(Test, AppendUtf32AsUtf8) {
+    const std::u32string text = Utf8ToUtf32(kText);
+    std::string output = "prefix ";
+    AppendUtf32AsUtf8(text.data(), text.length(), &output);
+    EXPECT_EQ(std::string("prefix ") + kText, output);
+}
+
+TEST(Test, AppendpdfClientTextAsUtf8) {
+    std::string output;
+    AppendpdfClientTextAsUtf8(U"\x2line bro\x2ken over lines\x2", &output);
+    EXPECT_EQ("-\r\nline bro-\r\nken over lines-\r\n", output);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
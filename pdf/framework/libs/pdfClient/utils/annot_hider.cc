@@ -22,7 +22,12 @@
 namespace pdfClient_utils {
 
 AnnotHider::AnnotHider(FPDF_PAGE page, const std::unordered_set<int>& types) {
-    GetVisibleAnnots(page, types, &annots_);
+    GetVisibleAnnots(page, types, &owned_annots_);
+    annots_ = owned_annots_;
+    HideAnnots(annots_);
+}
+
+AnnotHider::AnnotHider(std::span<const ScopedFPDFAnnotation> annots) : annots_(annots) {
     HideAnnots(annots_);
 }
 
@@ -17,6 +17,7 @@
 #ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTILS_HIDER_H_
 #define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTILS_HIDER_H_
 
+#include <span>
 #include <unordered_set>
 #include <vector>
 
@@ -28,11 +29,18 @@ namespace pdfClient_utils {
 // RAII wrapper for hiding annotations of the specified types.
 class AnnotHider {
   public:
+    // Hides the visible annotations of |page| not of one of |types|.
     AnnotHider(FPDF_PAGE page, const std::unordered_set<int>& types);
+
+    // Hides |annots|, e.g. those found by GetVisibleAnnots for an earlier
+    // render, which must outlive this.
+    explicit AnnotHider(std::span<const ScopedFPDFAnnotation> annots);
+
     ~AnnotHider();
 
   private:
-    std::vector<ScopedFPDFAnnotation> annots_;
+    std::vector<ScopedFPDFAnnotation> owned_annots_;
+    std::span<const ScopedFPDFAnnotation> annots_;
 };
 
 }  // namespace pdfClient_utils
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pixels.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace pdfClient_utils {
+
+namespace {
+
+void SwapRedBlueRow(const uint8_t* src, uint8_t* dst, size_t width, bool opaque) {
+    size_t x = 0;
+#if defined(__ARM_NEON)
+    const uint8x16_t alpha = vdupq_n_u8(0xFF);
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+        const uint8x16_t blue = pixels.val[0];
+        pixels.val[0] = pixels.val[2];
+        pixels.val[2] = blue;
+        if (opaque) {
+            pixels.val[3] = alpha;
+        }
+        vst4q_u8(dst + x * 4, pixels);
+    }
+#elif defined(__SSSE3__)
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const __m128i alpha = _mm_set1_epi32(opaque ? 0xFF000000 : 0);
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), pixels);
+    }
+#endif
+    for (; x < width; x++) {
+        const uint8_t first = src[x * 4];
+        dst[x * 4] = src[x * 4 + 2];
+        dst[x * 4 + 1] = src[x * 4 + 1];
+        dst[x * 4 + 2] = first;
+        dst[x * 4 + 3] = opaque ? 0xFF : src[x * 4 + 3];
+    }
+}
+
+void ExpandBgrToRgbaRow(const uint8_t* src, uint8_t* dst, size_t width) {
+    size_t x = 0;
+#if defined(__ARM_NEON)
+    uint8x16x4_t rgba;
+    rgba.val[3] = vdupq_n_u8(0xFF);
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x3_t bgr = vld3q_u8(src + x * 3);
+        rgba.val[0] = bgr.val[2];
+        rgba.val[1] = bgr.val[1];
+        rgba.val[2] = bgr.val[0];
+        vst4q_u8(dst + x * 4, rgba);
+    }
+#elif defined(__SSSE3__)
+    // Each load reads 16 bytes for 4 pixels, so stop before the last one of
+    // the row reads past its end.
+    const __m128i shuffle =
+            _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    for (; x + 6 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), pixels);
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x * 4] = src[x * 3 + 2];
+        dst[x * 4 + 1] = src[x * 3 + 1];
+        dst[x * 4 + 2] = src[x * 3];
+        dst[x * 4 + 3] = 0xFF;
+    }
+}
+
+}  // namespace
+
+void SwapRedBlue(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                 size_t width, size_t height, bool opaque) {
+    for (size_t y = 0; y < height; y++) {
+        SwapRedBlueRow(src + y * src_stride, dst + y * dst_stride, width, opaque);
+    }
+}
+
+void SwapRedBlueInPlace(uint8_t* pixels, size_t num_pixels) {
+    SwapRedBlueRow(pixels, pixels, num_pixels, false);
+}
+
+void ExpandBgrToRgba(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                     size_t width, size_t height) {
+    for (size_t y = 0; y < height; y++) {
+        ExpandBgrToRgbaRow(src + y * src_stride, dst + y * dst_stride, width);
+    }
+}
+
+void PackBgrxToRgb565(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                      size_t width, size_t height) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t* in = src + y * src_stride;
+        uint16_t* out = reinterpret_cast<uint16_t*>(dst + y * dst_stride);
+        for (size_t x = 0; x < width; x++) {
+            out[x] = ((in[x * 4 + 2] >> 3) << 11) | ((in[x * 4 + 1] >> 2) << 5) |
+                     (in[x * 4] >> 3);
+        }
+    }
+}
+
+void ScaleToBgrx(const uint8_t* src, size_t src_stride, size_t src_width, size_t src_height,
+                 size_t src_bytes_per_pixel, uint8_t* dst, size_t dst_stride, size_t dst_width,
+                 size_t dst_height) {
+    if (src_width == 0 || src_height == 0) {
+        return;
+    }
+    for (size_t y = 0; y < dst_height; y++) {
+        const uint8_t* in = src + (y * src_height / dst_height) * src_stride;
+        uint8_t* out = dst + y * dst_stride;
+        for (size_t x = 0; x < dst_width; x++) {
+            const uint8_t* pixel = in + (x * src_width / dst_width) * src_bytes_per_pixel;
+            out[x * 4] = pixel[0];
+            out[x * 4 + 1] = pixel[1];
+            out[x * 4 + 2] = pixel[2];
+            out[x * 4 + 3] = 0xFF;
+        }
+    }
+}
+
+}  // namespace pdfClient_utils
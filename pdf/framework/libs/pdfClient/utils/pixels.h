@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTILS_PIXELS_H_
+#define MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTILS_PIXELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversions between the pixel formats of PDFium bitmaps (BGR, BGRA and BGRx)
+// and of Android bitmaps (RGBA_8888). These use NEON or SSSE3 when available,
+// and plain loops otherwise or for what is left of each row.
+namespace pdfClient_utils {
+
+// Swaps the red and blue channels of |width| x |height| 4-byte pixels from
+// |src| into |dst|, i.e. converts BGRA to RGBA or the other way around. If
+// |opaque| the alpha channel is set to 0xFF, as for BGRx. |src| and |dst| can
+// be the same memory, with the same stride.
+void SwapRedBlue(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                 size_t width, size_t height, bool opaque);
+
+// Same as above for |num_pixels| contiguous pixels, in place.
+void SwapRedBlueInPlace(uint8_t* pixels, size_t num_pixels);
+
+// Expands |width| x |height| 3-byte BGR pixels from |src| into opaque 4-byte
+// RGBA pixels in |dst|.
+void ExpandBgrToRgba(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                     size_t width, size_t height);
+
+// Packs |width| x |height| 4-byte BGRx pixels from |src| into 2-byte RGB_565
+// pixels in |dst|, as Android bitmaps hold them, dropping the low bits of
+// each channel. A plain loop, which compilers vectorize well enough.
+void PackBgrxToRgb565(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                      size_t width, size_t height);
+
+// Scales |src_width| x |src_height| pixels of |src_bytes_per_pixel| bytes, 3
+// for BGR and 4 for BGRx or BGRA, from |src| to |dst_width| x |dst_height|
+// opaque 4-byte BGRx pixels in |dst|, taking the nearest source pixel.
+void ScaleToBgrx(const uint8_t* src, size_t src_stride, size_t src_width, size_t src_height,
+                 size_t src_bytes_per_pixel, uint8_t* dst, size_t dst_stride, size_t dst_width,
+                 size_t dst_height);
+
+}  // namespace pdfClient_utils
+
+#endif  // MEDIAPROVIDER_PDF_JNI_PDFCLIENT_UTILS_PIXELS_H_
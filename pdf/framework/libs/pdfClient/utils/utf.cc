@@ -19,11 +19,10 @@
 #include <android-base/logging.h>
 
 #include <algorithm>
-#include <iterator>
 #include <string>
 #include <vector>
 
-#include "../unchecked.h"
+#include "../utf.h"
 #include "byte_value.h"
 #include "fpdfview.h"
 
@@ -53,17 +52,13 @@ std::string GetUtf8Result(const std::function<size_t(T*, size_t)>& f) {
     // Remove null terminators if there are any.
     while (start != end && *(end - 1) == 0) --end;
 
-    // If the last UTF-16 character is a leading surrogate, UTF8-CPP will fail to
-    // properly check the boundary and go off the end of the buffer. Since leading
-    // surrogates not followed by a trailing surrogate are invalid UTF-16 anyway,
+    // Leading surrogates not followed by a trailing surrogate are invalid UTF-16,
     // just remove them.
     while (start != end && IsLeadingSurrogate(*(end - 1))) {
         --end;
     }
 
-    std::string result;
-    pdfClient::unchecked::utf16to8(start, end, std::back_inserter(result));
-    return result;
+    return pdfClient::Utf16ToUtf8(start, end - start);
 }
 
 // Instantiate all known template specializations
@@ -71,8 +66,7 @@ template std::string GetUtf8Result<void>(const std::function<size_t(void*, size_
 template std::string GetUtf8Result<FPDF_WCHAR>(const std::function<size_t(FPDF_WCHAR*, size_t)>& f);
 
 std::u16string Utf8ToUtf16Le(std::string_view utf8) {
-    std::u16string result;
-    pdfClient::unchecked::utf8to16(utf8.begin(), utf8.end(), std::back_inserter(result));
+    std::u16string result = pdfClient::Utf8ToUtf16(utf8);
 #ifdef IS_BIG_ENDIAN
     // Convert from big-endian to little-endian.
     std::transform(result.begin(), result.end(), result.begin(), &LittleEndian::FromHost16);
@@ -374,14 +374,23 @@ public class DatabaseBackupAndRecovery {
         try {
             final String data = getFuseDaemonForPath(getFuseFilePathFromVolumeName(volumeName))
                     .readBackedUpData(filePath);
-            if (data == null || data.isEmpty()) {
-                Log.w(TAG, "No backup found for path: " + filePath);
-                return Optional.empty();
-            }
+            return deserializeBackedUpData(filePath, data);
+        } catch (Exception e) {
+            Log.e(TAG, "Failure in getting backed up data for filePath: " + filePath, e);
+            return Optional.empty();
+        }
+    }
 
+    private static Optional<BackupIdRow> deserializeBackedUpData(String filePath, String data) {
+        if (data == null || data.isEmpty()) {
+            Log.w(TAG, "No backup found for path: " + filePath);
+            return Optional.empty();
+        }
+
+        try {
             return Optional.of(BackupIdRow.deserialize(data));
         } catch (Exception e) {
-            Log.e(TAG, "Failure in getting backed up data for filePath: " + filePath, e);
+            Log.e(TAG, "Failure in deserializing backed up data for filePath: " + filePath, e);
             return Optional.empty();
         }
     }
@@ -557,6 +566,20 @@ public class DatabaseBackupAndRecovery {
                 .readBackedUpFilePaths(volumeName, lastReadValue, limit);
     }
 
+    /**
+     * Like {@link #readBackedUpFilePaths}, but returns each file path followed by its backed up
+     * data, read in the same pass.
+     */
+    String[] readBackedUpEntries(String volumeName, String lastReadValue, int limit)
+            throws IOException, UnsupportedOperationException {
+        if (!isStableUrisEnabled(volumeName)) {
+            throw new UnsupportedOperationException("Stable Uris are not enabled");
+        }
+
+        return getFuseDaemonForPath(getFuseFilePathFromVolumeName(volumeName))
+                .readBackedUpEntries(volumeName, lastReadValue, limit);
+    }
+
     void updateNextRowIdXattr(DatabaseHelper helper, long id) {
         if (helper.isInternal()) {
             updateNextRowIdForInternal(helper, id);
@@ -1042,20 +1065,24 @@ public class DatabaseBackupAndRecovery {
                         "Volume not attached in given time. Cannot recover data.", e);
             }
 
-            String[] backedUpFilePaths;
+            // File paths interleaved with their backed up data.
+            String[] backedUpEntries;
             String lastReadValue = "";
             while (true) {
-                backedUpFilePaths = readBackedUpFilePaths(volumeName, lastReadValue,
+                backedUpEntries = readBackedUpEntries(volumeName, lastReadValue,
                         LEVEL_DB_READ_LIMIT);
-                if (backedUpFilePaths == null || backedUpFilePaths.length == 0) {
+                if (backedUpEntries == null || backedUpEntries.length == 0) {
                     break;
                 }
-                totalLevelDbRows += backedUpFilePaths.length;
+                final int backedUpFilesCount = backedUpEntries.length / 2;
+                totalLevelDbRows += backedUpFilesCount;
 
                 // Reset cached owner id relation map
                 sOwnerIdRelationMap = null;
-                for (String filePath : backedUpFilePaths) {
-                    Optional<BackupIdRow> fileRow = readDataFromBackup(volumeName, filePath);
+                for (int i = 0; i + 1 < backedUpEntries.length; i += 2) {
+                    final String filePath = backedUpEntries[i];
+                    Optional<BackupIdRow> fileRow =
+                            deserializeBackedUpData(filePath, backedUpEntries[i + 1]);
                     if (fileRow.isPresent()) {
                         if (fileRow.get().getIsDirty()) {
                             dirtyRowsCount++;
@@ -1071,10 +1098,10 @@ public class DatabaseBackupAndRecovery {
                 }
 
                 // Read less rows than expected
-                if (backedUpFilePaths.length < LEVEL_DB_READ_LIMIT) {
+                if (backedUpFilesCount < LEVEL_DB_READ_LIMIT) {
                     break;
                 }
-                lastReadValue = backedUpFilePaths[backedUpFilePaths.length - 1];
+                lastReadValue = backedUpEntries[backedUpEntries.length - 2];
             }
             long recoveryTime = SystemClock.elapsedRealtime() - startTime;
             publishRecoveryMetric(volumeName, recoveryTime, rowsRecovered, dirtyRowsCount,
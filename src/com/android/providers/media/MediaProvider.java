@@ -23,6 +23,7 @@ import static android.app.PendingIntent.FLAG_IMMUTABLE;
 import static android.app.PendingIntent.FLAG_ONE_SHOT;
 import static android.content.ContentResolver.QUERY_ARG_SQL_GROUP_BY;
 import static android.content.ContentResolver.QUERY_ARG_SQL_HAVING;
+import static android.content.ContentResolver.QUERY_ARG_SQL_LIMIT;
 import static android.content.ContentResolver.QUERY_ARG_SQL_SELECTION;
 import static android.content.ContentResolver.QUERY_ARG_SQL_SELECTION_ARGS;
 import static android.content.ContentResolver.QUERY_ARG_SQL_SORT_ORDER;
@@ -881,6 +882,7 @@ public class MediaProvider extends ContentProvider {
                     int uid = intent.getIntExtra(Intent.EXTRA_UID, 0);
                     if (pkg != null) {
                         invalidateLocalCallingIdentityCache(uid, "package " + intent.getAction());
+                        invalidateFileLookupForExternalStorage();
                         if (Intent.ACTION_PACKAGE_REMOVED.equals(intent.getAction())) {
                             mUserCache.invalidateWorkProfileOwnerApps(pkg);
                             mPickerSyncController.notifyPackageRemoval(pkg);
@@ -921,11 +923,48 @@ public class MediaProvider extends ContentProvider {
         }
     }
 
+    /**
+     * Drops the file lookup results cached by the FUSE daemons, which depend on the installed
+     * packages (e.g. whether they support transcoding).
+     */
+    private void invalidateFileLookupForExternalStorage() {
+        for (MediaVolume vol : mVolumeCache.getExternalVolumes()) {
+            try {
+                final FuseDaemon daemon = getFuseDaemonForFile(getVolumePath(vol.getName()),
+                        mVolumeCache);
+                daemon.invalidateFileLookupCache(null);
+            } catch (FileNotFoundException e) {
+                Log.w(TAG, "Failed to invalidate file lookup cache for " + vol.getName(), e);
+            }
+        }
+    }
+
+    /**
+     * Drops the access decisions cached by the FUSE daemons, which depend on the installed
+     * packages, their permissions and mount modes, and on the users on the device.
+     */
+    private void invalidateAccessDecisionsForExternalStorage() {
+        for (MediaVolume vol : mVolumeCache.getExternalVolumes()) {
+            try {
+                final FuseDaemon daemon = getFuseDaemonForFile(getVolumePath(vol.getName()),
+                        mVolumeCache);
+                daemon.invalidateAccessDecisionCache();
+            } catch (FileNotFoundException e) {
+                Log.w(TAG, "Failed to invalidate access decision cache for " + vol.getName(), e);
+            }
+        }
+    }
+
     private final BroadcastReceiver mUserIntentReceiver = new BroadcastReceiver() {
         @Override
         public void onReceive(Context context, Intent intent) {
             switch (intent.getAction()) {
+                case Intent.ACTION_USER_ADDED:
+                    // A new clone profile may now be allowed to look up files of this user.
+                    invalidateAccessDecisionsForExternalStorage();
+                    break;
                 case Intent.ACTION_USER_REMOVED:
+                    invalidateAccessDecisionsForExternalStorage();
                     /**
                      * Removing media files for user being deleted. This would impact if the deleted
                      * user have been using same MediaProvider as the current user i.e. when
@@ -1004,6 +1043,7 @@ public class MediaProvider extends ContentProvider {
                 mCachedCallingIdentityForFuse.remove(packageUid);
             }
         }
+        invalidateAccessDecisionsForExternalStorage();
     }
 
     protected void updateQuotaTypeForUri(@NonNull FileRow row) {
@@ -1547,8 +1587,10 @@ public class MediaProvider extends ContentProvider {
         context.registerReceiver(mPackageReceiver, packageFilter);
 
         // Creating intent broadcast receiver for user actions like Intent.ACTION_USER_REMOVED,
-        // where we would need to remove files stored by removed user.
+        // where we would need to remove files stored by removed user, and
+        // Intent.ACTION_USER_ADDED, which changes which users may access each other's files.
         final IntentFilter userIntentFilter = new IntentFilter();
+        userIntentFilter.addAction(Intent.ACTION_USER_ADDED);
         userIntentFilter.addAction(Intent.ACTION_USER_REMOVED);
         context.registerReceiver(mUserIntentReceiver, userIntentFilter);
 
@@ -2264,6 +2306,7 @@ public class MediaProvider extends ContentProvider {
             Os.rename(originalPath, newPath);
             invalidateFuseDentry(originalPath);
             invalidateFuseDentry(newPath);
+            flushFuseDentryInvalidations(newPath);
             return true;
         } catch (ErrnoException e) {
             final String errorMessage = "Rename " + originalPath + " to " + newPath
@@ -2600,6 +2643,31 @@ public class MediaProvider extends ContentProvider {
         return new FileLookupResult(/* transforms */ 0, uid, /* ioPath */ "");
     }
 
+    /**
+     * Called from FUSE to get the {@link FileLookupResult} of each of {@code paths} for
+     * {@code uid}, e.g. for all entries of a directory being listed, in a single call.
+     *
+     * @param paths file paths to get transforms for
+     * @param uid app requesting IO form kernel
+     * @param tid FUSE thread id handling IO request from kernel
+     * @return results in the same order as {@code paths}, {@code null} for paths that couldn't
+     * be looked up
+     *
+     * Called from JNI in jni/MediaProviderWrapper.cpp
+     */
+    @Keep
+    public FileLookupResult[] onFileLookupBatchForFuse(String[] paths, int uid, int tid) {
+        final FileLookupResult[] results = new FileLookupResult[paths.length];
+        for (int i = 0; i < paths.length; i++) {
+            try {
+                results[i] = onFileLookupForFuse(paths[i], uid, tid);
+            } catch (RuntimeException e) {
+                Log.w(TAG, "Failed to look up " + paths[i], e);
+            }
+        }
+        return results;
+    }
+
     private FileLookupResult handleTranscodedFileLookup(String path, int uid, int tid) {
         final int transformsReason;
         final PendingOpenInfo info;
@@ -3143,10 +3211,32 @@ public class MediaProvider extends ContentProvider {
      *
      * <p>Directory names are always obtained from lower file system.
      *
-     * Called from JNI in jni/MediaProviderWrapper.cpp
+     * @see #getFilesInDirectoryPageForFuse(String, int, long, int)
      */
     @Keep
     public String[] getFilesInDirectoryForFuse(String path, int uid) {
+        return getFilesInDirectoryPageForFuse(path, uid, /* afterId */ 0, /* limit */ 0);
+    }
+
+    /**
+     * Gets one page of the list of files in {@code path} from media provider database, like
+     * {@link #getFilesInDirectoryForFuse(String, int)}, so that large directories can be listed
+     * incrementally.
+     *
+     * @param path path of the directory.
+     * @param uid UID of the calling process.
+     * @param afterId only files whose row id is greater than this are returned, 0 for the first
+     * page.
+     * @param limit maximum number of file names to return, or 0 for no limit.
+     * @return the same as {@link #getFilesInDirectoryForFuse(String, int)}, except that if the
+     * page is full and more files may follow, the last element of the list is not a file name but
+     * the {@code afterId} of the next page.
+     *
+     * Called from JNI in jni/MediaProviderWrapper.cpp
+     */
+    @Keep
+    public String[] getFilesInDirectoryPageForFuse(String path, int uid, long afterId,
+            int limit) {
         final LocalCallingIdentity token =
                 clearLocalCallingIdentity(getCachedCallingIdentityForFuse(uid));
         PulledMetrics.logFileAccessViaFuse(getCallingUidOrSelf(), path);
@@ -3195,21 +3285,33 @@ public class MediaProvider extends ContentProvider {
             ArrayList<String> fileNamesList = new ArrayList<>();
 
             // Only FileColumns.DATA contains actual name of the file.
-            String[] projection = {MediaColumns.DATA};
+            String[] projection = {MediaColumns.DATA, FileColumns._ID};
 
             Bundle queryArgs = new Bundle();
             queryArgs.putString(QUERY_ARG_SQL_SELECTION, MediaColumns.RELATIVE_PATH +
-                    " =? and " + FileColumns._USER_ID + " =? and mime_type not like 'null'");
+                    " =? and " + FileColumns._USER_ID + " =? and mime_type not like 'null' and "
+                    + FileColumns._ID + " >?");
             queryArgs.putStringArray(QUERY_ARG_SQL_SELECTION_ARGS, new String[] {relativePath,
-                    String.valueOf(userIdFromPath)});
+                    String.valueOf(userIdFromPath), String.valueOf(afterId)});
+            if (limit > 0) {
+                // Pages are keyed by row id rather than offset, so that each page is a range
+                // scan and rows inserted or deleted meanwhile don't shift the following pages.
+                queryArgs.putString(QUERY_ARG_SQL_SORT_ORDER, FileColumns._ID);
+                queryArgs.putString(QUERY_ARG_SQL_LIMIT, String.valueOf(limit));
+            }
             // Get database entries for files from MediaProvider database with
             // MediaColumns.RELATIVE_PATH as the given path.
+            long lastId = afterId;
             try (final Cursor cursor = query(FileUtils.getContentUriForPath(path), projection,
                     queryArgs, null)) {
                 while(cursor.moveToNext()) {
                     fileNamesList.add(extractDisplayName(cursor.getString(0)));
+                    lastId = cursor.getLong(1);
                 }
             }
+            if (limit > 0 && fileNamesList.size() == limit) {
+                fileNamesList.add(String.valueOf(lastId));
+            }
             return fileNamesList.toArray(new String[fileNamesList.size()]);
         } finally {
             restoreLocalCallingIdentity(token);
@@ -6984,6 +7086,10 @@ public class MediaProvider extends ContentProvider {
                     } finally {
                         FileUtils.closeQuietly(c);
                     }
+                    // Deleted files must be gone for apps once this returns.
+                    if (count > 0) {
+                        flushFuseDentryInvalidationsForExternalStorage();
+                    }
                     // Do not allow deletion if the file/object is referenced as parent
                     // by some other entries. It could cause database corruption.
                     appendWhereStandalone(qb, ID_NOT_PARENT_CLAUSE);
@@ -9043,6 +9149,8 @@ public class MediaProvider extends ContentProvider {
                     Os.rename(beforePath, afterPath);
                     invalidateFuseDentry(beforePath);
                     invalidateFuseDentry(afterPath);
+                    // Moves and (un)trashing must be visible to apps once this returns.
+                    flushFuseDentryInvalidations(afterPath);
                 } catch (ErrnoException e) {
                     if (e.errno == OsConstants.ENOENT) {
                         Log.d(TAG, "Missing file at " + beforePath + "; continuing anyway");
@@ -10174,6 +10282,42 @@ public class MediaProvider extends ContentProvider {
         }
     }
 
+    /**
+     * Waits until the FUSE dentry invalidations requested so far for the volume of {@code path}
+     * have reached the kernel.
+     */
+    private void flushFuseDentryInvalidations(@NonNull String path) {
+        if (isFuseThread()) {
+            // Nothing was invalidated from a FUSE thread, see invalidateFuseDentry(), and it
+            // *must* not wait for the kernel.
+            return;
+        }
+        try {
+            getFuseDaemonForFile(new File(path), mVolumeCache).flushFuseDentryInvalidations();
+        } catch (FileNotFoundException e) {
+            Log.w(TAG, "Failed to flush FUSE dentry invalidations", e);
+        }
+    }
+
+    /**
+     * Waits until the FUSE dentry invalidations requested so far for all external volumes have
+     * reached the kernel.
+     */
+    private void flushFuseDentryInvalidationsForExternalStorage() {
+        if (isFuseThread()) {
+            return;
+        }
+        for (MediaVolume vol : mVolumeCache.getExternalVolumes()) {
+            try {
+                final FuseDaemon daemon = getFuseDaemonForFile(getVolumePath(vol.getName()),
+                        mVolumeCache);
+                daemon.flushFuseDentryInvalidations();
+            } catch (FileNotFoundException e) {
+                Log.w(TAG, "Failed to flush FUSE dentry invalidations for " + vol.getName(), e);
+            }
+        }
+    }
+
     /**
      * Replacement for {@link #openFileHelper(Uri, String)} which enforces any
      * permissions applicable to the path before returning.
@@ -10900,6 +11044,20 @@ public class MediaProvider extends ContentProvider {
         }
     }
 
+    /**
+     * Called when the app identified by the given UID opens the given file for reading, reusing
+     * the result of an earlier {@link #onFileOpenForFuse} for the same file and UID.
+     *
+     * @param path the path of the opened file
+     * @param uid UID of the app that opened the file
+     *
+     * Called from JNI in jni/MediaProviderWrapper.cpp
+     */
+    @Keep
+    public void onCachedFileOpenForFuse(String path, int uid) {
+        PulledMetrics.logFileAccessViaFuse(uid, path);
+    }
+
     @Nullable
     private Uri getOtherUriGrantsForPath(String path, boolean forWrite) {
         final Uri contentUri = FileUtils.getContentUriForPath(path);
@@ -12385,9 +12543,25 @@ public class MediaProvider extends ContentProvider {
         dumpAccessLogs(writer);
         writer.println();
 
+        dumpFuseDaemons(writer);
+        writer.println();
+
         Logging.dumpPersistent(writer);
     }
 
+    private void dumpFuseDaemons(PrintWriter writer) {
+        for (MediaVolume vol : mVolumeCache.getExternalVolumes()) {
+            try {
+                final FuseDaemon daemon = getFuseDaemonForFile(getVolumePath(vol.getName()),
+                        mVolumeCache);
+                writer.println("FUSE daemon for " + vol.getName() + ":");
+                daemon.dump(writer);
+            } catch (FileNotFoundException e) {
+                // Volume not mounted through FUSE.
+            }
+        }
+    }
+
     private void dumpAccessLogs(PrintWriter writer) {
         synchronized (mCachedCallingIdentityForFuse) {
             for (int i = 0; i < mCachedCallingIdentityForFuse.size(); i++) {
@@ -20,6 +20,7 @@ import android.os.ParcelFileDescriptor;
 import android.util.Log;
 
 import androidx.annotation.NonNull;
+import androidx.annotation.Nullable;
 
 import com.android.internal.annotations.GuardedBy;
 import com.android.providers.media.FdAccessResult;
@@ -28,6 +29,7 @@ import com.android.providers.media.util.FileUtils;
 
 import java.io.File;
 import java.io.IOException;
+import java.io.PrintWriter;
 import java.util.HashMap;
 import java.util.Objects;
 
@@ -49,6 +51,9 @@ public final class FuseDaemon extends Thread {
     private final ExternalStorageServiceImpl mService;
     @GuardedBy("mLock")
     private long mPtr;
+    // Number of calls using mPtr without holding mLock, it's only deleted once there are none.
+    @GuardedBy("mLock")
+    private int mPtrUsers;
 
     public FuseDaemon(@NonNull MediaProvider mediaProvider,
             @NonNull ExternalStorageServiceImpl service, @NonNull ParcelFileDescriptor fd,
@@ -85,6 +90,13 @@ public final class FuseDaemon extends Thread {
         Log.i(TAG, "Exiting thread for " + getName() + " ...");
 
         synchronized (mLock) {
+            while (mPtrUsers > 0) {
+                try {
+                    mLock.wait();
+                } catch (InterruptedException e) {
+                    Log.w(TAG, "Interrupted while waiting for FUSE daemon users", e);
+                }
+            }
             native_delete(mPtr);
             mPtr = 0;
         }
@@ -196,6 +208,75 @@ public final class FuseDaemon extends Thread {
         }
     }
 
+    /**
+     * Waits until the dentry invalidations requested so far, which are issued asynchronously,
+     * have reached the kernel.
+     *
+     * <p>Must not be called from a FUSE thread: issuing the invalidations may need the kernel to
+     * wait for the request that thread is serving.
+     */
+    public void flushFuseDentryInvalidations() {
+        final long ptr;
+        synchronized (mLock) {
+            if (mPtr == 0) {
+                Log.i(TAG, "flushFuseDentryInvalidations failed, FUSE daemon unavailable");
+                return;
+            }
+            ptr = mPtr;
+            mPtrUsers++;
+        }
+        // Don't block other calls into the daemon, FUSE upcalls among them, while waiting for the
+        // kernel.
+        try {
+            native_flush_fuse_dentry_invalidations(ptr);
+        } finally {
+            synchronized (mLock) {
+                mPtrUsers--;
+                mLock.notifyAll();
+            }
+        }
+    }
+
+    /**
+     * Invalidates cached file lookup results for {@code path}, or for all paths if it is
+     * {@code null}
+     */
+    public void invalidateFileLookupCache(@Nullable String path) {
+        synchronized (mLock) {
+            if (mPtr == 0) {
+                Log.i(TAG, "invalidateFileLookupCache failed, FUSE daemon unavailable");
+                return;
+            }
+            native_invalidate_file_lookup_cache(mPtr, path);
+        }
+    }
+
+    /**
+     * Invalidates the cached results of the access checks FUSE makes to MediaProvider
+     */
+    public void invalidateAccessDecisionCache() {
+        synchronized (mLock) {
+            if (mPtr == 0) {
+                Log.i(TAG, "invalidateAccessDecisionCache failed, FUSE daemon unavailable");
+                return;
+            }
+            native_invalidate_access_decision_cache(mPtr);
+        }
+    }
+
+    /**
+     * Dumps latency statistics of the FUSE operations served by this daemon
+     */
+    public void dump(@NonNull PrintWriter writer) {
+        synchronized (mLock) {
+            if (mPtr == 0) {
+                writer.println("FUSE daemon unavailable");
+                return;
+            }
+            writer.print(native_dump_stats(mPtr));
+        }
+    }
+
     public FdAccessResult checkFdAccess(ParcelFileDescriptor fileDescriptor, int uid)
             throws IOException {
         synchronized (mLock) {
@@ -267,6 +348,20 @@ public final class FuseDaemon extends Thread {
         }
     }
 
+    /**
+     * Reads backed up file paths for given volume from external storage along with their backed
+     * up data, interleaved.
+     */
+    public String[] readBackedUpEntries(String volumeName, String lastReadValue, int limit)
+            throws IOException {
+        synchronized (mLock) {
+            if (mPtr == 0) {
+                throw new IOException("FUSE daemon unavailable");
+            }
+            return native_read_backed_up_entries(mPtr, volumeName, lastReadValue, limit);
+        }
+    }
+
     /**
      * Reads backed up data for given file from external storage.
      */
@@ -341,6 +436,10 @@ public final class FuseDaemon extends Thread {
             int fd);
     private native boolean native_uses_fuse_passthrough(long daemon);
     private native void native_invalidate_fuse_dentry_cache(long daemon, String path);
+    private native void native_flush_fuse_dentry_invalidations(long daemon);
+    private native void native_invalidate_file_lookup_cache(long daemon, String path);
+    private native void native_invalidate_access_decision_cache(long daemon);
+    private native String native_dump_stats(long daemon);
     private native boolean native_is_started(long daemon);
     private native FdAccessResult native_check_fd_access(long daemon, int fd, int uid);
     private native void native_initialize_device_id(long daemon, String path);
@@ -351,6 +450,8 @@ public final class FuseDaemon extends Thread {
             String value);
     private native String[] native_read_backed_up_file_paths(long daemon, String volumeName,
             String lastReadValue, int limit);
+    private native String[] native_read_backed_up_entries(long daemon, String volumeName,
+            String lastReadValue, int limit);
     private native String native_read_backed_up_data(long daemon, String key);
     private native String native_read_ownership(long daemon, String ownerPackageIdentifier);
     private native void native_create_owner_id_relation(long daemon, String ownerId,
@@ -75,6 +75,27 @@ public final class LevelDBInstance {
         }
     }
 
+    /**
+     * Fetch values for given keys from leveldb in a single call, all read from the same snapshot
+     * of the database.
+     *
+     * @param keys for entries
+     * @return results in the order of {@code keys}
+     */
+    public LevelDBResult[] bulkQuery(String[] keys) {
+        synchronized (this) {
+            if (keys == null) {
+                throw new IllegalArgumentException("No keys provided to query");
+            }
+
+            if (mNativePtr == 0) {
+                throw new IllegalStateException("Leveldb connection is missing");
+            }
+
+            return nativeBulkQuery(mNativePtr, keys);
+        }
+    }
+
     /**
      * Inserts key,value entry in leveldb.
      *
@@ -154,6 +175,8 @@ public final class LevelDBInstance {
 
     private native LevelDBResult nativeQuery(long nativePtr, String key);
 
+    private native LevelDBResult[] nativeBulkQuery(long nativePtr, String[] keys);
+
     private native LevelDBResult nativeInsert(long nativePtr, LevelDBEntry levelDbEntry);
 
     private native LevelDBResult nativeBulkInsert(long nativePtr, List<LevelDBEntry> entryList);
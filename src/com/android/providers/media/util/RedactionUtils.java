@@ -18,7 +18,11 @@ package com.android.providers.media.util;
 
 import android.media.ExifInterface;
 import android.os.Trace;
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.StructStat;
 import android.util.ArraySet;
+import android.util.LruCache;
 
 import java.io.File;
 import java.io.FileInputStream;
@@ -78,6 +82,47 @@ public class RedactionUtils {
     private static final Set<String> sRedactedExifTags = new ArraySet<>(
             Arrays.asList(REDACTED_EXIF_TAGS));
 
+    private static final int REDACTION_RANGES_CACHE_SIZE = 256;
+
+    /**
+     * Redaction ranges of recently redacted files, by path. Apps such as galleries open the same
+     * files over and over, and parsing their metadata is most of the cost of opening them.
+     */
+    private static final LruCache<String, CachedRedactionRanges> sRedactionRangesCache =
+            new LruCache<>(REDACTION_RANGES_CACHE_SIZE);
+
+    /**
+     * Redaction ranges of a file, valid as long as the file is the same inode and wasn't changed
+     * since, as told by its size and change times.
+     */
+    private static final class CachedRedactionRanges {
+        private final long mDev;
+        private final long mIno;
+        private final long mSize;
+        private final long mMtimeNs;
+        private final long mCtimeNs;
+        private final long[] mRanges;
+
+        CachedRedactionRanges(StructStat stat, long[] ranges) {
+            mDev = stat.st_dev;
+            mIno = stat.st_ino;
+            mSize = stat.st_size;
+            mMtimeNs = toNanos(stat.st_mtim.tv_sec, stat.st_mtim.tv_nsec);
+            mCtimeNs = toNanos(stat.st_ctim.tv_sec, stat.st_ctim.tv_nsec);
+            mRanges = ranges;
+        }
+
+        boolean matches(StructStat stat) {
+            return mDev == stat.st_dev && mIno == stat.st_ino && mSize == stat.st_size
+                    && mMtimeNs == toNanos(stat.st_mtim.tv_sec, stat.st_mtim.tv_nsec)
+                    && mCtimeNs == toNanos(stat.st_ctim.tv_sec, stat.st_ctim.tv_nsec);
+        }
+
+        private static long toNanos(long sec, long nsec) {
+            return sec * 1_000_000_000L + nsec;
+        }
+    }
+
     private RedactionUtils() {
         // Utility Class
     }
@@ -100,7 +145,26 @@ public class RedactionUtils {
      */
     public static long[] getRedactionRanges(File file) throws IOException {
         try (FileInputStream is = new FileInputStream(file)) {
-            return getRedactionRanges(is, MimeUtils.resolveMimeType(file));
+            final String path = file.getPath();
+            StructStat stat = null;
+            try {
+                stat = Os.fstat(is.getFD());
+            } catch (ErrnoException ignored) {
+                // Without knowing whether the file changed, neither use nor fill the cache
+            }
+
+            if (stat != null) {
+                final CachedRedactionRanges cached = sRedactionRangesCache.get(path);
+                if (cached != null && cached.matches(stat)) {
+                    return cached.mRanges.clone();
+                }
+            }
+
+            final long[] ranges = getRedactionRanges(is, MimeUtils.resolveMimeType(file));
+            if (stat != null) {
+                sRedactionRangesCache.put(path, new CachedRedactionRanges(stat, ranges.clone()));
+            }
+            return ranges;
         } catch (FileNotFoundException ignored) {
             // If file not found, then there's nothing to redact
             return new long[0];
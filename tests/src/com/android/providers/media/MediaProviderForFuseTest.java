@@ -52,7 +52,9 @@ import java.io.File;
 import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InterruptedIOException;
+import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.List;
 import java.util.Locale;
 
 /**
@@ -145,6 +147,40 @@ public class MediaProviderForFuseTest {
                 targetDir.getPath(), sTestUid))).doesNotContain(renamed.getName());
     }
 
+    @Test
+    public void testGetFilesInDirectoryPage() throws Exception {
+        final File dir = new File(sTestDir, "paged" + System.nanoTime());
+        dir.mkdirs();
+        final List<String> names = new ArrayList<>();
+        for (int i = 0; i < 5; i++) {
+            final File file = new File(dir, "test" + i + ".jpg");
+            Truth.assertThat(sMediaProvider.insertFileIfNecessaryForFuse(
+                    file.getPath(), sTestUid)).isEqualTo(0);
+            names.add(file.getName());
+        }
+
+        // Full pages end with where the next one starts.
+        final List<String> listed = new ArrayList<>();
+        long afterId = 0;
+        while (true) {
+            final String[] page = sMediaProvider.getFilesInDirectoryPageForFuse(
+                    dir.getPath(), sTestUid, afterId, /* limit */ 2);
+            if (page.length <= 2) {
+                listed.addAll(Arrays.asList(page));
+                break;
+            }
+            Truth.assertThat(page.length).isEqualTo(3);
+            listed.addAll(Arrays.asList(page).subList(0, 2));
+            afterId = Long.parseLong(page[2]);
+        }
+        Truth.assertThat(listed).containsExactlyElementsIn(names);
+
+        for (String name : names) {
+            sMediaProvider.deleteFileForFuse(new File(dir, name).getPath(), sTestUid);
+        }
+        dir.delete();
+    }
+
     @Test
     public void testTypical() throws Exception {
         final File file = new File(sTestDir, "test" + System.nanoTime() + ".jpg");
@@ -23,6 +23,7 @@ import com.android.providers.media.stableuris.dao.BackupIdRow;
 
 import java.io.File;
 import java.io.FileNotFoundException;
+import java.io.IOException;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.List;
@@ -64,6 +65,18 @@ public class TestDatabaseBackupAndRecovery extends DatabaseBackupAndRecovery {
         return Arrays.copyOf(backedUpValues, backedUpValues.length, String[].class);
     }
 
+    @Override
+    protected String[] readBackedUpEntries(String volumeName, String lastReadValue, int limit)
+            throws IOException {
+        String[] backedUpEntries = new String[mBackedUpData.size() * 2];
+        int i = 0;
+        for (Map.Entry<String, BackupIdRow> entry : mBackedUpData.entrySet()) {
+            backedUpEntries[i++] = entry.getKey();
+            backedUpEntries[i++] = BackupIdRow.serialize(entry.getValue());
+        }
+        return backedUpEntries;
+    }
+
     @Override
     protected Optional<BackupIdRow> readDataFromBackup(String volumeName,
             String filePath) {
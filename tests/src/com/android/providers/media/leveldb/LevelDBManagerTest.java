@@ -69,6 +69,25 @@ public class LevelDBManagerTest {
             assertThat(levelDBInstance.query("b").getValue()).isEqualTo("");
             assertThat(levelDBInstance.query("a").getValue()).isEqualTo("1");
 
+            // Entries of a bulk insert are applied in order.
+            levelDBResult = levelDBInstance.bulkInsert(Arrays.asList(new LevelDBEntry("c", "5"),
+                    new LevelDBEntry("e", "6"), new LevelDBEntry("c", "7")));
+            verifySuccessResult(levelDBResult);
+
+            assertThat(levelDBInstance.query("c").getValue()).isEqualTo("7");
+            assertThat(levelDBInstance.query("e").getValue()).isEqualTo("6");
+
+            LevelDBResult[] levelDBResults =
+                    levelDBInstance.bulkQuery(new String[] {"e", "b", "c"});
+            assertThat(levelDBResults).hasLength(3);
+            verifySuccessResult(levelDBResults[0]);
+            assertThat(levelDBResults[0].getValue()).isEqualTo("6");
+            assertThat(levelDBResults[1].isNotFound()).isTrue();
+            assertThat(levelDBResults[1].getValue()).isEqualTo("");
+            verifySuccessResult(levelDBResults[2]);
+            assertThat(levelDBResults[2].getValue()).isEqualTo("7");
+            assertThat(levelDBInstance.bulkQuery(new String[0])).isEmpty();
+
         } finally {
             // Deletes leveldb file
             levelDBInstance.deleteInstance();
@@ -25,6 +25,7 @@ import com.android.providers.media.R;
 import org.junit.Test;
 
 import java.io.File;
+import java.io.FileOutputStream;
 
 public class RedactionUtilsTest {
 
@@ -54,4 +55,22 @@ public class RedactionUtilsTest {
         assertThat(RedactionUtils.getRedactionRanges(file)).isNotNull();
     }
 
+    @Test
+    public void testGetRedactionRanges_CachedUntilFileChanges() throws Exception {
+        final File file = File.createTempFile("test", ".jpg");
+        stage(R.raw.test_image, file);
+        final long[] ranges = RedactionUtils.getRedactionRanges(file);
+
+        // Callers get their own copy of the cached ranges.
+        final long[] cachedRanges = RedactionUtils.getRedactionRanges(file);
+        assertThat(cachedRanges).isEqualTo(ranges);
+        assertThat(cachedRanges).isNotSameInstanceAs(ranges);
+
+        // A file without metadata replacing it isn't redacted from the stale ranges.
+        try (FileOutputStream os = new FileOutputStream(file)) {
+            os.write(new byte[16]);
+        }
+        assertThat(RedactionUtils.getRedactionRanges(file)).isEmpty();
+    }
+
 }